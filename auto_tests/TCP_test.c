@@ -46,9 +46,10 @@ static inline IP get_loopback()
     return ip;
 }
 
-static void do_TCP_server_delay(TCP_Server *tcp_s, int delay)
+static void do_TCP_server_delay(TCP_Server *tcp_s, Mono_Time *mono_time, int delay)
 {
     c_sleep(delay);
+    mono_time_update(mono_time);
     do_TCP_server(tcp_s);
     c_sleep(delay);
 }
@@ -56,11 +57,13 @@ static uint16_t ports[NUM_PORTS] = {13215, 33445, 25643};
 
 START_TEST(test_basic)
 {
+    Mono_Time *mono_time = mono_time_new();
+
     // Attempt to create a new TCP_Server instance.
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Server *tcp_s = new_TCP_server(USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
     ck_assert_msg(tcp_s != nullptr, "Failed to create a TCP relay server.");
     ck_assert_msg(tcp_server_listen_count(tcp_s) == NUM_PORTS,
                   "Failed to bind a TCP relay server to all %d attempted ports.", NUM_PORTS);
@@ -108,12 +111,12 @@ START_TEST(test_basic)
     ck_assert_msg(net_send(sock, handshake, TCP_CLIENT_HANDSHAKE_SIZE - 1) == TCP_CLIENT_HANDSHAKE_SIZE - 1,
                   "An attempt to send the initial handshake minus last byte failed.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     ck_assert_msg(net_send(sock, handshake + (TCP_CLIENT_HANDSHAKE_SIZE - 1), 1) == 1,
                   "The attempt to send the last byte of handshake failed.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     // Receiving server response and decrypting it
     uint8_t response[TCP_SERVER_HANDSHAKE_SIZE];
@@ -151,6 +154,7 @@ START_TEST(test_basic)
         i += msg_length;
 
         c_sleep(50);
+        mono_time_update(mono_time);
         do_TCP_server(tcp_s);
     }
 
@@ -175,6 +179,8 @@ START_TEST(test_basic)
     // Closing connections.
     kill_sock(sock);
     kill_TCP_server(tcp_s);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -186,7 +192,7 @@ struct sec_TCP_con {
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
 };
 
-static struct sec_TCP_con *new_TCP_con(TCP_Server *tcp_s)
+static struct sec_TCP_con *new_TCP_con(TCP_Server *tcp_s, Mono_Time *mono_time)
 {
     struct sec_TCP_con *sec_c = (struct sec_TCP_con *)malloc(sizeof(struct sec_TCP_con));
     Socket sock = net_socket(net_family_ipv6, TOX_SOCK_STREAM, TOX_PROTO_TCP);
@@ -218,12 +224,14 @@ static struct sec_TCP_con *new_TCP_con(TCP_Server *tcp_s)
     ck_assert_msg(net_send(sock, handshake, TCP_CLIENT_HANDSHAKE_SIZE - 1) == TCP_CLIENT_HANDSHAKE_SIZE - 1,
                   "Failed to send the first portion of the handshake to the TCP relay server.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     ck_assert_msg(net_send(sock, handshake + (TCP_CLIENT_HANDSHAKE_SIZE - 1), 1) == 1,
                   "Failed to send last byte of handshake.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    // A server with handshake threads sends the response once it picks up the result.
+    do_TCP_server_delay(tcp_s, mono_time, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     uint8_t response[TCP_SERVER_HANDSHAKE_SIZE];
     uint8_t response_plain[TCP_HANDSHAKE_PLAIN_SIZE];
@@ -274,16 +282,18 @@ static int read_packet_sec_TCP(struct sec_TCP_con *con, uint8_t *data, uint16_t
 
 START_TEST(test_some)
 {
+    Mono_Time *mono_time = mono_time_new();
+
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Server *tcp_s = new_TCP_server(USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
     ck_assert_msg(tcp_s != nullptr, "Failed to create TCP relay server");
     ck_assert_msg(tcp_server_listen_count(tcp_s) == NUM_PORTS, "Failed to bind to all ports.");
 
-    struct sec_TCP_con *con1 = new_TCP_con(tcp_s);
-    struct sec_TCP_con *con2 = new_TCP_con(tcp_s);
-    struct sec_TCP_con *con3 = new_TCP_con(tcp_s);
+    struct sec_TCP_con *con1 = new_TCP_con(tcp_s, mono_time);
+    struct sec_TCP_con *con2 = new_TCP_con(tcp_s, mono_time);
+    struct sec_TCP_con *con3 = new_TCP_con(tcp_s, mono_time);
 
     uint8_t requ_p[1 + CRYPTO_PUBLIC_KEY_SIZE];
     requ_p[0] = 0;
@@ -294,7 +304,7 @@ START_TEST(test_some)
     memcpy(requ_p + 1, con1->public_key, CRYPTO_PUBLIC_KEY_SIZE);
     write_packet_TCP_secure_connection(con3, requ_p, sizeof(requ_p));
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     // Testing response from connection 1
     uint8_t data[2048];
@@ -317,7 +327,7 @@ START_TEST(test_some)
     write_packet_TCP_secure_connection(con3, test_packet, sizeof(test_packet));
     write_packet_TCP_secure_connection(con3, test_packet, sizeof(test_packet));
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     len = read_packet_sec_TCP(con1, data, 2 + 2 + CRYPTO_MAC_SIZE);
     ck_assert_msg(len == 2, "wrong len %d", len);
@@ -342,7 +352,7 @@ START_TEST(test_some)
     write_packet_TCP_secure_connection(con1, test_packet, sizeof(test_packet));
     write_packet_TCP_secure_connection(con1, test_packet, sizeof(test_packet));
     write_packet_TCP_secure_connection(con1, test_packet, sizeof(test_packet));
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
     len = read_packet_sec_TCP(con3, data, 2 + sizeof(test_packet) + CRYPTO_MAC_SIZE);
     ck_assert_msg(len == sizeof(test_packet), "wrong len %d", len);
     ck_assert_msg(memcmp(data, test_packet, sizeof(test_packet)) == 0, "packet is wrong %u %u %u %u", data[0], data[1],
@@ -359,7 +369,7 @@ START_TEST(test_some)
     uint8_t ping_packet[1 + sizeof(uint64_t)] = {4, 8, 6, 9, 67};
     write_packet_TCP_secure_connection(con1, ping_packet, sizeof(ping_packet));
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     len = read_packet_sec_TCP(con1, data, 2 + sizeof(ping_packet) + CRYPTO_MAC_SIZE);
     ck_assert_msg(len == sizeof(ping_packet), "wrong len %d", len);
@@ -371,6 +381,54 @@ START_TEST(test_some)
     kill_TCP_con(con1);
     kill_TCP_con(con2);
     kill_TCP_con(con3);
+
+    mono_time_free(mono_time);
+}
+END_TEST
+
+START_TEST(test_handshake_threads)
+{
+    Mono_Time *mono_time = mono_time_new();
+
+    uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
+    crypto_new_keypair(self_public_key, self_secret_key);
+
+    TCP_Server_Options options;
+    tcp_server_options_default(&options);
+    options.max_incoming_connections = 4;
+    options.handshake_threads = 2;
+    TCP_Server *tcp_s = new_TCP_server_options(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr, &options);
+    ck_assert_msg(tcp_s != nullptr, "Failed to create TCP relay server");
+
+    struct sec_TCP_con *con1 = new_TCP_con(tcp_s, mono_time);
+    struct sec_TCP_con *con2 = new_TCP_con(tcp_s, mono_time);
+
+    uint8_t requ_p[1 + CRYPTO_PUBLIC_KEY_SIZE];
+    requ_p[0] = 0;
+    memcpy(requ_p + 1, con2->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    write_packet_TCP_secure_connection(con1, requ_p, sizeof(requ_p));
+    memcpy(requ_p + 1, con1->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    write_packet_TCP_secure_connection(con2, requ_p, sizeof(requ_p));
+
+    do_TCP_server_delay(tcp_s, mono_time, 50);
+
+    uint8_t data[2048];
+    int len = read_packet_sec_TCP(con1, data, 2 + 1 + 1 + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_MAC_SIZE);
+    ck_assert_msg(len == 1 + 1 + CRYPTO_PUBLIC_KEY_SIZE, "Wrong response packet length of %d.", len);
+    ck_assert_msg(data[0] == 1, "Wrong response packet id of %d.", data[0]);
+    ck_assert_msg(public_key_cmp(data + 2, con2->public_key) == 0, "Key in response packet wrong.");
+
+    len = read_packet_sec_TCP(con2, data, 2 + 1 + 1 + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_MAC_SIZE);
+    ck_assert_msg(len == 1 + 1 + CRYPTO_PUBLIC_KEY_SIZE, "Wrong response packet length of %d.", len);
+    ck_assert_msg(data[0] == 1, "Wrong response packet id of %d.", data[0]);
+    ck_assert_msg(public_key_cmp(data + 2, con1->public_key) == 0, "Key in response packet wrong.");
+
+    kill_TCP_server(tcp_s);
+    kill_TCP_con(con1);
+    kill_TCP_con(con2);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -457,11 +515,12 @@ static int oob_data_callback(void *object, const uint8_t *public_key, const uint
 
 START_TEST(test_client)
 {
-    unix_time_update();
+    Mono_Time *mono_time = mono_time_new();
+
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Server *tcp_s = new_TCP_server(USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
     ck_assert_msg(tcp_s != nullptr, "Failed to create a TCP relay server.");
     ck_assert_msg(tcp_server_listen_count(tcp_s) == NUM_PORTS, "Failed to bind the relay server to all ports.");
 
@@ -473,7 +532,8 @@ START_TEST(test_client)
     ip_port_tcp_s.port = net_htons(ports[random_u32() % NUM_PORTS]);
     ip_port_tcp_s.ip = get_loopback();
 
-    TCP_Client_Connection *conn = new_TCP_connection(ip_port_tcp_s, self_public_key, f_public_key, f_secret_key, nullptr);
+    TCP_Client_Connection *conn = new_TCP_connection(mono_time, ip_port_tcp_s, self_public_key, f_public_key, f_secret_key,
+                                  nullptr);
     do_TCP_connection(conn, nullptr);
     c_sleep(50);
 
@@ -482,11 +542,12 @@ START_TEST(test_client)
     ck_assert_msg(tcp_con_status(conn) == TCP_CLIENT_UNCONFIRMED, "Wrong connection status. Expected: %d, is: %d.",
                   TCP_CLIENT_UNCONFIRMED, tcp_con_status(conn));
 
-    do_TCP_server_delay(tcp_s, 50); // Now let the server handle requests...
+    do_TCP_server_delay(tcp_s, mono_time, 50); // Now let the server handle requests...
 
     const uint8_t LOOP_SIZE = 3;
 
     for (uint8_t i = 0; i < LOOP_SIZE; i++) {
+        mono_time_update(mono_time);
         do_TCP_connection(conn, nullptr); // Run the connection loop.
 
         // The status of the connection should continue to be TCP_CLIENT_CONFIRMED after multiple subsequent do_TCP_connection() calls.
@@ -496,7 +557,7 @@ START_TEST(test_client)
         c_sleep(i == LOOP_SIZE - 1 ? 0 : 500); // Sleep for 500ms on all except third loop.
     }
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     // And still after the server runs again.
     ck_assert_msg(tcp_con_status(conn) == TCP_CLIENT_CONFIRMED, "Wrong status. Expected: %d, is: %d", TCP_CLIENT_CONFIRMED,
@@ -507,7 +568,7 @@ START_TEST(test_client)
     crypto_new_keypair(f2_public_key, f2_secret_key);
     ip_port_tcp_s.port = net_htons(ports[random_u32() % NUM_PORTS]);
     TCP_Client_Connection *conn2 = new_TCP_connection(
-                                       ip_port_tcp_s, self_public_key, f2_public_key, f2_secret_key, nullptr);
+                                       mono_time, ip_port_tcp_s, self_public_key, f2_public_key, f2_secret_key, nullptr);
 
     // The client should call this function (defined earlier) during the routing process.
     routing_response_handler(conn, response_callback, (char *)conn + 2);
@@ -524,7 +585,7 @@ START_TEST(test_client)
     do_TCP_connection(conn, nullptr);
     do_TCP_connection(conn2, nullptr);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_TCP_connection(conn, nullptr);
     do_TCP_connection(conn2, nullptr);
@@ -536,7 +597,7 @@ START_TEST(test_client)
     send_routing_request(conn, f2_public_key);
     send_routing_request(conn2, f_public_key);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_TCP_connection(conn, nullptr);
     do_TCP_connection(conn2, nullptr);
@@ -550,11 +611,11 @@ START_TEST(test_client)
     ck_assert_msg(status_callback_connection_id == response_callback_connection_id,
                   "Status and response callback connection IDs are not equal.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     ck_assert_msg(send_data(conn2, 0, data, 5) == 1, "Failed a send_data() call.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_TCP_connection(conn, nullptr);
     do_TCP_connection(conn2, nullptr);
@@ -562,7 +623,7 @@ START_TEST(test_client)
     status_callback_good = 0;
     send_disconnect_request(conn2, 0);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_TCP_connection(conn, nullptr);
     do_TCP_connection(conn2, nullptr);
@@ -573,13 +634,16 @@ START_TEST(test_client)
     kill_TCP_server(tcp_s);
     kill_TCP_connection(conn);
     kill_TCP_connection(conn2);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
 // Test how the client handles servers that don't respond.
 START_TEST(test_client_invalid)
 {
-    unix_time_update();
+    Mono_Time *mono_time = mono_time_new();
+
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
@@ -591,7 +655,8 @@ START_TEST(test_client_invalid)
 
     ip_port_tcp_s.port = net_htons(ports[random_u32() % NUM_PORTS]);
     ip_port_tcp_s.ip = get_loopback();
-    TCP_Client_Connection *conn = new_TCP_connection(ip_port_tcp_s, self_public_key, f_public_key, f_secret_key, nullptr);
+    TCP_Client_Connection *conn = new_TCP_connection(mono_time, ip_port_tcp_s, self_public_key, f_public_key, f_secret_key,
+                                  nullptr);
 
     // Run the client's main loop but not the server.
     do_TCP_connection(conn, nullptr);
@@ -602,16 +667,20 @@ START_TEST(test_client_invalid)
                   TCP_CLIENT_CONNECTING, tcp_con_status(conn));
     // After 5s...
     c_sleep(5000);
+    mono_time_update(mono_time);
     do_TCP_connection(conn, nullptr);
     ck_assert_msg(tcp_con_status(conn) == TCP_CLIENT_CONNECTING, "Wrong status. Expected: %d, is: %d.",
                   TCP_CLIENT_CONNECTING, tcp_con_status(conn));
     // 11s... (Should wait for 10 before giving up.)
     c_sleep(6000);
+    mono_time_update(mono_time);
     do_TCP_connection(conn, nullptr);
     ck_assert_msg(tcp_con_status(conn) == TCP_CLIENT_DISCONNECTED, "Wrong status. Expected: %d, is: %d.",
                   TCP_CLIENT_DISCONNECTED, tcp_con_status(conn));
 
     kill_TCP_connection(conn);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -644,21 +713,22 @@ static int tcp_data_callback(void *object, int id, const uint8_t *data, uint16_t
 START_TEST(test_tcp_connection)
 {
     tcp_data_callback_called = 0;
-    unix_time_update();
+    Mono_Time *mono_time = mono_time_new();
+
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Server *tcp_s = new_TCP_server(USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
     ck_assert_msg(public_key_cmp(tcp_server_public_key(tcp_s), self_public_key) == 0, "Wrong public key");
 
     TCP_Proxy_Info proxy_info;
     proxy_info.proxy_type = TCP_PROXY_NONE;
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Connections *tc_1 = new_tcp_connections(self_secret_key, &proxy_info);
+    TCP_Connections *tc_1 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
     ck_assert_msg(public_key_cmp(tcp_connections_public_key(tc_1), self_public_key) == 0, "Wrong public key");
 
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Connections *tc_2 = new_tcp_connections(self_secret_key, &proxy_info);
+    TCP_Connections *tc_2 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
     ck_assert_msg(public_key_cmp(tcp_connections_public_key(tc_2), self_public_key) == 0, "Wrong public key");
 
     IP_Port ip_port_tcp_s;
@@ -680,45 +750,54 @@ START_TEST(test_tcp_connection)
     ck_assert_msg(new_tcp_connection_to(tc_2, tcp_connections_public_key(tc_1), 123) == -1,
                   "Managed to readd same connection\n");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    int ret = send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6);
+    int ret = send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6, false);
     ck_assert_msg(ret == 0, "could not send packet.");
     set_packet_tcp_connection_callback(tc_2, &tcp_data_callback, (void *) 120397);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
     ck_assert_msg(tcp_data_callback_called, "could not recv packet.");
     ck_assert_msg(tcp_connection_to_online_tcp_relays(tc_1, 0) == 1, "Wrong number of connected relays");
+
+    TCP_Relay_Stats stats;
+    ck_assert_msg(tcp_copy_relay_stats(tc_1, &stats, 1) == 1, "could not get relay stats");
+    ck_assert_msg(stats.friends == 1 && stats.packets_sent == 1 && stats.bytes_sent == 6 && stats.packets_dropped == 0,
+                  "wrong relay stats: %u friends, %u packets, %u bytes, %u dropped", stats.friends,
+                  (unsigned)stats.packets_sent, (unsigned)stats.bytes_sent, (unsigned)stats.packets_dropped);
+
     ck_assert_msg(kill_tcp_connection_to(tc_1, 0) == 0, "could not kill connection to\n");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    ck_assert_msg(send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6) == -1, "could send packet.");
+    ck_assert_msg(send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6, false) == -1, "could send packet.");
     ck_assert_msg(kill_tcp_connection_to(tc_2, 0) == 0, "could not kill connection to\n");
 
     kill_TCP_server(tcp_s);
     kill_tcp_connections(tc_1);
     kill_tcp_connections(tc_2);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -748,21 +827,22 @@ START_TEST(test_tcp_connection2)
     tcp_oobdata_callback_called = 0;
     tcp_data_callback_called = 0;
 
-    unix_time_update();
+    Mono_Time *mono_time = mono_time_new();
+
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Server *tcp_s = new_TCP_server(USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
     ck_assert_msg(public_key_cmp(tcp_server_public_key(tcp_s), self_public_key) == 0, "Wrong public key");
 
     TCP_Proxy_Info proxy_info;
     proxy_info.proxy_type = TCP_PROXY_NONE;
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Connections *tc_1 = new_tcp_connections(self_secret_key, &proxy_info);
+    TCP_Connections *tc_1 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
     ck_assert_msg(public_key_cmp(tcp_connections_public_key(tc_1), self_public_key) == 0, "Wrong public key");
 
     crypto_new_keypair(self_public_key, self_secret_key);
-    TCP_Connections *tc_2 = new_tcp_connections(self_secret_key, &proxy_info);
+    TCP_Connections *tc_2 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
     ck_assert_msg(public_key_cmp(tcp_connections_public_key(tc_2), self_public_key) == 0, "Wrong public key");
 
     IP_Port ip_port_tcp_s;
@@ -778,34 +858,34 @@ START_TEST(test_tcp_connection2)
     ck_assert_msg(add_tcp_relay_global(tc_2, ip_port_tcp_s, tcp_server_public_key(tcp_s)) == 0,
                   "Could not add global relay");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
-    int ret = send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6);
+    int ret = send_packet_tcp_connection(tc_1, 0, (const uint8_t *)"Gentoo", 6, false);
     ck_assert_msg(ret == 0, "could not send packet.");
     set_oob_packet_tcp_connection_callback(tc_2, &tcp_oobdata_callback, tc_2);
     set_packet_tcp_connection_callback(tc_1, &tcp_data_callback, (void *) 120397);
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
 
     ck_assert_msg(tcp_oobdata_callback_called, "could not recv packet.");
 
-    do_TCP_server_delay(tcp_s, 50);
+    do_TCP_server_delay(tcp_s, mono_time, 50);
 
     do_tcp_connections(tc_1, nullptr);
     do_tcp_connections(tc_2, nullptr);
@@ -816,6 +896,129 @@ START_TEST(test_tcp_connection2)
     kill_TCP_server(tcp_s);
     kill_tcp_connections(tc_1);
     kill_tcp_connections(tc_2);
+
+    mono_time_free(mono_time);
+}
+END_TEST
+
+static uint16_t ports2[NUM_PORTS] = {13216, 33446, 25644};
+
+/* Find the statistics of the relay with the given public key. */
+static const TCP_Relay_Stats *find_relay_stats(const TCP_Relay_Stats *stats, uint32_t num, const uint8_t *public_key)
+{
+    for (uint32_t i = 0; i < num; ++i) {
+        if (public_key_cmp(stats[i].public_key, public_key) == 0) {
+            return &stats[i];
+        }
+    }
+
+    ck_abort_msg("relay not found in stats");
+    return nullptr;
+}
+
+START_TEST(test_tcp_relay_selection)
+{
+    Mono_Time *mono_time = mono_time_new();
+
+    uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t self_secret_key[CRYPTO_SECRET_KEY_SIZE];
+    crypto_new_keypair(self_public_key, self_secret_key);
+    TCP_Server *tcp_s1 = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports, self_secret_key, nullptr);
+    ck_assert_msg(tcp_s1 != nullptr, "Failed to create first TCP relay server");
+    crypto_new_keypair(self_public_key, self_secret_key);
+    TCP_Server *tcp_s2 = new_TCP_server(mono_time, USE_IPV6, NUM_PORTS, ports2, self_secret_key, nullptr);
+    ck_assert_msg(tcp_s2 != nullptr, "Failed to create second TCP relay server");
+
+    TCP_Proxy_Info proxy_info;
+    proxy_info.proxy_type = TCP_PROXY_NONE;
+    crypto_new_keypair(self_public_key, self_secret_key);
+    TCP_Connections *tc_1 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
+    crypto_new_keypair(self_public_key, self_secret_key);
+    TCP_Connections *tc_2 = new_tcp_connections(mono_time, self_secret_key, &proxy_info);
+
+    IP_Port ip_port_tcp_s1;
+    ip_port_tcp_s1.ip = get_loopback();
+    ip_port_tcp_s1.port = net_htons(ports[0]);
+    IP_Port ip_port_tcp_s2;
+    ip_port_tcp_s2.ip = get_loopback();
+    ip_port_tcp_s2.port = net_htons(ports2[0]);
+
+    ck_assert_msg(new_tcp_connection_to(tc_1, tcp_connections_public_key(tc_2), 123) == 0, "Connection id wrong");
+    ck_assert_msg(new_tcp_connection_to(tc_2, tcp_connections_public_key(tc_1), 123) == 0, "Connection id wrong");
+
+    ck_assert(add_tcp_relay_connection(tc_1, 0, ip_port_tcp_s1, tcp_server_public_key(tcp_s1)) == 0);
+    ck_assert(add_tcp_relay_connection(tc_1, 0, ip_port_tcp_s2, tcp_server_public_key(tcp_s2)) == 0);
+    ck_assert(add_tcp_relay_connection(tc_2, 0, ip_port_tcp_s1, tcp_server_public_key(tcp_s1)) == 0);
+    ck_assert(add_tcp_relay_connection(tc_2, 0, ip_port_tcp_s2, tcp_server_public_key(tcp_s2)) == 0);
+
+    for (int i = 0; i < 100 && (tcp_connection_to_online_tcp_relays(tc_1, 0) != 2
+                                || tcp_connection_to_online_tcp_relays(tc_2, 0) != 2); ++i) {
+        do_TCP_server_delay(tcp_s1, mono_time, 10);
+        do_TCP_server_delay(tcp_s2, mono_time, 10);
+        do_tcp_connections(tc_1, nullptr);
+        do_tcp_connections(tc_2, nullptr);
+    }
+
+    ck_assert_msg(tcp_connection_to_online_tcp_relays(tc_1, 0) == 2, "friend is not online through both relays");
+
+    /* The relays stop reading, so everything sent from now on stays queued and
+     * makes the relay that took it more expensive. */
+    uint8_t packet[1000];
+    memset(packet, 0x42, sizeof(packet));
+
+    TCP_Relay_Stats stats[2];
+    const TCP_Relay_Stats *s1 = nullptr;
+    const TCP_Relay_Stats *s2 = nullptr;
+
+    for (int i = 0; i < 100000; ++i) {
+        ck_assert_msg(send_packet_tcp_connection(tc_1, 0, packet, sizeof(packet), false) == 0,
+                      "could not send lossless packet %d", i);
+        ck_assert(tcp_copy_relay_stats(tc_1, stats, 2) == 2);
+        s1 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s1));
+        s2 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s2));
+
+        if (s1->queued_bytes >= TCP_RELAY_LOSSY_QUEUE_LIMIT || s2->queued_bytes >= TCP_RELAY_LOSSY_QUEUE_LIMIT) {
+            break;
+        }
+    }
+
+    /* Neither relay reached the limit while the other one was much cheaper. */
+    ck_assert_msg(s1->queued_bytes >= TCP_RELAY_LOSSY_QUEUE_LIMIT / 2
+                  && s2->queued_bytes >= TCP_RELAY_LOSSY_QUEUE_LIMIT / 2,
+                  "packets were not sent through the cheaper relay: %u and %u bytes queued",
+                  s1->queued_bytes, s2->queued_bytes);
+    ck_assert(s1->packets_sent > 0 && s2->packets_sent > 0);
+
+    for (int i = 0; i < 100 && (s1->queued_bytes < TCP_RELAY_LOSSY_QUEUE_LIMIT
+                                || s2->queued_bytes < TCP_RELAY_LOSSY_QUEUE_LIMIT); ++i) {
+        ck_assert(send_packet_tcp_connection(tc_1, 0, packet, sizeof(packet), false) == 0);
+        ck_assert(tcp_copy_relay_stats(tc_1, stats, 2) == 2);
+        s1 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s1));
+        s2 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s2));
+    }
+
+    ck_assert(s1->packets_dropped == 0 && s2->packets_dropped == 0);
+
+    /* Both queues are over the limit: lossy packets are refused, lossless ones
+     * are still queued. */
+    ck_assert_msg(send_packet_tcp_connection(tc_1, 0, packet, sizeof(packet), true) == -1,
+                  "lossy packet was queued behind %u and %u bytes", s1->queued_bytes, s2->queued_bytes);
+    ck_assert(tcp_copy_relay_stats(tc_1, stats, 2) == 2);
+    s1 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s1));
+    s2 = find_relay_stats(stats, 2, tcp_server_public_key(tcp_s2));
+    ck_assert(s1->packets_dropped == 1 && s2->packets_dropped == 1);
+
+    const uint64_t sent = s1->packets_sent + s2->packets_sent;
+    ck_assert(send_packet_tcp_connection(tc_1, 0, packet, sizeof(packet), false) == 0);
+    ck_assert(tcp_copy_relay_stats(tc_1, stats, 2) == 2);
+    ck_assert(stats[0].packets_sent + stats[1].packets_sent == sent + 1);
+
+    kill_tcp_connections(tc_1);
+    kill_tcp_connections(tc_2);
+    kill_TCP_server(tcp_s1);
+    kill_TCP_server(tcp_s2);
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -825,10 +1028,12 @@ static Suite *TCP_suite(void)
 
     DEFTESTCASE_SLOW(basic, 5);
     DEFTESTCASE_SLOW(some, 10);
+    DEFTESTCASE_SLOW(handshake_threads, 10);
     DEFTESTCASE_SLOW(client, 10);
     DEFTESTCASE_SLOW(client_invalid, 15);
     DEFTESTCASE_SLOW(tcp_connection, 20);
     DEFTESTCASE_SLOW(tcp_connection2, 20);
+    DEFTESTCASE_SLOW(tcp_relay_selection, 20);
     return s;
 }
 
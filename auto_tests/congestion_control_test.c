@@ -0,0 +1,207 @@
+/* Harness comparing the net_crypto congestion control algorithms.
+ *
+ * Two net_crypto instances on a simulated network send each other a fixed
+ * amount of lossless data with every algorithm, first over a clean link and
+ * then over links with added latency and loss. The test checks that all data
+ * arrives and prints the throughput of each run in simulated time.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/net_crypto.h"
+#include "../toxcore/net_sim.h"
+
+/* First byte of a lossless packet. */
+#define TRANSFER_PACKET_ID 160
+#define TRANSFER_PACKET_COUNT 500
+#define TRANSFER_TIMEOUT 60
+#define CONNECT_TIMEOUT 10
+/* Milliseconds the simulated clock moves on per iteration. */
+#define STEP 1
+
+typedef struct Link {
+    const char *name;
+    Net_Sim_Link link;
+} Link;
+
+static const Link links[] = {
+    {"clean", {1, 0, 0}},
+    {"delay", {40, 0, 0}},
+    {"lossy", {20, 0, 3}},
+};
+
+static const Congestion_Control_Type algorithms[] = {
+    CONGESTION_CONTROL_TOX,
+    CONGESTION_CONTROL_BBR,
+    CONGESTION_CONTROL_CUBIC,
+};
+
+typedef struct Peer {
+    Net_Sim_Node *node;
+    Networking_Core *net;
+    DHT *dht;
+    Net_Crypto *net_crypto;
+    int connection_id;
+    uint32_t received;
+} Peer;
+
+static int handle_data(void *object, int id, const uint8_t *data, uint16_t length, void *userdata)
+{
+    Peer *peer = (Peer *)object;
+
+    if (length == MAX_CRYPTO_DATA_SIZE && data[0] == TRANSFER_PACKET_ID) {
+        ++peer->received;
+    }
+
+    return 0;
+}
+
+static int handle_new_connection(void *object, New_Connection *n_c)
+{
+    Peer *peer = (Peer *)object;
+    peer->connection_id = accept_crypto_connection(peer->net_crypto, n_c);
+
+    if (peer->connection_id == -1) {
+        return -1;
+    }
+
+    return connection_data_handler(peer->net_crypto, peer->connection_id, &handle_data, peer, 0);
+}
+
+static void peer_init(Peer *peer, Net_Sim *sim, const Logger *log)
+{
+    TCP_Proxy_Info proxy_info;
+    memset(&proxy_info, 0, sizeof(proxy_info));
+
+    peer->node = net_sim_node_new(sim, NET_SIM_NAT_NONE);
+    ck_assert_msg(peer->node != nullptr, "failed to add a node");
+    peer->net = new_networking_sim(log, peer->node);
+    ck_assert_msg(peer->net != nullptr, "failed to create networking");
+    peer->dht = new_dht(log, net_sim_mono_time(sim), peer->net, true);
+    ck_assert_msg(peer->dht != nullptr, "failed to create the DHT");
+    peer->net_crypto = new_net_crypto(log, net_sim_mono_time(sim), peer->dht, &proxy_info);
+    ck_assert_msg(peer->net_crypto != nullptr, "failed to create net_crypto");
+    peer->connection_id = -1;
+    peer->received = 0;
+}
+
+static void peer_kill(Peer *peer)
+{
+    kill_net_crypto(peer->net_crypto);
+    kill_dht(peer->dht);
+    kill_networking(peer->net);
+}
+
+static void iterate(Net_Sim *sim, Peer *peers, uint32_t num_peers)
+{
+    for (uint32_t i = 0; i < num_peers; ++i) {
+        networking_poll(peers[i].net, &peers[i]);
+        do_net_crypto(peers[i].net_crypto, &peers[i]);
+    }
+
+    net_sim_advance(sim, STEP);
+}
+
+static bool established(const Peer *peer)
+{
+    return peer->connection_id != -1
+           && crypto_connection_status(peer->net_crypto, peer->connection_id, nullptr, nullptr) == CRYPTO_CONN_ESTABLISHED;
+}
+
+static void transfer(Net_Sim *sim, Peer *peers, const Link *link, Congestion_Control_Type algorithm)
+{
+    for (uint32_t i = 0; i < 2; ++i) {
+        net_sim_node_set_link(peers[i].node, &link->link);
+        ck_assert_msg(net_crypto_set_congestion_control(peers[i].net_crypto, algorithm) == 0,
+                      "failed to set the congestion control algorithm");
+    }
+
+    Peer *sender = &peers[0];
+    Peer *receiver = &peers[1];
+
+    uint8_t packet[MAX_CRYPTO_DATA_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = TRANSFER_PACKET_ID;
+
+    uint32_t sent = 0;
+    receiver->received = 0;
+    const uint64_t start = net_sim_time(sim);
+
+    while (receiver->received < TRANSFER_PACKET_COUNT) {
+        while (sent < TRANSFER_PACKET_COUNT
+                && write_cryptpacket(sender->net_crypto, sender->connection_id, packet, sizeof(packet), 1) != -1) {
+            ++sent;
+        }
+
+        iterate(sim, peers, 2);
+
+        ck_assert_msg(net_sim_time(sim) - start < TRANSFER_TIMEOUT * 1000,
+                      "%s link, %s: only %u of %u packets arrived within %d seconds", link->name,
+                      congestion_control_type_to_string(algorithm), receiver->received, TRANSFER_PACKET_COUNT,
+                      TRANSFER_TIMEOUT);
+    }
+
+    const uint64_t duration = net_sim_time(sim) - start;
+    printf("%-6s link (latency %3u ms, loss %u%%), %-5s: %5u ms, %6.1f KiB/s\n", link->name, link->link.latency,
+           link->link.loss_percent, congestion_control_type_to_string(algorithm), (unsigned)duration,
+           (double)TRANSFER_PACKET_COUNT * MAX_CRYPTO_DATA_SIZE / 1024.0 / ((double)(duration + 1) / 1000.0));
+}
+
+static void test_congestion_control(void)
+{
+    Logger *log = logger_new();
+    Net_Sim *sim = net_sim_new(1);
+    ck_assert_msg(log != nullptr && sim != nullptr, "failed to create the simulation");
+
+    Peer peers[2];
+    peer_init(&peers[0], sim, log);
+    peer_init(&peers[1], sim, log);
+
+    new_connection_handler(peers[1].net_crypto, &handle_new_connection, &peers[1]);
+
+    peers[0].connection_id = new_crypto_connection(peers[0].net_crypto, nc_get_self_public_key(peers[1].net_crypto),
+                             dht_get_self_public_key(peers[1].dht));
+    ck_assert_msg(peers[0].connection_id != -1, "failed to create the connection");
+    set_direct_ip_port(peers[0].net_crypto, peers[0].connection_id, net_sim_node_ip_port(peers[1].node), true);
+
+    const uint64_t start = net_sim_time(sim);
+
+    while (!established(&peers[0]) || !established(&peers[1])) {
+        iterate(sim, peers, 2);
+        ck_assert_msg(net_sim_time(sim) - start < CONNECT_TIMEOUT * 1000, "peers failed to connect");
+    }
+
+    printf("peers are connected, starting transfers of %u packets\n", TRANSFER_PACKET_COUNT);
+
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); ++i) {
+        for (size_t j = 0; j < sizeof(algorithms) / sizeof(algorithms[0]); ++j) {
+            transfer(sim, peers, &links[i], algorithms[j]);
+        }
+    }
+
+    peer_kill(&peers[1]);
+    peer_kill(&peers[0]);
+    net_sim_kill(sim);
+    logger_kill(log);
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_congestion_control();
+    return 0;
+}
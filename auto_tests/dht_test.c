@@ -40,39 +40,39 @@ static inline IP get_loopback()
     return ip;
 }
 
-static void mark_bad(IPPTsPng *ipptp)
+static void mark_bad(const Mono_Time *mono_time, IPPTsPng *ipptp)
 {
-    ipptp->timestamp = unix_time() - 2 * BAD_NODE_TIMEOUT;
+    ipptp->timestamp = mono_time_get(mono_time) - 2 * BAD_NODE_TIMEOUT;
     ipptp->hardening.routes_requests_ok = 0;
     ipptp->hardening.send_nodes_ok = 0;
     ipptp->hardening.testing_requests = 0;
 }
 
-static void mark_possible_bad(IPPTsPng *ipptp)
+static void mark_possible_bad(const Mono_Time *mono_time, IPPTsPng *ipptp)
 {
-    ipptp->timestamp = unix_time();
+    ipptp->timestamp = mono_time_get(mono_time);
     ipptp->hardening.routes_requests_ok = 0;
     ipptp->hardening.send_nodes_ok = 0;
     ipptp->hardening.testing_requests = 0;
 }
 
-static void mark_good(IPPTsPng *ipptp)
+static void mark_good(const Mono_Time *mono_time, IPPTsPng *ipptp)
 {
-    ipptp->timestamp = unix_time();
+    ipptp->timestamp = mono_time_get(mono_time);
     ipptp->hardening.routes_requests_ok = (HARDENING_ALL_OK >> 0) & 1;
     ipptp->hardening.send_nodes_ok = (HARDENING_ALL_OK >> 1) & 1;
     ipptp->hardening.testing_requests = (HARDENING_ALL_OK >> 2) & 1;
 }
 
-static void mark_all_good(Client_data *list, uint32_t length, uint8_t ipv6)
+static void mark_all_good(const Mono_Time *mono_time, Client_data *list, uint32_t length, uint8_t ipv6)
 {
     uint32_t i;
 
     for (i = 0; i < length; ++i) {
         if (ipv6) {
-            mark_good(&list[i].assoc6);
+            mark_good(mono_time, &list[i].assoc6);
         } else {
-            mark_good(&list[i].assoc4);
+            mark_good(mono_time, &list[i].assoc4);
         }
     }
 }
@@ -191,7 +191,7 @@ static void test_addto_lists_bad(DHT            *dht,
     uint8_t ipv6 = net_family_is_ipv6(ip_port->ip.family) ? 1 : 0;
 
     random_bytes(public_key, sizeof(public_key));
-    mark_all_good(list, length, ipv6);
+    mark_all_good(dht->mono_time, list, length, ipv6);
 
     test1 = random_u32() % (length / 3);
     test2 = random_u32() % (length / 3) + length / 3;
@@ -204,13 +204,13 @@ static void test_addto_lists_bad(DHT            *dht,
 
     // mark nodes as "bad"
     if (ipv6) {
-        mark_bad(&list[test1].assoc6);
-        mark_bad(&list[test2].assoc6);
-        mark_bad(&list[test3].assoc6);
+        mark_bad(dht->mono_time, &list[test1].assoc6);
+        mark_bad(dht->mono_time, &list[test2].assoc6);
+        mark_bad(dht->mono_time, &list[test3].assoc6);
     } else {
-        mark_bad(&list[test1].assoc4);
-        mark_bad(&list[test2].assoc4);
-        mark_bad(&list[test3].assoc4);
+        mark_bad(dht->mono_time, &list[test1].assoc4);
+        mark_bad(dht->mono_time, &list[test2].assoc4);
+        mark_bad(dht->mono_time, &list[test3].assoc4);
     }
 
     ip_port->port += 1;
@@ -235,7 +235,7 @@ static void test_addto_lists_possible_bad(DHT            *dht,
     uint8_t ipv6 = net_family_is_ipv6(ip_port->ip.family) ? 1 : 0;
 
     random_bytes(public_key, sizeof(public_key));
-    mark_all_good(list, length, ipv6);
+    mark_all_good(dht->mono_time, list, length, ipv6);
 
     test1 = random_u32() % (length / 3);
     test2 = random_u32() % (length / 3) + length / 3;
@@ -248,13 +248,13 @@ static void test_addto_lists_possible_bad(DHT            *dht,
 
     // mark nodes as "possibly bad"
     if (ipv6) {
-        mark_possible_bad(&list[test1].assoc6);
-        mark_possible_bad(&list[test2].assoc6);
-        mark_possible_bad(&list[test3].assoc6);
+        mark_possible_bad(dht->mono_time, &list[test1].assoc6);
+        mark_possible_bad(dht->mono_time, &list[test2].assoc6);
+        mark_possible_bad(dht->mono_time, &list[test3].assoc6);
     } else {
-        mark_possible_bad(&list[test1].assoc4);
-        mark_possible_bad(&list[test2].assoc4);
-        mark_possible_bad(&list[test3].assoc4);
+        mark_possible_bad(dht->mono_time, &list[test1].assoc4);
+        mark_possible_bad(dht->mono_time, &list[test2].assoc4);
+        mark_possible_bad(dht->mono_time, &list[test3].assoc4);
     }
 
     ip_port->port += 1;
@@ -296,7 +296,7 @@ static void test_addto_lists_good(DHT            *dht,
     uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t ipv6 = net_family_is_ipv6(ip_port->ip.family) ? 1 : 0;
 
-    mark_all_good(list, length, ipv6);
+    mark_all_good(dht->mono_time, list, length, ipv6);
 
     // check "good" client id replacement
     do {
@@ -327,10 +327,13 @@ static void test_addto_lists(IP ip)
     uint32_t index = 1;
     logger_callback_log(log, (logger_cb *)print_debug_log, nullptr, &index);
 
+    Mono_Time *mono_time = mono_time_new();
+    ck_assert_msg(mono_time != nullptr, "Failed to create Mono_Time");
+
     Networking_Core *net = new_networking(log, ip, TOX_PORT_DEFAULT);
     ck_assert_msg(net != nullptr, "Failed to create Networking_Core");
 
-    DHT *dht = new_dht(log, net, true);
+    DHT *dht = new_dht(log, mono_time, net, true);
     ck_assert_msg(dht != nullptr, "Failed to create DHT");
 
     IP_Port ip_port;
@@ -393,6 +396,7 @@ static void test_addto_lists(IP ip)
 
     kill_dht(dht);
     kill_networking(net);
+    mono_time_free(mono_time);
     logger_kill(log);
 }
 
@@ -460,6 +464,7 @@ static void test_list_main(void)
 {
     DHT *dhts[NUM_DHT];
     Logger *logs[NUM_DHT];
+    Mono_Time *mono_time = mono_time_new();
     uint32_t index[NUM_DHT];
 
     uint8_t cmp_list1[NUM_DHT][MAX_FRIEND_CLIENTS][CRYPTO_PUBLIC_KEY_SIZE + 1];
@@ -475,7 +480,7 @@ static void test_list_main(void)
         index[i] = i + 1;
         logger_callback_log(logs[i], (logger_cb *)print_debug_log, nullptr, &index[i]);
 
-        dhts[i] = new_dht(logs[i], new_networking(logs[i], ip, DHT_DEFAULT_PORT + i), true);
+        dhts[i] = new_dht(logs[i], mono_time, new_networking(logs[i], ip, DHT_DEFAULT_PORT + i), true);
         ck_assert_msg(dhts[i] != nullptr, "Failed to create dht instances %u", i);
         ck_assert_msg(net_port(dhts[i]->net) != DHT_DEFAULT_PORT + i,
                       "Bound to wrong port: %d", net_port(dhts[i]->net));
@@ -584,6 +589,8 @@ static void test_list_main(void)
         kill_networking(n);
         logger_kill(logs[i]);
     }
+
+    mono_time_free(mono_time);
 }
 
 
@@ -608,6 +615,7 @@ START_TEST(test_DHT_test)
     uint32_t to_comp = 8394782;
     DHT *dhts[NUM_DHT];
     Logger *logs[NUM_DHT];
+    Mono_Time *mono_time = mono_time_new();
     uint32_t index[NUM_DHT];
 
     unsigned int i, j;
@@ -620,7 +628,7 @@ START_TEST(test_DHT_test)
         index[i] = i + 1;
         logger_callback_log(logs[i], (logger_cb *)print_debug_log, nullptr, &index[i]);
 
-        dhts[i] = new_dht(logs[i], new_networking(logs[i], ip, DHT_DEFAULT_PORT + i), true);
+        dhts[i] = new_dht(logs[i], mono_time, new_networking(logs[i], ip, DHT_DEFAULT_PORT + i), true);
         ck_assert_msg(dhts[i] != nullptr, "Failed to create dht instances %u", i);
         ck_assert_msg(net_port(dhts[i]->net) != DHT_DEFAULT_PORT + i, "Bound to wrong port");
     }
@@ -669,6 +677,8 @@ loop_top:
             break;
         }
 
+        mono_time_update(mono_time);
+
         for (i = 0; i < NUM_DHT; ++i) {
             networking_poll(dhts[i]->net, nullptr);
             do_dht(dhts[i]);
@@ -683,6 +693,8 @@ loop_top:
         kill_networking(n);
         logger_kill(logs[i]);
     }
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
@@ -0,0 +1,151 @@
+/* Tests that two toxes can connect to each other when they are only iterated
+ * after their event descriptor became readable, and that an idle tox rarely
+ * wakes up.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(WIN32)
+#include <poll.h>
+#endif
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+
+#include "helpers.h"
+
+#define NUM_TOXES 2
+
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(WIN32)
+/* Wait for any of the toxes to have work and iterate exactly those. Returns the number of iterated toxes. */
+static uint32_t wait_and_iterate(Tox **toxes, struct pollfd *fds)
+{
+    const int ret = poll(fds, NUM_TOXES, 1000);
+    ck_assert_msg(ret >= 0, "poll failed");
+
+    uint32_t iterated = 0;
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        if (fds[i].revents & POLLIN) {
+            tox_iterate(toxes[i], nullptr);
+            ++iterated;
+        }
+    }
+
+    return iterated;
+}
+#endif
+
+static void test_event_fd(void)
+{
+    uint32_t index[] = { 1, 2 };
+    Tox *toxes[NUM_TOXES];
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        toxes[i] = tox_new_log(nullptr, nullptr, &index[i]);
+        ck_assert_msg(toxes[i] != nullptr, "failed to create tox instance %u", i);
+    }
+
+#if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
+    ck_assert_msg(tox_get_event_fd(toxes[0]) == -1, "event fd should not be supported on windows");
+#else
+    struct pollfd fds[NUM_TOXES];
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        const int32_t fd = tox_get_event_fd(toxes[i]);
+
+        if (fd == -1) {
+            printf("event fd not supported on this platform, skipping test\n");
+            tox_kill(toxes[0]);
+            tox_kill(toxes[1]);
+            return;
+        }
+
+        ck_assert_msg(fd == tox_get_event_fd(toxes[i]), "event fd changed between calls");
+        fds[i].fd = fd;
+        fds[i].events = POLLIN;
+    }
+
+    const time_t cur_time = time(nullptr);
+
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(toxes[1], public_key);
+    tox_friend_add_norequest(toxes[0], public_key, nullptr);
+    tox_self_get_public_key(toxes[0], public_key);
+    tox_friend_add_norequest(toxes[1], public_key, nullptr);
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(toxes[0], dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(toxes[0], nullptr);
+    tox_bootstrap(toxes[1], "localhost", dht_port, dht_key, nullptr);
+
+    uint32_t wakeups = 0;
+
+    while (tox_friend_get_connection_status(toxes[0], 0, nullptr) != TOX_CONNECTION_UDP ||
+            tox_friend_get_connection_status(toxes[1], 0, nullptr) != TOX_CONNECTION_UDP) {
+        wakeups += wait_and_iterate(toxes, fds);
+    }
+
+    printf("toxes connected after %u wakeups, took %ld seconds\n", wakeups, (long)(time(nullptr) - cur_time));
+#endif
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        tox_kill(toxes[i]);
+    }
+}
+
+#define IDLE_SECONDS 5
+
+static void test_idle_wakeups(void)
+{
+    Tox *tox = tox_new_log(nullptr, nullptr, nullptr);
+    ck_assert_msg(tox != nullptr, "failed to create tox instance");
+
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(WIN32)
+    struct pollfd fd;
+    fd.fd = tox_get_event_fd(tox);
+    fd.events = POLLIN;
+
+    if (fd.fd != -1) {
+        const time_t start = time(nullptr);
+        uint32_t wakeups = 0;
+
+        while (time(nullptr) - start < IDLE_SECONDS) {
+            ck_assert_msg(poll(&fd, 1, 1000) >= 0, "poll failed");
+
+            if (fd.revents & POLLIN) {
+                tox_iterate(tox, nullptr);
+                ++wakeups;
+            }
+        }
+
+        printf("idle tox woke up %u times in %d seconds\n", wakeups, IDLE_SECONDS);
+        // Once per second, and some slack for the first iterations and LAN discovery packets.
+        ck_assert_msg(wakeups <= IDLE_SECONDS * 3, "idle tox woke up %u times in %d seconds", wakeups, IDLE_SECONDS);
+    }
+
+#endif
+
+    tox_kill(tox);
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_event_fd();
+    test_idle_wakeups();
+    return 0;
+}
@@ -80,6 +80,9 @@ static void test_lossless_packet(void)
 
     printf("tox clients connected took %ld seconds\n", time(nullptr) - con_time);
 
+    ck_assert_msg(!tox_set_congestion_control(tox1, (Tox_Congestion_Control)99), "set an unknown congestion control");
+    ck_assert_msg(tox_set_congestion_control(tox1, TOX_CONGESTION_CONTROL_BBR), "failed to switch congestion control");
+
     tox_callback_friend_lossless_packet(tox2, &handle_lossless_packet);
     uint8_t packet[TOX_MAX_CUSTOM_PACKET_SIZE + 1];
     memset(packet, LOSSLESS_PACKET_FILLER, sizeof(packet));
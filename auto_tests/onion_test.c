@@ -167,9 +167,11 @@ START_TEST(test_basic)
     Logger *log2 = logger_new();
     logger_callback_log(log2, (logger_cb *)print_debug_log, nullptr, &index[1]);
 
+    Mono_Time *mono_time = mono_time_new();
+
     IP ip = get_loopback();
-    Onion *onion1 = new_onion(new_dht(log1, new_networking(log1, ip, 36567), true));
-    Onion *onion2 = new_onion(new_dht(log2, new_networking(log2, ip, 36568), true));
+    Onion *onion1 = new_onion(mono_time, new_dht(log1, mono_time, new_networking(log1, ip, 36567), true));
+    Onion *onion2 = new_onion(mono_time, new_dht(log2, mono_time, new_networking(log2, ip, 36568), true));
     ck_assert_msg((onion1 != nullptr) && (onion2 != nullptr), "Onion failed initializing.");
     networking_registerhandler(onion2->net, NET_PACKET_ANNOUNCE_REQUEST, &handle_test_1, onion2);
 
@@ -209,8 +211,8 @@ START_TEST(test_basic)
         do_onion(onion2);
     }
 
-    Onion_Announce *onion1_a = new_onion_announce(onion1->dht);
-    Onion_Announce *onion2_a = new_onion_announce(onion2->dht);
+    Onion_Announce *onion1_a = new_onion_announce(mono_time, onion1->dht);
+    Onion_Announce *onion2_a = new_onion_announce(mono_time, onion2->dht);
     networking_registerhandler(onion1->net, NET_PACKET_ANNOUNCE_RESPONSE, &handle_test_3, onion1);
     ck_assert_msg((onion1_a != nullptr) && (onion2_a != nullptr), "Onion_Announce failed initializing.");
     uint8_t zeroes[64] = {0};
@@ -228,6 +230,7 @@ START_TEST(test_basic)
     handled_test_3 = 0;
 
     while (handled_test_3 == 0) {
+        mono_time_update(mono_time);
         do_onion(onion1);
         do_onion(onion2);
         c_sleep(50);
@@ -236,7 +239,7 @@ START_TEST(test_basic)
     random_bytes(sb_data, sizeof(sb_data));
     memcpy(&s, sb_data, sizeof(uint64_t));
     memcpy(onion_announce_entry_public_key(onion2_a, 1), dht_get_self_public_key(onion2->dht), CRYPTO_PUBLIC_KEY_SIZE);
-    onion_announce_entry_set_time(onion2_a, 1, unix_time());
+    onion_announce_entry_set_time(onion2_a, 1, mono_time_get(mono_time));
     networking_registerhandler(onion1->net, NET_PACKET_ONION_DATA_RESPONSE, &handle_test_4, onion1);
     send_announce_request(onion1->net, &path, nodes[3],
                           dht_get_self_public_key(onion1->dht),
@@ -257,7 +260,7 @@ START_TEST(test_basic)
     Logger *log3 = logger_new();
     logger_callback_log(log3, (logger_cb *)print_debug_log, nullptr, &index[2]);
 
-    Onion *onion3 = new_onion(new_dht(log3, new_networking(log3, ip, 36569), true));
+    Onion *onion3 = new_onion(mono_time, new_dht(log3, mono_time, new_networking(log3, ip, 36569), true));
     ck_assert_msg((onion3 != nullptr), "Onion failed initializing.");
 
     random_nonce(nonce);
@@ -269,6 +272,7 @@ START_TEST(test_basic)
     handled_test_4 = 0;
 
     while (handled_test_4 == 0) {
+        mono_time_update(mono_time);
         do_onion(onion1);
         do_onion(onion2);
         c_sleep(50);
@@ -309,11 +313,14 @@ START_TEST(test_basic)
         kill_networking(net);
         logger_kill(log1);
     }
+
+    mono_time_free(mono_time);
 }
 END_TEST
 
 typedef struct {
     Logger *log;
+    Mono_Time *mono_time;
     Onion *onion;
     Onion_Announce *onion_a;
     Onion_Client *onion_c;
@@ -338,52 +345,65 @@ static Onions *new_onions(uint16_t port, uint32_t *index)
 
     logger_callback_log(on->log, (logger_cb *)print_debug_log, nullptr, index);
 
+    on->mono_time = mono_time_new();
+
+    if (!on->mono_time) {
+        logger_kill(on->log);
+        free(on);
+        return nullptr;
+    }
+
     Networking_Core *net = new_networking(on->log, ip, port);
 
     if (!net) {
+        mono_time_free(on->mono_time);
         logger_kill(on->log);
         free(on);
         return nullptr;
     }
 
-    DHT *dht = new_dht(on->log, net, true);
+    DHT *dht = new_dht(on->log, on->mono_time, net, true);
 
     if (!dht) {
         kill_networking(net);
+        mono_time_free(on->mono_time);
         logger_kill(on->log);
         free(on);
         return nullptr;
     }
 
-    on->onion = new_onion(dht);
+    on->onion = new_onion(on->mono_time, dht);
 
     if (!on->onion) {
         kill_dht(dht);
         kill_networking(net);
+        mono_time_free(on->mono_time);
         logger_kill(on->log);
         free(on);
         return nullptr;
     }
 
-    on->onion_a = new_onion_announce(dht);
+    on->onion_a = new_onion_announce(on->mono_time, dht);
 
     if (!on->onion_a) {
         kill_onion(on->onion);
         kill_dht(dht);
         kill_networking(net);
+        mono_time_free(on->mono_time);
         logger_kill(on->log);
         free(on);
         return nullptr;
     }
 
     TCP_Proxy_Info inf = {{{{0}}}};
-    on->onion_c = new_onion_client(new_net_crypto(on->log, dht, &inf));
+    on->onion_c = new_onion_client(on->mono_time, new_net_crypto(on->log, on->mono_time, dht, &inf));
 
     if (!on->onion_c) {
         kill_onion_announce(on->onion_a);
         kill_onion(on->onion);
         kill_dht(dht);
         kill_networking(net);
+        mono_time_free(on->mono_time);
         logger_kill(on->log);
         free(on);
         return nullptr;
@@ -394,6 +414,8 @@ static Onions *new_onions(uint16_t port, uint32_t *index)
 
 static void do_onions(Onions *on)
 {
+    mono_time_update(on->mono_time);
+
     networking_poll(on->onion->net, nullptr);
     do_dht(on->onion->dht);
     do_onion_client(on->onion_c);
@@ -410,6 +432,7 @@ static void kill_onions(Onions *on)
     kill_net_crypto(c);
     kill_dht(dht);
     kill_networking(net);
+    mono_time_free(on->mono_time);
     logger_kill(on->log);
     free(on);
 }
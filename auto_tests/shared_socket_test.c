@@ -0,0 +1,179 @@
+/* Tests that toxes sharing the UDP socket of another tox can connect to their
+ * friends and to each other.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/tox.h"
+
+#include "helpers.h"
+
+#define NUM_TOXES 4
+
+static void befriend(Tox *tox1, Tox *tox2)
+{
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(tox2, public_key);
+    tox_friend_add_norequest(tox1, public_key, nullptr);
+    tox_self_get_public_key(tox1, public_key);
+    tox_friend_add_norequest(tox2, public_key, nullptr);
+}
+
+static bool friends_connected(Tox *tox, const uint8_t *public_key)
+{
+    const uint32_t friend_number = tox_friend_by_public_key(tox, public_key, nullptr);
+    return tox_friend_get_connection_status(tox, friend_number, nullptr) == TOX_CONNECTION_UDP;
+}
+
+/* A tox sharing the socket of another, iterated on a thread of its own. */
+typedef struct Tenant_Thread {
+    Tox *tox;
+    const uint8_t *friend_keys[2];
+    uint32_t num_friends;
+
+    pthread_mutex_t *mutex;
+    bool connected; /* to all its friends, guarded by mutex */
+    bool stop; /* guarded by mutex */
+} Tenant_Thread;
+
+static void *tenant_thread(void *arg)
+{
+    Tenant_Thread *tenant = (Tenant_Thread *)arg;
+
+    while (true) {
+        tox_iterate(tenant->tox, nullptr);
+
+        bool connected = true;
+
+        for (uint32_t i = 0; i < tenant->num_friends; ++i) {
+            connected = connected && friends_connected(tenant->tox, tenant->friend_keys[i]);
+        }
+
+        pthread_mutex_lock(tenant->mutex);
+        tenant->connected = connected;
+        const bool stop = tenant->stop;
+        pthread_mutex_unlock(tenant->mutex);
+
+        if (stop) {
+            return nullptr;
+        }
+
+        c_sleep(ITERATION_INTERVAL);
+    }
+}
+
+static void test_shared_socket(void)
+{
+    uint32_t index[] = { 1, 2, 3, 4 };
+    const time_t cur_time = time(nullptr);
+
+    /* toxes[0] owns the socket shared by toxes[1] and toxes[2], toxes[3] is a regular tox. */
+    Tox *toxes[NUM_TOXES];
+    toxes[0] = tox_new_log(nullptr, nullptr, &index[0]);
+    ck_assert_msg(toxes[0] != nullptr, "failed to create host tox");
+
+    for (uint32_t i = 1; i < 3; ++i) {
+        struct Tox_Options *opts = tox_options_new(nullptr);
+        tox_options_set_log_callback(opts, &print_debug_log);
+        tox_options_set_log_user_data(opts, &index[i]);
+        tox_options_set_local_discovery_enabled(opts, false);
+        TOX_ERR_NEW err;
+        toxes[i] = tox_new_shared(opts, toxes[0], &err);
+        tox_options_free(opts);
+        ck_assert_msg(err == TOX_ERR_NEW_OK, "failed to create shared tox %u: %d", i, err);
+        ck_assert_msg(tox_self_get_udp_port(toxes[i], nullptr) == tox_self_get_udp_port(toxes[0], nullptr),
+                      "shared tox does not use the port of its host");
+    }
+
+    TOX_ERR_NEW err;
+    ck_assert_msg(tox_new_shared(nullptr, toxes[1], &err) == nullptr && err == TOX_ERR_NEW_PORT_ALLOC,
+                  "sharing the socket of a shared tox should fail");
+
+    toxes[3] = tox_new_log(nullptr, nullptr, &index[3]);
+    ck_assert_msg(toxes[3] != nullptr, "failed to create regular tox");
+
+    befriend(toxes[1], toxes[3]);
+    befriend(toxes[1], toxes[2]);
+
+    uint8_t public_keys[NUM_TOXES][TOX_PUBLIC_KEY_SIZE];
+
+    for (uint32_t i = 0; i < NUM_TOXES; ++i) {
+        tox_self_get_public_key(toxes[i], public_keys[i]);
+    }
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(toxes[0], dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(toxes[0], nullptr);
+
+    for (uint32_t i = 1; i < NUM_TOXES; ++i) {
+        tox_bootstrap(toxes[i], "localhost", dht_port, dht_key, nullptr);
+    }
+
+    /* The host and the regular tox run on this thread, each tox sharing the socket on one of its own. */
+    pthread_mutex_t mutex;
+    ck_assert(pthread_mutex_init(&mutex, nullptr) == 0);
+
+    Tenant_Thread tenants[2] = {
+        { toxes[1], { public_keys[3], public_keys[2] }, 2, &mutex, false, false },
+        { toxes[2], { public_keys[1], nullptr }, 1, &mutex, false, false },
+    };
+    pthread_t threads[2];
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        ck_assert(pthread_create(&threads[i], nullptr, tenant_thread, &tenants[i]) == 0);
+    }
+
+    while (true) {
+        tox_iterate(toxes[0], nullptr);
+        tox_iterate(toxes[3], nullptr);
+
+        pthread_mutex_lock(&mutex);
+        const bool tenants_connected = tenants[0].connected && tenants[1].connected;
+        pthread_mutex_unlock(&mutex);
+
+        if (tenants_connected && friends_connected(toxes[3], public_keys[1])) {
+            break;
+        }
+
+        c_sleep(ITERATION_INTERVAL);
+    }
+
+    pthread_mutex_lock(&mutex);
+    tenants[0].stop = true;
+    tenants[1].stop = true;
+    pthread_mutex_unlock(&mutex);
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        ck_assert(pthread_join(threads[i], nullptr) == 0);
+    }
+
+    pthread_mutex_destroy(&mutex);
+
+    printf("test_shared_socket succeeded, took %ld seconds\n", (long)(time(nullptr) - cur_time));
+
+    for (uint32_t i = NUM_TOXES; i > 0; --i) {
+        tox_kill(toxes[i - 1]);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_shared_socket();
+    return 0;
+}
@@ -0,0 +1,371 @@
+/* Tests that calls are iterated by toxav's worker threads: calls with high
+ * friend numbers, several calls per worker, frames sent from other threads
+ * while the workers run, and calls ending while they run.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "check_compat.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toxav/toxav.h"
+#include "../toxcore/crypto_core.h"
+#include "../toxcore/tox.h"
+
+#include "helpers.h"
+
+#define NUM_BOBS 3
+#define NUM_WORKERS 2
+
+/* Friends Alice adds before the Bobs, so that the calls have high friend numbers. */
+#define NUM_OTHER_FRIENDS 100
+
+#define AUDIO_FRAME_SIZE 960
+#define AUDIO_SAMPLING_RATE 48000
+
+typedef struct Alice_State {
+    uint32_t bob_friend_numbers[NUM_BOBS];
+    pthread_mutex_t mutex; /* the workers call audio_receive_frame on threads of their own */
+    uint32_t frames_from[NUM_BOBS];
+} Alice_State;
+
+typedef struct Bob_State {
+    bool incoming;
+    uint32_t state;
+    uint32_t frames;
+} Bob_State;
+
+typedef struct Sender {
+    ToxAV *av;
+    uint32_t friend_number;
+    pthread_mutex_t *mutex;
+    bool stop; /* guarded by mutex */
+} Sender;
+
+static void t_accept_friend_request_cb(Tox *m, const uint8_t *public_key, const uint8_t *data, size_t length,
+                                       void *userdata)
+{
+    if (length == 7 && memcmp("gentoo", data, 7) == 0) {
+        ck_assert(tox_friend_add_norequest(m, public_key, nullptr) != UINT32_MAX);
+    }
+}
+
+static void alice_audio_receive_frame_cb(ToxAV *av, uint32_t friend_number, const int16_t *pcm, size_t sample_count,
+        uint8_t channels, uint32_t sampling_rate, void *user_data)
+{
+    Alice_State *alice = (Alice_State *)user_data;
+
+    pthread_mutex_lock(&alice->mutex);
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        if (alice->bob_friend_numbers[i] == friend_number) {
+            ++alice->frames_from[i];
+        }
+    }
+
+    pthread_mutex_unlock(&alice->mutex);
+}
+
+static void bob_call_cb(ToxAV *av, uint32_t friend_number, bool audio_enabled, bool video_enabled, void *user_data)
+{
+    ((Bob_State *)user_data)->incoming = true;
+}
+
+static void bob_call_state_cb(ToxAV *av, uint32_t friend_number, uint32_t state, void *user_data)
+{
+    ((Bob_State *)user_data)->state = state;
+}
+
+static void bob_audio_receive_frame_cb(ToxAV *av, uint32_t friend_number, const int16_t *pcm, size_t sample_count,
+                                       uint8_t channels, uint32_t sampling_rate, void *user_data)
+{
+    ++((Bob_State *)user_data)->frames;
+}
+
+static uint32_t frames_from(Alice_State *alice, uint32_t bob)
+{
+    pthread_mutex_lock(&alice->mutex);
+    const uint32_t frames = alice->frames_from[bob];
+    pthread_mutex_unlock(&alice->mutex);
+    return frames;
+}
+
+/* Send Alice's audio to one Bob until told to stop, while the workers iterate the calls. */
+static void *sender_thread(void *arg)
+{
+    Sender *sender = (Sender *)arg;
+    int16_t pcm[AUDIO_FRAME_SIZE] = {0};
+
+    while (true) {
+        pthread_mutex_lock(sender->mutex);
+        const bool stop = sender->stop;
+        pthread_mutex_unlock(sender->mutex);
+
+        if (stop) {
+            return nullptr;
+        }
+
+        /* Fails once the call is hung up, which is fine. */
+        toxav_audio_send_frame(sender->av, sender->friend_number, pcm, AUDIO_FRAME_SIZE, 1, AUDIO_SAMPLING_RATE,
+                               nullptr);
+        c_sleep(20);
+    }
+}
+
+/* Iterate all toxes, and the ToxAVs of the Bobs, who send audio to Alice. */
+static void iterate_all(Tox **toxes, ToxAV **bobs_av)
+{
+    int16_t pcm[AUDIO_FRAME_SIZE] = {0};
+
+    for (uint32_t i = 0; i < 2 + NUM_BOBS; ++i) {
+        tox_iterate(toxes[i], nullptr);
+    }
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        toxav_iterate(bobs_av[i]);
+        toxav_audio_send_frame(bobs_av[i], 0, pcm, AUDIO_FRAME_SIZE, 1, AUDIO_SAMPLING_RATE, nullptr);
+    }
+}
+
+static void iterate_all_for(Tox **toxes, ToxAV **bobs_av, ToxAV *alice_av, time_t seconds)
+{
+    const time_t start_time = time(nullptr);
+
+    while (time(nullptr) - start_time < seconds) {
+        if (alice_av != nullptr) {
+            toxav_iterate(alice_av);
+        }
+
+        iterate_all(toxes, bobs_av);
+        c_sleep(20);
+    }
+}
+
+static void test_av_workers(void)
+{
+    uint32_t index[] = { 1, 2, 3, 4, 5 };
+    Tox *toxes[2 + NUM_BOBS];
+
+    for (uint32_t i = 0; i < 2 + NUM_BOBS; ++i) {
+        TOX_ERR_NEW error;
+        toxes[i] = tox_new_log(nullptr, &error, &index[i]);
+        ck_assert(error == TOX_ERR_NEW_OK);
+    }
+
+    Tox *bootstrap = toxes[0];
+    Tox *alice = toxes[1];
+    Tox **bobs = toxes + 2;
+
+    for (uint32_t i = 0; i < NUM_OTHER_FRIENDS; ++i) {
+        uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+        uint8_t secret_key[CRYPTO_SECRET_KEY_SIZE];
+        crypto_new_keypair(public_key, secret_key);
+        ck_assert(tox_friend_add_norequest(alice, public_key, nullptr) == i);
+    }
+
+    uint8_t address[TOX_ADDRESS_SIZE];
+    tox_callback_friend_request(alice, t_accept_friend_request_cb);
+    tox_self_get_address(alice, address);
+
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(bootstrap, dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(bootstrap, nullptr);
+
+    for (uint32_t i = 1; i < 2 + NUM_BOBS; ++i) {
+        tox_bootstrap(toxes[i], "localhost", dht_port, dht_key, nullptr);
+    }
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        ck_assert(tox_friend_add(bobs[i], address, (const uint8_t *)"gentoo", 7, nullptr) != UINT32_MAX);
+    }
+
+    Alice_State alice_state;
+    memset(&alice_state, 0, sizeof(alice_state));
+    ck_assert(pthread_mutex_init(&alice_state.mutex, nullptr) == 0);
+
+    printf("Waiting for the Bobs to connect to Alice\n");
+    const time_t cur_time = time(nullptr);
+
+    while (true) {
+        for (uint32_t i = 0; i < 2 + NUM_BOBS; ++i) {
+            tox_iterate(toxes[i], nullptr);
+        }
+
+        bool connected = true;
+
+        for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+            uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+            tox_self_get_public_key(bobs[i], public_key);
+            alice_state.bob_friend_numbers[i] = tox_friend_by_public_key(alice, public_key, nullptr);
+
+            connected = connected && alice_state.bob_friend_numbers[i] != UINT32_MAX
+                        && tox_friend_get_connection_status(alice, alice_state.bob_friend_numbers[i], nullptr)
+                        == TOX_CONNECTION_UDP
+                        && tox_friend_get_connection_status(bobs[i], 0, nullptr) == TOX_CONNECTION_UDP;
+        }
+
+        if (connected) {
+            break;
+        }
+
+        c_sleep(20);
+    }
+
+    printf("Connected after %ld seconds\n", (long)(time(nullptr) - cur_time));
+
+    TOXAV_ERR_NEW error;
+    ToxAV *alice_av = toxav_new(alice, &error);
+    ck_assert(error == TOXAV_ERR_NEW_OK);
+    toxav_callback_audio_receive_frame(alice_av, alice_audio_receive_frame_cb, &alice_state);
+
+    ToxAV *bobs_av[NUM_BOBS];
+    Bob_State bobs_state[NUM_BOBS];
+    memset(bobs_state, 0, sizeof(bobs_state));
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        bobs_av[i] = toxav_new(bobs[i], &error);
+        ck_assert(error == TOXAV_ERR_NEW_OK);
+        toxav_callback_call(bobs_av[i], bob_call_cb, &bobs_state[i]);
+        toxav_callback_call_state(bobs_av[i], bob_call_state_cb, &bobs_state[i]);
+        toxav_callback_audio_receive_frame(bobs_av[i], bob_audio_receive_frame_cb, &bobs_state[i]);
+    }
+
+    ck_assert_msg(!toxav_set_iterate_workers(alice_av, TOXAV_MAX_ITERATE_WORKERS + 1),
+                  "more than TOXAV_MAX_ITERATE_WORKERS workers should be refused");
+    ck_assert(toxav_get_iterate_workers(alice_av) == 0);
+    ck_assert(toxav_set_iterate_workers(alice_av, NUM_WORKERS));
+    ck_assert(toxav_get_iterate_workers(alice_av) == NUM_WORKERS);
+
+    {
+        /* No call is found for a friend that isn't in one. */
+        int16_t pcm[AUDIO_FRAME_SIZE] = {0};
+        TOXAV_ERR_SEND_FRAME rc;
+        toxav_audio_send_frame(alice_av, alice_state.bob_friend_numbers[0], pcm, AUDIO_FRAME_SIZE, 1,
+                               AUDIO_SAMPLING_RATE, &rc);
+        ck_assert_msg(rc == TOXAV_ERR_SEND_FRAME_FRIEND_NOT_IN_CALL, "sending outside a call: %d", rc);
+    }
+
+    /* Three calls on two workers: one worker iterates two of them. */
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        TOXAV_ERR_CALL rc;
+        toxav_call(alice_av, alice_state.bob_friend_numbers[i], 48, 0, &rc);
+        ck_assert_msg(rc == TOXAV_ERR_CALL_OK, "toxav_call failed: %d", rc);
+    }
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        while (!bobs_state[i].incoming) {
+            iterate_all(toxes, bobs_av);
+            c_sleep(20);
+        }
+
+        TOXAV_ERR_ANSWER rc;
+        toxav_answer(bobs_av[i], 0, 48, 0, &rc);
+        ck_assert_msg(rc == TOXAV_ERR_ANSWER_OK, "toxav_answer failed: %d", rc);
+    }
+
+    pthread_mutex_t senders_mutex;
+    ck_assert(pthread_mutex_init(&senders_mutex, nullptr) == 0);
+
+    Sender senders[NUM_BOBS];
+    pthread_t sender_threads[NUM_BOBS];
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        senders[i].av = alice_av;
+        senders[i].friend_number = alice_state.bob_friend_numbers[i];
+        senders[i].mutex = &senders_mutex;
+        senders[i].stop = false;
+        ck_assert(pthread_create(&sender_threads[i], nullptr, sender_thread, &senders[i]) == 0);
+    }
+
+    iterate_all_for(toxes, bobs_av, nullptr, 3);
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        ck_assert_msg(frames_from(&alice_state, i) > 0, "the workers did not iterate the call with Bob %u", i);
+        ck_assert_msg(bobs_state[i].frames > 0, "Bob %u got no audio from Alice", i);
+    }
+
+    /* End a call while the workers iterate and a thread sends to it. */
+    {
+        TOXAV_ERR_CALL_CONTROL rc;
+        toxav_call_control(alice_av, alice_state.bob_friend_numbers[0], TOXAV_CALL_CONTROL_CANCEL, &rc);
+        ck_assert_msg(rc == TOXAV_ERR_CALL_CONTROL_OK, "toxav_call_control failed: %d", rc);
+    }
+
+    uint32_t frames[NUM_BOBS];
+
+    for (uint32_t i = 1; i < NUM_BOBS; ++i) {
+        frames[i] = frames_from(&alice_state, i);
+    }
+
+    iterate_all_for(toxes, bobs_av, nullptr, 2);
+
+    ck_assert_msg(bobs_state[0].state == TOXAV_FRIEND_CALL_STATE_FINISHED, "Bob 0 did not see the call end");
+
+    for (uint32_t i = 1; i < NUM_BOBS; ++i) {
+        ck_assert_msg(frames_from(&alice_state, i) > frames[i], "the call with Bob %u stopped with another", i);
+    }
+
+    pthread_mutex_lock(&senders_mutex);
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        senders[i].stop = true;
+    }
+
+    pthread_mutex_unlock(&senders_mutex);
+
+    for (uint32_t i = 0; i < NUM_BOBS; ++i) {
+        ck_assert(pthread_join(sender_threads[i], nullptr) == 0);
+    }
+
+    pthread_mutex_destroy(&senders_mutex);
+
+    /* Without workers, toxav_iterate() iterates the calls again. */
+    ck_assert(toxav_set_iterate_workers(alice_av, 0));
+    ck_assert(toxav_get_iterate_workers(alice_av) == 0);
+
+    for (uint32_t i = 1; i < NUM_BOBS; ++i) {
+        frames[i] = frames_from(&alice_state, i);
+    }
+
+    iterate_all_for(toxes, bobs_av, alice_av, 2);
+
+    for (uint32_t i = 1; i < NUM_BOBS; ++i) {
+        ck_assert_msg(frames_from(&alice_state, i) > frames[i], "toxav_iterate did not iterate the call with Bob %u",
+                      i);
+    }
+
+    printf("Killing all instances\n");
+
+    for (uint32_t i = NUM_BOBS; i > 0; --i) {
+        toxav_kill(bobs_av[i - 1]);
+    }
+
+    toxav_kill(alice_av);
+    pthread_mutex_destroy(&alice_state.mutex);
+
+    for (uint32_t i = 2 + NUM_BOBS; i > 0; --i) {
+        tox_kill(toxes[i - 1]);
+    }
+
+    printf("\nTest successful!\n");
+}
+
+int main(void)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    test_av_workers();
+    return 0;
+}
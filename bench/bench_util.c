@@ -0,0 +1,187 @@
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bench_util.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/mono_time.h"
+
+/* The Travis-CI container responds poorly to ::1 as a localhost address
+ * You're encouraged to -D FORCE_TESTS_IPV6 on a local test  */
+#ifdef FORCE_TESTS_IPV6
+#define TOX_LOCALHOST "::1"
+#else
+#define TOX_LOCALHOST "127.0.0.1"
+#endif
+
+bool bench_report_open(Bench_Report *report, const char *name, int argc, char **argv)
+{
+    report->out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    report->num_results = 0;
+
+    if (report->out == nullptr) {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return false;
+    }
+
+    fprintf(report->out, "{\"benchmark\": \"%s\", \"version\": \"%u.%u.%u\", \"results\": [", name,
+            tox_version_major(), tox_version_minor(), tox_version_patch());
+    return true;
+}
+
+void bench_report_add(Bench_Report *report, const char *name, double value, const char *unit)
+{
+    fprintf(report->out, "%s\n  {\"name\": \"%s\", \"value\": %.3f, \"unit\": \"%s\"}",
+            report->num_results == 0 ? "" : ",", name, value, unit);
+    ++report->num_results;
+
+    /* Show progress when the report goes to a file. */
+    if (report->out != stdout) {
+        fprintf(stderr, "%s: %.3f %s\n", name, value, unit);
+    }
+}
+
+void bench_report_close(Bench_Report *report)
+{
+    fprintf(report->out, "\n]}\n");
+
+    if (report->out != stdout) {
+        fclose(report->out);
+    }
+
+    report->out = nullptr;
+}
+
+void bench_fail(const char *message)
+{
+    fprintf(stderr, "benchmark failed: %s\n", message);
+    exit(1);
+}
+
+uint64_t bench_time(void)
+{
+    return current_time_actual() / 1000;
+}
+
+void bench_sleep(uint32_t ms)
+{
+#if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
+    Sleep(ms);
+#else
+    usleep(1000 * ms);
+#endif
+}
+
+static void bench_log(Tox *tox, TOX_LOG_LEVEL level, const char *file, uint32_t line, const char *func,
+                      const char *message, void *user_data)
+{
+    if (level == TOX_LOG_LEVEL_ERROR) {
+        fprintf(stderr, "%s:%u\t%s:\t%s\n", file, line, func, message);
+    }
+}
+
+Tox *bench_tox_new(bool udp_enabled, uint16_t tcp_port)
+{
+    struct Tox_Options *options = tox_options_new(nullptr);
+
+    if (options == nullptr) {
+        bench_fail("could not allocate tox options");
+    }
+
+    tox_options_set_local_discovery_enabled(options, false);
+    tox_options_set_udp_enabled(options, udp_enabled);
+    tox_options_set_tcp_port(options, tcp_port);
+    tox_options_set_start_port(options, 33445);
+    tox_options_set_end_port(options, 33445 + 2000);
+    tox_options_set_log_callback(options, &bench_log);
+
+    Tox *tox = tox_new(options, nullptr);
+    tox_options_free(options);
+
+    if (tox == nullptr) {
+        bench_fail("could not create a tox instance");
+    }
+
+    return tox;
+}
+
+void bench_bootstrap(Tox *tox, Tox *node)
+{
+    uint8_t dht_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_dht_id(node, dht_key);
+    const uint16_t dht_port = tox_self_get_udp_port(node, nullptr);
+
+    if (!tox_bootstrap(tox, TOX_LOCALHOST, dht_port, dht_key, nullptr)) {
+        bench_fail("could not bootstrap");
+    }
+
+    const uint16_t tcp_port = tox_self_get_tcp_port(node, nullptr);
+
+    if (tcp_port != 0 && !tox_add_tcp_relay(tox, TOX_LOCALHOST, tcp_port, dht_key, nullptr)) {
+        bench_fail("could not add the TCP relay");
+    }
+}
+
+static bool bench_pair_connected(const Bench_Pair *pair, TOX_CONNECTION connection)
+{
+    return tox_friend_get_connection_status(pair->tox1, 0, nullptr) == connection
+           && tox_friend_get_connection_status(pair->tox2, 0, nullptr) == connection;
+}
+
+uint64_t bench_pair_connect(Bench_Pair *pair, bool tcp)
+{
+    const uint64_t start = bench_time();
+
+    pair->node = bench_tox_new(true, BENCH_TCP_RELAY_PORT);
+    pair->tox1 = bench_tox_new(!tcp, 0);
+    pair->tox2 = bench_tox_new(!tcp, 0);
+
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+    tox_self_get_public_key(pair->tox2, public_key);
+    tox_friend_add_norequest(pair->tox1, public_key, nullptr);
+    tox_self_get_public_key(pair->tox1, public_key);
+    tox_friend_add_norequest(pair->tox2, public_key, nullptr);
+
+    bench_bootstrap(pair->tox1, pair->node);
+    bench_bootstrap(pair->tox2, pair->node);
+
+    const TOX_CONNECTION connection = tcp ? TOX_CONNECTION_TCP : TOX_CONNECTION_UDP;
+
+    while (!bench_pair_connected(pair, connection)) {
+        if (bench_time() - start > BENCH_TIMEOUT) {
+            bench_fail("friends did not connect");
+        }
+
+        bench_pair_iterate(pair, nullptr, nullptr);
+        bench_sleep(tox_iteration_interval(pair->tox1));
+    }
+
+    return bench_time() - start;
+}
+
+void bench_pair_iterate(Bench_Pair *pair, void *user_data1, void *user_data2)
+{
+    tox_iterate(pair->node, nullptr);
+    tox_iterate(pair->tox1, user_data1);
+    tox_iterate(pair->tox2, user_data2);
+}
+
+void bench_pair_kill(Bench_Pair *pair)
+{
+    tox_kill(pair->tox2);
+    tox_kill(pair->tox1);
+    tox_kill(pair->node);
+}
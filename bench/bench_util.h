@@ -0,0 +1,106 @@
+/**
+ * Shared code of the network benchmarks.
+ *
+ * Every benchmark runs tox instances in one process talking to each other over
+ * loopback and writes its results as a JSON object, to the file named by its
+ * first argument or to stdout:
+ *
+ *     {"benchmark": "lossless", "version": "0.2.10", "results": [
+ *       {"name": "udp_throughput", "value": 12.5, "unit": "MiB/s"}
+ *     ]}
+ *
+ * The amount of work a benchmark does is fixed, so runs of different builds can
+ * be compared result by result.
+ */
+#ifndef C_TOXCORE_BENCH_BENCH_UTIL_H
+#define C_TOXCORE_BENCH_BENCH_UTIL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../toxcore/tox.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_TCP_RELAY_PORT 33448
+
+/* Give up on a benchmark step after this many milliseconds. */
+#define BENCH_TIMEOUT 120000
+
+typedef struct Bench_Report {
+    FILE *out;
+    uint32_t num_results;
+} Bench_Report;
+
+/**
+ * Start the report of the benchmark called name. argv[1], if given, is the
+ * file to write it to.
+ *
+ * @return false if the file can't be opened.
+ */
+bool bench_report_open(Bench_Report *report, const char *name, int argc, char **argv);
+
+/**
+ * Add a result to the report.
+ */
+void bench_report_add(Bench_Report *report, const char *name, double value, const char *unit);
+
+/**
+ * Finish the report and close its file.
+ */
+void bench_report_close(Bench_Report *report);
+
+/**
+ * Print an error and exit the benchmark.
+ */
+void bench_fail(const char *message);
+
+/* Milliseconds of wall clock time. */
+uint64_t bench_time(void);
+
+void bench_sleep(uint32_t ms);
+
+/**
+ * Create a tox without local discovery, printing only errors.
+ * With udp_enabled false, it connects through the TCP relay on
+ * BENCH_TCP_RELAY_PORT.
+ */
+Tox *bench_tox_new(bool udp_enabled, uint16_t tcp_port);
+
+/**
+ * Bootstrap tox off node, and add node as TCP relay if tox has UDP disabled.
+ */
+void bench_bootstrap(Tox *tox, Tox *node);
+
+/**
+ * Two friends, and the node they bootstrap from which is also their TCP relay.
+ */
+typedef struct Bench_Pair {
+    Tox *node;
+    Tox *tox1;
+    Tox *tox2;
+} Bench_Pair;
+
+/**
+ * Create the toxes of the pair, make them friends, and wait until they are
+ * connected to each other with UDP, or through the relay if tcp is true.
+ *
+ * @return the milliseconds it took from creation to connection.
+ */
+uint64_t bench_pair_connect(Bench_Pair *pair, bool tcp);
+
+/**
+ * Iterate all toxes of the pair. user_data1 and user_data2 go to tox1 and tox2.
+ */
+void bench_pair_iterate(Bench_Pair *pair, void *user_data1, void *user_data2);
+
+void bench_pair_kill(Bench_Pair *pair);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_BENCH_BENCH_UTIL_H
@@ -0,0 +1,83 @@
+/* Time until all of N toxes bootstrapping off the same node are connected to
+ * the DHT.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+static const uint32_t node_counts[] = {8, 32};
+
+static bool all_connected(Tox **toxes, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        if (tox_self_get_connection_status(toxes[i]) == TOX_CONNECTION_NONE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static double bootstrap_time(uint32_t count)
+{
+    Tox **toxes = (Tox **)calloc(count, sizeof(Tox *));
+
+    if (toxes == nullptr) {
+        bench_fail("could not allocate the toxes");
+    }
+
+    const uint64_t start = bench_time();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        toxes[i] = bench_tox_new(true, 0);
+    }
+
+    for (uint32_t i = 1; i < count; ++i) {
+        bench_bootstrap(toxes[i], toxes[0]);
+    }
+
+    while (!all_connected(toxes, count)) {
+        for (uint32_t i = 0; i < count; ++i) {
+            tox_iterate(toxes[i], nullptr);
+        }
+
+        if (bench_time() - start > BENCH_TIMEOUT) {
+            bench_fail("toxes did not connect to the DHT");
+        }
+
+        bench_sleep(tox_iteration_interval(toxes[0]));
+    }
+
+    const uint64_t duration = bench_time() - start;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        tox_kill(toxes[i]);
+    }
+
+    free(toxes);
+    return (double)duration;
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "dht_bootstrap", argc, argv)) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(node_counts) / sizeof(node_counts[0]); ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "bootstrap_time_%u_nodes", node_counts[i]);
+        bench_report_add(&report, name, bootstrap_time(node_counts[i]), "ms");
+    }
+
+    bench_report_close(&report);
+    return 0;
+}
@@ -0,0 +1,247 @@
+/* DHT of N nodes on the simulated network, N being the second argument (1000
+ * by default): time until the nodes are connected, time for nodes to find the
+ * address of random other nodes, and the traffic that costs. All times are on
+ * the virtual clock, which runs as fast as the nodes can be iterated. One in
+ * four nodes is behind a port restricted NAT.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "../toxcore/DHT.h"
+#include "../toxcore/ccompat.h"
+#include "../toxcore/net_sim.h"
+#include "bench_util.h"
+
+#define DEFAULT_NODES 1000
+#define STEP 50
+#define LOOKUPS 50
+
+/* Nodes not connected yet bootstrap again this often, as tox instances do. */
+#define BOOTSTRAP_INTERVAL 5000
+
+/* Virtual milliseconds allowed for connecting, and for the lookups. Targets
+ * behind a NAT may never be found.
+ */
+#define CONNECT_TIMEOUT 300000
+#define LOOKUP_TIMEOUT 60000
+
+typedef struct Sim_Node {
+    Net_Sim_Node *node;
+    Networking_Core *net;
+    DHT *dht;
+    uint32_t bootstrap;
+} Sim_Node;
+
+typedef struct Lookup {
+    uint32_t from;
+    uint32_t to;
+    uint64_t duration;
+} Lookup;
+
+static uint32_t random_state = 1;
+
+/* The bench picks nodes with its own generator, so that runs are alike. */
+static uint32_t sim_random(uint32_t bound)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 8) % bound;
+}
+
+static void step(Net_Sim *sim, Sim_Node *nodes, uint32_t count)
+{
+    net_sim_advance(sim, STEP);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        networking_poll(nodes[i].net, nullptr);
+        do_dht(nodes[i].dht);
+    }
+}
+
+static void bootstrap(Sim_Node *nodes, uint32_t i)
+{
+    const Sim_Node *node = &nodes[nodes[i].bootstrap];
+    dht_bootstrap(nodes[i].dht, net_sim_node_ip_port(node->node), dht_get_self_public_key(node->dht));
+}
+
+static void bootstrap_disconnected(Sim_Node *nodes, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; ++i) {
+        if (!dht_isconnected(nodes[i].dht)) {
+            bootstrap(nodes, i);
+        }
+    }
+}
+
+static uint32_t count_connected(const Sim_Node *nodes, uint32_t count)
+{
+    uint32_t connected = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        connected += dht_isconnected(nodes[i].dht);
+    }
+
+    return connected;
+}
+
+static uint64_t bytes_sent(const Sim_Node *nodes, uint32_t count)
+{
+    uint64_t bytes = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        bytes += net_sim_node_stats(nodes[i].node)->bytes_sent;
+    }
+
+    return bytes;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "dht_sim", argc, argv)) {
+        return 1;
+    }
+
+    const uint32_t count = argc > 2 ? (uint32_t)atoi(argv[2]) : DEFAULT_NODES;
+
+    if (count < 2) {
+        bench_fail("need at least 2 nodes");
+    }
+
+    Logger *log = logger_new();
+    Net_Sim *sim = net_sim_new(1);
+    Sim_Node *nodes = (Sim_Node *)calloc(count, sizeof(Sim_Node));
+
+    if (log == nullptr || sim == nullptr || nodes == nullptr) {
+        bench_fail("could not allocate the simulation");
+    }
+
+    const Net_Sim_Link link = {40, 20, 1};
+    net_sim_set_link(sim, &link);
+
+    const uint64_t wall_start = bench_time();
+    const uint64_t start = net_sim_time(sim);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        nodes[i].node = net_sim_node_new(sim, i % 4 == 3 ? NET_SIM_NAT_PORT_RESTRICTED_CONE : NET_SIM_NAT_NONE);
+        nodes[i].net = nodes[i].node == nullptr ? nullptr : new_networking_sim(log, nodes[i].node);
+        nodes[i].dht = nodes[i].net == nullptr ? nullptr : new_dht(log, net_sim_mono_time(sim), nodes[i].net, true);
+
+        if (nodes[i].dht == nullptr) {
+            bench_fail("could not create a DHT node");
+        }
+
+        if (i > 0) {
+            /* Bootstrap off a random earlier node with a public address. */
+            do {
+                nodes[i].bootstrap = sim_random(i);
+            } while (nodes[i].bootstrap % 4 == 3);
+
+            bootstrap(nodes, i);
+        }
+    }
+
+    uint64_t last_bootstrap = start;
+
+    while (count_connected(nodes, count) < count) {
+        if (net_sim_time(sim) - start > CONNECT_TIMEOUT) {
+            bench_fail("nodes did not connect to the DHT");
+        }
+
+        if (net_sim_time(sim) - last_bootstrap >= BOOTSTRAP_INTERVAL) {
+            bootstrap_disconnected(nodes, count);
+            last_bootstrap = net_sim_time(sim);
+        }
+
+        step(sim, nodes, count);
+    }
+
+    bench_report_add(&report, "nodes", count, "nodes");
+    bench_report_add(&report, "connect_time", (double)(net_sim_time(sim) - start), "ms");
+
+    Lookup lookups[LOOKUPS];
+    uint32_t num_found = 0;
+
+    for (uint32_t i = 0; i < LOOKUPS; ++i) {
+        lookups[i].from = sim_random(count);
+
+        do {
+            lookups[i].to = sim_random(count);
+        } while (lookups[i].to == lookups[i].from);
+
+        lookups[i].duration = 0;
+
+        if (dht_addfriend(nodes[lookups[i].from].dht, dht_get_self_public_key(nodes[lookups[i].to].dht), nullptr, nullptr,
+                          0, nullptr) != 0) {
+            bench_fail("could not add a DHT friend");
+        }
+    }
+
+    const uint64_t lookup_start = net_sim_time(sim);
+    const uint64_t lookup_bytes = bytes_sent(nodes, count);
+
+    while (num_found < LOOKUPS && net_sim_time(sim) - lookup_start <= LOOKUP_TIMEOUT) {
+        step(sim, nodes, count);
+
+        for (uint32_t i = 0; i < LOOKUPS; ++i) {
+            IP_Port ip_port;
+
+            if (lookups[i].duration == 0
+                    && dht_getfriendip(nodes[lookups[i].from].dht, dht_get_self_public_key(nodes[lookups[i].to].dht),
+                                       &ip_port) == 1) {
+                lookups[i].duration = net_sim_time(sim) - lookup_start;
+                ++num_found;
+            }
+        }
+    }
+
+    const double lookup_seconds = (double)(net_sim_time(sim) - lookup_start) / 1000.0;
+    uint64_t durations[LOOKUPS];
+    uint32_t num_durations = 0;
+
+    for (uint32_t i = 0; i < LOOKUPS; ++i) {
+        if (lookups[i].duration != 0) {
+            durations[num_durations] = lookups[i].duration;
+            ++num_durations;
+        }
+    }
+
+    qsort(durations, num_durations, sizeof(uint64_t), &cmp_u64);
+
+    bench_report_add(&report, "lookups_found", 100.0 * num_found / LOOKUPS, "%");
+
+    if (num_durations != 0) {
+        bench_report_add(&report, "lookup_time_median", (double)durations[num_durations / 2], "ms");
+        bench_report_add(&report, "lookup_time_p95", (double)durations[num_durations * 95 / 100], "ms");
+    }
+
+    bench_report_add(&report, "traffic_per_node", (double)(bytes_sent(nodes, count) - lookup_bytes) / count / lookup_seconds,
+                     "B/s");
+
+    const uint64_t wall_time = bench_time() - wall_start;
+    bench_report_add(&report, "virtual_time_per_wall_time",
+                     (double)(net_sim_time(sim) - start) / (double)(wall_time == 0 ? 1 : wall_time), "x");
+
+    for (uint32_t i = 0; i < count; ++i) {
+        kill_dht(nodes[i].dht);
+        kill_networking(nodes[i].net);
+    }
+
+    free(nodes);
+    net_sim_kill(sim);
+    logger_kill(log);
+
+    bench_report_close(&report);
+    return 0;
+}
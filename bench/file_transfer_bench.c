@@ -0,0 +1,104 @@
+/* File transfer speed between two friends connected over UDP.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+#define FILE_TRANSFER_SIZE (16 * 1024 * 1024)
+
+typedef struct Transfer {
+    uint64_t sent;
+    uint64_t received;
+    bool done;
+} Transfer;
+
+static void handle_file_chunk_request(Tox *tox, uint32_t friend_number, uint32_t file_number, uint64_t position,
+                                      size_t length, void *user_data)
+{
+    Transfer *transfer = (Transfer *)user_data;
+    uint8_t data[TOX_MAX_CUSTOM_PACKET_SIZE];
+
+    if (length == 0 || length > sizeof(data)) {
+        return;
+    }
+
+    memset(data, (uint8_t)position, length);
+
+    if (tox_file_send_chunk(tox, friend_number, file_number, position, data, length, nullptr)) {
+        transfer->sent += length;
+    }
+}
+
+static void handle_file_recv(Tox *tox, uint32_t friend_number, uint32_t file_number, uint32_t kind, uint64_t file_size,
+                             const uint8_t *filename, size_t filename_length, void *user_data)
+{
+    if (!tox_file_control(tox, friend_number, file_number, TOX_FILE_CONTROL_RESUME, nullptr)) {
+        bench_fail("could not accept the file");
+    }
+}
+
+static void handle_file_recv_chunk(Tox *tox, uint32_t friend_number, uint32_t file_number, uint64_t position,
+                                   const uint8_t *data, size_t length, void *user_data)
+{
+    Transfer *transfer = (Transfer *)user_data;
+
+    if (length == 0) {
+        transfer->done = true;
+        return;
+    }
+
+    transfer->received += length;
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "file_transfer", argc, argv)) {
+        return 1;
+    }
+
+    Bench_Pair pair;
+    bench_pair_connect(&pair, false);
+    tox_callback_file_chunk_request(pair.tox1, &handle_file_chunk_request);
+    tox_callback_file_recv(pair.tox2, &handle_file_recv);
+    tox_callback_file_recv_chunk(pair.tox2, &handle_file_recv_chunk);
+
+    const uint8_t filename[] = "bench.bin";
+
+    if (tox_file_send(pair.tox1, 0, TOX_FILE_KIND_DATA, FILE_TRANSFER_SIZE, nullptr, filename, sizeof(filename) - 1,
+                      nullptr) == UINT32_MAX) {
+        bench_fail("could not send the file");
+    }
+
+    Transfer transfer = {0};
+    const uint64_t start = bench_time();
+
+    while (!transfer.done) {
+        bench_pair_iterate(&pair, &transfer, &transfer);
+
+        if (bench_time() - start > BENCH_TIMEOUT) {
+            bench_fail("file transfer did not finish");
+        }
+
+        bench_sleep(1);
+    }
+
+    const uint64_t duration = bench_time() - start;
+    bench_pair_kill(&pair);
+
+    if (transfer.received != FILE_TRANSFER_SIZE) {
+        bench_fail("received file has the wrong size");
+    }
+
+    bench_report_add(&report, "udp_throughput",
+                     (double)FILE_TRANSFER_SIZE / (1024.0 * 1024.0) / ((double)(duration + 1) / 1000.0), "MiB/s");
+    bench_report_close(&report);
+    return 0;
+}
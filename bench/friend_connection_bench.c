@@ -0,0 +1,50 @@
+/* Time from starting two toxes that have each other as friends until their
+ * friend connection is up, over UDP and through a TCP relay. Each is measured
+ * a few times and the median is reported.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+#define FRIEND_CONNECTION_RUNS 5
+
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median_connection_time(bool tcp)
+{
+    uint64_t times[FRIEND_CONNECTION_RUNS];
+
+    for (uint32_t i = 0; i < FRIEND_CONNECTION_RUNS; ++i) {
+        Bench_Pair pair;
+        times[i] = bench_pair_connect(&pair, tcp);
+        bench_pair_kill(&pair);
+    }
+
+    qsort(times, FRIEND_CONNECTION_RUNS, sizeof(uint64_t), &cmp_u64);
+    return (double)times[FRIEND_CONNECTION_RUNS / 2];
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "friend_connection", argc, argv)) {
+        return 1;
+    }
+
+    bench_report_add(&report, "udp_connect_time", median_connection_time(false), "ms");
+    bench_report_add(&report, "tcp_relay_connect_time", median_connection_time(true), "ms");
+    bench_report_close(&report);
+    return 0;
+}
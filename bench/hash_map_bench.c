@@ -0,0 +1,184 @@
+/* Hash_Map against the BS_List it replaces, with random 32 byte public keys as
+ * keys: nanoseconds per lookup of a key in the container, and per churn
+ * operation, which removes a key and adds a new one, at 10k, 100k and 1M
+ * entries.
+ *
+ * The list is filled in sorted order, because adding the keys in random order
+ * takes quadratic time at these sizes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../toxcore/ccompat.h"
+#include "../toxcore/crypto_core.h"
+#include "../toxcore/hash_map.h"
+#include "../toxcore/list.h"
+#include "../toxcore/mono_time.h"
+#include "bench_util.h"
+
+#define KEY_SIZE CRYPTO_PUBLIC_KEY_SIZE
+#define LOOKUPS 1000000
+#define CHURN 1000
+
+static uint32_t random_state = 1;
+
+/* The bench makes keys with its own generator, so that runs are alike. */
+static uint32_t bench_random(void)
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+    return memcmp(a, b, KEY_SIZE);
+}
+
+static uint8_t *key_at(uint8_t *keys, uint32_t i)
+{
+    return keys + (size_t)i * KEY_SIZE;
+}
+
+static void add_result(Bench_Report *report, const char *container, const char *op, uint32_t count,
+                       uint64_t us, uint32_t ops)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%s_%u", container, op, count);
+    bench_report_add(report, name, 1000.0 * (double)us / ops, "ns");
+}
+
+/* Keys [0, count) are in the containers, keys [count, count + CHURN) are the
+ * ones churn adds.
+ */
+static void bench_hash_map(Bench_Report *report, uint8_t *keys, uint32_t count, const uint32_t *lookups)
+{
+    Hash_Map map;
+
+    if (!hash_map_init(&map, KEY_SIZE, 0)) {
+        bench_fail("could not allocate the hash map");
+    }
+
+    uint64_t start = current_time_actual();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!hash_map_add(&map, key_at(keys, i), i)) {
+            bench_fail("could not add a key to the hash map");
+        }
+    }
+
+    add_result(report, "hash_map", "add", count, current_time_actual() - start, count);
+
+    start = current_time_actual();
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < LOOKUPS; ++i) {
+        sum += hash_map_find(&map, key_at(keys, lookups[i]));
+    }
+
+    add_result(report, "hash_map", "find", count, current_time_actual() - start, LOOKUPS);
+
+    start = current_time_actual();
+
+    for (uint32_t i = 0; i < CHURN; ++i) {
+        if (!hash_map_remove(&map, key_at(keys, i), i) || !hash_map_add(&map, key_at(keys, count + i), count + i)) {
+            bench_fail("hash map churn failed");
+        }
+    }
+
+    add_result(report, "hash_map", "churn", count, current_time_actual() - start, CHURN);
+
+    if (sum == 0) {
+        bench_fail("hash map lookups failed");
+    }
+
+    hash_map_free(&map);
+}
+
+static void bench_list(Bench_Report *report, uint8_t *keys, uint32_t count, const uint32_t *lookups)
+{
+    BS_List list;
+    uint8_t *sorted = (uint8_t *)malloc((size_t)count * KEY_SIZE);
+
+    if (sorted == nullptr || !bs_list_init(&list, KEY_SIZE, count)) {
+        bench_fail("could not allocate the list");
+    }
+
+    memcpy(sorted, keys, (size_t)count * KEY_SIZE);
+    qsort(sorted, count, KEY_SIZE, &cmp_key);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        bs_list_add(&list, key_at(sorted, i), 0);
+    }
+
+    free(sorted);
+
+    uint64_t start = current_time_actual();
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < LOOKUPS; ++i) {
+        sum += bs_list_find(&list, key_at(keys, lookups[i])) + 1;
+    }
+
+    add_result(report, "bs_list", "find", count, current_time_actual() - start, LOOKUPS);
+
+    start = current_time_actual();
+
+    for (uint32_t i = 0; i < CHURN; ++i) {
+        if (!bs_list_remove(&list, key_at(keys, i), 0) || !bs_list_add(&list, key_at(keys, count + i), 0)) {
+            bench_fail("list churn failed");
+        }
+    }
+
+    add_result(report, "bs_list", "churn", count, current_time_actual() - start, CHURN);
+
+    if (sum != LOOKUPS) {
+        bench_fail("list lookups failed");
+    }
+
+    bs_list_free(&list);
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "hash_map", argc, argv)) {
+        return 1;
+    }
+
+    static const uint32_t counts[] = {10000, 100000, 1000000};
+
+    for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        const uint32_t count = counts[c];
+        uint8_t *keys = (uint8_t *)malloc((size_t)(count + CHURN) * KEY_SIZE);
+        uint32_t *lookups = (uint32_t *)malloc(LOOKUPS * sizeof(uint32_t));
+
+        if (keys == nullptr || lookups == nullptr) {
+            bench_fail("could not allocate the keys");
+        }
+
+        for (size_t i = 0; i < (size_t)(count + CHURN) * KEY_SIZE; ++i) {
+            /* The low bits of the generator repeat too soon to make distinct keys. */
+            keys[i] = (uint8_t)(bench_random() >> 16);
+        }
+
+        for (uint32_t i = 0; i < LOOKUPS; ++i) {
+            lookups[i] = bench_random() % count;
+        }
+
+        bench_hash_map(&report, keys, count, lookups);
+        bench_list(&report, keys, count, lookups);
+
+        free(lookups);
+        free(keys);
+    }
+
+    bench_report_close(&report);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* Lossless custom packet throughput between two friends, over UDP and through
+ * a TCP relay.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+/* First byte of a lossless custom packet. */
+#define LOSSLESS_PACKET_ID 160
+#define LOSSLESS_PACKET_COUNT 4000
+
+static void handle_lossless_packet(Tox *tox, uint32_t friend_number, const uint8_t *data, size_t length,
+                                   void *user_data)
+{
+    if (length == TOX_MAX_CUSTOM_PACKET_SIZE && data[0] == LOSSLESS_PACKET_ID) {
+        uint32_t *received = (uint32_t *)user_data;
+        ++*received;
+    }
+}
+
+static double lossless_throughput(bool tcp)
+{
+    Bench_Pair pair;
+    bench_pair_connect(&pair, tcp);
+    tox_callback_friend_lossless_packet(pair.tox2, &handle_lossless_packet);
+
+    uint8_t packet[TOX_MAX_CUSTOM_PACKET_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = LOSSLESS_PACKET_ID;
+
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    const uint64_t start = bench_time();
+
+    while (received < LOSSLESS_PACKET_COUNT) {
+        while (sent < LOSSLESS_PACKET_COUNT
+                && tox_friend_send_lossless_packet(pair.tox1, 0, packet, sizeof(packet), nullptr)) {
+            ++sent;
+        }
+
+        bench_pair_iterate(&pair, nullptr, &received);
+
+        if (bench_time() - start > BENCH_TIMEOUT) {
+            bench_fail("lossless packets did not arrive");
+        }
+
+        bench_sleep(1);
+    }
+
+    const uint64_t duration = bench_time() - start;
+    bench_pair_kill(&pair);
+
+    return (double)LOSSLESS_PACKET_COUNT * TOX_MAX_CUSTOM_PACKET_SIZE / (1024.0 * 1024.0)
+           / ((double)(duration + 1) / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "lossless", argc, argv)) {
+        return 1;
+    }
+
+    bench_report_add(&report, "udp_throughput", lossless_throughput(false), "MiB/s");
+    bench_report_add(&report, "tcp_relay_throughput", lossless_throughput(true), "MiB/s");
+    bench_report_close(&report);
+    return 0;
+}
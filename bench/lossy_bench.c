@@ -0,0 +1,87 @@
+/* Lossy custom packet rate between two friends: the sender offers packets as
+ * fast as it can for a fixed time, and the rate at which they arrive and the
+ * share of them that arrive are measured.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+/* First byte of a lossy custom packet. */
+#define LOSSY_PACKET_ID 200
+#define LOSSY_PACKET_SIZE 1000
+/* Packets offered per iteration. */
+#define LOSSY_BURST 32
+#define LOSSY_DURATION 3000
+/* Time left for packets in flight to arrive after sending stops. */
+#define LOSSY_DRAIN 500
+
+static void handle_lossy_packet(Tox *tox, uint32_t friend_number, const uint8_t *data, size_t length,
+                                void *user_data)
+{
+    if (length == LOSSY_PACKET_SIZE && data[0] == LOSSY_PACKET_ID) {
+        uint32_t *received = (uint32_t *)user_data;
+        ++*received;
+    }
+}
+
+static void lossy_rate(Bench_Report *report, bool tcp)
+{
+    Bench_Pair pair;
+    bench_pair_connect(&pair, tcp);
+    tox_callback_friend_lossy_packet(pair.tox2, &handle_lossy_packet);
+
+    uint8_t packet[LOSSY_PACKET_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = LOSSY_PACKET_ID;
+
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    const uint64_t start = bench_time();
+
+    while (bench_time() - start < LOSSY_DURATION) {
+        for (uint32_t i = 0; i < LOSSY_BURST; ++i) {
+            if (tox_friend_send_lossy_packet(pair.tox1, 0, packet, sizeof(packet), nullptr)) {
+                ++sent;
+            }
+        }
+
+        bench_pair_iterate(&pair, nullptr, &received);
+        bench_sleep(1);
+    }
+
+    const uint64_t drain_start = bench_time();
+
+    while (bench_time() - drain_start < LOSSY_DRAIN) {
+        bench_pair_iterate(&pair, nullptr, &received);
+        bench_sleep(1);
+    }
+
+    bench_pair_kill(&pair);
+
+    const char *transport = tcp ? "tcp_relay" : "udp";
+    char name[64];
+    snprintf(name, sizeof(name), "%s_received_rate", transport);
+    bench_report_add(report, name, (double)received / (LOSSY_DURATION / 1000.0), "packets/s");
+    snprintf(name, sizeof(name), "%s_delivered", transport);
+    bench_report_add(report, name, sent == 0 ? 0.0 : 100.0 * received / sent, "%");
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "lossy", argc, argv)) {
+        return 1;
+    }
+
+    lossy_rate(&report, false);
+    lossy_rate(&report, true);
+    bench_report_close(&report);
+    return 0;
+}
@@ -0,0 +1,257 @@
+/* Audio and video frame latency of a call between two friends connected over
+ * UDP: frames are sent at their real time rate, and the nth frame received is
+ * matched with the nth frame sent. Loopback doesn't lose packets, so the two
+ * stay in step.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../toxav/toxav.h"
+#include "../toxcore/ccompat.h"
+#include "bench_util.h"
+
+#define AUDIO_BIT_RATE 48
+#define VIDEO_BIT_RATE 4000
+
+#define AUDIO_SAMPLING_RATE 48000
+#define AUDIO_FRAME_DURATION 20
+#define AUDIO_FRAME_SAMPLES (AUDIO_SAMPLING_RATE * AUDIO_FRAME_DURATION / 1000)
+#define AUDIO_FRAMES 250
+
+#define VIDEO_WIDTH 640
+#define VIDEO_HEIGHT 480
+#define VIDEO_FRAME_DURATION 40
+#define VIDEO_FRAMES 125
+
+/* Time left for frames in flight to arrive after sending stops. */
+#define LATENCY_DRAIN 1000
+
+typedef struct Frame_Times {
+    uint64_t sent[AUDIO_FRAMES > VIDEO_FRAMES ? AUDIO_FRAMES : VIDEO_FRAMES];
+    uint64_t received[AUDIO_FRAMES > VIDEO_FRAMES ? AUDIO_FRAMES : VIDEO_FRAMES];
+    uint32_t num_sent;
+    uint32_t num_received;
+} Frame_Times;
+
+typedef struct Call {
+    uint32_t state;
+    Frame_Times audio;
+    Frame_Times video;
+} Call;
+
+static void frame_received(Frame_Times *times)
+{
+    if (times->num_received < times->num_sent) {
+        times->received[times->num_received] = bench_time();
+        ++times->num_received;
+    }
+}
+
+static void handle_call(ToxAV *av, uint32_t friend_number, bool audio_enabled, bool video_enabled, void *user_data)
+{
+    if (!toxav_answer(av, friend_number, AUDIO_BIT_RATE, VIDEO_BIT_RATE, nullptr)) {
+        bench_fail("could not answer the call");
+    }
+}
+
+static void handle_call_state(ToxAV *av, uint32_t friend_number, uint32_t state, void *user_data)
+{
+    Call *call = (Call *)user_data;
+    call->state = state;
+}
+
+static void handle_audio_receive_frame(ToxAV *av, uint32_t friend_number, const int16_t *pcm, size_t sample_count,
+                                       uint8_t channels, uint32_t sampling_rate, void *user_data)
+{
+    Call *call = (Call *)user_data;
+    frame_received(&call->audio);
+}
+
+static void handle_video_receive_frame(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
+                                       const uint8_t *y, const uint8_t *u, const uint8_t *v, int32_t ystride, int32_t ustride, int32_t vstride,
+                                       void *user_data)
+{
+    Call *call = (Call *)user_data;
+    frame_received(&call->video);
+}
+
+typedef struct AV_Pair {
+    Bench_Pair pair;
+    ToxAV *av1;
+    ToxAV *av2;
+    Call call;
+} AV_Pair;
+
+static void av_pair_iterate(AV_Pair *av_pair)
+{
+    bench_pair_iterate(&av_pair->pair, nullptr, nullptr);
+    toxav_iterate(av_pair->av1);
+    toxav_iterate(av_pair->av2);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report_latency(Bench_Report *report, const char *kind, const Frame_Times *times)
+{
+    if (times->num_received == 0) {
+        bench_fail("no frames arrived");
+    }
+
+    uint64_t latencies[sizeof(times->sent) / sizeof(times->sent[0])];
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < times->num_received; ++i) {
+        latencies[i] = times->received[i] - times->sent[i];
+        sum += latencies[i];
+    }
+
+    qsort(latencies, times->num_received, sizeof(uint64_t), &cmp_u64);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s_latency_mean", kind);
+    bench_report_add(report, name, (double)sum / times->num_received, "ms");
+    snprintf(name, sizeof(name), "%s_latency_p95", kind);
+    bench_report_add(report, name, (double)latencies[times->num_received * 95 / 100], "ms");
+    snprintf(name, sizeof(name), "%s_delivered", kind);
+    bench_report_add(report, name, 100.0 * times->num_received / times->num_sent, "%");
+}
+
+static void send_audio(AV_Pair *av_pair)
+{
+    int16_t pcm[AUDIO_FRAME_SAMPLES];
+
+    for (uint32_t i = 0; i < AUDIO_FRAME_SAMPLES; ++i) {
+        pcm[i] = (int16_t)((i * 64) % 8192 - 4096);
+    }
+
+    Frame_Times *times = &av_pair->call.audio;
+    const uint64_t start = bench_time();
+
+    while (times->num_sent < AUDIO_FRAMES) {
+        if (bench_time() - start >= (uint64_t)times->num_sent * AUDIO_FRAME_DURATION) {
+            times->sent[times->num_sent] = bench_time();
+
+            if (toxav_audio_send_frame(av_pair->av1, 0, pcm, AUDIO_FRAME_SAMPLES, 1, AUDIO_SAMPLING_RATE, nullptr)) {
+                ++times->num_sent;
+            }
+        }
+
+        av_pair_iterate(av_pair);
+        bench_sleep(1);
+    }
+}
+
+static void send_video(AV_Pair *av_pair)
+{
+    uint8_t *y = (uint8_t *)malloc(VIDEO_WIDTH * VIDEO_HEIGHT);
+    uint8_t *u = (uint8_t *)malloc(VIDEO_WIDTH * VIDEO_HEIGHT / 4);
+    uint8_t *v = (uint8_t *)malloc(VIDEO_WIDTH * VIDEO_HEIGHT / 4);
+
+    if (y == nullptr || u == nullptr || v == nullptr) {
+        bench_fail("could not allocate a video frame");
+    }
+
+    memset(u, 128, VIDEO_WIDTH * VIDEO_HEIGHT / 4);
+    memset(v, 128, VIDEO_WIDTH * VIDEO_HEIGHT / 4);
+
+    Frame_Times *times = &av_pair->call.video;
+    const uint64_t start = bench_time();
+
+    while (times->num_sent < VIDEO_FRAMES) {
+        if (bench_time() - start >= (uint64_t)times->num_sent * VIDEO_FRAME_DURATION) {
+            /* A moving gradient, so that every frame has something to encode. */
+            for (uint32_t i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; ++i) {
+                y[i] = (uint8_t)(i % VIDEO_WIDTH + times->num_sent * 4);
+            }
+
+            times->sent[times->num_sent] = bench_time();
+
+            if (toxav_video_send_frame(av_pair->av1, 0, VIDEO_WIDTH, VIDEO_HEIGHT, y, u, v, nullptr)) {
+                ++times->num_sent;
+            }
+        }
+
+        av_pair_iterate(av_pair);
+        bench_sleep(1);
+    }
+
+    free(v);
+    free(u);
+    free(y);
+}
+
+static void drain(AV_Pair *av_pair)
+{
+    const uint64_t start = bench_time();
+
+    while (bench_time() - start < LATENCY_DRAIN) {
+        av_pair_iterate(av_pair);
+        bench_sleep(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Report report;
+
+    if (!bench_report_open(&report, "toxav_latency", argc, argv)) {
+        return 1;
+    }
+
+    AV_Pair av_pair;
+    memset(&av_pair, 0, sizeof(av_pair));
+    bench_pair_connect(&av_pair.pair, false);
+
+    av_pair.av1 = toxav_new(av_pair.pair.tox1, nullptr);
+    av_pair.av2 = toxav_new(av_pair.pair.tox2, nullptr);
+
+    if (av_pair.av1 == nullptr || av_pair.av2 == nullptr) {
+        bench_fail("could not create the A/V sessions");
+    }
+
+    toxav_callback_call_state(av_pair.av1, &handle_call_state, &av_pair.call);
+    toxav_callback_call(av_pair.av2, &handle_call, nullptr);
+    toxav_callback_audio_receive_frame(av_pair.av2, &handle_audio_receive_frame, &av_pair.call);
+    toxav_callback_video_receive_frame(av_pair.av2, &handle_video_receive_frame, &av_pair.call);
+
+    if (!toxav_call(av_pair.av1, 0, AUDIO_BIT_RATE, VIDEO_BIT_RATE, nullptr)) {
+        bench_fail("could not start the call");
+    }
+
+    const uint64_t start = bench_time();
+
+    while (!(av_pair.call.state & (TOXAV_FRIEND_CALL_STATE_ACCEPTING_A | TOXAV_FRIEND_CALL_STATE_ACCEPTING_V))) {
+        if (av_pair.call.state & (TOXAV_FRIEND_CALL_STATE_ERROR | TOXAV_FRIEND_CALL_STATE_FINISHED)
+                || bench_time() - start > BENCH_TIMEOUT) {
+            bench_fail("the call was not answered");
+        }
+
+        av_pair_iterate(&av_pair);
+        bench_sleep(1);
+    }
+
+    send_audio(&av_pair);
+    drain(&av_pair);
+    report_latency(&report, "audio", &av_pair.call.audio);
+
+    send_video(&av_pair);
+    drain(&av_pair);
+    report_latency(&report, "video", &av_pair.call.video);
+
+    toxav_kill(av_pair.av2);
+    toxav_kill(av_pair.av1);
+    bench_pair_kill(&av_pair.pair);
+
+    bench_report_close(&report);
+    return 0;
+}
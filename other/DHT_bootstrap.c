@@ -118,9 +118,10 @@ int main(int argc, char *argv[])
     ip_init(&ip, ipv6enabled);
 
     Logger *logger = logger_new();
-    DHT *dht = new_dht(logger, new_networking(logger, ip, PORT), true);
-    Onion *onion = new_onion(dht);
-    Onion_Announce *onion_a = new_onion_announce(dht);
+    Mono_Time *mono_time = mono_time_new();
+    DHT *dht = new_dht(logger, mono_time, new_networking(logger, ip, PORT), true);
+    Onion *onion = new_onion(mono_time, dht);
+    Onion_Announce *onion_a = new_onion_announce(mono_time, dht);
 
 #ifdef DHT_NODE_EXTRA_PACKETS
     bootstrap_set_callbacks(dht_get_net(dht), DHT_VERSION_NUMBER, DHT_MOTD, sizeof(DHT_MOTD));
@@ -140,7 +141,7 @@ int main(int argc, char *argv[])
 #ifdef TCP_RELAY_ENABLED
 #define NUM_PORTS 3
     uint16_t ports[NUM_PORTS] = {443, 3389, PORT};
-    TCP_Server *tcp_s = new_TCP_server(ipv6enabled, NUM_PORTS, ports, dht_get_self_secret_key(dht), onion);
+    TCP_Server *tcp_s = new_TCP_server(mono_time, ipv6enabled, NUM_PORTS, ports, dht_get_self_secret_key(dht), onion);
 
     if (tcp_s == nullptr) {
         printf("TCP server failed to initialize.\n");
@@ -188,6 +189,8 @@ int main(int argc, char *argv[])
     lan_discovery_init(dht);
 
     while (1) {
+        mono_time_update(mono_time);
+
         if (is_waiting_for_dht_connection && dht_isconnected(dht)) {
             printf("Connected to other bootstrap node successfully.\n");
             is_waiting_for_dht_connection = 0;
@@ -195,9 +198,9 @@ int main(int argc, char *argv[])
 
         do_dht(dht);
 
-        if (is_timeout(last_LANdiscovery, is_waiting_for_dht_connection ? 5 : LAN_DISCOVERY_INTERVAL)) {
+        if (mono_time_is_timeout(mono_time, last_LANdiscovery, is_waiting_for_dht_connection ? 5 : LAN_DISCOVERY_INTERVAL)) {
             lan_discovery_send(net_htons(PORT), dht);
-            last_LANdiscovery = unix_time();
+            last_LANdiscovery = mono_time_get(mono_time);
         }
 
 #ifdef TCP_RELAY_ENABLED
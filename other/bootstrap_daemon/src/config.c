@@ -143,7 +143,8 @@ static void parse_tcp_relay_ports_config(config_t *cfg, uint16_t **tcp_relay_por
 
 int get_general_config(const char *cfg_file_path, char **pid_file_path, char **keys_file_path, int *port,
                        int *enable_ipv6, int *enable_ipv4_fallback, int *enable_lan_discovery, int *enable_tcp_relay,
-                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *enable_motd, char **motd)
+                       uint16_t **tcp_relay_ports, int *tcp_relay_port_count, int *tcp_relay_max_incoming_connections,
+                       int *tcp_relay_handshake_threads, int *enable_motd, char **motd)
 {
     config_t cfg;
 
@@ -154,6 +155,8 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
     const char *NAME_ENABLE_IPV4_FALLBACK = "enable_ipv4_fallback";
     const char *NAME_ENABLE_LAN_DISCOVERY = "enable_lan_discovery";
     const char *NAME_ENABLE_TCP_RELAY     = "enable_tcp_relay";
+    const char *NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS = "tcp_relay_max_incoming_connections";
+    const char *NAME_TCP_RELAY_HANDSHAKE_THREADS        = "tcp_relay_handshake_threads";
     const char *NAME_ENABLE_MOTD          = "enable_motd";
     const char *NAME_MOTD                 = "motd";
 
@@ -234,6 +237,34 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
         *tcp_relay_port_count = 0;
     }
 
+    // Get the number of TCP connections that can wait for their handshake at once
+    if (config_lookup_int(&cfg, NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS, tcp_relay_max_incoming_connections) == CONFIG_FALSE) {
+        log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS,
+                  DEFAULT_TCP_RELAY_MAX_INCOMING_CONNECTIONS);
+        *tcp_relay_max_incoming_connections = DEFAULT_TCP_RELAY_MAX_INCOMING_CONNECTIONS;
+    } else if (*tcp_relay_max_incoming_connections < 1 || *tcp_relay_max_incoming_connections > UINT16_MAX) {
+        log_write(LOG_LEVEL_WARNING, "Invalid '%s': %d, should be in [1, %d]\n", NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS,
+                  *tcp_relay_max_incoming_connections, UINT16_MAX);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS,
+                  DEFAULT_TCP_RELAY_MAX_INCOMING_CONNECTIONS);
+        *tcp_relay_max_incoming_connections = DEFAULT_TCP_RELAY_MAX_INCOMING_CONNECTIONS;
+    }
+
+    // Get the number of TCP handshake threads
+    if (config_lookup_int(&cfg, NAME_TCP_RELAY_HANDSHAKE_THREADS, tcp_relay_handshake_threads) == CONFIG_FALSE) {
+        log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_TCP_RELAY_HANDSHAKE_THREADS);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_TCP_RELAY_HANDSHAKE_THREADS,
+                  DEFAULT_TCP_RELAY_HANDSHAKE_THREADS);
+        *tcp_relay_handshake_threads = DEFAULT_TCP_RELAY_HANDSHAKE_THREADS;
+    } else if (*tcp_relay_handshake_threads < 0 || *tcp_relay_handshake_threads > UINT8_MAX) {
+        log_write(LOG_LEVEL_WARNING, "Invalid '%s': %d, should be in [0, %d]\n", NAME_TCP_RELAY_HANDSHAKE_THREADS,
+                  *tcp_relay_handshake_threads, UINT8_MAX);
+        log_write(LOG_LEVEL_WARNING, "Using default '%s': %d\n", NAME_TCP_RELAY_HANDSHAKE_THREADS,
+                  DEFAULT_TCP_RELAY_HANDSHAKE_THREADS);
+        *tcp_relay_handshake_threads = DEFAULT_TCP_RELAY_HANDSHAKE_THREADS;
+    }
+
     // Get MOTD option
     if (config_lookup_bool(&cfg, NAME_ENABLE_MOTD, enable_motd) == CONFIG_FALSE) {
         log_write(LOG_LEVEL_WARNING, "No '%s' setting in configuration file.\n", NAME_ENABLE_MOTD);
@@ -283,6 +314,9 @@ int get_general_config(const char *cfg_file_path, char **pid_file_path, char **k
                 log_write(LOG_LEVEL_INFO, "Port #%d: %u\n", i, (*tcp_relay_ports)[i]);
             }
         }
+
+        log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_TCP_RELAY_MAX_INCOMING_CONNECTIONS, *tcp_relay_max_incoming_connections);
+        log_write(LOG_LEVEL_INFO, "'%s': %d\n", NAME_TCP_RELAY_HANDSHAKE_THREADS, *tcp_relay_handshake_threads);
     }
 
     log_write(LOG_LEVEL_INFO, "'%s': %s\n", NAME_ENABLE_MOTD,          *enable_motd          ? "true" : "false");
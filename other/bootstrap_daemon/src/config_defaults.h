@@ -36,6 +36,8 @@
 #define DEFAULT_ENABLE_TCP_RELAY      1 // 1 - true, 0 - false
 #define DEFAULT_TCP_RELAY_PORTS       443, 3389, 33445 // comma-separated list of ports. make sure to adjust DEFAULT_TCP_RELAY_PORTS_COUNT accordingly
 #define DEFAULT_TCP_RELAY_PORTS_COUNT 3
+#define DEFAULT_TCP_RELAY_MAX_INCOMING_CONNECTIONS 1024
+#define DEFAULT_TCP_RELAY_HANDSHAKE_THREADS 2 // 0 - handshakes are done in the main loop
 #define DEFAULT_ENABLE_MOTD           1 // 1 - true, 0 - false
 #define DEFAULT_MOTD                  DAEMON_NAME
 
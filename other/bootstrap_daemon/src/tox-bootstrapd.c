@@ -202,11 +202,14 @@ int main(int argc, char *argv[])
     int enable_tcp_relay;
     uint16_t *tcp_relay_ports;
     int tcp_relay_port_count;
+    int tcp_relay_max_incoming_connections;
+    int tcp_relay_handshake_threads;
     int enable_motd;
     char *motd;
 
     if (get_general_config(cfg_file_path, &pid_file_path, &keys_file_path, &port, &enable_ipv6, &enable_ipv4_fallback,
-                           &enable_lan_discovery, &enable_tcp_relay, &tcp_relay_ports, &tcp_relay_port_count, &enable_motd, &motd)) {
+                           &enable_lan_discovery, &enable_tcp_relay, &tcp_relay_ports, &tcp_relay_port_count,
+                           &tcp_relay_max_incoming_connections, &tcp_relay_handshake_threads, &enable_motd, &motd)) {
         log_write(LOG_LEVEL_INFO, "General config read successfully\n");
     } else {
         log_write(LOG_LEVEL_ERROR, "Couldn't read config file: %s. Exiting.\n", cfg_file_path);
@@ -251,7 +254,15 @@ int main(int argc, char *argv[])
         }
     }
 
-    DHT *dht = new_dht(logger, net, true);
+    Mono_Time *const mono_time = mono_time_new();
+
+    if (mono_time == nullptr) {
+        log_write(LOG_LEVEL_ERROR, "Couldn't initialize monotonic timer. Exiting.\n");
+        logger_kill(logger);
+        return 1;
+    }
+
+    DHT *dht = new_dht(logger, mono_time, net, true);
 
     if (dht == nullptr) {
         log_write(LOG_LEVEL_ERROR, "Couldn't initialize Tox DHT instance. Exiting.\n");
@@ -259,8 +270,8 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    Onion *onion = new_onion(dht);
-    Onion_Announce *onion_a = new_onion_announce(dht);
+    Onion *onion = new_onion(mono_time, dht);
+    Onion_Announce *onion_a = new_onion_announce(mono_time, dht);
 
     if (!(onion && onion_a)) {
         log_write(LOG_LEVEL_ERROR, "Couldn't initialize Tox Onion. Exiting.\n");
@@ -299,7 +310,13 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        tcp_server = new_TCP_server(enable_ipv6, tcp_relay_port_count, tcp_relay_ports, dht_get_self_secret_key(dht), onion);
+        TCP_Server_Options tcp_server_options;
+        tcp_server_options_default(&tcp_server_options);
+        tcp_server_options.max_incoming_connections = tcp_relay_max_incoming_connections;
+        tcp_server_options.handshake_threads = tcp_relay_handshake_threads;
+
+        tcp_server = new_TCP_server_options(mono_time, enable_ipv6, tcp_relay_port_count, tcp_relay_ports,
+                                            dht_get_self_secret_key(dht), onion, &tcp_server_options);
 
         // tcp_relay_port_count != 0 at this point
         free(tcp_relay_ports);
@@ -334,11 +351,13 @@ int main(int argc, char *argv[])
     }
 
     while (1) {
+        mono_time_update(mono_time);
+
         do_dht(dht);
 
-        if (enable_lan_discovery && is_timeout(last_LANdiscovery, LAN_DISCOVERY_INTERVAL)) {
+        if (enable_lan_discovery && mono_time_is_timeout(mono_time, last_LANdiscovery, LAN_DISCOVERY_INTERVAL)) {
             lan_discovery_send(net_htons_port, dht);
-            last_LANdiscovery = unix_time();
+            last_LANdiscovery = mono_time_get(mono_time);
         }
 
         if (enable_tcp_relay) {
@@ -5,15 +5,21 @@
 #include "../toxcore/Messenger.c"
 #include "../toxcore/TCP_client.c"
 #include "../toxcore/TCP_connection.c"
+#include "../toxcore/TCP_handshake_pool.c"
+#include "../toxcore/TCP_send_queue.c"
 #include "../toxcore/TCP_server.c"
+#include "../toxcore/congestion_control.c"
 #include "../toxcore/crypto_core.c"
 #include "../toxcore/crypto_core_mem.c"
+#include "../toxcore/event_loop.c"
 #include "../toxcore/friend_connection.c"
 #include "../toxcore/friend_requests.c"
 #include "../toxcore/group.c"
+#include "../toxcore/hash_map.c"
 #include "../toxcore/list.c"
 #include "../toxcore/logger.c"
 #include "../toxcore/mono_time.c"
+#include "../toxcore/net_sim.c"
 #include "../toxcore/network.c"
 #include "../toxcore/net_crypto.c"
 #include "../toxcore/onion.c"
@@ -21,14 +27,18 @@
 #include "../toxcore/onion_client.c"
 #include "../toxcore/ping.c"
 #include "../toxcore/ping_array.c"
+#include "../toxcore/sack.c"
 #include "../toxcore/state.c"
 #include "../toxcore/tox_api.c"
 #include "../toxcore/util.c"
 
 #include "../toxav/audio.c"
+#include "../toxav/audio_frontend.c"
 #include "../toxav/bwcontroller.c"
 #include "../toxav/groupav.c"
+#include "../toxav/media_sched.c"
 #include "../toxav/msi.c"
+#include "../toxav/playout.c"
 #include "../toxav/ring_buffer.c"
 #include "../toxav/rtp.c"
 #include "../toxav/toxav.c"
@@ -190,7 +190,8 @@ int main(int argc, char *argv[])
     IP ip;
     ip_init(&ip, ipv6enabled);
 
-    DHT *dht = new_dht(nullptr, new_networking(nullptr, ip, PORT), true);
+    Mono_Time *const mono_time = mono_time_new();
+    DHT *dht = new_dht(nullptr, mono_time, new_networking(nullptr, ip, PORT), true);
     printf("OUR ID: ");
     uint32_t i;
 
@@ -238,6 +239,8 @@ int main(int argc, char *argv[])
 #endif
 
     while (1) {
+        mono_time_update(mono_time);
+
         do_dht(dht);
 
 #if 0 /* TODO(slvr): */
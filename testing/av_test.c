@@ -45,7 +45,7 @@ extern "C" {
 #include "../toxav/ring_buffer.c"
 
 #include "../toxav/toxav.h"
-#include "../toxcore/mono_time.h" /* current_time_monotonic() */
+#include "../toxcore/mono_time.h" /* mono_time_new(), current_time_monotonic() */
 #include "../toxcore/tox.h"
 #include "../toxcore/util.h"
 
@@ -656,8 +656,10 @@ CHECK_ARG:
 
         printf("Sample rate %d\n", af_info.samplerate);
 
+        Mono_Time *mono_time = mono_time_new();
+
         while (start_time + expected_time > time(nullptr)) {
-            uint64_t enc_start_time = current_time_monotonic();
+            uint64_t enc_start_time = current_time_monotonic(mono_time);
             int64_t count = sf_read_short(af_handle, PCM, frame_size);
 
             if (count > 0) {
@@ -670,9 +672,11 @@ CHECK_ARG:
             }
 
             iterate_tox(bootstrap, AliceAV, BobAV, nullptr);
-            c_sleep((audio_frame_duration - (current_time_monotonic() - enc_start_time) - 1));
+            c_sleep((audio_frame_duration - (current_time_monotonic(mono_time) - enc_start_time) - 1));
         }
 
+        mono_time_free(mono_time);
+
         printf("Played file in: %lu; stopping stream...\n", time(nullptr) - start_time);
 
         Pa_StopStream(adout);
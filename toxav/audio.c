@@ -45,13 +45,13 @@ static void jbuf_free(struct RingBuffer *q);
 static int jbuf_write(Logger *log, ACSession *ac, struct RingBuffer *q, struct RTPMessage *m);
 #endif
 OpusEncoder *create_audio_encoder(Logger *log, int32_t bit_rate, int32_t sampling_rate, int32_t channel_count);
-bool reconfigure_audio_encoder(Logger *log, OpusEncoder **e, int32_t new_br, int32_t new_sr, uint8_t new_ch,
+bool reconfigure_audio_encoder(Logger *log, OpusEncoder *e, int32_t new_br, int32_t new_sr, uint8_t new_ch,
                                int32_t *old_br, int32_t *old_sr, int32_t *old_ch);
-bool reconfigure_audio_decoder(ACSession *ac, int32_t sampling_rate, int8_t channels);
 
 
 
-ACSession *ac_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_audio_receive_frame_cb *cb, void *cb_data)
+ACSession *ac_new(const Mono_Time *mono_time, Logger *log, ToxAV *av, uint32_t friend_number,
+                  toxav_audio_receive_frame_cb *cb, void *cb_data)
 {
     ACSession *ac = (ACSession *)calloc(sizeof(ACSession), 1);
 
@@ -92,10 +92,9 @@ ACSession *ac_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_audio_re
     ac->le_bit_rate = AUDIO_START_BITRATE_RATE;
     ac->le_sample_rate = AUDIO_START_SAMPLING_RATE;
     ac->le_channel_count = AUDIO_START_CHANNEL_COUNT;
-
-    ac->ld_channel_count = AUDIO_DECODER__START_SAMPLING_RATE;
-    ac->ld_sample_rate = AUDIO_DECODER__START_CHANNEL_COUNT;
-    ac->ldrts = 0; /* Make it possible to reconfigure straight away */
+    ac->le_gain = AFE_GAIN_UNITY;
+    ac->ld_gain = AFE_GAIN_UNITY;
+    ac->ld_playout_delay_ms = UINT32_MAX;
 
     ac->lp_seqnum_new = -1;
 
@@ -110,6 +109,7 @@ ACSession *ac_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_audio_re
 
     ac->encoder_frame_has_record_timestamp = 1;
 
+    ac->mono_time = mono_time;
     ac->av = av;
     ac->friend_number = friend_number;
     ac->acb.first = cb;
@@ -155,8 +155,7 @@ void ac_kill(ACSession *ac)
 
 #ifdef USE_TS_BUFFER_FOR_VIDEO
 static inline struct RTPMessage *jbuf_read(Logger *log, struct TSBuffer *q, int32_t *success,
-        int64_t timestamp_difference_adjustment_,
-        int64_t timestamp_difference_to_sender_,
+        Playout_Clock *playout,
         uint8_t encoder_frame_has_record_timestamp,
         ACSession *ac)
 {
@@ -166,8 +165,7 @@ static inline struct RTPMessage *jbuf_read(Logger *log, struct TSBuffer *q, int3
     void *ret = NULL;
     uint64_t lost_frame = 0;
     uint32_t timestamp_out_ = 0;
-    int64_t want_remote_video_ts = (current_time_monotonic() + timestamp_difference_to_sender_ +
-                                    timestamp_difference_adjustment_);
+    uint32_t want_remote_video_ts = playout_want_ts(playout, current_time_monotonic(ac->mono_time));
     *success = 0;
     uint16_t removed_entries;
 
@@ -196,6 +194,10 @@ static inline struct RTPMessage *jbuf_read(Logger *log, struct TSBuffer *q, int3
 
         struct RTPMessage *m = (struct RTPMessage *)ret;
 
+        if (encoder_frame_has_record_timestamp == 1) {
+            playout_played(playout, PLAYOUT_AUDIO, timestamp_out_, current_time_monotonic(ac->mono_time));
+        }
+
 
         if (ac->lp_seqnum_new == -1) {
             ac->lp_seqnum_new = m->header.sequnum;
@@ -231,8 +233,7 @@ static inline bool jbuf_is_empty(struct TSBuffer *q)
 }
 #else
 static inline struct RTPMessage *jbuf_read(Logger *log, struct RingBuffer *q, int32_t *success,
-        int64_t timestamp_difference_adjustment_,
-        int64_t timestamp_difference_to_sender_,
+        Playout_Clock *playout,
         uint8_t encoder_frame_has_record_timestamp,
         ACSession *ac)
 {
@@ -265,10 +266,79 @@ static inline bool jbuf_is_empty(struct RingBuffer *q)
 }
 #endif
 
+/*
+ * Follow the changes of the playout delay: when it grows, the audio has to
+ * last longer than it was recorded, when it shrinks shorter.
+ */
+static void ac_update_stretch(ACSession *ac, Playout_Clock *playout)
+{
+#define AUDIO_MAX_STRETCH_FRAMES (AUDIO_DECODER__START_SAMPLING_RATE / 2)
+    const uint32_t delay_ms = playout_delay_ms(playout);
+
+    if (ac->ld_playout_delay_ms != UINT32_MAX) {
+        ac->ld_stretch += ((int32_t)delay_ms - (int32_t)ac->ld_playout_delay_ms)
+                          * (AUDIO_DECODER__START_SAMPLING_RATE / 1000);
+
+        /* Silence or noise can keep it from catching up, then the clock wins. */
+        if (ac->ld_stretch > AUDIO_MAX_STRETCH_FRAMES) {
+            ac->ld_stretch = AUDIO_MAX_STRETCH_FRAMES;
+        } else if (ac->ld_stretch < -AUDIO_MAX_STRETCH_FRAMES) {
+            ac->ld_stretch = -AUDIO_MAX_STRETCH_FRAMES;
+        }
+    }
+
+    ac->ld_playout_delay_ms = delay_ms;
+}
+
+/* Time stretch, mix and resample the frame decoded into ld_pcm, and hand it to the application. */
+static void ac_play_frame(ACSession *ac, Playout_Clock *playout, int rc)
+{
+    if (rc < 0) {
+        LOGGER_WARNING(ac->log, "Decoding error: %s", opus_strerror(rc));
+        return;
+    }
+
+    ++ac->ld_frames_played;
+
+    if (!ac->acb.first) {
+        return;
+    }
+
+    /* Enough space for the maximum frame size (120 ms 48 KHz stereo audio) */
+    int16_t temp_audio_buffer[AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL *
+                              AUDIO_MAX_CHANNEL_COUNT];
+    int16_t *pcm = ac->ld_pcm;
+    size_t frames = rc;
+
+    ac->lp_frame_duration = (rc * 1000) / AUDIO_DECODER__START_SAMPLING_RATE;
+
+    ac_update_stretch(ac, playout);
+
+    if (ac->ld_stretch != 0) {
+        frames = afe_stretch(ac->ld_pcm, rc, AUDIO_DECODER__START_SAMPLING_RATE, AUDIO_DECODER__START_CHANNEL_COUNT,
+                             ac->ld_stretch, ac->ld_stretched);
+        ac->ld_stretch -= (int32_t)frames - rc;
+        pcm = ac->ld_stretched;
+    }
+
+    /* Downmixing works in place, so mix first and resample the fewer channels. */
+    afe_mix(pcm, AUDIO_DECODER__START_CHANNEL_COUNT, pcm, ac->lp_channel_count, frames, ac->ld_gain);
+
+    size_t sample_count = frames;
+
+    if (ac->lp_sampling_rate != AUDIO_DECODER__START_SAMPLING_RATE) {
+        sample_count = afe_resampled_frames(frames, AUDIO_DECODER__START_SAMPLING_RATE, ac->lp_sampling_rate);
+        afe_resample(pcm, frames, AUDIO_DECODER__START_SAMPLING_RATE, temp_audio_buffer, sample_count,
+                     ac->lp_sampling_rate, ac->lp_channel_count, ac->ld_history);
+        pcm = temp_audio_buffer;
+    }
+
+    ac->acb.first(ac->av, ac->friend_number, pcm, sample_count, ac->lp_channel_count,
+                  ac->lp_sampling_rate, ac->acb.second);
+}
+
 uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timestamp, uint64_t *v_r_timestamp,
-                   uint64_t *v_l_timestamp,
-                   int64_t *timestamp_difference_adjustment_,
-                   int64_t *timestamp_difference_to_sender_)
+                   uint64_t *v_l_timestamp, Playout_Clock *playout)
 {
     if (!ac) {
         return 0;
@@ -285,19 +355,14 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
         return 0;
     }
 
-
-    /* Enough space for the maximum frame size (120 ms 48 KHz stereo audio) */
-    int16_t temp_audio_buffer[AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL *
-                              AUDIO_MAX_CHANNEL_COUNT];
-
     struct RTPMessage *msg = NULL;
     int rc = 0;
 
     pthread_mutex_lock(ac->queue_mutex);
 
-    while ((msg = jbuf_read(ac->log, jbuffer, &rc,
-                            *timestamp_difference_adjustment_,
-                            *timestamp_difference_to_sender_,
+    playout_set_jitter(playout, PLAYOUT_AUDIO, playout_jitter_ms(&ac->jitter));
+
+    while ((msg = jbuf_read(ac->log, jbuffer, &rc, playout,
                             ac->encoder_frame_has_record_timestamp, ac))
             || rc == AUDIO_LOST_FRAME_INDICATOR) {
         pthread_mutex_unlock(ac->queue_mutex);
@@ -305,14 +370,22 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
         if (rc == AUDIO_LOST_FRAME_INDICATOR) {
             LOGGER_DEBUG(ac->log, "OPUS correction for lost frame (3)");
 
-            if (ac->lp_sampling_rate > 0) {
-                int fs = (ac->lp_sampling_rate * ac->lp_frame_duration) / 1000;
-                rc = opus_decode(ac->decoder, NULL, 0, temp_audio_buffer, fs, 1);
+            /* The packet after the gap carries the in-band FEC of the frame before it. Without a packet, or
+             * without FEC in it, the decoder conceals the lost frame. Either way the packet itself is decoded
+             * below. */
+            int fs = (AUDIO_DECODER__START_SAMPLING_RATE * ac->lp_frame_duration) / 1000;
+
+            if (msg) {
+                rc = opus_decode(ac->decoder, msg->data + 4, msg->len - 4, ac->ld_pcm, fs, 1);
+            } else {
+                rc = opus_decode(ac->decoder, NULL, 0, ac->ld_pcm, fs, 1);
             }
 
-            free(msg);
-            msg = NULL;
-        } else {
+            ++ac->ld_frames_concealed;
+            ac_play_frame(ac, playout, rc);
+        }
+
+        if (msg) {
 
             int use_fec = 0;
             /* TODO: check if we have the full data of this frame */
@@ -330,15 +403,14 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
                  */
             }
 
+            /* The decoder stays at 48 KHz stereo, the frame is converted to what the sender announced below,
+             * instead of creating a new decoder every time that changes. */
+            if (ac->lp_sampling_rate < AUDIO_MIN_SAMPLING_RATE || ac->lp_sampling_rate > AUDIO_MAX_SAMPLING_RATE) {
+                ac->lp_sampling_rate = AUDIO_DECODER__START_SAMPLING_RATE;
+            }
 
-            /** NOTE: even though OPUS supports decoding mono frames with stereo decoder and vice versa,
-              * it didn't work quite well.
-              */
-            if (!reconfigure_audio_decoder(ac, ac->lp_sampling_rate, ac->lp_channel_count)) {
-                LOGGER_WARNING(ac->log, "Failed to reconfigure decoder!");
-                free(msg);
-                msg = NULL;
-                continue;
+            if (ac->lp_channel_count != 1) {
+                ac->lp_channel_count = AUDIO_DECODER__START_CHANNEL_COUNT;
             }
 
             /*
@@ -355,7 +427,8 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
             /* TODO: msg->data + 4, msg->len - 4
              * this should be defined, not hardcoded
              */
-            rc = opus_decode(ac->decoder, msg->data + 4, msg->len - 4, temp_audio_buffer, 5760, use_fec);
+            rc = opus_decode(ac->decoder, msg->data + 4, msg->len - 4, ac->ld_pcm,
+                             AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL, use_fec);
 
 #if 0
 
@@ -363,12 +436,12 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
                 // what is the audio to video latency?
                 const struct RTPHeader *header_v3 = (void *) & (msg->header);
 
-                // LOGGER_ERROR(ac->log, "AUDIO:TTx: %llu %lld now=%llu", header_v3->frame_record_timestamp, (long long)*a_r_timestamp, current_time_monotonic());
+                // LOGGER_ERROR(ac->log, "AUDIO:TTx: %llu %lld now=%llu", header_v3->frame_record_timestamp, (long long)*a_r_timestamp, current_time_monotonic(ac->mono_time));
                 if (header_v3->frame_record_timestamp > 0) {
                     if (*a_r_timestamp < header_v3->frame_record_timestamp) {
                         // LOGGER_ERROR(ac->log, "AUDIO:TTx:2: %llu", header_v3->frame_record_timestamp);
                         *a_r_timestamp = header_v3->frame_record_timestamp;
-                        *a_l_timestamp = current_time_monotonic();
+                        *a_l_timestamp = current_time_monotonic(ac->mono_time);
                     } else {
                         // TODO: this should not happen here!
                         LOGGER_DEBUG(ac->log, "AUDIO: remote timestamp older");
@@ -383,14 +456,8 @@ uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timesta
 
             free(msg);
             msg = NULL;
-        }
 
-        if (rc < 0) {
-            LOGGER_WARNING(ac->log, "Decoding error: %s", opus_strerror(rc));
-        } else if (ac->acb.first) {
-            ac->lp_frame_duration = (rc * 1000) / ac->lp_sampling_rate;
-            ac->acb.first(ac->av, ac->friend_number, temp_audio_buffer, rc, ac->lp_channel_count,
-                          ac->lp_sampling_rate, ac->acb.second);
+            ac_play_frame(ac, playout, rc);
         }
 
         return ret_value;
@@ -432,6 +499,8 @@ int ac_queue_message(void *acp, struct RTPMessage *msg)
         msg->header.frame_record_timestamp = msg->header.timestamp;
     }
 
+    playout_jitter_update(&ac->jitter, current_time_monotonic(ac->mono_time), msg->header.frame_record_timestamp);
+
 #ifdef USE_TS_BUFFER_FOR_VIDEO
     int rc = jbuf_write(ac->log, ac, (struct TSBuffer *)ac->j_buf, msg);
 #else
@@ -453,18 +522,18 @@ int ac_queue_message(void *acp, struct RTPMessage *msg)
         LOGGER_DEBUG(ac->log, "AADEBUG:seqnum=%d dt=%d ts:%lu curts:%ld", (int)header_v3->sequnum,
                      (int)((uint64_t)header_v3->frame_record_timestamp - (uint64_t)ac->last_incoming_frame_ts),
                      header_v3->frame_record_timestamp,
-                     current_time_monotonic());
+                     current_time_monotonic(ac->mono_time));
 
         ac->last_incoming_frame_ts = header_v3->frame_record_timestamp;
 
 #if 0
-        int64_t cur_diff_in_ms = (int64_t)(current_time_monotonic() - ac->last_incoming_frame_ts);
+        int64_t cur_diff_in_ms = (int64_t)(current_time_monotonic(ac->mono_time) - ac->last_incoming_frame_ts);
         ac->timestamp_difference_to_sender = ac->timestamp_difference_to_sender
                                              + ((cur_diff_in_ms - ac->timestamp_difference_to_sender) / 2); // go half way in that direction
         LOGGER_DEBUG(ac->log, "AADEBUG:diff_ms:%lld", (int64_t)ac->timestamp_difference_to_sender);
         LOGGER_DEBUG(ac->log, "AADEBUG:ts_corr:%llu dt=%d",
-                     (uint64_t)(current_time_monotonic() - ac->timestamp_difference_to_sender),
-                     (int)((uint64_t)(current_time_monotonic() - ac->timestamp_difference_to_sender) -
+                     (uint64_t)(current_time_monotonic(ac->mono_time) - ac->timestamp_difference_to_sender),
+                     (int)((uint64_t)(current_time_monotonic(ac->mono_time) - ac->timestamp_difference_to_sender) -
                            (uint64_t)ac->last_incoming_frame_ts));
 #endif
     }
@@ -474,7 +543,11 @@ int ac_queue_message(void *acp, struct RTPMessage *msg)
 
 int ac_reconfigure_encoder(ACSession *ac, int32_t bit_rate, int32_t sampling_rate, uint8_t channels)
 {
-    if (!ac || !reconfigure_audio_encoder(ac->log, &ac->encoder, bit_rate,
+    if (ac && (ac->le_sample_rate != sampling_rate || ac->le_channel_count != channels)) {
+        memset(ac->le_history, 0, sizeof(ac->le_history));
+    }
+
+    if (!ac || !reconfigure_audio_encoder(ac->log, ac->encoder, bit_rate,
                                           sampling_rate, channels,
                                           &ac->le_bit_rate,
                                           &ac->le_sample_rate,
@@ -485,6 +558,40 @@ int ac_reconfigure_encoder(ACSession *ac, int32_t bit_rate, int32_t sampling_rat
     return 0;
 }
 
+int ac_encode_frame(ACSession *ac, const int16_t *pcm, size_t sample_count, uint8_t channels, uint32_t sampling_rate,
+                    uint8_t *dest, size_t dest_max)
+{
+    if (channels == 0 || channels > AUDIO_MAX_CHANNEL_COUNT
+            || sampling_rate < AUDIO_MIN_SAMPLING_RATE || sampling_rate > AUDIO_MAX_SAMPLING_RATE) {
+        return OPUS_BAD_ARG;
+    }
+
+    /* Opus takes 2.5 to 120 ms frames, those must come out as whole samples at the encoder rate. */
+    const size_t frames = afe_resampled_frames(sample_count, sampling_rate, AUDIO_START_SAMPLING_RATE);
+
+    if (frames == 0 || frames > AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL
+            || ((uint64_t)sample_count * AUDIO_START_SAMPLING_RATE) % sampling_rate != 0) {
+        return OPUS_BAD_ARG;
+    }
+
+    if (sampling_rate == AUDIO_START_SAMPLING_RATE && channels == AUDIO_START_CHANNEL_COUNT
+            && ac->le_gain == AFE_GAIN_UNITY) {
+        return opus_encode(ac->encoder, pcm, frames, dest, dest_max);
+    }
+
+    const int16_t *src = pcm;
+
+    if (sampling_rate != AUDIO_START_SAMPLING_RATE) {
+        afe_resample(pcm, sample_count, sampling_rate, ac->le_resampled, frames, AUDIO_START_SAMPLING_RATE, channels,
+                     ac->le_history);
+        src = ac->le_resampled;
+    }
+
+    afe_mix(src, channels, ac->le_pcm, AUDIO_START_CHANNEL_COUNT, frames, ac->le_gain);
+
+    return opus_encode(ac->encoder, ac->le_pcm, frames, dest, dest_max);
+}
+
 #ifdef USE_TS_BUFFER_FOR_VIDEO
 static struct TSBuffer *jbuf_new(int size)
 {
@@ -729,67 +836,61 @@ FAILURE:
     return NULL;
 }
 
-bool reconfigure_audio_encoder(Logger *log, OpusEncoder **e, int32_t new_br, int32_t new_sr, uint8_t new_ch,
-                               int32_t *old_br, int32_t *old_sr, int32_t *old_ch)
+/* Opus bandwidth that covers everything below the Nyquist frequency of the input. */
+static int32_t audio_encoder_bandwidth(int32_t sampling_rate)
 {
-    /* Values are checked in toxav.c */
-    if (*old_sr != new_sr || *old_ch != new_ch) {
-        OpusEncoder *new_encoder = create_audio_encoder(log, new_br, new_sr, new_ch);
-
-        if (new_encoder == NULL) {
-            return false;
-        }
-
-        opus_encoder_destroy(*e);
-        *e = new_encoder;
-    } else if (*old_br == new_br) {
-        return true; /* Nothing changed */
+    if (sampling_rate <= 8000) {
+        return OPUS_BANDWIDTH_NARROWBAND;
     }
 
-    int status = opus_encoder_ctl(*e, OPUS_SET_BITRATE(new_br));
+    if (sampling_rate <= 12000) {
+        return OPUS_BANDWIDTH_MEDIUMBAND;
+    }
 
-    if (status != OPUS_OK) {
-        LOGGER_ERROR(log, "Error while setting encoder ctl: %s", opus_strerror(status));
-        return false;
+    if (sampling_rate <= 16000) {
+        return OPUS_BANDWIDTH_WIDEBAND;
     }
 
-    *old_br = new_br;
-    *old_sr = new_sr;
-    *old_ch = new_ch;
+    if (sampling_rate <= 24000) {
+        return OPUS_BANDWIDTH_SUPERWIDEBAND;
+    }
 
-    LOGGER_DEBUG(log, "Reconfigured audio encoder br: %d sr: %d cc:%d", new_br, new_sr, new_ch);
-    return true;
+    return OPUS_BANDWIDTH_FULLBAND;
 }
 
-bool reconfigure_audio_decoder(ACSession *ac, int32_t sampling_rate, int8_t channels)
+bool reconfigure_audio_encoder(Logger *log, OpusEncoder *e, int32_t new_br, int32_t new_sr, uint8_t new_ch,
+                               int32_t *old_br, int32_t *old_sr, int32_t *old_ch)
 {
-    if (sampling_rate <= 0) {
-        return false;
+    /* Values are checked in toxav.c
+     * The encoder keeps its rate and channel count, the input is converted in ac_encode_frame(). Opus is only
+     * told how much of the converted signal carries anything, which needs no new encoder. */
+    if (*old_sr == new_sr && *old_ch == new_ch && *old_br == new_br) {
+        return true; /* Nothing changed */
     }
 
-    if (sampling_rate != ac->ld_sample_rate || channels != ac->ld_channel_count) {
-        if (current_time_monotonic() - ac->ldrts < 500) {
-            return false;
-        }
-
-        int status;
-        OpusDecoder *new_dec = opus_decoder_create(sampling_rate, channels, &status);
+    int status = OPUS_OK;
 
-        if (status != OPUS_OK) {
-            LOGGER_ERROR(ac->log, "Error while starting audio decoder(%d %d): %s", sampling_rate, channels, opus_strerror(status));
-            return false;
-        }
+    if (*old_sr != new_sr) {
+        status = opus_encoder_ctl(e, OPUS_SET_MAX_BANDWIDTH(audio_encoder_bandwidth(new_sr)));
+    }
 
-        ac->ld_sample_rate = sampling_rate;
-        ac->ld_channel_count = channels;
-        ac->ldrts = current_time_monotonic();
+    if (status == OPUS_OK && *old_ch != new_ch) {
+        status = opus_encoder_ctl(e, OPUS_SET_FORCE_CHANNELS(new_ch == 1 ? 1 : OPUS_AUTO));
+    }
 
-        opus_decoder_destroy(ac->decoder);
-        ac->decoder = new_dec;
+    if (status == OPUS_OK && *old_br != new_br) {
+        status = opus_encoder_ctl(e, OPUS_SET_BITRATE(new_br));
+    }
 
-        LOGGER_DEBUG(ac->log, "Reconfigured audio decoder sr: %d cc: %d", sampling_rate, channels);
+    if (status != OPUS_OK) {
+        LOGGER_ERROR(log, "Error while setting encoder ctl: %s", opus_strerror(status));
+        return false;
     }
 
+    *old_br = new_br;
+    *old_sr = new_sr;
+    *old_ch = new_ch;
+
+    LOGGER_DEBUG(log, "Reconfigured audio encoder br: %d sr: %d cc:%d", new_br, new_sr, new_ch);
     return true;
 }
-
@@ -20,6 +20,8 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
+#include "audio_frontend.h"
+#include "playout.h"
 #include "toxav.h"
 #include "video.h"
 
@@ -36,6 +38,7 @@
 
 #define AUDIO_JITTERBUFFER_MIN_FILLED (0)
 
+#define AUDIO_MIN_SAMPLING_RATE (8000)
 #define AUDIO_MAX_SAMPLING_RATE (48000)
 #define AUDIO_MAX_CHANNEL_COUNT (2)
 
@@ -52,6 +55,8 @@
 
 #define AUDIO_LOST_FRAME_INDICATOR (4)
 
+#define AUDIO_MAX_GAIN_PERCENT (1000)
+
 // ((sampling_rate_in_hz * frame_duration_in_ms) / 1000) * 2 // because PCM16 needs 2 bytes for 1 sample
 #define AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL ((AUDIO_MAX_SAMPLING_RATE * AUDIO_MAX_FRAME_DURATION_MS) / 1000)
 #define AUDIO_MAX_BUFFER_SIZE_BYTES_FOR_FRAME_PER_CHANNEL (AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL * 2)
@@ -64,27 +69,39 @@
 struct RTPMessage;
 
 typedef struct ACSession_s {
+    const Mono_Time *mono_time;
     Logger *log;
 
-    /* encoding */
+    /* encoding, the encoder always runs at AUDIO_START_SAMPLING_RATE stereo */
     OpusEncoder *encoder;
-    int32_t le_sample_rate; /* Last encoder sample rate */
-    int32_t le_channel_count; /* Last encoder channel count */
+    int32_t le_sample_rate; /* Last input sample rate */
+    int32_t le_channel_count; /* Last input channel count */
     int32_t le_bit_rate; /* Last encoder bit rate */
+    int32_t le_gain; /* Input gain, see afe_mix() */
+    int16_t le_history[AUDIO_MAX_CHANNEL_COUNT]; /* Resampler state of the input */
+    int16_t le_resampled[AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL * AUDIO_MAX_CHANNEL_COUNT];
+    int16_t le_pcm[AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL * AUDIO_MAX_CHANNEL_COUNT];
 
-    /* decoding */
+    /* decoding, the decoder always runs at AUDIO_DECODER__START_SAMPLING_RATE stereo */
     OpusDecoder *decoder;
     int32_t lp_channel_count; /* Last packet channel count */
     int32_t lp_sampling_rate; /* Last packet sample rate */
     int32_t lp_frame_duration; /* Last packet frame duration */
-    int32_t ld_sample_rate; /* Last decoder sample rate */
-    int32_t ld_channel_count; /* Last decoder channel count */
-    uint64_t ldrts; /* Last decoder reconfiguration time stamp */
+    int32_t ld_gain; /* Output gain, see afe_mix() */
+    int16_t ld_history[AUDIO_MAX_CHANNEL_COUNT]; /* Resampler state of the output */
+    int16_t ld_pcm[AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL * AUDIO_MAX_CHANNEL_COUNT];
+    int16_t ld_stretched[(AUDIO_MAX_BUFFER_SIZE_PCM16_FOR_FRAME_PER_CHANNEL
+                          + AFE_STRETCH_MAX_FRAMES(AUDIO_DECODER__START_SAMPLING_RATE)) * AUDIO_MAX_CHANNEL_COUNT];
+    int32_t ld_stretch; /* Frames to add to (or remove from, if negative) the output, see afe_stretch() */
+    uint32_t ld_playout_delay_ms; /* Playout delay ld_stretch has been updated to, UINT32_MAX before the first frame */
+    uint32_t ld_frames_played; /* Decoded frames handed to the application */
+    uint32_t ld_frames_concealed; /* Of those, recovered with FEC or concealed by the decoder */
     int32_t lp_seqnum_new; /* last incoming packet sequence number */
     void *j_buf; /* it's a Ringbuffer now */
 
     int64_t timestamp_difference_to_sender;
     uint64_t last_incoming_frame_ts;
+    Playout_Jitter jitter;
     uint8_t encoder_frame_has_record_timestamp;
 
     pthread_mutex_t queue_mutex[1];
@@ -94,13 +111,19 @@ typedef struct ACSession_s {
     PAIR(toxav_audio_receive_frame_cb *, void *) acb; /* Audio frame receive callback */
 } ACSession;
 
-ACSession *ac_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_audio_receive_frame_cb *cb, void *cb_data);
+ACSession *ac_new(const Mono_Time *mono_time, Logger *log, ToxAV *av, uint32_t friend_number,
+                  toxav_audio_receive_frame_cb *cb, void *cb_data);
 void ac_kill(ACSession *ac);
 uint8_t ac_iterate(ACSession *ac, uint64_t *a_r_timestamp, uint64_t *a_l_timestamp, uint64_t *v_r_timestamp,
-                   uint64_t *v_l_timestamp,
-                   int64_t *timestamp_difference_adjustment_,
-                   int64_t *timestamp_difference_to_sender_);
+                   uint64_t *v_l_timestamp, Playout_Clock *playout);
 int ac_queue_message(void *acp, struct RTPMessage *msg);
 int ac_reconfigure_encoder(ACSession *ac, int32_t bit_rate, int32_t sampling_rate, uint8_t channels);
+/*
+ * Convert one frame of application PCM to the encoder's rate and channels and
+ * encode it into dest. Returns the encoded length, or a negative value if the
+ * frame can not be encoded.
+ */
+int ac_encode_frame(ACSession *ac, const int16_t *pcm, size_t sample_count, uint8_t channels, uint32_t sampling_rate,
+                    uint8_t *dest, size_t dest_max);
 
 #endif /* AUDIO_H */
@@ -0,0 +1,275 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "audio_frontend.h"
+
+#include <string.h>
+
+#define AFE_STEP_SHIFT 16
+#define AFE_STEP_ONE ((uint64_t)1 << AFE_STEP_SHIFT)
+
+static inline int16_t afe_saturate(int32_t value)
+{
+    return (int16_t)(value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value);
+}
+
+int32_t afe_gain_from_percent(int32_t percent)
+{
+    if (percent < 0) {
+        percent = 0;
+    }
+
+    return (int32_t)(((int64_t)percent * AFE_GAIN_UNITY) / 100);
+}
+
+size_t afe_resampled_frames(size_t frames, uint32_t in_rate, uint32_t out_rate)
+{
+    if (in_rate == 0) {
+        return 0;
+    }
+
+    return (size_t)(((uint64_t)frames * out_rate) / in_rate);
+}
+
+static void afe_gain(const int16_t *in, int16_t *out, size_t samples, int32_t gain)
+{
+    if (gain == AFE_GAIN_UNITY) {
+        if (in != out) {
+            memmove(out, in, samples * sizeof(int16_t));
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < samples; ++i) {
+        out[i] = afe_saturate((in[i] * gain) >> AFE_GAIN_SHIFT);
+    }
+}
+
+static void afe_downmix(const int16_t *in, int16_t *out, size_t frames, int32_t gain)
+{
+    /* Average before the gain, the sum of both channels times a large gain
+     * doesn't fit in 32 bits. */
+    for (size_t i = 0; i < frames; ++i) {
+        out[i] = afe_saturate((((in[2 * i] + in[2 * i + 1]) >> 1) * gain) >> AFE_GAIN_SHIFT);
+    }
+}
+
+static void afe_upmix(const int16_t *in, int16_t *out, size_t frames, int32_t gain)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        const int16_t sample = afe_saturate((in[i] * gain) >> AFE_GAIN_SHIFT);
+        out[2 * i] = sample;
+        out[2 * i + 1] = sample;
+    }
+}
+
+void afe_mix(const int16_t *in, uint8_t in_channels, int16_t *out, uint8_t out_channels, size_t frames,
+             int32_t gain)
+{
+    if (in_channels == out_channels) {
+        afe_gain(in, out, frames * in_channels, gain);
+    } else if (in_channels == 2) {
+        afe_downmix(in, out, frames, gain);
+    } else {
+        afe_upmix(in, out, frames, gain);
+    }
+}
+
+static void afe_decimate(const int16_t *in, int16_t *out, size_t out_frames, uint32_t factor, uint8_t channels)
+{
+    const size_t stride = (size_t)factor * channels;
+
+    for (uint8_t c = 0; c < channels; ++c) {
+        const int16_t *src = in + c;
+        int16_t *dst = out + c;
+
+        for (size_t i = 0; i < out_frames; ++i) {
+            int32_t sum = 0;
+
+            for (uint32_t k = 0; k < factor; ++k) {
+                sum += src[i * stride + k * channels];
+            }
+
+            dst[i * channels] = (int16_t)(sum / (int32_t)factor);
+        }
+    }
+}
+
+static void afe_interpolate(const int16_t *in, int16_t *out, size_t out_frames, uint64_t step, uint8_t channels,
+                            const int16_t *history)
+{
+    /* Output sample i sits at i * step on the input, where position 0 is the
+     * last sample of the previous frame and position 1 the first of this one.
+     * The outputs before position 1 are the only ones that need the history,
+     * so the main loop below has no branch in it. */
+    size_t head = (size_t)((AFE_STEP_ONE + step - 1) / step);
+
+    if (head > out_frames) {
+        head = out_frames;
+    }
+
+    for (uint8_t c = 0; c < channels; ++c) {
+        const int16_t *src = in + c;
+        int16_t *dst = out + c;
+        const int32_t first = src[0];
+
+        for (size_t i = 0; i < head; ++i) {
+            const int32_t frac = (int32_t)((i * step) & (AFE_STEP_ONE - 1));
+            dst[i * channels] = (int16_t)(history[c] + (((first - history[c]) * frac) >> AFE_STEP_SHIFT));
+        }
+
+        for (size_t i = head; i < out_frames; ++i) {
+            const uint64_t pos = i * step;
+            const size_t idx = (size_t)(pos >> AFE_STEP_SHIFT);
+            const int32_t frac = (int32_t)(pos & (AFE_STEP_ONE - 1));
+            const int32_t a = src[(idx - 1) * channels];
+            const int32_t b = src[idx * channels];
+            dst[i * channels] = (int16_t)(a + (((b - a) * frac) >> AFE_STEP_SHIFT));
+        }
+    }
+}
+
+void afe_resample(const int16_t *in, size_t in_frames, uint32_t in_rate, int16_t *out, size_t out_frames,
+                  uint32_t out_rate, uint8_t channels, int16_t *history)
+{
+    if (in_frames == 0 || out_frames == 0 || in_rate == 0 || out_rate == 0) {
+        return;
+    }
+
+    if (in_rate == out_rate) {
+        memcpy(out, in, (in_frames < out_frames ? in_frames : out_frames) * channels * sizeof(int16_t));
+    } else if (in_rate > out_rate && in_rate % out_rate == 0 && out_frames * (in_rate / out_rate) <= in_frames) {
+        afe_decimate(in, out, out_frames, in_rate / out_rate, channels);
+    } else {
+        const uint64_t step = ((uint64_t)in_rate << AFE_STEP_SHIFT) / out_rate;
+
+        /* Never read past the end of the input, whatever out_frames says. */
+        const size_t max_frames = (size_t)((((uint64_t)in_frames << AFE_STEP_SHIFT) - 1) / step) + 1;
+
+        afe_interpolate(in, out, out_frames < max_frames ? out_frames : max_frames, step, channels, history);
+    }
+
+    memcpy(history, in + (in_frames - 1) * channels, channels * sizeof(int16_t));
+}
+
+/* Frame of the sum of all channels, as the pitch search sees it. */
+static inline int32_t afe_frame_sum(const int16_t *in, size_t frame, uint8_t channels)
+{
+    int32_t sum = 0;
+
+    for (uint8_t c = 0; c < channels; ++c) {
+        sum += in[frame * channels + c];
+    }
+
+    return sum;
+}
+
+/*
+ * The lag in [min_lag, max_lag] at which in best matches itself over length
+ * frames, by normalised cross correlation. Every other frame is enough to find
+ * the pitch and halves the work.
+ */
+static size_t afe_find_period(const int16_t *in, uint8_t channels, size_t min_lag, size_t max_lag, size_t length)
+{
+    size_t best_lag = min_lag;
+    double best_score = 0.0;
+
+    for (size_t lag = min_lag; lag <= max_lag; ++lag) {
+        int64_t xy = 0;
+        int64_t yy = 0;
+
+        for (size_t i = 0; i < length; i += 2) {
+            const int64_t x = afe_frame_sum(in, i, channels);
+            const int64_t y = afe_frame_sum(in, i + lag, channels);
+            xy += x * y;
+            yy += y * y;
+        }
+
+        if (xy <= 0 || yy == 0) {
+            continue;
+        }
+
+        const double score = (double)xy * (double)xy / (double)yy;
+
+        if (score > best_score) {
+            best_score = score;
+            best_lag = lag;
+        }
+    }
+
+    return best_lag;
+}
+
+size_t afe_stretch(const int16_t *in, size_t frames, uint32_t rate, uint8_t channels, int32_t change,
+                   int16_t *out)
+{
+    const size_t min_lag = rate / 400;
+    size_t max_lag = AFE_STRETCH_MAX_FRAMES(rate);
+    const size_t wanted = change < 0 ? (size_t)(-(int64_t)change) : (size_t)change;
+
+    if (max_lag > wanted) {
+        max_lag = wanted;
+    }
+
+    if (max_lag > frames / 2) {
+        max_lag = frames / 2;
+    }
+
+    if (change == 0 || min_lag == 0 || max_lag < min_lag) {
+        memcpy(out, in, frames * channels * sizeof(int16_t));
+        return frames;
+    }
+
+    /* Both copies of the period fit into the frame with length frames to fade over. */
+    const size_t length = frames - max_lag;
+    const size_t period = afe_find_period(in, channels, min_lag, max_lag, length);
+    const int32_t fade = (int32_t)length;
+
+    if (change < 0) {
+        /* Fade from the frame into itself one period later, then continue there. */
+        for (size_t i = 0; i < length; ++i) {
+            const int32_t w = (int32_t)i;
+
+            for (uint8_t c = 0; c < channels; ++c) {
+                out[i * channels + c] = (int16_t)((in[i * channels + c] * (fade - w)
+                                                   + in[(i + period) * channels + c] * w) / fade);
+            }
+        }
+
+        memcpy(out + length * channels, in + (length + period) * channels,
+               (frames - length - period) * channels * sizeof(int16_t));
+        return frames - period;
+    }
+
+    /* Play the first period, then fade from the frame back into itself one period earlier. */
+    memcpy(out, in, period * channels * sizeof(int16_t));
+
+    for (size_t i = 0; i < length; ++i) {
+        const int32_t w = (int32_t)i;
+
+        for (uint8_t c = 0; c < channels; ++c) {
+            out[(period + i) * channels + c] = (int16_t)((in[(period + i) * channels + c] * (fade - w)
+                                                          + in[i * channels + c] * w) / fade);
+        }
+    }
+
+    memcpy(out + (period + length) * channels, in + length * channels,
+           (frames - length) * channels * sizeof(int16_t));
+    return frames + period;
+}
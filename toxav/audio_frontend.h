@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef AUDIO_FRONTEND_H
+#define AUDIO_FRONTEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PCM conversion between what the application hands to toxav and what the
+ * Opus codecs of a call run at. All samples are interleaved int16_t. The inner
+ * loops are plain, branch free integer loops over contiguous samples so that
+ * the compiler can vectorise them.
+ */
+
+#define AFE_MAX_CHANNELS 2
+
+/* Gain is fixed point with 12 fractional bits. */
+#define AFE_GAIN_SHIFT 12
+#define AFE_GAIN_UNITY (1 << AFE_GAIN_SHIFT)
+
+/* Gain for a value in percent, 100 is unity. */
+int32_t afe_gain_from_percent(int32_t percent);
+
+/* Number of frames (samples per channel) frames at in_rate turn into at out_rate. */
+size_t afe_resampled_frames(size_t frames, uint32_t in_rate, uint32_t out_rate);
+
+/*
+ * Convert frames from in_channels to out_channels (1 or 2) and apply gain on
+ * the way. Stereo is downmixed to the average of both channels, mono is
+ * duplicated into both. in and out may be the same buffer, unless mono is
+ * turned into stereo.
+ */
+void afe_mix(const int16_t *in, uint8_t in_channels, int16_t *out, uint8_t out_channels, size_t frames,
+             int32_t gain);
+
+/*
+ * Resample in_frames at in_rate to out_frames at out_rate. Integer ratio
+ * downsampling averages the input samples of each output sample, everything
+ * else interpolates linearly. history holds the last input sample of every
+ * channel and carries the interpolation over from the previous frame, it
+ * should be zeroed when the stream starts. in and out must not overlap.
+ */
+void afe_resample(const int16_t *in, size_t in_frames, uint32_t in_rate, int16_t *out, size_t out_frames,
+                  uint32_t out_rate, uint8_t channels, int16_t *history);
+
+/* The most frames afe_stretch() adds to a frame at rate, one 10 ms pitch period. */
+#define AFE_STRETCH_MAX_FRAMES(rate) ((rate) / 100)
+
+/*
+ * Time stretch a frame WSOLA style: find the pitch period the signal repeats
+ * at, between 2.5 and 10 ms but at most |change| frames, and remove one period
+ * (change < 0) or repeat it (change > 0), cross-fading over the rest of the
+ * frame so that there is no seam. Returns the number of frames written to out,
+ * which is frames if the frame is too short or |change| is shorter than any
+ * period. out must hold frames + AFE_STRETCH_MAX_FRAMES(rate) frames and must
+ * not overlap in.
+ */
+size_t afe_stretch(const int16_t *in, size_t frames, uint32_t rate, uint8_t channels, int32_t change,
+                   int16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIO_FRONTEND_H */
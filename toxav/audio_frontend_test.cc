@@ -0,0 +1,149 @@
+#include "audio_frontend.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// The largest gain toxav_option_set accepts, AUDIO_MAX_GAIN_PERCENT.
+constexpr int32_t kMaxGainPercent = 1000;
+
+std::vector<int16_t> mix(const std::vector<int16_t> &in, uint8_t in_channels, uint8_t out_channels,
+                         int32_t gain) {
+  const size_t frames = in.size() / in_channels;
+  std::vector<int16_t> out(frames * out_channels);
+  afe_mix(in.data(), in_channels, out.data(), out_channels, frames, gain);
+  return out;
+}
+
+std::vector<int16_t> ramp(size_t frames, int16_t step) {
+  std::vector<int16_t> samples(frames);
+
+  for (size_t i = 0; i < frames; ++i) {
+    samples[i] = static_cast<int16_t>(i * step);
+  }
+
+  return samples;
+}
+
+// A mono triangle wave that repeats exactly every period frames.
+std::vector<int16_t> triangle(size_t frames, size_t period) {
+  std::vector<int16_t> samples(frames);
+
+  for (size_t i = 0; i < frames; ++i) {
+    const int32_t phase = static_cast<int32_t>(i % period);
+    const int32_t half = static_cast<int32_t>(period / 2);
+    samples[i] = static_cast<int16_t>((phase < half ? phase : 2 * half - phase) * 100 - half * 50);
+  }
+
+  return samples;
+}
+
+TEST(AudioFrontend, GainFromPercent) {
+  EXPECT_EQ(afe_gain_from_percent(100), AFE_GAIN_UNITY);
+  EXPECT_EQ(afe_gain_from_percent(50), AFE_GAIN_UNITY / 2);
+  EXPECT_EQ(afe_gain_from_percent(0), 0);
+  EXPECT_EQ(afe_gain_from_percent(-10), 0);
+}
+
+TEST(AudioFrontend, UnityGainCopies) {
+  const std::vector<int16_t> in{1, -2, 32767, -32768};
+  EXPECT_EQ(mix(in, 1, 1, AFE_GAIN_UNITY), in);
+  EXPECT_EQ(mix(in, 2, 2, AFE_GAIN_UNITY), in);
+}
+
+TEST(AudioFrontend, MaxGainSaturates) {
+  const int32_t gain = afe_gain_from_percent(kMaxGainPercent);
+  EXPECT_EQ(mix({1000, -3000, 32767, -32768}, 1, 1, gain), (std::vector<int16_t>{10000, -30000, 32767, -32768}));
+}
+
+TEST(AudioFrontend, DownmixAveragesChannels) {
+  EXPECT_EQ(mix({100, 300, -200, 0}, 2, 1, AFE_GAIN_UNITY), (std::vector<int16_t>{200, -100}));
+  EXPECT_EQ(mix({100, 300, -200, 0}, 2, 1, afe_gain_from_percent(200)), (std::vector<int16_t>{400, -200}));
+}
+
+TEST(AudioFrontend, DownmixAtMaxGainSaturates) {
+  const int32_t gain = afe_gain_from_percent(kMaxGainPercent);
+  EXPECT_EQ(mix({32767, 32767, -32768, -32768, 32767, -32768}, 2, 1, gain),
+            (std::vector<int16_t>{32767, -32768, -10}));
+}
+
+TEST(AudioFrontend, UpmixDuplicatesChannel) {
+  EXPECT_EQ(mix({100, -50}, 1, 2, afe_gain_from_percent(200)), (std::vector<int16_t>{200, 200, -100, -100}));
+}
+
+TEST(AudioFrontend, UpmixAtMaxGainSaturates) {
+  const int32_t gain = afe_gain_from_percent(kMaxGainPercent);
+  EXPECT_EQ(mix({32767, -32768}, 1, 2, gain), (std::vector<int16_t>{32767, 32767, -32768, -32768}));
+}
+
+TEST(AudioFrontend, ResampledFrames) {
+  EXPECT_EQ(afe_resampled_frames(480, 48000, 16000), 160u);
+  EXPECT_EQ(afe_resampled_frames(160, 8000, 48000), 960u);
+  EXPECT_EQ(afe_resampled_frames(160, 0, 48000), 0u);
+}
+
+TEST(AudioFrontend, DecimationAveragesSamples) {
+  const std::vector<int16_t> in{3, 6, 9, 30, 60, 90};
+  std::vector<int16_t> out(2);
+  int16_t history[AFE_MAX_CHANNELS] = {0};
+  afe_resample(in.data(), in.size(), 48000, out.data(), out.size(), 16000, 1, history);
+  EXPECT_EQ(out, (std::vector<int16_t>{6, 60}));
+  EXPECT_EQ(history[0], 90);
+}
+
+TEST(AudioFrontend, InterpolationStartsFromHistory) {
+  const std::vector<int16_t> in{100, 200};
+  std::vector<int16_t> out(4);
+  int16_t history[AFE_MAX_CHANNELS] = {-100};
+  afe_resample(in.data(), in.size(), 8000, out.data(), out.size(), 16000, 1, history);
+  EXPECT_EQ(out, (std::vector<int16_t>{-100, 0, 100, 150}));
+  EXPECT_EQ(history[0], 200);
+}
+
+TEST(AudioFrontend, ResamplerHistoryCarriesAcrossFrames) {
+  const std::vector<int16_t> in = ramp(160, 100);
+
+  std::vector<int16_t> whole(320);
+  int16_t whole_history[AFE_MAX_CHANNELS] = {0};
+  afe_resample(in.data(), 160, 8000, whole.data(), 320, 16000, 1, whole_history);
+
+  std::vector<int16_t> split(320);
+  int16_t split_history[AFE_MAX_CHANNELS] = {0};
+  afe_resample(in.data(), 80, 8000, split.data(), 160, 16000, 1, split_history);
+  afe_resample(in.data() + 80, 80, 8000, split.data() + 160, 160, 16000, 1, split_history);
+
+  EXPECT_EQ(split, whole);
+}
+
+TEST(AudioFrontend, StretchWithoutChangeCopies) {
+  const std::vector<int16_t> in = triangle(960, 240);
+  std::vector<int16_t> out(960 + AFE_STRETCH_MAX_FRAMES(48000));
+  EXPECT_EQ(afe_stretch(in.data(), in.size(), 48000, 1, 0, out.data()), 960u);
+  EXPECT_EQ(std::vector<int16_t>(out.begin(), out.begin() + 960), in);
+}
+
+TEST(AudioFrontend, StretchShorterThanAnyPeriodCopies) {
+  const std::vector<int16_t> in = triangle(960, 240);
+  std::vector<int16_t> out(960 + AFE_STRETCH_MAX_FRAMES(48000));
+  // 2.5 ms at 48 kHz is the shortest period searched for.
+  EXPECT_EQ(afe_stretch(in.data(), in.size(), 48000, 1, 119, out.data()), 960u);
+  EXPECT_EQ(afe_stretch(in.data(), in.size(), 48000, 1, -119, out.data()), 960u);
+}
+
+TEST(AudioFrontend, StretchRemovesOnePeriod) {
+  const std::vector<int16_t> in = triangle(960, 240);
+  std::vector<int16_t> out(960 + AFE_STRETCH_MAX_FRAMES(48000));
+  ASSERT_EQ(afe_stretch(in.data(), in.size(), 48000, 1, -480, out.data()), 720u);
+  EXPECT_EQ(std::vector<int16_t>(out.begin(), out.begin() + 720), std::vector<int16_t>(in.begin(), in.begin() + 720));
+}
+
+TEST(AudioFrontend, StretchRepeatsOnePeriod) {
+  const std::vector<int16_t> in = triangle(1200, 240);
+  std::vector<int16_t> out(960 + AFE_STRETCH_MAX_FRAMES(48000));
+  ASSERT_EQ(afe_stretch(in.data(), 960, 48000, 1, 480, out.data()), 1200u);
+  EXPECT_EQ(std::vector<int16_t>(out.begin(), out.begin() + 1200), in);
+}
+
+}  // namespace
@@ -87,7 +87,7 @@ BWController *bwc_new(Messenger *m, uint32_t friendnumber,
     retu->mcb_data = udata;
     retu->m = m;
     retu->friend_number = friendnumber;
-    retu->cycle.last_sent_timestamp = retu->cycle.last_refresh_timestamp = current_time_monotonic();
+    retu->cycle.last_sent_timestamp = retu->cycle.last_refresh_timestamp = current_time_monotonic(m->mono_time);
     retu->rcvpkt.rb = rb_new(BWC_AVG_PKT_COUNT);
 
     retu->cycle.lost = 0;
@@ -159,7 +159,7 @@ void bwc_add_recv(BWController *bwc, uint32_t recv_bytes)
 
 void send_update(BWController *bwc, bool force_update_now)
 {
-    if ((current_time_monotonic() - bwc->cycle.last_sent_timestamp > BWC_SEND_INTERVAL_MS)
+    if ((current_time_monotonic(bwc->m->mono_time) - bwc->cycle.last_sent_timestamp > BWC_SEND_INTERVAL_MS)
             || (force_update_now == true)) {
 
         bwc->packet_loss_counted_cycles = 0;
@@ -183,7 +183,7 @@ void send_update(BWController *bwc, bool force_update_now)
             LOGGER_WARNING(bwc->m->log, "BWC send failed (len: %d)! std error: %s", sizeof(bwc_packet), strerror(errno));
         }
 
-        bwc->cycle.last_sent_timestamp = current_time_monotonic();
+        bwc->cycle.last_sent_timestamp = current_time_monotonic(bwc->m->mono_time);
 
         bwc->cycle.lost = 0;
         bwc->cycle.recv = 0;
@@ -197,14 +197,14 @@ static int on_update(BWController *bwc, const struct BWCMessage *msg)
 #if 1
 
     /* Peers sent update too soon */
-    if ((bwc->cycle.last_recv_timestamp + (BWC_SEND_INTERVAL_MS / 2)) > current_time_monotonic()) {
+    if ((bwc->cycle.last_recv_timestamp + (BWC_SEND_INTERVAL_MS / 2)) > current_time_monotonic(bwc->m->mono_time)) {
         LOGGER_INFO(bwc->m->log, "%p Rejecting extra update", bwc);
         return -1;
     }
 
 #endif
 
-    bwc->cycle.last_recv_timestamp = current_time_monotonic();
+    bwc->cycle.last_recv_timestamp = current_time_monotonic(bwc->m->mono_time);
 
     uint32_t recv = net_ntohl(msg->recv);
     uint32_t lost = net_ntohl(msg->lost);
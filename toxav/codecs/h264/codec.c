@@ -34,6 +34,17 @@
 #define X264_ENCODER_THREADS 4
 #define X264_ENCODER_SLICES 4
 
+/* The call's share of the thread budget, capped at the counts above */
+static int h264_encoder_threads(const VCSession *vc)
+{
+    return vc->encoder_threads < X264_ENCODER_THREADS ? (int)vc->encoder_threads : X264_ENCODER_THREADS;
+}
+
+static int h264_decoder_threads(const VCSession *vc)
+{
+    return vc->decoder_threads < H264_DECODER_THREADS ? (int)vc->decoder_threads : H264_DECODER_THREADS;
+}
+
 
 VCSession *vc_new_h264(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_receive_frame_cb *cb, void *cb_data,
                        VCSession *vc)
@@ -53,8 +64,9 @@ VCSession *vc_new_h264(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vid
     param.i_height = 1080;
     vc->h264_enc_width = param.i_width;
     vc->h264_enc_height = param.i_height;
+    vc->h264_enc_threads = h264_encoder_threads(vc);
 #if 1
-    param.i_threads = X264_ENCODER_THREADS;
+    param.i_threads = h264_encoder_threads(vc);
     param.b_sliced_threads = 1;
     param.i_slice_count = X264_ENCODER_SLICES;
 #endif
@@ -92,13 +104,8 @@ VCSession *vc_new_h264(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vid
         // goto fail;
     }
 
-    if (x264_picture_alloc(&(vc->h264_in_pic), param.i_csp, param.i_width, param.i_height) < 0) {
-        // goto fail;
-    }
-
-    // vc->h264_in_pic.img.plane[0] --> Y
-    // vc->h264_in_pic.img.plane[1] --> U
-    // vc->h264_in_pic.img.plane[2] --> V
+    // the planes of h264_in_pic are set to the caller's frame in encode_frame_h264
+    x264_picture_init(&(vc->h264_in_pic));
 
     vc->h264_encoder = x264_encoder_open(&param);
 
@@ -137,16 +144,18 @@ VCSession *vc_new_h264(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vid
 
     vc->h264_decoder->flags |= CODEC_FLAG2_FAST;
 
-    if (H264_DECODER_THREADS > 0) {
+    const int decoder_threads = h264_decoder_threads(vc);
+
+    if (decoder_threads > 1) {
         if (codec->capabilities & CODEC_CAP_SLICE_THREADS) {
-            vc->h264_decoder->thread_count = H264_DECODER_THREADS;
+            vc->h264_decoder->thread_count = decoder_threads;
             vc->h264_decoder->thread_type = FF_THREAD_SLICE;
             vc->h264_decoder->active_thread_type = FF_THREAD_SLICE;
         }
 
         if (H264_DECODER_THREAD_FRAME_ACTIVE == 1) {
             if (codec->capabilities & CODEC_CAP_FRAME_THREADS) {
-                vc->h264_decoder->thread_count = H264_DECODER_THREADS;
+                vc->h264_decoder->thread_count = decoder_threads;
                 vc->h264_decoder->thread_type |= FF_THREAD_FRAME;
                 vc->h264_decoder->active_thread_type |= FF_THREAD_FRAME;
             }
@@ -173,11 +182,58 @@ VCSession *vc_new_h264(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vid
     *             decoder. The caller may not write to it.
     */
 
+    vc->h264_in_pkt = av_packet_alloc();
+    vc->h264_out_frame = av_frame_alloc();
+    vc->h264_in_buf = NULL;
+    vc->h264_decoded_frames = 0;
+    vc->h264_decode_allocs = 0;
+
+    if (vc->h264_in_pkt == NULL || vc->h264_out_frame == NULL) {
+        LOGGER_WARNING(log, "could not allocate H264 decoder packet or frame");
+    }
+
     // DECODER -------
 
     return vc;
 }
 
+/*
+ * Make the decoder input buffer hold at least len bytes plus the zeroed
+ * padding that libavcodec reads past the end of the data. The buffer is
+ * refcounted and handed to the decoder with the packet, so libavcodec takes a
+ * reference to it instead of copying the frame. It is written again once the
+ * decoder dropped its reference; while the decoder still holds it, or when it
+ * is too small, a new one is allocated, by at least half again the old size.
+ */
+static bool h264_reserve_in_buf(VCSession *vc, uint32_t len)
+{
+    const size_t needed = (size_t)len + FF_INPUT_BUFFER_PADDING_SIZE;
+    size_t new_size = needed;
+
+    if (vc->h264_in_buf != NULL) {
+        const size_t size = (size_t)vc->h264_in_buf->size;
+
+        if (needed <= size && av_buffer_is_writable(vc->h264_in_buf)) {
+            return true;
+        }
+
+        if (new_size < size + size / 2) {
+            new_size = size + size / 2;
+        }
+
+        av_buffer_unref(&vc->h264_in_buf);
+    }
+
+    vc->h264_in_buf = av_buffer_alloc(new_size);
+
+    if (vc->h264_in_buf == NULL) {
+        return false;
+    }
+
+    ++vc->h264_decode_allocs;
+    return true;
+}
+
 int vc_reconfigure_encoder_h264(Logger *log, VCSession *vc, uint32_t bit_rate,
                                 uint16_t width, uint16_t height,
                                 int16_t kf_max_dist)
@@ -189,6 +245,7 @@ int vc_reconfigure_encoder_h264(Logger *log, VCSession *vc, uint32_t bit_rate,
     if ((vc->h264_enc_width == width) &&
             (vc->h264_enc_height == height) &&
             (vc->h264_enc_bitrate != bit_rate) &&
+            (vc->h264_enc_threads == h264_encoder_threads(vc)) &&
             (kf_max_dist != -2)) {
         // only bit rate changed
 
@@ -212,9 +269,10 @@ int vc_reconfigure_encoder_h264(Logger *log, VCSession *vc, uint32_t bit_rate,
         if ((vc->h264_enc_width != width) ||
                 (vc->h264_enc_height != height) ||
                 (vc->h264_enc_bitrate != bit_rate) ||
+                (vc->h264_enc_threads != h264_encoder_threads(vc)) ||
                 (kf_max_dist == -2)
            ) {
-            // input image size changed
+            // input image size or thread count changed
 
             x264_param_t param;
 
@@ -231,7 +289,8 @@ int vc_reconfigure_encoder_h264(Logger *log, VCSession *vc, uint32_t bit_rate,
             vc->h264_enc_width = param.i_width;
             vc->h264_enc_height = param.i_height;
 #if 1
-            param.i_threads = X264_ENCODER_THREADS;
+            param.i_threads = h264_encoder_threads(vc);
+            vc->h264_enc_threads = param.i_threads;
             param.b_sliced_threads = 1;
             param.i_slice_count = X264_ENCODER_SLICES;
 #endif
@@ -278,15 +337,12 @@ int vc_reconfigure_encoder_h264(Logger *log, VCSession *vc, uint32_t bit_rate,
 
             // free old stuff ---------
             x264_encoder_close(vc->h264_encoder);
-            x264_picture_clean(&(vc->h264_in_pic));
             // free old stuff ---------
 
             LOGGER_DEBUG(log, "H264: reconfigure encoder:002\n");
 
             // alloc with new values -------
-            if (x264_picture_alloc(&(vc->h264_in_pic), param.i_csp, param.i_width, param.i_height) < 0) {
-                // goto fail;
-            }
+            x264_picture_init(&(vc->h264_in_pic));
 
             LOGGER_DEBUG(log, "H264: reconfigure encoder:003\n");
 
@@ -329,30 +385,30 @@ void decode_frame_h264(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uin
 
      */
 
-    AVPacket *compr_data;
-    compr_data = av_packet_alloc();
-
-#if 0
-    compr_data->pts = AV_NOPTS_VALUE;
-    compr_data->dts = AV_NOPTS_VALUE;
+    AVPacket *compr_data = vc->h264_in_pkt;
+    AVFrame *frame = vc->h264_out_frame;
 
-    compr_data->duration = 0;
-    compr_data->post = -1;
-#endif
+    if (compr_data == NULL || frame == NULL || !h264_reserve_in_buf(vc, full_data_len)) {
+        LOGGER_WARNING(vc->log, "H264 decoder has no buffers, dropping frame");
+        free(p);
+        return;
+    }
 
-    // uint32_t start_time_ms = current_time_monotonic();
-    // HINT: dirty hack to add FF_INPUT_BUFFER_PADDING_SIZE bytes!! ----------
-    uint8_t *tmp_buf = calloc(1, full_data_len + FF_INPUT_BUFFER_PADDING_SIZE);
-    memcpy(tmp_buf, p->data, full_data_len);
-    // HINT: dirty hack to add FF_INPUT_BUFFER_PADDING_SIZE bytes!! ----------
-    // uint32_t end_time_ms = current_time_monotonic();
-    // LOGGER_WARNING(vc->log, "decode_frame_h264:001: %d ms", (int)(end_time_ms - start_time_ms));
+    /* libavcodec may read FF_INPUT_BUFFER_PADDING_SIZE bytes past the end of
+     * the data, and they must be zero. */
+    memcpy(vc->h264_in_buf->data, p->data, full_data_len);
+    memset(vc->h264_in_buf->data + full_data_len, 0, FF_INPUT_BUFFER_PADDING_SIZE);
 
-    compr_data->data = tmp_buf; // p->data;
+    /* The packet borrows the session's reference; avcodec_send_packet takes
+     * its own reference to the buffer rather than copying the data. */
+    compr_data->buf = vc->h264_in_buf;
+    compr_data->data = vc->h264_in_buf->data;
     compr_data->size = (int)full_data_len; // hmm, "int" again
 
     if (header_v3->frame_record_timestamp > 0) {
         compr_data->dts = (int64_t)header_v3->frame_record_timestamp;
+    } else {
+        compr_data->dts = AV_NOPTS_VALUE;
     }
 
     /* ------------------------------------------------------- */
@@ -361,9 +417,9 @@ void decode_frame_h264(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uin
     /* HINT: this is the only part that takes all the time !!! */
     /* HINT: this is the only part that takes all the time !!! */
 
-    // uint32_t start_time_ms = current_time_monotonic();
+    // uint32_t start_time_ms = current_time_monotonic(vc->mono_time);
     avcodec_send_packet(vc->h264_decoder, compr_data);
-    // uint32_t end_time_ms = current_time_monotonic();
+    // uint32_t end_time_ms = current_time_monotonic(vc->mono_time);
     // if ((int)(end_time_ms - start_time_ms) > 4) {
     //    LOGGER_WARNING(vc->log, "decode_frame_h264:002: %d ms", (int)(end_time_ms - start_time_ms));
     //}
@@ -379,14 +435,9 @@ void decode_frame_h264(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uin
 
     while (ret_ >= 0) {
 
-        // start_time_ms = current_time_monotonic();
-        AVFrame *frame = av_frame_alloc();
-        // end_time_ms = current_time_monotonic();
-        // LOGGER_WARNING(vc->log, "decode_frame_h264:003: %d ms", (int)(end_time_ms - start_time_ms));
-
-        // start_time_ms = current_time_monotonic();
+        // start_time_ms = current_time_monotonic(vc->mono_time);
         ret_ = avcodec_receive_frame(vc->h264_decoder, frame);
-        // end_time_ms = current_time_monotonic();
+        // end_time_ms = current_time_monotonic(vc->mono_time);
         // LOGGER_WARNING(vc->log, "decode_frame_h264:004: %d ms", (int)(end_time_ms - start_time_ms));
 
         // LOGGER_ERROR(vc->log, "H264:decoder:ret_=%d\n", (int)ret_);
@@ -408,55 +459,80 @@ void decode_frame_h264(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uin
             // calculate the real play delay (from toxcore-in to toxcore-out)
             if (header_v3->frame_record_timestamp > 0) {
                 vc->video_play_delay_real =
-                    (current_time_monotonic() + vc->timestamp_difference_to_sender) -
+                    (current_time_monotonic(vc->mono_time) + vc->timestamp_difference_to_sender) -
                     frame->pkt_dts;
                 LOGGER_DEBUG(vc->log, "real play delay=%d", (int)(vc->video_play_delay_real));
             }
 
-            // start_time_ms = current_time_monotonic();
+            // start_time_ms = current_time_monotonic(vc->mono_time);
             vc->vcb.first(vc->av, vc->friend_number, frame->width, frame->height,
                           (const uint8_t *)frame->data[0],
                           (const uint8_t *)frame->data[1],
                           (const uint8_t *)frame->data[2],
                           frame->linesize[0], frame->linesize[1],
                           frame->linesize[2], vc->vcb.second);
-            // end_time_ms = current_time_monotonic();
+            // end_time_ms = current_time_monotonic(vc->mono_time);
             // LOGGER_WARNING(vc->log, "decode_frame_h264:005: %d ms", (int)(end_time_ms - start_time_ms));
 
+            ++vc->h264_decoded_frames;
         } else {
             // some other error
         }
 
-        // start_time_ms = current_time_monotonic();
-        av_frame_free(&frame);
-        // end_time_ms = current_time_monotonic();
-        // LOGGER_WARNING(vc->log, "decode_frame_h264:006: %d ms", (int)(end_time_ms - start_time_ms));
+        /* hand the picture back to the decoder, the frame itself is reused */
+        av_frame_unref(frame);
     }
 
-    // start_time_ms = current_time_monotonic();
-    av_packet_free(&compr_data);
-    // end_time_ms = current_time_monotonic();
-    // LOGGER_WARNING(vc->log, "decode_frame_h264:007: %d ms", (int)(end_time_ms - start_time_ms));
+    /* the reference stays with the session, not the packet */
+    compr_data->buf = NULL;
+    compr_data->data = NULL;
+    compr_data->size = 0;
 
-    // HINT: dirty hack to add FF_INPUT_BUFFER_PADDING_SIZE bytes!! ----------
-    free(tmp_buf);
-    // HINT: dirty hack to add FF_INPUT_BUFFER_PADDING_SIZE bytes!! ----------
+    if ((vc->h264_decoded_frames & 0xff) == 0 && vc->h264_decoded_frames > 0) {
+        LOGGER_DEBUG(vc->log, "H264 decoder: %lu input buffers allocated in %lu frames",
+                     (unsigned long)vc->h264_decode_allocs, (unsigned long)vc->h264_decoded_frames);
+    }
 
     free(p);
 }
 
 uint32_t encode_frame_h264(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
-                           const uint8_t *y,
-                           const uint8_t *u, const uint8_t *v, ToxAVCall *call,
+                           const VC_Frame_Planes *planes, ToxAVCall *call,
                            uint64_t *video_frame_record_timestamp,
                            int vpx_encode_flags,
                            x264_nal_t **nal,
                            int *i_frame_size)
 {
+    /* Point the input picture at the caller's planes for this frame. x264
+     * copies the frame into its own buffers, converting I420 or NV12 and
+     * reading through any stride. */
+    VCSession *vc = call->video.second;
+
+    /* x264 reads as many rows and columns as the encoder was opened with, so a
+     * frame of another size, left by a failed reconfiguration, would be read
+     * past its end. */
+    if (width != vc->h264_enc_width || height != vc->h264_enc_height) {
+        LOGGER_WARNING(av->m->log, "H264 frame of %dx%d does not match the encoder size %dx%d",
+                       (int)width, (int)height, vc->h264_enc_width, vc->h264_enc_height);
+        return 1;
+    }
+
+    x264_image_t *img = &vc->h264_in_pic.img;
+
+    img->plane[0] = (uint8_t *)planes->y;
+    img->i_stride[0] = planes->ystride;
+    img->plane[1] = (uint8_t *)planes->u;
+    img->i_stride[1] = planes->ustride;
 
-    memcpy(call->video.second->h264_in_pic.img.plane[0], y, width * height);
-    memcpy(call->video.second->h264_in_pic.img.plane[1], u, (width / 2) * (height / 2));
-    memcpy(call->video.second->h264_in_pic.img.plane[2], v, (width / 2) * (height / 2));
+    if (planes->format == TOXAV_VIDEO_FORMAT_NV12) {
+        img->i_csp = X264_CSP_NV12;
+        img->i_plane = 2;
+    } else {
+        img->i_csp = X264_CSP_I420;
+        img->i_plane = 3;
+        img->plane[2] = (uint8_t *)planes->v;
+        img->i_stride[2] = planes->vstride;
+    }
 
     int i_nal;
 
@@ -464,7 +540,7 @@ uint32_t encode_frame_h264(ToxAV *av, uint32_t friend_number, uint16_t width, ui
 
     if ((vpx_encode_flags & VPX_EFLAG_FORCE_KF) > 0) {
         call->video.second->h264_in_pic.i_type = X264_TYPE_IDR; // real full i-frame
-        call->video.second->last_sent_keyframe_ts = current_time_monotonic();
+        call->video.second->last_sent_keyframe_ts = current_time_monotonic(av->m->mono_time);
     } else {
         call->video.second->h264_in_pic.i_type = X264_TYPE_AUTO;
     }
@@ -544,6 +620,7 @@ uint32_t send_frames_h264(ToxAV *av, uint32_t friend_number, uint16_t width, uin
                       (const uint8_t *)((*nal)->p_payload),
                       frame_length_in_bytes,
                       keyframe,
+                      0,
                       *video_frame_record_timestamp,
                       (int32_t)0,
                       TOXAV_ENCODER_CODEC_USED_H264,
@@ -570,9 +647,11 @@ void vc_kill_h264(VCSession *vc)
 {
     // encoder
     x264_encoder_close(vc->h264_encoder);
-    x264_picture_clean(&(vc->h264_in_pic));
     // decoder
     avcodec_free_context(&vc->h264_decoder);
+    av_packet_free(&vc->h264_in_pkt);
+    av_frame_free(&vc->h264_out_frame);
+    av_buffer_unref(&vc->h264_in_buf);
 }
 
 
@@ -958,7 +958,7 @@ uint32_t send_frames_h264_omx_raspi(ToxAV *av, uint32_t friend_number, uint16_t
         }
 
         // TODO: use the record timestamp that was actually used for this frame
-        *video_frame_record_timestamp = current_time_monotonic();
+        *video_frame_record_timestamp = current_time_monotonic(av->m->mono_time);
 
         const int keyframe = ctx->encoder_ppBuffer_out->nFlags & OMX_BUFFERFLAG_SYNCFRAME;
         const int spspps = ctx->encoder_ppBuffer_out->nFlags & OMX_BUFFERFLAG_CODECCONFIG;
@@ -985,6 +985,7 @@ uint32_t send_frames_h264_omx_raspi(ToxAV *av, uint32_t friend_number, uint16_t
                       (const uint8_t *)buf,
                       (uint32_t)(frame_bytes + 4),
                       keyframe,
+                      0,
                       *video_frame_record_timestamp,
                       (int32_t)0,
                       TOXAV_ENCODER_CODEC_USED_H264,
@@ -1023,7 +1024,7 @@ uint32_t send_frames_h264_omx_raspi(ToxAV *av, uint32_t friend_number, uint16_t
                     header->ma = 0;
                     header->pt = rtp_TypeVideo % 128;
                     header->sequnum = fake_sequnum;
-                    header->timestamp = current_time_monotonic();
+                    header->timestamp = current_time_monotonic(av->m->mono_time);
                     header->ssrc = 0;
                     header->offset_lower = 0;
                     header->data_length_lower = (frame_bytes + 4);
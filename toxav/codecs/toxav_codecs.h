@@ -68,8 +68,7 @@ void decode_frame_vpx(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint
                       uint8_t *ret_value);
 
 uint32_t encode_frame_vpx(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
-                          const uint8_t *y,
-                          const uint8_t *u, const uint8_t *v, ToxAVCall *call,
+                          const VC_Frame_Planes *planes, ToxAVCall *call,
                           uint64_t *video_frame_record_timestamp,
                           int vpx_encode_flags,
                           x264_nal_t **nal,
@@ -104,8 +103,7 @@ void decode_frame_h264(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uin
                        uint8_t *ret_value);
 
 uint32_t encode_frame_h264(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
-                           const uint8_t *y,
-                           const uint8_t *u, const uint8_t *v, ToxAVCall *call,
+                           const VC_Frame_Planes *planes, ToxAVCall *call,
                            uint64_t *video_frame_record_timestamp,
                            int vpx_encode_flags,
                            x264_nal_t **nal,
@@ -45,9 +45,20 @@ static uint32_t MaxIntraTarget(uint32_t optimalBuffersize)
 }
 
 
+/* The call's share of the thread budget, capped at what VPX makes use of */
+static unsigned int vc__encoder_threads(const VCSession *vc)
+{
+    return vc->encoder_threads < VPX_MAX_ENCODER_THREADS ? vc->encoder_threads : VPX_MAX_ENCODER_THREADS;
+}
+
+static unsigned int vc__decoder_threads(const VCSession *vc)
+{
+    return vc->decoder_threads < VPX_MAX_DECODER_THREADS ? vc->decoder_threads : VPX_MAX_DECODER_THREADS;
+}
+
 static void vc__init_encoder_cfg(Logger *log, vpx_codec_enc_cfg_t *cfg, int16_t kf_max_dist, int32_t quality,
                                  int32_t rc_max_quantizer, int32_t rc_min_quantizer, int32_t encoder_codec,
-                                 int32_t video_keyframe_method)
+                                 int32_t video_keyframe_method, unsigned int threads)
 {
 
     vpx_codec_err_t rc;
@@ -122,7 +133,7 @@ static void vc__init_encoder_cfg(Logger *log, vpx_codec_enc_cfg_t *cfg, int16_t
         LOGGER_WARNING(log, "kf_max_dist=%d (3)", cfg->kf_max_dist);
     }
 
-    cfg->g_threads = VPX_MAX_ENCODER_THREADS; // Maximum number of threads to use
+    cfg->g_threads = threads; // Maximum number of threads to use
 
     cfg->g_timebase.num = 1; // 0.1 ms = timebase units = (1/10000)s
     cfg->g_timebase.den = 10000; // 0.1 ms = timebase units = (1/10000)s
@@ -161,6 +172,56 @@ static void vc__init_encoder_cfg(Logger *log, vpx_codec_enc_cfg_t *cfg, int16_t
     }
 }
 
+/*
+ * VP8 keeps a rate control per temporal layer, the target of each layer
+ * includes the layers below it. VP9 only takes temporal layers in its SVC mode,
+ * so it gets the reference pattern of vc__temporal_layer_flags() alone, at one
+ * rate.
+ */
+static void vc__set_temporal_layers(vpx_codec_enc_cfg_t *cfg, uint8_t temporal_layers, int32_t encoder_codec)
+{
+    if (encoder_codec == TOXAV_ENCODER_CODEC_USED_VP9) {
+        return;
+    }
+
+    if (temporal_layers < 2) {
+        cfg->ts_number_layers = 1;
+        return;
+    }
+
+    cfg->ts_number_layers = 2;
+    cfg->ts_periodicity = 2;
+    cfg->ts_layer_id[0] = 0;
+    cfg->ts_layer_id[1] = 1;
+    cfg->ts_rate_decimator[0] = 2;
+    cfg->ts_rate_decimator[1] = 1;
+    cfg->ts_target_bitrate[0] = cfg->rc_target_bitrate * VIDEO_BASE_LAYER_BITRATE_PERCENT / 100;
+    cfg->ts_target_bitrate[1] = cfg->rc_target_bitrate;
+}
+
+/*
+ * Enhancement layer frames do not update any reference buffer or the entropy
+ * context, see temporal_layers.h.
+ *
+ * Returns the flags to encode the next frame with, or -1 if it is not encoded
+ * at all because the enhancement layer is left out while the peer reports
+ * loss.
+ */
+static int vc__temporal_layer_flags(VCSession *vc, int vpx_encode_flags)
+{
+    const bool keyframe = (vpx_encode_flags & VPX_EFLAG_FORCE_KF) != 0;
+
+    if (!temporal_layers_next(&vc->temporal_layers, vc->video_temporal_layers, keyframe)) {
+        return -1;
+    }
+
+    if (temporal_layers_is_reference(&vc->temporal_layers)) {
+        return vpx_encode_flags;
+    }
+
+    return vpx_encode_flags | VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF
+           | VP8_EFLAG_NO_UPD_ENTROPY;
+}
 
 VCSession *vc_new_vpx(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_receive_frame_cb *cb, void *cb_data,
                       VCSession *vc)
@@ -176,7 +237,7 @@ VCSession *vc_new_vpx(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vide
        Conceal errors in decoded frames
     */
     vpx_codec_dec_cfg_t  dec_cfg;
-    dec_cfg.threads = VPX_MAX_DECODER_THREADS; // Maximum number of threads to use
+    dec_cfg.threads = vc__decoder_threads(vc); // Maximum number of threads to use
     dec_cfg.w = VIDEO_CODEC_DECODER_MAX_WIDTH;
     dec_cfg.h = VIDEO_CODEC_DECODER_MAX_HEIGHT;
 
@@ -273,7 +334,11 @@ VCSession *vc_new_vpx(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vide
                          vc->video_rc_max_quantizer,
                          vc->video_rc_min_quantizer,
                          vc->video_encoder_coded_used,
-                         vc->video_keyframe_method);
+                         vc->video_keyframe_method,
+                         vc__encoder_threads(vc));
+    vc__set_temporal_layers(&cfg, vc->video_temporal_layers, vc->video_encoder_coded_used);
+    vc->video_temporal_layers_prev = vc->video_temporal_layers;
+    temporal_layers_reset(&vc->temporal_layers);
 
     if (vc->video_encoder_coded_used != TOXAV_ENCODER_CODEC_USED_VP9) {
         LOGGER_WARNING(log, "Using VP8 codec for encoder (0.1)");
@@ -465,7 +530,7 @@ VCSession *vc_new_vpx(Logger *log, ToxAV *av, uint32_t friend_number, toxav_vide
     // VP8E_SET_STATIC_THRESHOLD
 
 
-    vc->linfts = current_time_monotonic();
+    vc->linfts = current_time_monotonic(vc->mono_time);
     vc->lcfd = 10; // initial value in ms for av_iterate sleep
     vc->vcb.first = cb;
     vc->vcb.second = cb_data;
@@ -528,6 +593,8 @@ int vc_reconfigure_encoder_vpx(Logger *log, VCSession *vc, uint32_t bit_rate,
             && vc->video_rc_min_quantizer == vc->video_rc_min_quantizer_prev
             && vc->video_encoder_coded_used == vc->video_encoder_coded_used_prev
             && vc->video_keyframe_method == vc->video_keyframe_method_prev
+            && vc->video_temporal_layers == vc->video_temporal_layers_prev
+            && cfg2.g_threads == vc__encoder_threads(vc)
        ) {
         return 0; /* Nothing changed */
     }
@@ -539,6 +606,8 @@ int vc_reconfigure_encoder_vpx(Logger *log, VCSession *vc, uint32_t bit_rate,
             && vc->video_rc_min_quantizer == vc->video_rc_min_quantizer_prev
             && vc->video_encoder_coded_used == vc->video_encoder_coded_used_prev
             && vc->video_keyframe_method == vc->video_keyframe_method_prev
+            && vc->video_temporal_layers == vc->video_temporal_layers_prev
+            && cfg2.g_threads == vc__encoder_threads(vc)
        ) {
         /* Only bit rate changed */
 
@@ -546,6 +615,7 @@ int vc_reconfigure_encoder_vpx(Logger *log, VCSession *vc, uint32_t bit_rate,
                      (uint32_t)(bit_rate / 1000));
 
         cfg2.rc_target_bitrate = (bit_rate / 1000);
+        vc__set_temporal_layers(&cfg2, vc->video_temporal_layers, vc->video_encoder_coded_used);
 
         rc = vpx_codec_enc_config_set(vc->encoder, &cfg2);
 
@@ -571,17 +641,21 @@ int vc_reconfigure_encoder_vpx(Logger *log, VCSession *vc, uint32_t bit_rate,
                              vc->video_rc_max_quantizer,
                              vc->video_rc_min_quantizer,
                              vc->video_encoder_coded_used,
-                             vc->video_keyframe_method);
+                             vc->video_keyframe_method,
+                             vc__encoder_threads(vc));
 
         vc->video_encoder_coded_used_prev = vc->video_encoder_coded_used;
         vc->video_encoder_vp8_quality_prev = vc->video_encoder_vp8_quality;
         vc->video_rc_max_quantizer_prev = vc->video_rc_max_quantizer;
         vc->video_rc_min_quantizer_prev = vc->video_rc_min_quantizer;
         vc->video_keyframe_method_prev = vc->video_keyframe_method;
+        vc->video_temporal_layers_prev = vc->video_temporal_layers;
+        temporal_layers_reset(&vc->temporal_layers);
 
         cfg.rc_target_bitrate = (bit_rate / 1000);
         cfg.g_w = width;
         cfg.g_h = height;
+        vc__set_temporal_layers(&cfg, vc->video_temporal_layers, vc->video_encoder_coded_used);
 
 
         if (vc->video_encoder_coded_used != TOXAV_ENCODER_CODEC_USED_VP9) {
@@ -907,14 +981,14 @@ void decode_frame_vpx(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint
                 if (dest->user_priv != NULL) {
                     uint64_t frame_record_timestamp_vpx = ((struct vpx_frame_user_data *)(dest->user_priv))->record_timestamp;
 
-                    //LOGGER_ERROR(vc->log, "VIDEO:TTx: %llu now=%llu", frame_record_timestamp_vpx, current_time_monotonic());
+                    //LOGGER_ERROR(vc->log, "VIDEO:TTx: %llu now=%llu", frame_record_timestamp_vpx, current_time_monotonic(vc->mono_time));
                     if (frame_record_timestamp_vpx > 0) {
                         *ret_value = 1;
 
                         if (*v_r_timestamp < frame_record_timestamp_vpx) {
                             // LOGGER_ERROR(vc->log, "VIDEO:TTx:2: %llu", frame_record_timestamp_vpx);
                             *v_r_timestamp = frame_record_timestamp_vpx;
-                            *v_l_timestamp = current_time_monotonic();
+                            *v_l_timestamp = current_time_monotonic(vc->mono_time);
                         } else {
                             // TODO: this should not happen here!
                             LOGGER_DEBUG(vc->log, "VIDEO: remote timestamp older");
@@ -977,25 +1051,91 @@ void decode_frame_vpx(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint
 }
 
 
+/* Copy the chroma of a frame into I420 U and V planes of img, in a buffer of
+ * the session that is reused for every frame. This splits the interleaved UV
+ * plane of NV12 frames, which VPX can't take, and pads the chroma of frames
+ * with an odd width or height: the caller passes width/2 by height/2 chroma
+ * samples, but VPX reads (width+1)/2 by (height+1)/2, so the last column and
+ * row are repeated.
+ */
+static int vpx_copy_chroma(VCSession *vc, vpx_image_t *img, const VC_Frame_Planes *planes,
+                           uint16_t width, uint16_t height)
+{
+    const uint16_t src_width = width / 2;
+    const uint16_t src_height = height / 2;
+    const uint16_t chroma_width = (width + 1) / 2;
+    const uint16_t chroma_height = (height + 1) / 2;
+    const size_t chroma_size = (size_t)chroma_width * chroma_height;
+
+    if (vc->vpx_chroma_buf_size < 2 * chroma_size) {
+        uint8_t *buf = (uint8_t *)realloc(vc->vpx_chroma_buf, 2 * chroma_size);
+
+        if (buf == NULL) {
+            return -1;
+        }
+
+        vc->vpx_chroma_buf = buf;
+        vc->vpx_chroma_buf_size = 2 * chroma_size;
+    }
+
+    uint8_t *u = vc->vpx_chroma_buf;
+    uint8_t *v = vc->vpx_chroma_buf + chroma_size;
+
+    if (src_width == 0 || src_height == 0) {
+        /* A frame one pixel wide or high has no chroma to repeat */
+        memset(vc->vpx_chroma_buf, 128, 2 * chroma_size);
+    } else {
+        const bool nv12 = planes->format == TOXAV_VIDEO_FORMAT_NV12;
+
+        for (uint16_t row = 0; row < chroma_height; ++row) {
+            const size_t src_row = row < src_height ? row : src_height - 1;
+            const uint8_t *src_u = planes->u + src_row * planes->ustride;
+            const uint8_t *src_v = nv12 ? src_u + 1 : planes->v + src_row * planes->vstride;
+            const uint8_t step = nv12 ? 2 : 1;
+
+            for (uint16_t col = 0; col < chroma_width; ++col) {
+                const size_t src_col = col < src_width ? col : src_width - 1;
+                u[(size_t)row * chroma_width + col] = src_u[step * src_col];
+                v[(size_t)row * chroma_width + col] = src_v[step * src_col];
+            }
+        }
+    }
+
+    img->planes[VPX_PLANE_U] = u;
+    img->planes[VPX_PLANE_V] = v;
+    img->stride[VPX_PLANE_U] = chroma_width;
+    img->stride[VPX_PLANE_V] = chroma_width;
+    return 0;
+}
+
 uint32_t encode_frame_vpx(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
-                          const uint8_t *y,
-                          const uint8_t *u, const uint8_t *v, ToxAVCall *call,
+                          const VC_Frame_Planes *planes, ToxAVCall *call,
                           uint64_t *video_frame_record_timestamp,
                           int vpx_encode_flags,
                           x264_nal_t **nal,
                           int *i_frame_size)
 {
-
-    vpx_image_t img;
-    img.w = img.h = img.d_w = img.d_h = 0;
-    vpx_img_alloc(&img, VPX_IMG_FMT_I420, width, height, 0);
-
-    /* I420 "It comprises an NxM Y plane followed by (N/2)x(M/2) V and U planes."
+    /* The image points into the caller's planes; the encoder copies the
+     * frame into its own buffers, so it reads them with any stride.
+     * I420 "It comprises an NxM Y plane followed by (N/2)x(M/2) V and U planes."
      * http://fourcc.org/yuv.php#IYUV
      */
-    memcpy(img.planes[VPX_PLANE_Y], y, width * height);
-    memcpy(img.planes[VPX_PLANE_U], u, (width / 2) * (height / 2));
-    memcpy(img.planes[VPX_PLANE_V], v, (width / 2) * (height / 2));
+    vpx_image_t img;
+    vpx_img_wrap(&img, VPX_IMG_FMT_I420, width, height, 1, (unsigned char *)planes->y);
+    img.planes[VPX_PLANE_Y] = (unsigned char *)planes->y;
+    img.stride[VPX_PLANE_Y] = planes->ystride;
+
+    if (planes->format == TOXAV_VIDEO_FORMAT_NV12 || (width % 2) != 0 || (height % 2) != 0) {
+        if (vpx_copy_chroma(call->video.second, &img, planes, width, height) != 0) {
+            LOGGER_ERROR(av->m->log, "Could not allocate the chroma planes of a frame");
+            return 1;
+        }
+    } else {
+        img.planes[VPX_PLANE_U] = (unsigned char *)planes->u;
+        img.planes[VPX_PLANE_V] = (unsigned char *)planes->v;
+        img.stride[VPX_PLANE_U] = planes->ustride;
+        img.stride[VPX_PLANE_V] = planes->vstride;
+    }
 
 #if 0
     uint32_t duration = (ms_to_last_frame * 10) + 1;
@@ -1009,13 +1149,29 @@ uint32_t encode_frame_vpx(ToxAV *av, uint32_t friend_number, uint16_t width, uin
     uint32_t duration = (41 * 10); // HINT: 24fps ~= 41ms
 #endif
 
-    vpx_codec_err_t vrc = vpx_codec_encode(call->video.second->encoder, &img,
+    VCSession *vc = call->video.second;
+    vpx_encode_flags = vc__temporal_layer_flags(vc, vpx_encode_flags);
+
+    if (vpx_encode_flags < 0) {
+        LOGGER_DEBUG(av->m->log, "skipping an enhancement layer frame while the peer reports loss");
+        return 0;
+    }
+
+    if (vc->video_temporal_layers > 1 && vc->video_encoder_coded_used != TOXAV_ENCODER_CODEC_USED_VP9) {
+        int layer_id = vc->temporal_layers.layer_id;
+        vpx_codec_err_t lrc = vpx_codec_control(vc->encoder, VP8E_SET_TEMPORAL_LAYER_ID, layer_id);
+
+        if (lrc != VPX_CODEC_OK) {
+            LOGGER_WARNING(av->m->log, "Failed to set encoder VP8E_SET_TEMPORAL_LAYER_ID: %s",
+                           vpx_codec_err_to_string(lrc));
+        }
+    }
+
+    vpx_codec_err_t vrc = vpx_codec_encode(vc->encoder, &img,
                                            (int64_t) * video_frame_record_timestamp, duration,
                                            vpx_encode_flags,
                                            VPX_DL_REALTIME);
 
-    vpx_img_free(&img);
-
     if (vrc != VPX_CODEC_OK) {
         LOGGER_ERROR(av->m->log, "Could not encode video frame: %s\n", vpx_codec_err_to_string(vrc));
         return 1;
@@ -1042,7 +1198,7 @@ uint32_t send_frames_vpx(ToxAV *av, uint32_t friend_number, uint16_t width, uint
             const int keyframe = (pkt->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
 
             if (keyframe) {
-                call->video.second->last_sent_keyframe_ts = current_time_monotonic();
+                call->video.second->last_sent_keyframe_ts = current_time_monotonic(av->m->mono_time);
             }
 
             if ((pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT) != 0) {
@@ -1068,6 +1224,7 @@ uint32_t send_frames_vpx(ToxAV *av, uint32_t friend_number, uint16_t width, uint
                           (const uint8_t *)pkt->data.frame.buf,
                           frame_length_in_bytes,
                           keyframe,
+                          keyframe ? 0 : call->video.second->temporal_layers.layer_id,
                           *video_frame_record_timestamp,
                           (int32_t)pkt->data.frame.partition_id,
                           TOXAV_ENCODER_CODEC_USED_VP8,
@@ -1105,6 +1262,10 @@ void vc_kill_vpx(VCSession *vc)
 
     vc->fragment_buf_counter = 0;
 
+    free(vc->vpx_chroma_buf);
+    vc->vpx_chroma_buf = NULL;
+    vc->vpx_chroma_buf_size = 0;
+
     vpx_codec_destroy(vc->encoder);
     vpx_codec_destroy(vc->decoder);
 }
@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "media_sched.h"
+
+#define MEDIA_SCHED_WINDOW_US 1000000
+#define MEDIA_SCHED_DEFAULT_AUDIO_BUDGET_US 20000
+
+/* Load thresholds in permille; the gaps between going up and coming back
+ * down keep the level from flapping between two passes. */
+#define MEDIA_SCHED_HIGH_ENTER 700
+#define MEDIA_SCHED_HIGH_LEAVE 500
+#define MEDIA_SCHED_OVERLOAD_ENTER 900
+#define MEDIA_SCHED_OVERLOAD_LEAVE 750
+
+bool media_sched_init(Media_Scheduler *sched, uint32_t threads)
+{
+    if (pthread_mutex_init(sched->mutex, NULL) != 0) {
+        return false;
+    }
+
+    sched->threads = threads > 0 ? threads : 1;
+    sched->window_start_us = 0;
+    sched->codec_us = 0;
+    sched->codec_permille = 0;
+    sched->audio_budget_us = MEDIA_SCHED_DEFAULT_AUDIO_BUDGET_US;
+    sched->pass_permille = 0;
+    sched->load = MEDIA_LOAD_NORMAL;
+    return true;
+}
+
+void media_sched_free(Media_Scheduler *sched)
+{
+    pthread_mutex_destroy(sched->mutex);
+}
+
+void media_sched_set_threads(Media_Scheduler *sched, uint32_t threads)
+{
+    pthread_mutex_lock(sched->mutex);
+    sched->threads = threads > 0 ? threads : 1;
+    pthread_mutex_unlock(sched->mutex);
+}
+
+/* Assumes sched->mutex locked. */
+static void media_sched_update_load(Media_Scheduler *sched)
+{
+    const uint32_t pressure = sched->codec_permille > sched->pass_permille
+                              ? sched->codec_permille : sched->pass_permille;
+
+    switch (sched->load) {
+        case MEDIA_LOAD_NORMAL:
+            if (pressure > MEDIA_SCHED_OVERLOAD_ENTER) {
+                sched->load = MEDIA_LOAD_OVERLOAD;
+            } else if (pressure > MEDIA_SCHED_HIGH_ENTER) {
+                sched->load = MEDIA_LOAD_HIGH;
+            }
+
+            break;
+
+        case MEDIA_LOAD_HIGH:
+            if (pressure > MEDIA_SCHED_OVERLOAD_ENTER) {
+                sched->load = MEDIA_LOAD_OVERLOAD;
+            } else if (pressure < MEDIA_SCHED_HIGH_LEAVE) {
+                sched->load = MEDIA_LOAD_NORMAL;
+            }
+
+            break;
+
+        case MEDIA_LOAD_OVERLOAD:
+            if (pressure < MEDIA_SCHED_HIGH_LEAVE) {
+                sched->load = MEDIA_LOAD_NORMAL;
+            } else if (pressure < MEDIA_SCHED_OVERLOAD_LEAVE) {
+                sched->load = MEDIA_LOAD_HIGH;
+            }
+
+            break;
+    }
+}
+
+void media_sched_add_codec_time(Media_Scheduler *sched, uint64_t now_us, uint64_t codec_us)
+{
+    pthread_mutex_lock(sched->mutex);
+
+    if (sched->window_start_us == 0 || now_us < sched->window_start_us) {
+        sched->window_start_us = now_us;
+    }
+
+    sched->codec_us += codec_us;
+
+    const uint64_t window_us = now_us - sched->window_start_us;
+
+    if (window_us >= MEDIA_SCHED_WINDOW_US) {
+        sched->codec_permille = (uint32_t)(sched->codec_us * 1000 / (window_us * sched->threads));
+        sched->codec_us = 0;
+        sched->window_start_us = now_us;
+        media_sched_update_load(sched);
+    }
+
+    pthread_mutex_unlock(sched->mutex);
+}
+
+bool media_sched_video_allowed(Media_Scheduler *sched, uint64_t pass_start_us, uint64_t now_us,
+                               bool skipped_last_pass)
+{
+    pthread_mutex_lock(sched->mutex);
+
+    /* Past half the audio budget the rest of the pass is kept for audio. */
+    const bool allowed = sched->load == MEDIA_LOAD_NORMAL || skipped_last_pass
+                         || now_us - pass_start_us < sched->audio_budget_us / 2;
+
+    pthread_mutex_unlock(sched->mutex);
+    return allowed;
+}
+
+void media_sched_pass_end(Media_Scheduler *sched, uint64_t pass_start_us, uint64_t now_us,
+                          uint32_t audio_budget_ms)
+{
+    pthread_mutex_lock(sched->mutex);
+
+    if (audio_budget_ms > 0) {
+        sched->audio_budget_us = audio_budget_ms * 1000;
+    }
+
+    const uint64_t pass_us = now_us > pass_start_us ? now_us - pass_start_us : 0;
+    uint64_t permille = pass_us * 1000 / sched->audio_budget_us;
+
+    if (permille > 2000) {
+        permille = 2000;
+    }
+
+    /* Smooth over a few passes, a single slow pass is no overload. */
+    sched->pass_permille = (uint32_t)((sched->pass_permille * 3 + permille) / 4);
+    media_sched_update_load(sched);
+
+    pthread_mutex_unlock(sched->mutex);
+}
+
+Media_Load media_sched_load(Media_Scheduler *sched)
+{
+    pthread_mutex_lock(sched->mutex);
+    const Media_Load load = sched->load;
+    pthread_mutex_unlock(sched->mutex);
+    return load;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEDIA_SCHED_H
+#define MEDIA_SCHED_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The media scheduler watches how long the codecs of all calls of a ToxAV
+ * instance take, and how long each toxav_iterate pass over the calls takes
+ * compared to the shortest audio frame. From that it derives one load level
+ * for the whole instance, so that all calls back off together when the CPU
+ * is saturated:
+ *
+ * - MEDIA_LOAD_NORMAL: everything is decoded.
+ * - MEDIA_LOAD_HIGH: video of a call is only decoded while the pass still has
+ *   time left before the audio deadline, non-reference video frames are
+ *   dropped and senders are asked for fewer frames per second.
+ * - MEDIA_LOAD_OVERLOAD: as HIGH, and inter frames are dropped too, until the
+ *   next keyframe.
+ *
+ * Audio is never skipped.
+ */
+typedef enum Media_Load {
+    MEDIA_LOAD_NORMAL = 0,
+    MEDIA_LOAD_HIGH = 1,
+    MEDIA_LOAD_OVERLOAD = 2,
+} Media_Load;
+
+typedef struct Media_Scheduler {
+    pthread_mutex_t mutex[1];
+
+    uint32_t threads;         /* threads the codecs may use, see toxav_set_thread_budget() */
+    uint64_t window_start_us; /* start of the current codec time window */
+    uint64_t codec_us;        /* encode and decode time in the current window */
+    uint32_t codec_permille;  /* codec time in the last window, per thread and window length */
+
+    uint32_t audio_budget_us; /* time one pass may take before audio is late */
+    uint32_t pass_permille;   /* smoothed pass time per audio budget */
+
+    Media_Load load;
+} Media_Scheduler;
+
+bool media_sched_init(Media_Scheduler *sched, uint32_t threads);
+void media_sched_free(Media_Scheduler *sched);
+
+void media_sched_set_threads(Media_Scheduler *sched, uint32_t threads);
+
+/* Account time spent in a video encoder or decoder. Thread safe. */
+void media_sched_add_codec_time(Media_Scheduler *sched, uint64_t now_us, uint64_t codec_us);
+
+/*
+ * A pass is one walk of toxav_iterate, or of an iterate worker, over its
+ * calls. The caller keeps the time the pass started, so that several workers
+ * can be in a pass at once.
+ *
+ * Whether the pass should decode video for the next call. A call whose video
+ * was skipped in the last pass is always allowed, so that every call gets at
+ * least every other pass.
+ */
+bool media_sched_video_allowed(Media_Scheduler *sched, uint64_t pass_start_us, uint64_t now_us,
+                               bool skipped_last_pass);
+
+/*
+ * End a pass. audio_budget_ms is the shortest audio frame duration of the
+ * calls in the pass, 0 if none of them receives audio.
+ */
+void media_sched_pass_end(Media_Scheduler *sched, uint64_t pass_start_us, uint64_t now_us,
+                          uint32_t audio_budget_ms);
+
+Media_Load media_sched_load(Media_Scheduler *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEDIA_SCHED_H */
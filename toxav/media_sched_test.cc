@@ -0,0 +1,131 @@
+#include "media_sched.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr uint32_t kAudioBudgetMs = 20;
+constexpr uint64_t kAudioBudgetUs = kAudioBudgetMs * 1000;
+constexpr uint64_t kWindowUs = 1000000;
+
+class MediaSched : public ::testing::Test {
+ protected:
+  void SetUp() override { ASSERT_TRUE(media_sched_init(&sched_, 1)); }
+  void TearDown() override { media_sched_free(&sched_); }
+
+  // Run passes that each take pass_us, and return the load levels the
+  // scheduler went through, starting with the current one.
+  std::vector<Media_Load> passes(uint64_t pass_us, int count) {
+    std::vector<Media_Load> levels{media_sched_load(&sched_)};
+
+    for (int i = 0; i < count; ++i) {
+      media_sched_pass_end(&sched_, now_, now_ + pass_us, kAudioBudgetMs);
+      now_ += kAudioBudgetUs;
+
+      if (media_sched_load(&sched_) != levels.back()) {
+        levels.push_back(media_sched_load(&sched_));
+      }
+    }
+
+    return levels;
+  }
+
+  // Account codec_us of codec time over one full window.
+  void codec_window(uint64_t codec_us) {
+    media_sched_add_codec_time(&sched_, now_, 0);
+    now_ += kWindowUs;
+    media_sched_add_codec_time(&sched_, now_, codec_us);
+  }
+
+  Media_Scheduler sched_;
+  uint64_t now_ = 1000;
+};
+
+TEST_F(MediaSched, StartsAtNormalLoad) { EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_NORMAL); }
+
+TEST_F(MediaSched, SlowPassesRaiseLoadOneLevelAtATime) {
+  EXPECT_EQ(passes(kAudioBudgetUs, 20),
+            (std::vector<Media_Load>{MEDIA_LOAD_NORMAL, MEDIA_LOAD_HIGH, MEDIA_LOAD_OVERLOAD}));
+}
+
+TEST_F(MediaSched, FastPassesLowerLoadOneLevelAtATime) {
+  passes(kAudioBudgetUs, 20);
+  ASSERT_EQ(media_sched_load(&sched_), MEDIA_LOAD_OVERLOAD);
+
+  EXPECT_EQ(passes(0, 20), (std::vector<Media_Load>{MEDIA_LOAD_OVERLOAD, MEDIA_LOAD_HIGH, MEDIA_LOAD_NORMAL}));
+}
+
+TEST_F(MediaSched, SingleSlowPassIsNoOverload) {
+  passes(10 * kAudioBudgetUs, 1);
+  EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_NORMAL);
+}
+
+TEST_F(MediaSched, LoadBetweenThresholdsKeepsLevel) {
+  // 60% of the budget is below the threshold to enter HIGH and above the one
+  // to leave it.
+  passes(kAudioBudgetUs * 6 / 10, 50);
+  EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_NORMAL);
+
+  while (media_sched_load(&sched_) == MEDIA_LOAD_NORMAL) {
+    passes(kAudioBudgetUs, 1);
+  }
+
+  ASSERT_EQ(media_sched_load(&sched_), MEDIA_LOAD_HIGH);
+
+  passes(kAudioBudgetUs * 6 / 10, 50);
+  EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_HIGH);
+}
+
+TEST_F(MediaSched, CodecTimeIsAccountedPerThread) {
+  codec_window(kWindowUs);
+  EXPECT_EQ(sched_.codec_permille, 1000u);
+  EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_OVERLOAD);
+
+  media_sched_set_threads(&sched_, 4);
+  codec_window(kWindowUs);
+  EXPECT_EQ(sched_.codec_permille, 250u);
+  EXPECT_EQ(media_sched_load(&sched_), MEDIA_LOAD_NORMAL);
+}
+
+TEST_F(MediaSched, CodecTimeIsAccountedOncePerWindow) {
+  media_sched_add_codec_time(&sched_, now_, kWindowUs / 2);
+  media_sched_add_codec_time(&sched_, now_ + kWindowUs / 2, kWindowUs / 2);
+  EXPECT_EQ(sched_.codec_permille, 0u);
+
+  media_sched_add_codec_time(&sched_, now_ + kWindowUs, 0);
+  EXPECT_EQ(sched_.codec_permille, 1000u);
+}
+
+TEST_F(MediaSched, ZeroThreadsCountsAsOne) {
+  media_sched_set_threads(&sched_, 0);
+  EXPECT_EQ(sched_.threads, 1u);
+
+  codec_window(kWindowUs / 2);
+  EXPECT_EQ(sched_.codec_permille, 500u);
+}
+
+TEST_F(MediaSched, VideoIsAlwaysAllowedAtNormalLoad) {
+  EXPECT_TRUE(media_sched_video_allowed(&sched_, now_, now_ + 10 * kAudioBudgetUs, false));
+}
+
+TEST_F(MediaSched, VideoUnderLoadKeepsHalfThePassForAudio) {
+  passes(kAudioBudgetUs, 5);
+  ASSERT_EQ(media_sched_load(&sched_), MEDIA_LOAD_HIGH);
+
+  EXPECT_TRUE(media_sched_video_allowed(&sched_, now_, now_ + kAudioBudgetUs / 2 - 1, false));
+  EXPECT_FALSE(media_sched_video_allowed(&sched_, now_, now_ + kAudioBudgetUs / 2, false));
+  EXPECT_TRUE(media_sched_video_allowed(&sched_, now_, now_ + kAudioBudgetUs / 2, true));
+}
+
+TEST_F(MediaSched, ShortestAudioFrameSetsTheBudget) {
+  media_sched_pass_end(&sched_, now_, now_, 10);
+  EXPECT_EQ(sched_.audio_budget_us, 10000u);
+
+  // Passes without audio keep the last budget.
+  media_sched_pass_end(&sched_, now_, now_, 0);
+  EXPECT_EQ(sched_.audio_budget_us, 10000u);
+}
+
+}  // namespace
@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "playout.h"
+
+#define PLAYOUT_START_DELAY_MS 450
+#define PLAYOUT_MIN_DELAY_MS 80
+#define PLAYOUT_MAX_DELAY_MS 1000
+#define PLAYOUT_BASE_DELAY_MS 20 /* frame assembly and decoding */
+#define PLAYOUT_JITTER_FACTOR 3
+
+/* The delay grows by 1 ms every PLAYOUT_GROW_INTERVAL_MS and shrinks by 1 ms
+ * every PLAYOUT_SHRINK_INTERVAL_MS. Growing fast keeps frames from being late,
+ * shrinking slowly keeps from skipping through frames. Audio time stretches
+ * to follow, see ac_iterate(), which both rates leave room for. */
+#define PLAYOUT_GROW_INTERVAL_MS 10
+#define PLAYOUT_SHRINK_INTERVAL_MS 20
+
+/* The offset only drifts a few ms per update, anything larger is a jump. */
+#define PLAYOUT_OFFSET_JUMP_MS 100
+
+/* Transit times further apart than this are a restart of the sender, not jitter. */
+#define PLAYOUT_MAX_TRANSIT_STEP_MS 10000
+
+/* A media that was not played for this long does not count for the skew. */
+#define PLAYOUT_STALE_MS 2000
+
+void playout_jitter_update(Playout_Jitter *jitter, uint64_t arrival_ms, uint64_t record_ts)
+{
+    const int64_t transit = (int64_t)(arrival_ms - record_ts);
+
+    if (!jitter->have_transit) {
+        jitter->have_transit = true;
+        jitter->last_transit = transit;
+        return;
+    }
+
+    int64_t d = transit - jitter->last_transit;
+    jitter->last_transit = transit;
+
+    if (d < 0) {
+        d = -d;
+    }
+
+    if (d > PLAYOUT_MAX_TRANSIT_STEP_MS) {
+        return;
+    }
+
+    jitter->jitter_q4 = jitter->jitter_q4 + (uint32_t)d - ((jitter->jitter_q4 + 8) >> 4);
+}
+
+uint32_t playout_jitter_ms(const Playout_Jitter *jitter)
+{
+    return jitter->jitter_q4 >> 4;
+}
+
+bool playout_init(Playout_Clock *pc)
+{
+    if (pthread_mutex_init(pc->mutex, NULL) != 0) {
+        return false;
+    }
+
+    pc->offset_ms = 0;
+    pc->correction_ms = 0;
+    pc->rtt_ms = 0;
+    pc->delay_ms = PLAYOUT_START_DELAY_MS;
+    pc->target_delay_ms = PLAYOUT_START_DELAY_MS;
+    pc->last_slew_ms = 0;
+
+    for (int i = 0; i < PLAYOUT_MEDIA_COUNT; ++i) {
+        pc->stream[i].jitter_ms = 0;
+        pc->stream[i].delay_ms = 0;
+        pc->stream[i].last_play_ms = 0;
+    }
+
+    return true;
+}
+
+void playout_free(Playout_Clock *pc)
+{
+    pthread_mutex_destroy(pc->mutex);
+}
+
+/* Assumes pc->mutex locked. */
+static void playout_update_target(Playout_Clock *pc)
+{
+    uint32_t jitter_ms = 0;
+
+    for (int i = 0; i < PLAYOUT_MEDIA_COUNT; ++i) {
+        if (pc->stream[i].jitter_ms > jitter_ms) {
+            jitter_ms = pc->stream[i].jitter_ms;
+        }
+    }
+
+    uint32_t target = pc->rtt_ms / 2 + PLAYOUT_BASE_DELAY_MS + jitter_ms * PLAYOUT_JITTER_FACTOR;
+
+    if (target < PLAYOUT_MIN_DELAY_MS) {
+        target = PLAYOUT_MIN_DELAY_MS;
+    } else if (target > PLAYOUT_MAX_DELAY_MS) {
+        target = PLAYOUT_MAX_DELAY_MS;
+    }
+
+    pc->target_delay_ms = target;
+}
+
+/* Assumes pc->mutex locked. */
+static void playout_slew(Playout_Clock *pc, uint64_t now_ms)
+{
+    if (pc->last_slew_ms == 0 || now_ms < pc->last_slew_ms || pc->delay_ms == pc->target_delay_ms) {
+        pc->last_slew_ms = now_ms;
+        return;
+    }
+
+    const bool grow = pc->delay_ms < pc->target_delay_ms;
+    const uint32_t interval = grow ? PLAYOUT_GROW_INTERVAL_MS : PLAYOUT_SHRINK_INTERVAL_MS;
+    const uint32_t distance = grow ? pc->target_delay_ms - pc->delay_ms : pc->delay_ms - pc->target_delay_ms;
+    const uint64_t steps = (now_ms - pc->last_slew_ms) / interval;
+
+    if (steps >= distance) {
+        pc->delay_ms = pc->target_delay_ms;
+        pc->last_slew_ms = now_ms;
+        return;
+    }
+
+    pc->delay_ms = grow ? pc->delay_ms + (uint32_t)steps : pc->delay_ms - (uint32_t)steps;
+    pc->last_slew_ms += steps * interval;
+}
+
+void playout_set_offset(Playout_Clock *pc, int64_t offset_ms, uint32_t rtt_ms)
+{
+    pthread_mutex_lock(pc->mutex);
+
+    const int64_t change = offset_ms - pc->offset_ms;
+
+    if (change > PLAYOUT_OFFSET_JUMP_MS || change < -PLAYOUT_OFFSET_JUMP_MS) {
+        pc->correction_ms = 0;
+    }
+
+    pc->offset_ms = offset_ms;
+    pc->rtt_ms = rtt_ms;
+    playout_update_target(pc);
+
+    pthread_mutex_unlock(pc->mutex);
+}
+
+void playout_set_jitter(Playout_Clock *pc, Playout_Media media, uint32_t jitter_ms)
+{
+    pthread_mutex_lock(pc->mutex);
+    pc->stream[media].jitter_ms = jitter_ms;
+    playout_update_target(pc);
+    pthread_mutex_unlock(pc->mutex);
+}
+
+void playout_correct(Playout_Clock *pc, int64_t correction_ms)
+{
+    pthread_mutex_lock(pc->mutex);
+    pc->correction_ms += correction_ms;
+    pthread_mutex_unlock(pc->mutex);
+}
+
+uint32_t playout_delay_ms(Playout_Clock *pc)
+{
+    pthread_mutex_lock(pc->mutex);
+    const uint32_t delay_ms = pc->delay_ms;
+    pthread_mutex_unlock(pc->mutex);
+    return delay_ms;
+}
+
+uint32_t playout_want_ts(Playout_Clock *pc, uint64_t now_ms)
+{
+    pthread_mutex_lock(pc->mutex);
+    playout_slew(pc, now_ms);
+    const int64_t want = (int64_t)now_ms + pc->offset_ms + pc->correction_ms - pc->delay_ms;
+    pthread_mutex_unlock(pc->mutex);
+
+    /* the buffers keep the low 32 bits of the record timestamps */
+    return (uint32_t)want;
+}
+
+int32_t playout_played(Playout_Clock *pc, Playout_Media media, uint32_t record_ts, uint64_t now_ms)
+{
+    pthread_mutex_lock(pc->mutex);
+
+    const uint32_t sender_now = (uint32_t)((int64_t)now_ms + pc->offset_ms + pc->correction_ms);
+    const int32_t delay = (int32_t)(sender_now - record_ts);
+
+    pc->stream[media].delay_ms = delay;
+    pc->stream[media].last_play_ms = now_ms;
+
+    pthread_mutex_unlock(pc->mutex);
+    return delay;
+}
+
+/* Assumes pc->mutex locked. */
+static bool playout_is_playing(const Playout_Clock *pc, Playout_Media media, uint64_t now_ms)
+{
+    const uint64_t last = pc->stream[media].last_play_ms;
+    return last != 0 && last <= now_ms && now_ms - last < PLAYOUT_STALE_MS;
+}
+
+void playout_get_stats(Playout_Clock *pc, uint64_t now_ms, Playout_Stats *stats)
+{
+    pthread_mutex_lock(pc->mutex);
+
+    for (int i = 0; i < PLAYOUT_MEDIA_COUNT; ++i) {
+        const Playout_Media media = (Playout_Media)i;
+        stats->delay_ms[i] = playout_is_playing(pc, media, now_ms) ? pc->stream[i].delay_ms : 0;
+        stats->jitter_ms[i] = pc->stream[i].jitter_ms;
+    }
+
+    if (playout_is_playing(pc, PLAYOUT_AUDIO, now_ms) && playout_is_playing(pc, PLAYOUT_VIDEO, now_ms)) {
+        stats->av_skew_ms = stats->delay_ms[PLAYOUT_VIDEO] - stats->delay_ms[PLAYOUT_AUDIO];
+    } else {
+        stats->av_skew_ms = 0;
+    }
+
+    stats->buffer_ms = pc->delay_ms;
+    stats->added_delay_ms = pc->delay_ms > pc->rtt_ms / 2 ? pc->delay_ms - pc->rtt_ms / 2 : 0;
+
+    pthread_mutex_unlock(pc->mutex);
+}
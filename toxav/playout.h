@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The playout clock of a call says which frames the audio and the video
+ * receive paths should hand to the application now. It runs on the sender's
+ * frame record timestamps:
+ *
+ *   want = now + offset + correction - delay
+ *
+ * - offset is the difference between the sender's clock and ours, from the
+ *   dummy NTP exchange of the video session (drifting by dntp_drift()).
+ * - correction is added when the buffered frames show that the offset is off,
+ *   it is dropped again when the offset jumps.
+ * - delay is how far playout runs behind the sender. Its target is sized from
+ *   the round trip time and the interarrival jitter of both media, and delay
+ *   slews towards it a millisecond at a time, so that playout never jumps.
+ *
+ * Audio and video read the same clock, which keeps them in sync.
+ */
+typedef enum Playout_Media {
+    PLAYOUT_AUDIO = 0,
+    PLAYOUT_VIDEO = 1,
+} Playout_Media;
+
+#define PLAYOUT_MEDIA_COUNT 2
+
+/* Interarrival jitter as in RFC 3550 section 6.4.1, in milliseconds. */
+typedef struct Playout_Jitter {
+    bool have_transit;
+    int64_t last_transit; /* arrival time minus record timestamp of the last frame */
+    uint32_t jitter_q4;   /* jitter times 16 */
+} Playout_Jitter;
+
+void playout_jitter_update(Playout_Jitter *jitter, uint64_t arrival_ms, uint64_t record_ts);
+uint32_t playout_jitter_ms(const Playout_Jitter *jitter);
+
+typedef struct Playout_Stream {
+    uint32_t jitter_ms;    /* as last reported by the session */
+    int32_t delay_ms;      /* playout delay of the last frame played */
+    uint64_t last_play_ms; /* when the last frame was played, 0 for never */
+} Playout_Stream;
+
+typedef struct Playout_Clock {
+    pthread_mutex_t mutex[1];
+
+    int64_t offset_ms;     /* sender clock minus our clock */
+    int64_t correction_ms;
+    uint32_t rtt_ms;
+
+    uint32_t delay_ms;        /* how far playout runs behind the sender */
+    uint32_t target_delay_ms; /* delay_ms slews towards this */
+    uint64_t last_slew_ms;
+
+    Playout_Stream stream[PLAYOUT_MEDIA_COUNT];
+} Playout_Clock;
+
+typedef struct Playout_Stats {
+    int32_t av_skew_ms; /* video playout delay minus audio playout delay */
+    int32_t delay_ms[PLAYOUT_MEDIA_COUNT];
+    uint32_t jitter_ms[PLAYOUT_MEDIA_COUNT];
+    uint32_t buffer_ms; /* current playout delay of the clock */
+    uint32_t added_delay_ms; /* part of buffer_ms on top of the network delay */
+} Playout_Stats;
+
+bool playout_init(Playout_Clock *pc);
+void playout_free(Playout_Clock *pc);
+
+/* Update the clock from the dummy NTP offset and round trip time. */
+void playout_set_offset(Playout_Clock *pc, int64_t offset_ms, uint32_t rtt_ms);
+
+/* Update the jitter of one media, see playout_jitter_ms(). */
+void playout_set_jitter(Playout_Clock *pc, Playout_Media media, uint32_t jitter_ms);
+
+/* Move the clock by correction_ms on top of the offset. */
+void playout_correct(Playout_Clock *pc, int64_t correction_ms);
+
+/* The current playout delay, it changes by a millisecond at a time. */
+uint32_t playout_delay_ms(Playout_Clock *pc);
+
+/* The sender record timestamp that is due for playout at now_ms. */
+uint32_t playout_want_ts(Playout_Clock *pc, uint64_t now_ms);
+
+/*
+ * Note that a frame with the given record timestamp is played at now_ms.
+ * Returns its playout delay.
+ */
+int32_t playout_played(Playout_Clock *pc, Playout_Media media, uint32_t record_ts, uint64_t now_ms);
+
+/*
+ * The skew is only known while both media are played, otherwise it is 0. The
+ * delay of a media that is not played is 0 as well.
+ */
+void playout_get_stats(Playout_Clock *pc, uint64_t now_ms, Playout_Stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLAYOUT_H */
@@ -0,0 +1,152 @@
+#include "playout.h"
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(PlayoutJitter, FirstFrameOnlySetsTransit) {
+  Playout_Jitter jitter = {};
+  playout_jitter_update(&jitter, 1500, 1000);
+  EXPECT_TRUE(jitter.have_transit);
+  EXPECT_EQ(jitter.last_transit, 500);
+  EXPECT_EQ(playout_jitter_ms(&jitter), 0u);
+}
+
+TEST(PlayoutJitter, ConstantTransitHasNoJitter) {
+  Playout_Jitter jitter = {};
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    playout_jitter_update(&jitter, 5000 + i * 20, 1000 + i * 20);
+  }
+
+  EXPECT_EQ(playout_jitter_ms(&jitter), 0u);
+}
+
+TEST(PlayoutJitter, FollowsRfc3550) {
+  Playout_Jitter jitter = {};
+  double expected = 0.0;
+
+  // Every other frame arrives 16 ms late, so every transit differs by 16 ms
+  // from the one before: J += (|D| - J) / 16.
+  for (uint64_t i = 0; i < 100; ++i) {
+    playout_jitter_update(&jitter, 5000 + i * 20 + (i % 2) * 16, 1000 + i * 20);
+
+    if (i > 0) {
+      expected += (16.0 - expected) / 16.0;
+    }
+
+    EXPECT_LE(std::fabs(jitter.jitter_q4 / 16.0 - expected), 1.0) << "frame " << i;
+  }
+
+  EXPECT_EQ(playout_jitter_ms(&jitter), 15u);
+}
+
+TEST(PlayoutJitter, SenderRestartIsNoJitter) {
+  Playout_Jitter jitter = {};
+  playout_jitter_update(&jitter, 5000, 1000);
+  playout_jitter_update(&jitter, 5020, 1000000);
+  EXPECT_EQ(playout_jitter_ms(&jitter), 0u);
+  EXPECT_EQ(jitter.last_transit, 5020 - 1000000);
+}
+
+class Playout : public ::testing::Test {
+ protected:
+  void SetUp() override { ASSERT_TRUE(playout_init(&pc_)); }
+  void TearDown() override { playout_free(&pc_); }
+
+  // Let the clock run to now_ + ms, slewing the delay on the way.
+  void advance(uint64_t ms) {
+    now_ += ms;
+    playout_want_ts(&pc_, now_);
+  }
+
+  Playout_Clock pc_;
+  uint64_t now_ = 10000;
+};
+
+TEST_F(Playout, TargetDelayFromRttAndJitter) {
+  playout_set_offset(&pc_, 0, 100);
+  playout_set_jitter(&pc_, PLAYOUT_AUDIO, 10);
+  playout_set_jitter(&pc_, PLAYOUT_VIDEO, 30);
+
+  // Half the round trip, 20 ms for assembly and decoding and three times the
+  // larger jitter of both media.
+  EXPECT_EQ(pc_.target_delay_ms, 50u + 20u + 3 * 30u);
+}
+
+TEST_F(Playout, TargetDelayIsClamped) {
+  playout_set_offset(&pc_, 0, 0);
+  EXPECT_EQ(pc_.target_delay_ms, 80u);
+
+  playout_set_jitter(&pc_, PLAYOUT_VIDEO, 400);
+  EXPECT_EQ(pc_.target_delay_ms, 1000u);
+}
+
+TEST_F(Playout, DelayShrinksOneMsEvery20Ms) {
+  playout_set_offset(&pc_, 0, 0);
+  advance(0);
+  const uint32_t start = playout_delay_ms(&pc_);
+  ASSERT_GT(start, pc_.target_delay_ms);
+
+  advance(200);
+  EXPECT_EQ(playout_delay_ms(&pc_), start - 10);
+
+  // Time short of a whole step is kept for the next one.
+  advance(19);
+  EXPECT_EQ(playout_delay_ms(&pc_), start - 10);
+  advance(1);
+  EXPECT_EQ(playout_delay_ms(&pc_), start - 11);
+}
+
+TEST_F(Playout, DelayGrowsOneMsEvery10Ms) {
+  playout_set_offset(&pc_, 0, 0);
+  playout_set_jitter(&pc_, PLAYOUT_AUDIO, 200);
+  advance(0);
+  const uint32_t start = playout_delay_ms(&pc_);
+  ASSERT_LT(start, pc_.target_delay_ms);
+
+  advance(100);
+  EXPECT_EQ(playout_delay_ms(&pc_), start + 10);
+}
+
+TEST_F(Playout, DelayStopsAtTarget) {
+  playout_set_offset(&pc_, 0, 0);
+  advance(0);
+  advance(60000);
+  EXPECT_EQ(playout_delay_ms(&pc_), 80u);
+
+  playout_set_jitter(&pc_, PLAYOUT_VIDEO, 400);
+  advance(60000);
+  EXPECT_EQ(playout_delay_ms(&pc_), 1000u);
+}
+
+TEST_F(Playout, WantedTimestampFollowsOffsetCorrectionAndDelay) {
+  playout_set_offset(&pc_, 5000, 0);
+  playout_correct(&pc_, 30);
+  const uint32_t delay = playout_delay_ms(&pc_);
+  EXPECT_EQ(playout_want_ts(&pc_, now_), static_cast<uint32_t>(now_ + 5000 + 30 - delay));
+}
+
+TEST_F(Playout, OffsetDriftKeepsCorrection) {
+  playout_set_offset(&pc_, 5000, 0);
+  playout_correct(&pc_, 30);
+  playout_set_offset(&pc_, 5100, 0);
+  EXPECT_EQ(pc_.correction_ms, 30);
+  playout_set_offset(&pc_, 5000, 0);
+  EXPECT_EQ(pc_.correction_ms, 30);
+}
+
+TEST_F(Playout, OffsetJumpResetsCorrection) {
+  playout_set_offset(&pc_, 5000, 0);
+  playout_correct(&pc_, 30);
+  playout_set_offset(&pc_, 5101, 0);
+  EXPECT_EQ(pc_.correction_ms, 0);
+
+  playout_correct(&pc_, -20);
+  playout_set_offset(&pc_, 5000, 0);
+  EXPECT_EQ(pc_.correction_ms, 0);
+}
+
+}  // namespace
@@ -50,6 +50,11 @@ enum {
     VIDEO_KEEP_KEYFRAME_IN_BUFFER_FOR_MS = 20,
 };
 
+/* How long a frame that asked for pieces again waits for them on top of the
+ * round trip time, and at most, before it goes to the decoder as it is. */
+#define RTP_NACK_WAIT_MARGIN_MS 30
+#define RTP_NACK_MAX_WAIT_MS 300
+
 int TOXAV_SEND_VIDEO_LOSSLESS_PACKETS = 0;
 
 
@@ -81,6 +86,26 @@ enum {
     GET_SLOT_RESULT_DROP_INCOMING = -2,
 };
 
+int8_t rtp_find_frame_slot(Logger *log, const struct RTPWorkBufferList *wkbl, const struct RTPHeader *header)
+{
+    for (uint8_t i = 0; i < wkbl->next_free_entry; i++) {
+        const struct RTPWorkBuffer *slot = &wkbl->work_buffer[i];
+
+        if ((slot->buf->header.sequnum == header->sequnum) && (slot->buf->header.timestamp == header->timestamp)) {
+            // Sequence number and timestamp match, so this slot belongs to
+            // the same frame.
+            //
+            // In reality, these will almost certainly either both match or
+            // both not match. Only if somehow there were 65535 frames
+            // between, the timestamp will matter.
+            LOGGER_DEBUG(log, "get_slot:found slot num %d", (int)i);
+            return (int8_t)i;
+        }
+    }
+
+    return -1;
+}
+
 /**
  * Find the next free slot in work_buffer for the incoming data packet.
  *
@@ -107,19 +132,10 @@ static int8_t get_slot(Logger *log, struct RTPWorkBufferList *wkbl, bool is_keyf
     if (is_multipart) {
         // This RTP message is part of a multipart frame, so we try to find an
         // existing slot with the previous parts of the frame in it.
-        for (uint8_t i = 0; i < wkbl->next_free_entry; i++) {
-            const struct RTPWorkBuffer *slot = &wkbl->work_buffer[i];
+        const int8_t slot_id = rtp_find_frame_slot(log, wkbl, header);
 
-            if ((slot->buf->header.sequnum == header->sequnum) && (slot->buf->header.timestamp == header->timestamp)) {
-                // Sequence number and timestamp match, so this slot belongs to
-                // the same frame.
-                //
-                // In reality, these will almost certainly either both match or
-                // both not match. Only if somehow there were 65535 frames
-                // between, the timestamp will matter.
-                LOGGER_DEBUG(log, "get_slot:found slot num %d", (int)i);
-                return i;
-            }
+        if (slot_id >= 0) {
+            return slot_id;
         }
     }
 
@@ -332,8 +348,11 @@ static bool fill_data_into_slot(Logger *log, struct RTPWorkBufferList *wkbl, con
         assert(slot->buf == NULL);
 
         // No data for this slot has been received, yet, so we create a new
-        // message for it with enough memory for the entire frame.
-        struct RTPMessage *msg = (struct RTPMessage *)calloc(1, sizeof(struct RTPMessage) + header->data_length_full);
+        // message for it with enough memory for the entire frame, and the
+        // bits for its pieces after that.
+        const uint32_t piece_count = (header->data_length_full + RTP_PIECE_SIZE - 1) / RTP_PIECE_SIZE;
+        struct RTPMessage *msg = (struct RTPMessage *)calloc(1, sizeof(struct RTPMessage) + header->data_length_full
+                                 + (piece_count + 7) / 8);
 
         if (msg == NULL) {
             LOGGER_DEBUG(log, "Out of memory while trying to allocate for frame of size %u\n",
@@ -350,6 +369,11 @@ static bool fill_data_into_slot(Logger *log, struct RTPWorkBufferList *wkbl, con
         slot->buf = msg;
         slot->is_keyframe = is_keyframe;
         slot->received_len = 0;
+        slot->pieces = msg->data + header->data_length_full;
+        slot->piece_count = piece_count;
+        slot->next_piece = 0;
+        slot->nack_tail_sent = false;
+        slot->nack_ts = 0;
 
         assert(wkbl->next_free_entry < USED_RTP_WORKBUFFER_COUNT);
         wkbl->next_free_entry++;
@@ -363,6 +387,21 @@ static bool fill_data_into_slot(Logger *log, struct RTPWorkBufferList *wkbl, con
 
     // ***** // assert(header->offset_full < header->data_length_full);
 
+    if (slot->pieces != NULL) {
+        const uint32_t piece = header->offset_full / RTP_PIECE_SIZE;
+
+        if (header->offset_full % RTP_PIECE_SIZE != 0 || piece >= slot->piece_count) {
+            // not cut the way we cut frames, so duplicates can't be told apart
+            slot->pieces = NULL;
+        } else if ((slot->pieces[piece / 8] & (1 << (piece % 8))) != 0) {
+            LOGGER_DEBUG(log, "FPATH:slot num=%d:VSEQ:%d duplicate piece %d", slot_id, (int)header->sequnum,
+                         (int)piece);
+            return false;
+        } else {
+            slot->pieces[piece / 8] |= (uint8_t)(1 << (piece % 8));
+        }
+    }
+
     // Copy the incoming chunk of data into the correct position in the full
     // frame data array.
     memcpy(
@@ -383,6 +422,100 @@ static bool fill_data_into_slot(Logger *log, struct RTPWorkBufferList *wkbl, con
     return slot->received_len == header->data_length_full;
 }
 
+static void send_nack(RTPSession *session, uint16_t sequnum, uint32_t offset, uint32_t length)
+{
+    uint8_t pkg_buf[2 + sizeof(uint16_t) + sizeof(uint32_t) * 2];
+    pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
+    pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_NACK;
+
+    uint8_t *p = pkg_buf + 2;
+    p += net_pack_u16(p, sequnum);
+    p += net_pack_u32(p, offset);
+    net_pack_u32(p, length);
+
+    if (-1 == send_custom_lossless_packet(session->m, session->friend_number, pkg_buf, sizeof(pkg_buf))) {
+        LOGGER_WARNING(session->m->log, "PACKET_TOXAV_COMM_CHANNEL_NACK:RTP send failed");
+    } else {
+        LOGGER_DEBUG(session->m->log, "NACK:VSEQ:%d offset=%u length=%u", (int)sequnum, (unsigned)offset,
+                     (unsigned)length);
+    }
+}
+
+uint32_t rtp_missing_pieces(struct RTPWorkBufferList *wkbl, int8_t slot_id, const struct RTPHeader *header,
+                            uint64_t now, struct RTPNack *nacks)
+{
+    uint32_t count = 0;
+
+    for (int8_t i = 0; i < wkbl->next_free_entry; i++) {
+        struct RTPWorkBuffer *const slot = &wkbl->work_buffer[i];
+
+        if (slot->buf == NULL || slot->pieces == NULL) {
+            continue;
+        }
+
+        const uint16_t sequnum = slot->buf->header.sequnum;
+
+        if (i == slot_id) {
+            const uint32_t piece = header->offset_full / RTP_PIECE_SIZE;
+
+            if (piece > slot->next_piece) {
+                nacks[count].sequnum = sequnum;
+                nacks[count].offset = slot->next_piece * RTP_PIECE_SIZE;
+                nacks[count].length = header->offset_full - nacks[count].offset;
+                ++count;
+                slot->nack_ts = now;
+            }
+
+            if (piece >= slot->next_piece) {
+                slot->next_piece = piece + 1;
+            }
+        } else if (!slot->nack_tail_sent && slot->next_piece < slot->piece_count
+                   && (int16_t)(header->sequnum - sequnum) > 0) {
+            nacks[count].sequnum = sequnum;
+            nacks[count].offset = slot->next_piece * RTP_PIECE_SIZE;
+            nacks[count].length = slot->buf->header.data_length_full - nacks[count].offset;
+            ++count;
+            slot->next_piece = slot->piece_count;
+            slot->nack_tail_sent = true;
+            slot->nack_ts = now;
+        }
+    }
+
+    return count;
+}
+
+static void request_missing_pieces(RTPSession *session, int8_t slot_id, const struct RTPHeader *header, uint64_t now)
+{
+    struct RTPNack nacks[USED_RTP_WORKBUFFER_COUNT];
+    const uint32_t count = rtp_missing_pieces(session->work_buffer_list, slot_id, header, now, nacks);
+
+    for (uint32_t i = 0; i < count; i++) {
+        send_nack(session, nacks[i].sequnum, nacks[i].offset, nacks[i].length);
+    }
+}
+
+/**
+ * How long pieces asked for again take to arrive: a round trip, but no longer
+ * than a frame can wait to be played.
+ */
+static uint32_t nack_wait_ms(const RTPSession *session)
+{
+    const uint32_t wait_ms = ((const VCSession *)session->cs)->rountrip_time_ms + RTP_NACK_WAIT_MARGIN_MS;
+    return wait_ms > RTP_NACK_MAX_WAIT_MS ? RTP_NACK_MAX_WAIT_MS : wait_ms;
+}
+
+/**
+ * Whether the frame in the slot still waits for the pieces it asked for again.
+ */
+static bool slot_awaits_retransmission(const RTPSession *session, const struct RTPWorkBuffer *slot, uint64_t now)
+{
+    if (slot->nack_ts == 0) {
+        return false;
+    }
+
+    return now < slot->nack_ts + nack_wait_ms(session);
+}
+
 #if 0
 static void update_bwc_values(Logger *log, RTPSession *session, const struct RTPMessage *msg)
 {
@@ -464,6 +597,14 @@ static int handle_video_packet(RTPSession *session, const struct RTPHeader *head
 
     const bool is_multipart = (full_frame_length != incoming_data_length);
 
+    // A retransmitted piece only helps a frame that is still being assembled.
+    if ((header->flags & RTP_RETRANSMISSION) != 0 && rtp_find_frame_slot(log, session->work_buffer_list, header) < 0) {
+        LOGGER_DEBUG(log, "EE:5r:VSEQ:%d retransmission too late", (int)header->sequnum);
+        return -1;
+    }
+
+    const uint64_t now = current_time_monotonic(session->m->mono_time);
+
     /* The message was sent in single part */
     int8_t slot_id = get_slot(log, session->work_buffer_list, is_keyframe, header, is_multipart);
     LOGGER_DEBUG(log, "II:5:slot num=%d:VSEQ:%d", slot_id, (int)header->sequnum);
@@ -522,14 +663,20 @@ static int handle_video_packet(RTPSession *session, const struct RTPHeader *head
     LOGGER_DEBUG(log, "fill_data_into_slot.");
 
     // fill in this part into the slot buffer at the correct offset
-    if (!fill_data_into_slot(
-                log,
-                session->work_buffer_list,
-                slot_id,
-                is_keyframe,
-                header,
-                incoming_data,
-                incoming_data_length)) {
+    const bool frame_complete = fill_data_into_slot(
+                                    log,
+                                    session->work_buffer_list,
+                                    slot_id,
+                                    is_keyframe,
+                                    header,
+                                    incoming_data,
+                                    incoming_data_length);
+
+    if ((header->flags & RTP_RETRANSMISSION) == 0) {
+        request_missing_pieces(session, slot_id, header, now);
+    }
+
+    if (!frame_complete) {
 
         LOGGER_DEBUG(log, "FPATH:10:slot num=%d:VSEQ:%d", slot_id, (int)header->sequnum);
 
@@ -549,7 +696,7 @@ static int handle_video_packet(RTPSession *session, const struct RTPHeader *head
 
 #define LINGER_OLD_FRAMES_COUNT 2
 
-        if ((m_new0) && (m_new2)) {
+        if ((m_new0) && (m_new2) && !slot_awaits_retransmission(session, slot0, now)) {
             if ((m_new0->header.sequnum + 2) < m_new2->header.sequnum) {
                 LOGGER_DEBUG(log, "kick out:m_new0 seq#=%d", (int)m_new0->header.sequnum);
                 // change slot_id to "0" to process oldest frame in buffer instead of current one
@@ -584,6 +731,113 @@ static int handle_video_packet(RTPSession *session, const struct RTPHeader *head
     return 0;
 }
 
+/**
+ * Keep a sent piece of a video frame for retransmission.
+ */
+static void add_sent_packet(RTPSession *session, const struct RTPHeader *header, const uint8_t *data, uint16_t length)
+{
+    struct RTPSentHistory *const history = session->sent_history;
+
+    if (history == NULL || length > RTP_PIECE_SIZE) {
+        return;
+    }
+
+    pthread_mutex_lock(history->mutex);
+
+    struct RTPSentPacket *const packet = &history->packet[history->next];
+    packet->used = true;
+    packet->resent_ts = 0;
+    packet->header = *header;
+    packet->length = length;
+    memcpy(packet->data, data, length);
+    history->next = (history->next + 1) % RTP_SENT_HISTORY_PACKETS;
+
+    pthread_mutex_unlock(history->mutex);
+}
+
+uint32_t rtp_nack_select(struct RTPSentHistory *history, const uint8_t *data, uint16_t length, uint64_t now,
+                         uint32_t resend_interval_ms, uint8_t *selected)
+{
+    if (length < sizeof(uint16_t)) {
+        return 0;
+    }
+
+    uint16_t sequnum;
+    data += net_unpack_u16(data, &sequnum);
+    length -= sizeof(uint16_t);
+
+    uint32_t count = 0;
+
+    for (uint32_t r = 0; r < RTP_NACK_MAX_RANGES && length >= sizeof(uint32_t) * 2; r++) {
+        uint32_t offset;
+        uint32_t range_length;
+        data += net_unpack_u32(data, &offset);
+        data += net_unpack_u32(data, &range_length);
+        length -= sizeof(uint32_t) * 2;
+
+        for (uint32_t i = 0; i < RTP_SENT_HISTORY_PACKETS; i++) {
+            struct RTPSentPacket *const packet = &history->packet[i];
+
+            if (!packet->used || packet->header.sequnum != sequnum || packet->header.offset_full < offset
+                    || packet->header.offset_full - offset >= range_length) {
+                continue;
+            }
+
+            if (packet->resent_ts != 0 && now < packet->resent_ts + resend_interval_ms) {
+                continue;
+            }
+
+            packet->resent_ts = now;
+            selected[count] = (uint8_t)i;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Send again the pieces a NACK asks for, see rtp_nack_select().
+ */
+static void handle_nack(RTPSession *session, const uint8_t *data, uint16_t length)
+{
+    struct RTPSentHistory *const history = session->sent_history;
+
+    if (history == NULL) {
+        return;
+    }
+
+    const uint64_t now = current_time_monotonic(session->m->mono_time);
+    uint8_t selected[RTP_SENT_HISTORY_PACKETS];
+    uint8_t rdata[MAX_CRYPTO_DATA_SIZE];
+
+    pthread_mutex_lock(history->mutex);
+
+    const uint32_t count = rtp_nack_select(history, data, length, now, nack_wait_ms(session), selected);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const struct RTPSentPacket *const packet = &history->packet[selected[i]];
+
+        struct RTPHeader header = packet->header;
+        header.flags |= RTP_RETRANSMISSION;
+
+        rdata[0] = session->payload_type;
+        rtp_header_pack(rdata + 1, &header);
+        memcpy(rdata + 1 + RTP_HEADER_SIZE, packet->data, packet->length);
+
+        if (-1 == m_send_custom_lossy_packet(session->m, session->friend_number, rdata,
+                                             packet->length + RTP_HEADER_SIZE + 1)) {
+            LOGGER_WARNING(session->m->log, "RTP retransmission failed (len: %d)! std error: %s",
+                           packet->length + RTP_HEADER_SIZE + 1, strerror(errno));
+        } else {
+            LOGGER_DEBUG(session->m->log, "NACK:retransmitted VSEQ:%d offset=%u", (int)header.sequnum,
+                         (unsigned)header.offset_full);
+        }
+    }
+
+    pthread_mutex_unlock(history->mutex);
+}
+
 /**
  * @return -1 on error, 0 on success.
  */
@@ -616,15 +870,17 @@ static int handle_rtp_packet(Messenger *m, uint32_t friendnumber, const uint8_t
                         ((VCSession *)(session->cs))->skip_fps = data[2];
                     }
 
-                    ((VCSession *)(session->cs))->skip_fps_duration_until_ts = current_time_monotonic() + TOXAV_SKIP_FPS_RELEASE_AFTER_MS;
+                    ((VCSession *)(session->cs))->skip_fps_duration_until_ts = current_time_monotonic(m->mono_time) + TOXAV_SKIP_FPS_RELEASE_AFTER_MS;
                 }
+            } else if (data[1] == PACKET_TOXAV_COMM_CHANNEL_NACK) {
+                handle_nack(session, data + 2, length - 2);
             } else if (data[1] == PACKET_TOXAV_COMM_CHANNEL_DUMMY_NTP_REQUEST) {
 
                 uint32_t pkg_buf_len = (sizeof(uint32_t) * 3) + 2;
                 uint8_t pkg_buf[pkg_buf_len];
                 pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
                 pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_DUMMY_NTP_ANSWER;
-                uint32_t tmp = current_time_monotonic();
+                uint32_t tmp = current_time_monotonic(m->mono_time);
                 pkg_buf[2] = data[2];
                 pkg_buf[3] = data[3];
                 pkg_buf[4] = data[4];
@@ -679,7 +935,7 @@ static int handle_rtp_packet(Messenger *m, uint32_t friendnumber, const uint8_t
                     +
                     (data[13]);
 
-                ((VCSession *)(session->cs))->dummy_ntp_local_end = current_time_monotonic();
+                ((VCSession *)(session->cs))->dummy_ntp_local_end = current_time_monotonic(m->mono_time);
 
                 LOGGER_DEBUG(m->log, "DNTP:%ld %ld %ld %ld",
                              ((VCSession *)(session->cs))->dummy_ntp_local_start,
@@ -801,7 +1057,7 @@ static int handle_rtp_packet(Messenger *m, uint32_t friendnumber, const uint8_t
         uint8_t pkg_buf[pkg_buf_len];
         pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
         pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_DUMMY_NTP_REQUEST;
-        uint32_t tmp = current_time_monotonic();
+        uint32_t tmp = current_time_monotonic(m->mono_time);
         pkg_buf[2] = tmp >> 24 & 0xFF;
         pkg_buf[3] = tmp >> 16 & 0xFF;
         pkg_buf[4] = tmp >> 8  & 0xFF;
@@ -821,16 +1077,16 @@ static int handle_rtp_packet(Messenger *m, uint32_t friendnumber, const uint8_t
     // The sender uses the new large-frame capable protocol and is sending a
     // video packet.
     if ((header.flags & RTP_LARGE_FRAME) && (header.pt == (rtp_TypeVideo % 128))) {
+        const uint64_t now = current_time_monotonic(m->mono_time);
 
         if (session->incoming_packets_ts_last_ts == -1) {
             session->incoming_packets_ts[session->incoming_packets_ts_index] = 0;
             session->incoming_packets_ts_average = 0;
         } else {
-            session->incoming_packets_ts[session->incoming_packets_ts_index] = current_time_monotonic() -
-                    session->incoming_packets_ts_last_ts;
+            session->incoming_packets_ts[session->incoming_packets_ts_index] = now - session->incoming_packets_ts_last_ts;
         }
 
-        session->incoming_packets_ts_last_ts = current_time_monotonic();
+        session->incoming_packets_ts_last_ts = now;
         session->incoming_packets_ts_index++;
 
         if (session->incoming_packets_ts_index >= INCOMING_PACKETS_TS_ENTRIES) {
@@ -1065,6 +1321,18 @@ RTPSession *rtp_new(int payload_type, Messenger *m, uint32_t friendnumber,
     // First entry is free.
     session->work_buffer_list->next_free_entry = 0;
 
+    if (payload_type == rtp_TypeVideo) {
+        session->sent_history = (struct RTPSentHistory *)calloc(1, sizeof(struct RTPSentHistory));
+
+        if (session->sent_history == NULL || pthread_mutex_init(session->sent_history->mutex, NULL) != 0) {
+            LOGGER_ERROR(m->log, "out of memory while allocating the sent packet history");
+            free(session->sent_history);
+            free(session->work_buffer_list);
+            free(session);
+            return NULL;
+        }
+    }
+
     session->ssrc = payload_type == rtp_TypeVideo ? 0 : random_u32();
     session->payload_type = payload_type;
     session->m = m;
@@ -1089,6 +1357,12 @@ RTPSession *rtp_new(int payload_type, Messenger *m, uint32_t friendnumber,
 
     if (-1 == rtp_allow_receiving(session)) {
         LOGGER_WARNING(m->log, "Failed to start rtp receiving mode");
+
+        if (session->sent_history != NULL) {
+            pthread_mutex_destroy(session->sent_history->mutex);
+            free(session->sent_history);
+        }
+
         free(session->work_buffer_list);
         free(session);
         return NULL;
@@ -1109,6 +1383,11 @@ void rtp_kill(RTPSession *session)
     LOGGER_DEBUG(session->m->log, "Terminated RTP session V3 work_buffer_list->next_free_entry: %d",
                  (int)session->work_buffer_list->next_free_entry);
 
+    if (session->sent_history != NULL) {
+        pthread_mutex_destroy(session->sent_history->mutex);
+        free(session->sent_history);
+    }
+
     free(session->work_buffer_list);
     free(session);
 }
@@ -1165,11 +1444,21 @@ int rtp_stop_receiving(RTPSession *session)
     return 0;
 }
 
+uint64_t rtp_flags_set_temporal_layer(uint64_t flags, uint8_t temporal_layer)
+{
+    if (temporal_layer >= RTP_MAX_TEMPORAL_LAYERS) {
+        return flags;
+    }
+
+    flags &= ~(uint64_t)(RTP_TEMPORAL_LAYER_LOW | RTP_TEMPORAL_LAYER_HIGH);
+    return flags | (uint64_t)temporal_layer << RTP_TEMPORAL_LAYER_SHIFT;
+}
+
 /**
  * @param input is raw vpx data.
  * @param length is the length of the raw data.
  */
-int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, bool is_keyframe,
+int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, bool is_keyframe, uint8_t temporal_layer,
                   uint64_t frame_record_timestamp, int32_t fragment_num,
                   uint32_t codec_used, uint32_t bit_rate_used,
                   Logger *log)
@@ -1239,6 +1528,10 @@ int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, boo
         header.flags |= RTP_KEY_FRAME;
     }
 
+    if (is_video_payload == 1) {
+        header.flags = rtp_flags_set_temporal_layer(header.flags, temporal_layer);
+    }
+
     VLA(uint8_t, rdata, length + RTP_HEADER_SIZE + 1);
     memset(rdata, 0, SIZEOF_VLA(rdata));
     rdata[0] = session->payload_type;  // packet id == payload_type
@@ -1292,6 +1585,8 @@ int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, boo
                     LOGGER_WARNING(session->m->log, "RTP send failed (len: %d)! std error: %s",
                                    piece + RTP_HEADER_SIZE + 1, strerror(errno));
                 }
+
+                add_sent_packet(session, &header, data + sent, piece);
             }
 
             sent += piece;
@@ -1318,6 +1613,8 @@ int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, boo
                     LOGGER_WARNING(session->m->log, "RTP send failed (len: %d)! std error: %s",
                                    piece + RTP_HEADER_SIZE + 1, strerror(errno));
                 }
+
+                add_sent_packet(session, &header, data + sent, piece);
             }
         }
     }
@@ -25,6 +25,7 @@
 #include "../toxcore/Messenger.h"
 #include "../toxcore/logger.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -99,8 +100,34 @@ enum RTPFlags {
      */
     RTP_ENCODER_HAS_RECORD_TIMESTAMP = 1 << 3,
 
+    /**
+     * Two bits with the temporal layer of this video frame, 0 for the base
+     * layer. No frame refers to a frame of a higher layer than its own, so
+     * frames above the base layer can be dropped without breaking decoding.
+     * See \ref RTP_TEMPORAL_LAYER.
+     */
+    RTP_TEMPORAL_LAYER_LOW = 1 << 4,
+    RTP_TEMPORAL_LAYER_HIGH = 1 << 5,
+
+    /**
+     * The packet is sent again, because the receiver asked for it with a
+     * NACK. It only fills a frame that the receiver is still assembling.
+     */
+    RTP_RETRANSMISSION = 1 << 6,
+
 };
 
+#define RTP_TEMPORAL_LAYER_SHIFT 4
+#define RTP_MAX_TEMPORAL_LAYERS 4
+#define RTP_TEMPORAL_LAYER(flags) ((uint8_t)(((flags) >> RTP_TEMPORAL_LAYER_SHIFT) & (RTP_MAX_TEMPORAL_LAYERS - 1)))
+
+/**
+ * Put the temporal layer of a video frame into RTP header flags. Layers from
+ * RTP_MAX_TEMPORAL_LAYERS on can't be signalled, they leave the flags as they
+ * are.
+ */
+uint64_t rtp_flags_set_temporal_layer(uint64_t flags, uint8_t temporal_layer);
+
 
 struct RTPHeader {
     /* Standard RTP header */
@@ -200,6 +227,26 @@ struct RTPWorkBuffer {
      * The message currently being assembled.
      */
     struct RTPMessage *buf;
+    /**
+     * One bit per piece of the frame, set once the piece is received, so that
+     * retransmitted pieces are only counted once. The sender cuts frames into
+     * pieces of \ref RTP_PIECE_SIZE bytes. NULL if this frame is cut
+     * differently. Points into the bytes allocated after buf->data.
+     */
+    uint8_t *pieces;
+    uint32_t piece_count;
+    /**
+     * The pieces before this one were either received or asked for again.
+     */
+    uint32_t next_piece;
+    /**
+     * Whether the pieces from next_piece to the end were asked for again.
+     */
+    bool nack_tail_sent;
+    /**
+     * When pieces of this frame were last asked for again, 0 for never.
+     */
+    uint64_t nack_ts;
 };
 
 struct RTPWorkBufferList {
@@ -207,6 +254,55 @@ struct RTPWorkBufferList {
     struct RTPWorkBuffer work_buffer[USED_RTP_WORKBUFFER_COUNT];
 };
 
+/**
+ * Payload bytes in each packet of a frame that does not fit in one packet.
+ */
+#define RTP_PIECE_SIZE (MAX_CRYPTO_DATA_SIZE - (RTP_HEADER_SIZE + 1))
+
+/**
+ * Number of sent video packets kept for retransmission. At 2 Mbit/s this is
+ * about 0.7 seconds of video.
+ */
+#define RTP_SENT_HISTORY_PACKETS 128
+
+/**
+ * The most byte ranges of one NACK that are looked at, the rest is ignored.
+ */
+#define RTP_NACK_MAX_RANGES 8
+
+struct RTPSentPacket {
+    bool used;
+    /**
+     * When this packet was last sent again, 0 for never. It is sent again at
+     * most once per round trip, however often the receiver asks for it.
+     */
+    uint64_t resent_ts;
+    struct RTPHeader header;
+    uint16_t length;
+    uint8_t data[RTP_PIECE_SIZE];
+};
+
+/**
+ * The packets of the last few fragmented video frames, found again by their
+ * sequence number and offset when the receiver sends a NACK for them.
+ * Single packet frames are not kept, the receiver cannot tell that one of
+ * them was lost.
+ */
+struct RTPSentHistory {
+    pthread_mutex_t mutex[1];
+    uint32_t next; /* the oldest packet, overwritten next */
+    struct RTPSentPacket packet[RTP_SENT_HISTORY_PACKETS];
+};
+
+/**
+ * A byte range of a frame that the receiver asks the sender for again.
+ */
+struct RTPNack {
+    uint16_t sequnum;
+    uint32_t offset;
+    uint32_t length;
+};
+
 #define DISMISS_FIRST_LOST_VIDEO_PACKET_COUNT 10
 #define INCOMING_PACKETS_TS_ENTRIES 10
 
@@ -221,6 +317,7 @@ typedef struct RTPSession {
     uint32_t ssrc; //  this seems to be unused!?
     struct RTPMessage *mp; /* Expected parted message */
     struct RTPWorkBufferList *work_buffer_list;
+    struct RTPSentHistory *sent_history; /* video sessions only */
     uint8_t  first_packets_counter; /* dismiss first few lost video packets */
     uint32_t incoming_packets_ts[INCOMING_PACKETS_TS_ENTRIES];
     int64_t incoming_packets_ts_last_ts;
@@ -252,6 +349,40 @@ size_t rtp_header_pack(uint8_t *rdata, const struct RTPHeader *header);
  */
 size_t rtp_header_unpack(const uint8_t *data, struct RTPHeader *header);
 
+/**
+ * Find the slot with the earlier parts of the frame the packet belongs to.
+ *
+ * @return the slot, or -1 if there is none.
+ */
+int8_t rtp_find_frame_slot(Logger *log, const struct RTPWorkBufferList *wkbl, const struct RTPHeader *header);
+
+/**
+ * Find the pieces to ask the sender for again after the packet with header
+ * was put into slot_id: the pieces that the packet skipped, and the missing
+ * ends of earlier frames, which the sender finished sending before it started
+ * the frame of this packet. Every missing piece is only asked for once.
+ *
+ * @param nacks An array of USED_RTP_WORKBUFFER_COUNT entries for the ranges.
+ * @return the number of ranges written to nacks.
+ */
+uint32_t rtp_missing_pieces(struct RTPWorkBufferList *wkbl, int8_t slot_id, const struct RTPHeader *header,
+                            uint64_t now, struct RTPNack *nacks);
+
+/**
+ * Select the packets to send again for a NACK, as far as they are still kept.
+ * A NACK holds the sequence number of a frame, followed by one or more byte
+ * ranges of that frame, each an offset and a length. Only the first
+ * RTP_NACK_MAX_RANGES ranges are looked at, and a packet that was sent again
+ * less than resend_interval_ms ago is not selected again. The history mutex
+ * must be held.
+ *
+ * @param selected An array of RTP_SENT_HISTORY_PACKETS entries for the
+ *   indices of the selected packets in history->packet.
+ * @return the number of packets selected.
+ */
+uint32_t rtp_nack_select(struct RTPSentHistory *history, const uint8_t *data, uint16_t length, uint64_t now,
+                         uint32_t resend_interval_ms, uint8_t *selected);
+
 RTPSession *rtp_new(int payload_type, Messenger *m, uint32_t friendnumber,
                     BWController *bwc, void *cs,
                     int (*mcb)(void *, struct RTPMessage *));
@@ -266,8 +397,10 @@ int rtp_stop_receiving(RTPSession *session);
  * @param length The number of bytes to send from @p data.
  * @param is_keyframe Whether this video frame is a key frame. If it is an
  *   audio frame, this parameter is ignored.
+ * @param temporal_layer The temporal layer of this video frame, 0 for the
+ *   base layer. If it is an audio frame, this parameter is ignored.
  */
-int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, bool is_keyframe,
+int rtp_send_data(RTPSession *session, const uint8_t *data, uint32_t length, bool is_keyframe, uint8_t temporal_layer,
                   uint64_t frame_record_timestamp, int32_t fragment_num, uint32_t codec_used,
                   uint32_t bit_rate_used, Logger *log);
 
@@ -1,6 +1,11 @@
 #include "rtp.h"
 
 #include "../toxcore/crypto_core.h"
+#include "../toxcore/network.h"
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -61,4 +66,225 @@ TEST(Rtp, SerialisingAllOnes) {
                         RTP_HEADER_SIZE));
 }
 
+TEST(Rtp, TemporalLayerUsesFlagBits4And5) {
+  EXPECT_EQ(rtp_flags_set_temporal_layer(0, 0), 0u);
+  EXPECT_EQ(rtp_flags_set_temporal_layer(0, 1), uint64_t{RTP_TEMPORAL_LAYER_LOW});
+  EXPECT_EQ(rtp_flags_set_temporal_layer(0, 2), uint64_t{RTP_TEMPORAL_LAYER_HIGH});
+  EXPECT_EQ(rtp_flags_set_temporal_layer(0, 3), uint64_t{RTP_TEMPORAL_LAYER_LOW | RTP_TEMPORAL_LAYER_HIGH});
+  EXPECT_EQ(RTP_TEMPORAL_LAYER_LOW, 1 << 4);
+  EXPECT_EQ(RTP_TEMPORAL_LAYER_HIGH, 1 << 5);
+}
+
+TEST(Rtp, TemporalLayerKeepsOtherFlags) {
+  const uint64_t others = ~uint64_t{RTP_TEMPORAL_LAYER_LOW | RTP_TEMPORAL_LAYER_HIGH};
+
+  for (uint8_t layer = 0; layer < RTP_MAX_TEMPORAL_LAYERS; ++layer) {
+    const uint64_t flags = rtp_flags_set_temporal_layer(UINT64_MAX, layer);
+    EXPECT_EQ(flags & others, others);
+    EXPECT_EQ(RTP_TEMPORAL_LAYER(flags), layer);
+  }
+}
+
+TEST(Rtp, TemporalLayerOutOfRangeIsNotSignalled) {
+  const uint64_t flags = RTP_KEY_FRAME | RTP_TEMPORAL_LAYER_LOW;
+  EXPECT_EQ(rtp_flags_set_temporal_layer(flags, RTP_MAX_TEMPORAL_LAYERS), flags);
+}
+
+TEST(Rtp, TemporalLayerSurvivesSerialisation) {
+  for (uint8_t layer = 0; layer < RTP_MAX_TEMPORAL_LAYERS; ++layer) {
+    RTPHeader header = random_header();
+    header.flags = rtp_flags_set_temporal_layer(header.flags, layer);
+
+    uint8_t rdata[RTP_HEADER_SIZE];
+    rtp_header_pack(rdata, &header);
+
+    RTPHeader unpacked = {0};
+    rtp_header_unpack(rdata, &unpacked);
+    EXPECT_EQ(RTP_TEMPORAL_LAYER(unpacked.flags), layer);
+  }
+}
+
+constexpr uint32_t kPieceSize = RTP_PIECE_SIZE;
+
+class RtpWorkBuffers : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    for (int8_t i = 0; i < wkbl_.next_free_entry; ++i) {
+      std::free(wkbl_.work_buffer[i].buf);
+    }
+  }
+
+  // Start assembling a frame of piece_count pieces in the next slot.
+  int8_t add_frame(uint16_t sequnum, uint32_t timestamp, uint32_t piece_count) {
+    const int8_t slot_id = wkbl_.next_free_entry++;
+    RTPWorkBuffer *const slot = &wkbl_.work_buffer[slot_id];
+    slot->buf = static_cast<RTPMessage *>(std::calloc(1, sizeof(RTPMessage)));
+    slot->buf->header.sequnum = sequnum;
+    slot->buf->header.timestamp = timestamp;
+    slot->buf->header.data_length_full = piece_count * RTP_PIECE_SIZE;
+    slot->pieces = pieces_[slot_id];
+    slot->piece_count = piece_count;
+    return slot_id;
+  }
+
+  static RTPHeader piece_header(uint16_t sequnum, uint32_t piece) {
+    RTPHeader header = {};
+    header.sequnum = sequnum;
+    header.offset_full = piece * RTP_PIECE_SIZE;
+    return header;
+  }
+
+  std::vector<RTPNack> missing_pieces(int8_t slot_id, const RTPHeader &header) {
+    RTPNack nacks[USED_RTP_WORKBUFFER_COUNT];
+    const uint32_t count = rtp_missing_pieces(&wkbl_, slot_id, &header, now_, nacks);
+    return std::vector<RTPNack>(nacks, nacks + count);
+  }
+
+  RTPWorkBufferList wkbl_ = {};
+  uint8_t pieces_[USED_RTP_WORKBUFFER_COUNT][1] = {};
+  uint64_t now_ = 1000;
+};
+
+TEST_F(RtpWorkBuffers, FindFrameSlotMatchesSequnumAndTimestamp) {
+  add_frame(10, 100, 4);
+  add_frame(11, 120, 4);
+
+  RTPHeader header = {};
+  header.sequnum = 11;
+  header.timestamp = 120;
+  EXPECT_EQ(rtp_find_frame_slot(nullptr, &wkbl_, &header), 1);
+
+  header.timestamp = 100;
+  EXPECT_EQ(rtp_find_frame_slot(nullptr, &wkbl_, &header), -1);
+
+  header.sequnum = 12;
+  header.timestamp = 120;
+  EXPECT_EQ(rtp_find_frame_slot(nullptr, &wkbl_, &header), -1);
+}
+
+TEST_F(RtpWorkBuffers, SkippedPiecesAreAskedForOnce) {
+  const int8_t slot_id = add_frame(10, 100, 8);
+
+  const std::vector<RTPNack> nacks = missing_pieces(slot_id, piece_header(10, 3));
+  ASSERT_EQ(nacks.size(), 1u);
+  EXPECT_EQ(nacks[0].sequnum, 10);
+  EXPECT_EQ(nacks[0].offset, 0u);
+  EXPECT_EQ(nacks[0].length, 3 * kPieceSize);
+  EXPECT_EQ(wkbl_.work_buffer[slot_id].nack_ts, now_);
+
+  // The pieces before piece 3 were asked for, so only the gap after it is new.
+  EXPECT_TRUE(missing_pieces(slot_id, piece_header(10, 1)).empty());
+  EXPECT_TRUE(missing_pieces(slot_id, piece_header(10, 4)).empty());
+
+  const std::vector<RTPNack> gap = missing_pieces(slot_id, piece_header(10, 6));
+  ASSERT_EQ(gap.size(), 1u);
+  EXPECT_EQ(gap[0].offset, 5 * kPieceSize);
+  EXPECT_EQ(gap[0].length, kPieceSize);
+}
+
+TEST_F(RtpWorkBuffers, InOrderPiecesAreNotAskedFor) {
+  const int8_t slot_id = add_frame(10, 100, 4);
+
+  for (uint32_t piece = 0; piece < 4; ++piece) {
+    EXPECT_TRUE(missing_pieces(slot_id, piece_header(10, piece)).empty()) << "piece " << piece;
+  }
+
+  EXPECT_EQ(wkbl_.work_buffer[slot_id].nack_ts, 0u);
+}
+
+TEST_F(RtpWorkBuffers, NextFrameAsksForTailOfEarlierFrameOnce) {
+  const int8_t first = add_frame(10, 100, 4);
+  missing_pieces(first, piece_header(10, 0));
+  missing_pieces(first, piece_header(10, 1));
+
+  const int8_t second = add_frame(11, 120, 4);
+  const std::vector<RTPNack> nacks = missing_pieces(second, piece_header(11, 0));
+  ASSERT_EQ(nacks.size(), 1u);
+  EXPECT_EQ(nacks[0].sequnum, 10);
+  EXPECT_EQ(nacks[0].offset, 2 * kPieceSize);
+  EXPECT_EQ(nacks[0].length, 2 * kPieceSize);
+  EXPECT_TRUE(wkbl_.work_buffer[first].nack_tail_sent);
+
+  EXPECT_TRUE(missing_pieces(second, piece_header(11, 1)).empty());
+}
+
+TEST_F(RtpWorkBuffers, EarlierFrameDoesNotAskForTailOfLaterFrame) {
+  add_frame(11, 120, 4);
+  const int8_t earlier = add_frame(10, 100, 4);
+  EXPECT_TRUE(missing_pieces(earlier, piece_header(10, 0)).empty());
+}
+
+class RtpSentHistory : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kResendIntervalMs = 100;
+
+  void SetUp() override {
+    // Frame 20 in pieces 0 to 3, followed by frame 21 in pieces 0 and 1.
+    for (uint32_t piece = 0; piece < 6; ++piece) {
+      RTPSentPacket *const packet = &history_.packet[piece];
+      packet->used = true;
+      packet->header.sequnum = piece < 4 ? 20 : 21;
+      packet->header.offset_full = (piece < 4 ? piece : piece - 4) * RTP_PIECE_SIZE;
+    }
+  }
+
+  // A NACK for the pieces [first, first + count) of each range.
+  static std::vector<uint8_t> nack(uint16_t sequnum, const std::vector<std::pair<uint32_t, uint32_t>> &ranges) {
+    std::vector<uint8_t> data(sizeof(uint16_t) + ranges.size() * sizeof(uint32_t) * 2);
+    uint8_t *p = data.data();
+    p += net_pack_u16(p, sequnum);
+
+    for (const auto &range : ranges) {
+      p += net_pack_u32(p, range.first * RTP_PIECE_SIZE);
+      p += net_pack_u32(p, range.second * RTP_PIECE_SIZE);
+    }
+
+    return data;
+  }
+
+  std::vector<uint8_t> select(const std::vector<uint8_t> &data) {
+    uint8_t selected[RTP_SENT_HISTORY_PACKETS];
+    const uint32_t count = rtp_nack_select(&history_, data.data(), static_cast<uint16_t>(data.size()), now_,
+                                           kResendIntervalMs, selected);
+    return std::vector<uint8_t>(selected, selected + count);
+  }
+
+  RTPSentHistory history_ = {};
+  uint64_t now_ = 1000;
+};
+
+TEST_F(RtpSentHistory, SelectsPacketsOfTheFrameInTheRange) {
+  EXPECT_EQ(select(nack(20, {{1, 2}})), (std::vector<uint8_t>{1, 2}));
+  EXPECT_EQ(select(nack(21, {{0, 1}})), (std::vector<uint8_t>{4}));
+  EXPECT_TRUE(select(nack(22, {{0, 4}})).empty());
+}
+
+TEST_F(RtpSentHistory, TruncatedNackSelectsNothing) {
+  EXPECT_TRUE(select(std::vector<uint8_t>{0}).empty());
+
+  std::vector<uint8_t> data = nack(20, {{0, 1}});
+  data.pop_back();
+  EXPECT_TRUE(select(data).empty());
+}
+
+TEST_F(RtpSentHistory, PacketIsResentOncePerInterval) {
+  EXPECT_EQ(select(nack(20, {{0, 2}})), (std::vector<uint8_t>{0, 1}));
+
+  now_ += kResendIntervalMs - 1;
+  EXPECT_EQ(select(nack(20, {{0, 3}})), (std::vector<uint8_t>{2}));
+
+  now_ += 1;
+  EXPECT_EQ(select(nack(20, {{0, 3}})), (std::vector<uint8_t>{0, 1}));
+}
+
+TEST_F(RtpSentHistory, OverlappingRangesSelectPacketOnce) {
+  EXPECT_EQ(select(nack(20, {{0, 2}, {1, 2}})), (std::vector<uint8_t>{0, 1, 2}));
+}
+
+TEST_F(RtpSentHistory, RangesBeyondTheCapAreIgnored) {
+  std::vector<std::pair<uint32_t, uint32_t>> ranges(RTP_NACK_MAX_RANGES, {3, 1});
+  ranges.push_back({0, 1});
+  EXPECT_EQ(select(nack(20, ranges)), (std::vector<uint8_t>{3}));
+}
+
 }  // namespace
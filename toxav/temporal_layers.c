@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "temporal_layers.h"
+
+void temporal_layers_init(Temporal_Layers *tl)
+{
+    tl->layer_id = 0;
+    tl->frame_index = 0;
+    tl->skip_upper = false;
+}
+
+void temporal_layers_reset(Temporal_Layers *tl)
+{
+    tl->layer_id = 0;
+    tl->frame_index = 0;
+}
+
+void temporal_layers_report_loss(Temporal_Layers *tl, float loss)
+{
+    const float permille = loss * 1000.0f;
+
+    if (permille > TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE) {
+        tl->skip_upper = true;
+    } else if (permille < TEMPORAL_LAYERS_SKIP_LEAVE_PERMILLE) {
+        tl->skip_upper = false;
+    }
+}
+
+bool temporal_layers_next(Temporal_Layers *tl, uint8_t layers, bool keyframe)
+{
+    if (layers < 2) {
+        tl->layer_id = 0;
+        return true;
+    }
+
+    if (keyframe) {
+        tl->frame_index = 0;
+    }
+
+    tl->layer_id = (uint8_t)(tl->frame_index % layers);
+    ++tl->frame_index;
+
+    return tl->layer_id == 0 || !tl->skip_upper;
+}
+
+bool temporal_layers_is_reference(const Temporal_Layers *tl)
+{
+    return tl->layer_id == 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2016-2018 The TokTok team.
+ *
+ * This file is part of Tox, the free peer to peer instant messenger.
+ *
+ * Tox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TEMPORAL_LAYERS_H
+#define TEMPORAL_LAYERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The temporal layer pattern of a video encoder. With two layers the frames
+ * take turns between the base layer and the enhancement layer. Frames above
+ * the base layer are no reference for any other frame, so they can be left
+ * out without breaking decoding: by a receiver under load, and by the sender
+ * itself while its peer reports loss, so that the bitrate left goes to the
+ * frames everything else refers to. Keyframes restart the pattern in the base
+ * layer.
+ */
+typedef struct Temporal_Layers {
+    uint8_t layer_id;     /* layer of the last frame */
+    uint32_t frame_index; /* position of the next frame in the pattern */
+    bool skip_upper;      /* whether frames above the base layer are left out */
+} Temporal_Layers;
+
+/* Loss thresholds in permille; the gap between them keeps the sender from
+ * switching the upper layers on and off with every report. */
+#define TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE 20
+#define TEMPORAL_LAYERS_SKIP_LEAVE_PERMILLE 5
+
+void temporal_layers_init(Temporal_Layers *tl);
+
+/*
+ * Restart the pattern, e.g. when the encoder is set up again.
+ */
+void temporal_layers_reset(Temporal_Layers *tl);
+
+/*
+ * Account the loss the peer reported, as a fraction of the bytes it should have
+ * received. Frames above the base layer are left out once the loss exceeds
+ * TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE, until it falls below
+ * TEMPORAL_LAYERS_SKIP_LEAVE_PERMILLE.
+ */
+void temporal_layers_report_loss(Temporal_Layers *tl, float loss);
+
+/*
+ * Pick the layer of the next frame of a stream with the given number of layers
+ * and put it in layer_id.
+ *
+ * Returns false if the frame is above the base layer while they are left out.
+ * The frame should then not be encoded, the pattern still moves on.
+ */
+bool temporal_layers_next(Temporal_Layers *tl, uint8_t layers, bool keyframe);
+
+/*
+ * Returns whether the last frame may be a reference for later frames, i.e.
+ * whether it is in the base layer.
+ */
+bool temporal_layers_is_reference(const Temporal_Layers *tl);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // TEMPORAL_LAYERS_H
@@ -0,0 +1,92 @@
+#include "temporal_layers.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class TemporalLayers : public ::testing::Test {
+ protected:
+  void SetUp() override { temporal_layers_init(&tl_); }
+
+  // Pick the layers of count frames, with skipped frames as -1.
+  std::vector<int> frames(uint8_t layers, int count, bool keyframe_first = false) {
+    std::vector<int> picked;
+
+    for (int i = 0; i < count; ++i) {
+      const bool encode = temporal_layers_next(&tl_, layers, keyframe_first && i == 0);
+      picked.push_back(encode ? tl_.layer_id : -1);
+    }
+
+    return picked;
+  }
+
+  void report_loss_permille(uint32_t permille) { temporal_layers_report_loss(&tl_, permille / 1000.0f); }
+
+  Temporal_Layers tl_;
+};
+
+TEST_F(TemporalLayers, OneLayerIsAlwaysBase) {
+  EXPECT_EQ(frames(1, 4), (std::vector<int>{0, 0, 0, 0}));
+  EXPECT_TRUE(temporal_layers_is_reference(&tl_));
+}
+
+TEST_F(TemporalLayers, TwoLayersTakeTurns) { EXPECT_EQ(frames(2, 5), (std::vector<int>{0, 1, 0, 1, 0})); }
+
+TEST_F(TemporalLayers, OnlyBaseLayerIsReference) {
+  temporal_layers_next(&tl_, 2, false);
+  EXPECT_TRUE(temporal_layers_is_reference(&tl_));
+  temporal_layers_next(&tl_, 2, false);
+  EXPECT_FALSE(temporal_layers_is_reference(&tl_));
+}
+
+TEST_F(TemporalLayers, KeyframeRestartsPattern) {
+  frames(2, 1);
+  EXPECT_EQ(frames(2, 3, true), (std::vector<int>{0, 1, 0}));
+}
+
+TEST_F(TemporalLayers, ResetRestartsPattern) {
+  frames(2, 1);
+  temporal_layers_reset(&tl_);
+  EXPECT_EQ(frames(2, 2), (std::vector<int>{0, 1}));
+}
+
+TEST_F(TemporalLayers, LossSkipsUpperLayer) {
+  report_loss_permille(TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE + 1);
+  EXPECT_EQ(frames(2, 5), (std::vector<int>{0, -1, 0, -1, 0}));
+}
+
+TEST_F(TemporalLayers, LossNeverSkipsSingleLayer) {
+  report_loss_permille(500);
+  EXPECT_EQ(frames(1, 3), (std::vector<int>{0, 0, 0}));
+}
+
+TEST_F(TemporalLayers, LossNeverSkipsKeyframe) {
+  frames(2, 1);
+  report_loss_permille(500);
+  EXPECT_EQ(frames(2, 1, true), (std::vector<int>{0}));
+}
+
+TEST_F(TemporalLayers, LossBetweenThresholdsKeepsSkipping) {
+  report_loss_permille(TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE);
+  EXPECT_FALSE(tl_.skip_upper);
+
+  report_loss_permille(TEMPORAL_LAYERS_SKIP_ENTER_PERMILLE + 1);
+  EXPECT_TRUE(tl_.skip_upper);
+
+  report_loss_permille(TEMPORAL_LAYERS_SKIP_LEAVE_PERMILLE);
+  EXPECT_TRUE(tl_.skip_upper);
+
+  report_loss_permille(TEMPORAL_LAYERS_SKIP_LEAVE_PERMILLE - 1);
+  EXPECT_FALSE(tl_.skip_upper);
+  EXPECT_EQ(frames(2, 2), (std::vector<int>{0, 1}));
+}
+
+TEST_F(TemporalLayers, ResetKeepsLossState) {
+  report_loss_permille(500);
+  temporal_layers_reset(&tl_);
+  EXPECT_TRUE(tl_.skip_upper);
+}
+
+}  // namespace
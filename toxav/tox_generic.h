@@ -18,6 +18,10 @@
  * along with Tox.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "media_sched.h"
+#include "playout.h"
+
+#include "../toxcore/hash_map.h"
 
 #define DISABLE_H264_DECODER_FEATURE    0
 
@@ -53,6 +57,22 @@
 #define VIDEO_BITRATE_CORRECTION_FACTOR_VP8 (float)1
 
 
+typedef struct ToxAV_Iterate_Timing {
+    /** Decode time measures */
+    int32_t dmssc; /** Measure count */
+    int32_t dmsst; /** Last cycle total */
+    int32_t dmssa; /** Average decoding time in ms */
+
+    uint32_t interval; /** Calculated interval */
+} ToxAV_Iterate_Timing;
+
+typedef struct ToxAV_Iterate_Worker {
+    ToxAV *av;
+    pthread_t thread;
+    uint32_t shard;
+    ToxAV_Iterate_Timing timing;
+} ToxAV_Iterate_Worker;
+
 typedef struct ToxAVCall_s {
     ToxAV *av;
 
@@ -81,8 +101,8 @@ typedef struct ToxAVCall_s {
     uint64_t last_incoming_audio_frame_rtimestamp;
     uint64_t last_incoming_audio_frame_ltimestamp;
     
-    int64_t call_timestamp_difference_to_sender;
-    int64_t call_timestamp_difference_adjustment;
+    /** Shared by the audio and video receive paths, while transmitting */
+    Playout_Clock playout;
     uint32_t call_rountrip_time_ms;
 
     uint64_t reference_rtimestamp;
@@ -93,6 +113,12 @@ typedef struct ToxAVCall_s {
     /** Required for monitoring changes in states */
     uint8_t previous_self_capabilities;
 
+    /** The media scheduler skipped video in the last toxav_iterate pass */
+    bool video_skipped;
+
+    uint32_t call_slot; /** Slot in ToxAV.call_slots */
+    uint32_t iterate_shard; /** Iterate worker of the call, modulo the worker count */
+
     pthread_mutex_t mutex[1];
 
     struct ToxAVCall_s *prev;
@@ -104,10 +130,15 @@ struct ToxAV {
     Messenger *m;
     MSISession *msi;
 
-    /* Two-way storage: first is array of calls and second is list of calls with head and tail */
-    ToxAVCall **calls;
-    uint32_t calls_tail;
-    uint32_t calls_head;
+    /* All calls are in the list starting at calls, and call_index maps friend
+     * numbers to their slot in call_slots. Both are changed with mutex and
+     * calls_lock held, so either of the two is enough to look up a call. */
+    ToxAVCall *calls;
+    ToxAVCall **call_slots;
+    uint32_t call_slots_size;
+    Hash_Map call_index;
+    uint32_t next_iterate_shard;
+    pthread_mutex_t calls_lock[1];
     pthread_mutex_t mutex[1];
 
     PAIR(toxav_call_cb *, void *) ccb; /* Call callback */
@@ -119,11 +150,21 @@ struct ToxAV {
     PAIR(toxav_audio_bit_rate_cb *, void *) abcb; /* Bit rate control callback */
     PAIR(toxav_video_bit_rate_cb *, void *) vbcb; /* Bit rate control callback */
 
-    /** Decode time measures */
-    int32_t dmssc; /** Measure count */
-    int32_t dmsst; /** Last cycle total */
-    int32_t dmssa; /** Average decoding time in ms */
+    ToxAV_Iterate_Timing timing; /** Of toxav_iterate */
 
-    uint32_t interval; /** Calculated interval */
+    /** See toxav_set_iterate_workers() */
+    ToxAV_Iterate_Worker *workers;
+    uint32_t worker_count;
+    bool workers_stop;
+    pthread_mutex_t workers_mutex[1];
+    pthread_cond_t workers_cond[1];
+
+    /** Threads for the video codecs of all calls, see toxav_set_thread_budget() */
+    uint32_t thread_budget;
+    uint32_t transmitting_calls;
+    uint32_t call_encoder_threads; /** Share of each call's encoder */
+    uint32_t call_decoder_threads; /** Share of each call's decoder */
+
+    Media_Scheduler sched;
 };
 
@@ -71,8 +71,12 @@ bool invoke_call_state_callback(ToxAV *av, uint32_t friend_number, uint32_t stat
 ToxAVCall *call_new(ToxAV *av, uint32_t friend_number, TOXAV_ERR_CALL *error);
 ToxAVCall *call_get(ToxAV *av, uint32_t friend_number);
 ToxAVCall *call_remove(ToxAVCall *call);
+static bool calls_add(ToxAV *av, ToxAVCall *call);
 bool call_prepare_transmission(ToxAVCall *call);
 void call_kill_transmission(ToxAVCall *call);
+static void calls_rebalance_threads(ToxAV *av);
+static void iterate_workers_stop(ToxAV *av);
+static uint32_t online_cpu_cores(void);
 
 ToxAV *toxav_new(Tox *tox, TOXAV_ERR_NEW *error)
 {
@@ -113,9 +117,47 @@ ToxAV *toxav_new(Tox *tox, TOXAV_ERR_NEW *error)
         goto END;
     }
 
-    av->interval = 200;
+    av->timing.interval = 200;
     av->msi->av = av;
 
+    av->thread_budget = online_cpu_cores();
+    av->transmitting_calls = 0;
+    calls_rebalance_threads(av);
+
+    if (!media_sched_init(&av->sched, av->thread_budget)) {
+        msi_kill(av->msi, av->m->log);
+        pthread_mutex_destroy(av->mutex);
+        rc = TOXAV_ERR_NEW_MALLOC;
+        goto END;
+    }
+
+    if (!hash_map_init(&av->call_index, sizeof(uint32_t), 0)) {
+        media_sched_free(&av->sched);
+        msi_kill(av->msi, av->m->log);
+        pthread_mutex_destroy(av->mutex);
+        rc = TOXAV_ERR_NEW_MALLOC;
+        goto END;
+    }
+
+    if (create_recursive_mutex(av->calls_lock) != 0) {
+        hash_map_free(&av->call_index);
+        media_sched_free(&av->sched);
+        msi_kill(av->msi, av->m->log);
+        pthread_mutex_destroy(av->mutex);
+        rc = TOXAV_ERR_NEW_MALLOC;
+        goto END;
+    }
+
+    if (pthread_mutex_init(av->workers_mutex, NULL) != 0 || pthread_cond_init(av->workers_cond, NULL) != 0) {
+        pthread_mutex_destroy(av->calls_lock);
+        hash_map_free(&av->call_index);
+        media_sched_free(&av->sched);
+        msi_kill(av->msi, av->m->log);
+        pthread_mutex_destroy(av->mutex);
+        rc = TOXAV_ERR_NEW_MALLOC;
+        goto END;
+    }
+
     msi_register_callback(av->msi, callback_invite, msi_OnInvite);
     msi_register_callback(av->msi, callback_start, msi_OnStart);
     msi_register_callback(av->msi, callback_end, msi_OnEnd);
@@ -143,6 +185,8 @@ void toxav_kill(ToxAV *av)
         return;
     }
 
+    iterate_workers_stop(av);
+
     pthread_mutex_lock(av->mutex);
 
     /* To avoid possible deadlocks */
@@ -152,18 +196,21 @@ void toxav_kill(ToxAV *av)
     }
 
     /* Msi kill will hang up all calls so just clean these calls */
-    if (av->calls) {
-        ToxAVCall *it = call_get(av, av->calls_head);
+    ToxAVCall *it = av->calls;
 
-        while (it) {
-            call_kill_transmission(it);
-            it->msi_call = NULL; /* msi_kill() frees the call's msi_call handle; which causes #278 */
-            it = call_remove(it); /* This will eventually free av->calls */
-        }
+    while (it) {
+        call_kill_transmission(it);
+        it->msi_call = NULL; /* msi_kill() frees the call's msi_call handle; which causes #278 */
+        it = call_remove(it); /* This will eventually free av->call_slots */
     }
 
     pthread_mutex_unlock(av->mutex);
     pthread_mutex_destroy(av->mutex);
+    pthread_mutex_destroy(av->calls_lock);
+    hash_map_free(&av->call_index);
+    pthread_cond_destroy(av->workers_cond);
+    pthread_mutex_destroy(av->workers_mutex);
+    media_sched_free(&av->sched);
 
     free(av);
 }
@@ -175,8 +222,129 @@ Tox *toxav_get_tox(const ToxAV *av)
 
 uint32_t toxav_iteration_interval(const ToxAV *av)
 {
-    /* If no call is active interval is 200 */
-    return av->calls ? av->interval : 200;
+    /* If no call is active, or workers iterate the calls, interval is 200 */
+    return av->calls && av->worker_count == 0 ? av->timing.interval : 200;
+}
+
+static uint32_t online_cpu_cores(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cores > 0) {
+        return (uint32_t)cores;
+    }
+
+#endif
+    return 1;
+}
+
+void toxav_set_thread_budget(ToxAV *av, uint32_t threads)
+{
+    pthread_mutex_lock(av->mutex);
+    av->thread_budget = threads == 0 ? online_cpu_cores() : threads;
+    calls_rebalance_threads(av);
+    media_sched_set_threads(&av->sched, av->thread_budget);
+    pthread_mutex_unlock(av->mutex);
+}
+
+uint32_t toxav_get_thread_budget(const ToxAV *av)
+{
+    return av->thread_budget;
+}
+
+bool toxav_call_get_codec_time(ToxAV *av, uint32_t friend_number, uint64_t *encode_us, uint64_t *decode_us)
+{
+    pthread_mutex_lock(av->mutex);
+    ToxAVCall *call = call_get(av, friend_number);
+
+    if (call == NULL || !call->active || call->video.second == NULL) {
+        pthread_mutex_unlock(av->mutex);
+        return false;
+    }
+
+    /* the encoder runs under mutex_video, the decoder under the call mutex */
+    pthread_mutex_lock(call->mutex);
+    pthread_mutex_lock(call->mutex_video);
+
+    if (encode_us) {
+        *encode_us = call->video.second->encode_time_us;
+    }
+
+    if (decode_us) {
+        *decode_us = call->video.second->decode_time_us;
+    }
+
+    pthread_mutex_unlock(call->mutex_video);
+    pthread_mutex_unlock(call->mutex);
+    pthread_mutex_unlock(av->mutex);
+    return true;
+}
+
+bool toxav_call_get_sync_stats(ToxAV *av, uint32_t friend_number, int32_t *av_skew_ms, int32_t *audio_delay_ms,
+                               int32_t *video_delay_ms, uint32_t *buffer_ms)
+{
+    pthread_mutex_lock(av->mutex);
+    ToxAVCall *call = call_get(av, friend_number);
+
+    if (call == NULL || !call->active) {
+        pthread_mutex_unlock(av->mutex);
+        return false;
+    }
+
+    Playout_Stats stats;
+    playout_get_stats(&call->playout, current_time_monotonic(av->m->mono_time), &stats);
+    pthread_mutex_unlock(av->mutex);
+
+    if (av_skew_ms) {
+        *av_skew_ms = stats.av_skew_ms;
+    }
+
+    if (audio_delay_ms) {
+        *audio_delay_ms = stats.delay_ms[PLAYOUT_AUDIO];
+    }
+
+    if (video_delay_ms) {
+        *video_delay_ms = stats.delay_ms[PLAYOUT_VIDEO];
+    }
+
+    if (buffer_ms) {
+        *buffer_ms = stats.buffer_ms;
+    }
+
+    return true;
+}
+
+bool toxav_call_get_audio_jitter_stats(ToxAV *av, uint32_t friend_number, uint32_t *concealment_permille,
+                                       uint32_t *added_delay_ms)
+{
+    pthread_mutex_lock(av->mutex);
+    ToxAVCall *call = call_get(av, friend_number);
+
+    if (call == NULL || !call->active || call->audio.second == NULL) {
+        pthread_mutex_unlock(av->mutex);
+        return false;
+    }
+
+    /* the decoder runs under the call mutex */
+    pthread_mutex_lock(call->mutex);
+    const uint32_t played = call->audio.second->ld_frames_played;
+    const uint32_t concealed = call->audio.second->ld_frames_concealed;
+    pthread_mutex_unlock(call->mutex);
+
+    Playout_Stats stats;
+    playout_get_stats(&call->playout, current_time_monotonic(av->m->mono_time), &stats);
+    pthread_mutex_unlock(av->mutex);
+
+    if (concealment_permille) {
+        *concealment_permille = played == 0 ? 0 : (uint32_t)((uint64_t)concealed * 1000 / played);
+    }
+
+    if (added_delay_ms) {
+        *added_delay_ms = stats.added_delay_ms;
+    }
+
+    return true;
 }
 
 static void *video_play_bg(void *data)
@@ -191,10 +359,7 @@ static void *video_play_bg(void *data)
                                                  &(call->last_incoming_audio_frame_ltimestamp),
                                                  &(call->last_incoming_video_frame_rtimestamp),
                                                  &(call->last_incoming_video_frame_ltimestamp),
-                                                 call->bwc,
-                                                 &(call->call_timestamp_difference_adjustment),
-                                                 &(call->call_timestamp_difference_to_sender)
-                                                );
+                                                 call->bwc, &call->playout);
         }
     }
 
@@ -202,41 +367,65 @@ static void *video_play_bg(void *data)
 }
 
 
-void toxav_iterate(ToxAV *av)
+/*
+ * Iterate the calls of one shard, see toxav_set_iterate_workers(), and update
+ * the iteration interval of the shard in timing.
+ *
+ * Returns the number of calls iterated.
+ */
+static uint32_t iterate_calls(ToxAV *av, uint32_t shard, uint32_t shards, ToxAV_Iterate_Timing *timing)
 {
-    pthread_mutex_lock(av->mutex);
+    pthread_mutex_lock(av->calls_lock);
 
     if (av->calls == NULL) {
-        pthread_mutex_unlock(av->mutex);
-        return;
+        pthread_mutex_unlock(av->calls_lock);
+        return 0;
     }
 
-    uint64_t start = current_time_monotonic();
+    uint64_t start = current_time_monotonic(av->m->mono_time);
     int32_t rc = 500;
     uint32_t audio_iterations = 0;
+    uint32_t audio_budget_ms = 0;
+    uint32_t iterated = 0;
 
-    ToxAVCall *i = av->calls[av->calls_head];
+    const uint64_t pass_start_us = current_time_actual();
+
+    ToxAVCall *i = av->calls;
 
     for (; i; i = i->next) {
 
         audio_iterations = 0;
 
-        if (i->active) {
+        if (i->active && i->iterate_shard % shards == shard) {
             pthread_mutex_lock(i->mutex);
-            pthread_mutex_unlock(av->mutex);
+            pthread_mutex_unlock(av->calls_lock);
+
+            ++iterated;
 
+            // HINT: under load the media scheduler keeps the rest of the pass for audio
+            const bool run_video = media_sched_video_allowed(&av->sched, pass_start_us, current_time_actual(),
+                                   i->video_skipped);
+            i->video_skipped = !run_video;
 
 #if !defined(_GNU_SOURCE)
-            video_play_bg((void *)(i));
+
+            if (run_video) {
+                video_play_bg((void *)(i));
+            }
+
 #else
             // ------- multithreaded av_iterate for video -------
             pthread_t video_play_thread;
+            bool video_play_running = false;
             LOGGER_TRACE(av->m->log, "video_play -----");
 
-            if (pthread_create(&video_play_thread, NULL, video_play_bg, (void *)(i))) {
+            if (!run_video) {
+                LOGGER_TRACE(av->m->log, "video_play skipped under load");
+            } else if (pthread_create(&video_play_thread, NULL, video_play_bg, (void *)(i))) {
                 LOGGER_WARNING(av->m->log, "error creating video play thread");
             } else {
                 // TODO: set lower prio for video play thread ?
+                video_play_running = true;
             }
 
             // ------- multithreaded av_iterate for video -------
@@ -250,9 +439,7 @@ void toxav_iterate(ToxAV *av)
                                         &(i->last_incoming_audio_frame_ltimestamp),
                                         &(i->last_incoming_video_frame_rtimestamp),
                                         &(i->last_incoming_video_frame_ltimestamp),
-                                        &(i->call_timestamp_difference_adjustment),
-                                        &(i->call_timestamp_difference_to_sender)
-                                       );
+                                        &i->playout);
 
             if (res_ac == 2) {
                 i->skip_video_flag = 1;
@@ -271,7 +458,7 @@ void toxav_iterate(ToxAV *av)
             // pthread_join(video_play_thread, NULL);
 #else
 
-            while (pthread_tryjoin_np(video_play_thread, NULL) != 0) {
+            while (video_play_running && pthread_tryjoin_np(video_play_thread, NULL) != 0) {
                 if (audio_iterations < AUDIO_ITERATATIONS_WHILE_VIDEO) {
                     /* video thread still running, let's do some more audio */
                     if (ac_iterate(i->audio.second,
@@ -279,9 +466,7 @@ void toxav_iterate(ToxAV *av)
                                    &(i->last_incoming_audio_frame_ltimestamp),
                                    &(i->last_incoming_video_frame_rtimestamp),
                                    &(i->last_incoming_video_frame_ltimestamp),
-                                   &(i->call_timestamp_difference_adjustment),
-                                   &(i->call_timestamp_difference_to_sender)
-                                  ) == 0) {
+                                   &i->playout) == 0) {
                         // TODO: Zoff: not sure if this sleep is good, or bad??
                         usleep(40);
                     } else {
@@ -294,7 +479,10 @@ void toxav_iterate(ToxAV *av)
                 audio_iterations++;
             }
 
-            pthread_join(video_play_thread, NULL);
+            if (video_play_running) {
+                pthread_join(video_play_thread, NULL);
+            }
+
 #endif
 
 
@@ -307,6 +495,8 @@ void toxav_iterate(ToxAV *av)
                 // use 4ms less than the actual audio frame duration, to have still some time left
                 // LOGGER_WARNING(av->m->log, "lp_frame_duration=%d", (int)i->audio.second->lp_frame_duration);
                 rc = MIN((i->audio.second->lp_frame_duration - 4), rc);
+                audio_budget_ms = audio_budget_ms == 0 ? (uint32_t)i->audio.second->lp_frame_duration
+                                  : MIN((uint32_t)i->audio.second->lp_frame_duration, audio_budget_ms);
             }
 
             if (i->msi_call->self_capabilities & msi_CapRVideo &&
@@ -322,7 +512,7 @@ void toxav_iterate(ToxAV *av)
             uint32_t fid = i->friend_number;
 
             pthread_mutex_unlock(i->mutex);
-            pthread_mutex_lock(av->mutex);
+            pthread_mutex_lock(av->calls_lock);
 
             /* In case this call is popped from container stop iteration */
             if (call_get(av, fid) != i) {
@@ -370,16 +560,148 @@ void toxav_iterate(ToxAV *av)
         }
     }
 
+    pthread_mutex_unlock(av->calls_lock);
+
+    media_sched_pass_end(&av->sched, pass_start_us, current_time_actual(), audio_budget_ms);
+
+    timing->interval = rc < timing->dmssa ? 0 : (rc - timing->dmssa);
+    timing->dmsst += current_time_monotonic(av->m->mono_time) - start;
+
+    if (++timing->dmssc == 3) {
+        timing->dmssa = timing->dmsst / 3 + 5 /* NOTE Magic Offset for precission */;
+        timing->dmssc = 0;
+        timing->dmsst = 0;
+    }
+
+    return iterated;
+}
+
+void toxav_iterate(ToxAV *av)
+{
+    if (av->worker_count > 0) {
+        return;
+    }
+
+    iterate_calls(av, 0, 1, &av->timing);
+}
+
+static void *iterate_worker(void *data)
+{
+    ToxAV_Iterate_Worker *worker = (ToxAV_Iterate_Worker *)data;
+    ToxAV *av = worker->av;
+
+    pthread_mutex_lock(av->workers_mutex);
+
+    while (!av->workers_stop) {
+        pthread_mutex_unlock(av->workers_mutex);
+
+        uint32_t interval = 200;
+
+        if (iterate_calls(av, worker->shard, av->worker_count, &worker->timing) > 0) {
+            /* Don't spin when decoding takes longer than the frames last */
+            interval = worker->timing.interval > 0 ? worker->timing.interval : 1;
+        }
+
+        /* pthread_cond_timedwait() waits until a wall clock time */
+        const uint64_t until_us = current_time_actual() + (uint64_t)interval * 1000;
+        struct timespec until;
+        until.tv_sec = (time_t)(until_us / 1000000);
+        until.tv_nsec = (long)(until_us % 1000000) * 1000;
+
+        pthread_mutex_lock(av->workers_mutex);
+
+        if (!av->workers_stop) {
+            pthread_cond_timedwait(av->workers_cond, av->workers_mutex, &until);
+        }
+    }
+
+    pthread_mutex_unlock(av->workers_mutex);
+    return NULL;
+}
+
+/*
+ * Stop and join the first started workers. The workers read worker_count
+ * until they are joined, so it's only reset afterwards.
+ */
+static void iterate_workers_join(ToxAV *av, uint32_t started)
+{
+    pthread_mutex_lock(av->workers_mutex);
+    av->workers_stop = true;
+    pthread_cond_broadcast(av->workers_cond);
+    pthread_mutex_unlock(av->workers_mutex);
+
+    for (uint32_t k = 0; k < started; ++k) {
+        pthread_join(av->workers[k].thread, NULL);
+    }
+
+    free(av->workers);
+    av->workers = NULL;
+    av->worker_count = 0;
+}
+
+static void iterate_workers_stop(ToxAV *av)
+{
+    if (av->workers == NULL) {
+        return;
+    }
+
+    iterate_workers_join(av, av->worker_count);
+}
+
+bool toxav_set_iterate_workers(ToxAV *av, uint32_t workers)
+{
+    if (workers > TOXAV_MAX_ITERATE_WORKERS) {
+        return false;
+    }
+
+    iterate_workers_stop(av);
+
+    /* Deal the calls out evenly again, new calls go round from there */
+    pthread_mutex_lock(av->mutex);
+    pthread_mutex_lock(av->calls_lock);
+
+    av->next_iterate_shard = 0;
+
+    for (ToxAVCall *it = av->calls; it; it = it->next) {
+        it->iterate_shard = av->next_iterate_shard++;
+    }
+
+    pthread_mutex_unlock(av->calls_lock);
     pthread_mutex_unlock(av->mutex);
 
-    av->interval = rc < av->dmssa ? 0 : (rc - av->dmssa);
-    av->dmsst += current_time_monotonic() - start;
+    if (workers == 0) {
+        return true;
+    }
+
+    av->workers = (ToxAV_Iterate_Worker *)calloc(workers, sizeof(ToxAV_Iterate_Worker));
+
+    if (av->workers == NULL) {
+        return false;
+    }
+
+    av->workers_stop = false;
+
+    /* The workers read the count, so it's set before the first one starts */
+    av->worker_count = workers;
 
-    if (++av->dmssc == 3) {
-        av->dmssa = av->dmsst / 3 + 5 /* NOTE Magic Offset for precission */;
-        av->dmssc = 0;
-        av->dmsst = 0;
+    for (uint32_t k = 0; k < workers; ++k) {
+        av->workers[k].av = av;
+        av->workers[k].shard = k;
+        av->workers[k].timing.interval = 200;
+
+        if (pthread_create(&av->workers[k].thread, NULL, iterate_worker, &av->workers[k]) != 0) {
+            LOGGER_WARNING(av->m->log, "error creating iterate worker %u", k);
+            iterate_workers_join(av, k);
+            return false;
+        }
     }
+
+    return true;
+}
+
+uint32_t toxav_get_iterate_workers(const ToxAV *av)
+{
+    return av->worker_count;
 }
 
 bool toxav_call(ToxAV *av, uint32_t friend_number, uint32_t audio_bit_rate, uint32_t video_bit_rate,
@@ -789,6 +1111,35 @@ bool toxav_option_set(ToxAV *av, uint32_t friend_number, TOXAV_OPTIONS_OPTION op
             vc->video_rc_min_quantizer = (int32_t)value;
             LOGGER_WARNING(av->m->log, "video encoder setting video_rc_min_quantizer to: %d", (int)value);
         }
+    } else if (option == TOXAV_ENCODER_TEMPORAL_LAYERS) {
+        VCSession *vc = (VCSession *)call->video.second;
+
+        if (value < 1 || value > VIDEO_MAX_TEMPORAL_LAYERS) {
+            rc = TOXAV_ERR_OPTION_SET_INVALID_VALUE;
+        } else if (vc->video_temporal_layers == (uint8_t)value) {
+            LOGGER_WARNING(av->m->log, "video encoder temporal_layers already set to: %d", (int)value);
+        } else {
+            vc->video_temporal_layers_prev = vc->video_temporal_layers;
+            vc->video_temporal_layers = (uint8_t)value;
+            LOGGER_WARNING(av->m->log, "video encoder setting temporal_layers to: %d", (int)value);
+        }
+    } else if (option == TOXAV_AUDIO_INPUT_GAIN || option == TOXAV_AUDIO_OUTPUT_GAIN) {
+        ACSession *ac = (ACSession *)call->audio.second;
+
+        if (value < 0 || value > AUDIO_MAX_GAIN_PERCENT) {
+            rc = TOXAV_ERR_OPTION_SET_INVALID_VALUE;
+        } else if (ac != NULL) {
+            pthread_mutex_lock(call->mutex_audio);
+
+            if (option == TOXAV_AUDIO_INPUT_GAIN) {
+                ac->le_gain = afe_gain_from_percent(value);
+            } else {
+                ac->ld_gain = afe_gain_from_percent(value);
+            }
+
+            pthread_mutex_unlock(call->mutex_audio);
+            LOGGER_DEBUG(av->m->log, "audio setting gain %d to: %d", (int)option, (int)value);
+        }
     } else if (option == TOXAV_DECODER_ERROR_CONCEALMENT) {
         VCSession *vc = (VCSession *)call->video.second;
 
@@ -975,14 +1326,14 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
     TOXAV_ERR_SEND_FRAME rc = TOXAV_ERR_SEND_FRAME_OK;
     ToxAVCall *call;
 
-    uint64_t audio_frame_record_timestamp = current_time_monotonic();
+    uint64_t audio_frame_record_timestamp = current_time_monotonic(av->m->mono_time);
 
     if (m_friend_exists(av->m, friend_number) == 0) {
         rc = TOXAV_ERR_SEND_FRAME_FRIEND_NOT_FOUND;
         goto END;
     }
 
-    if (pthread_mutex_trylock(av->mutex) != 0) {
+    if (pthread_mutex_trylock(av->calls_lock) != 0) {
         rc = TOXAV_ERR_SEND_FRAME_SYNC;
         goto END;
     }
@@ -990,7 +1341,7 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
     call = call_get(av, friend_number);
 
     if (call == NULL || !call->active || call->msi_call->state != msi_CallActive) {
-        pthread_mutex_unlock(av->mutex);
+        pthread_mutex_unlock(av->calls_lock);
         rc = TOXAV_ERR_SEND_FRAME_FRIEND_NOT_IN_CALL;
         goto END;
     }
@@ -998,13 +1349,13 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
     if (call->audio_bit_rate == 0 ||
             !(call->msi_call->self_capabilities & msi_CapSAudio) ||
             !(call->msi_call->peer_capabilities & msi_CapRAudio)) {
-        pthread_mutex_unlock(av->mutex);
+        pthread_mutex_unlock(av->calls_lock);
         rc = TOXAV_ERR_SEND_FRAME_PAYLOAD_TYPE_DISABLED;
         goto END;
     }
 
     pthread_mutex_lock(call->mutex_audio);
-    pthread_mutex_unlock(av->mutex);
+    pthread_mutex_unlock(av->calls_lock);
 
     if (pcm == NULL) {
         pthread_mutex_unlock(call->mutex_audio);
@@ -1012,7 +1363,8 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
         goto END;
     }
 
-    if (channels > 2) {
+    if (channels == 0 || channels > 2
+            || sampling_rate < AUDIO_MIN_SAMPLING_RATE || sampling_rate > AUDIO_MAX_SAMPLING_RATE) {
         pthread_mutex_unlock(call->mutex_audio);
         rc = TOXAV_ERR_SEND_FRAME_INVALID;
         goto END;
@@ -1026,12 +1378,15 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
             goto END;
         }
 
-        VLA(uint8_t, dest, sample_count + sizeof(sampling_rate)); /* This is more than enough always */
+        /* This is more than enough always */
+        VLA(uint8_t, dest, afe_resampled_frames(sample_count, sampling_rate, AUDIO_START_SAMPLING_RATE)
+            * AUDIO_START_CHANNEL_COUNT + sizeof(sampling_rate));
 
-        sampling_rate = net_htonl(sampling_rate);
-        memcpy(dest, &sampling_rate, sizeof(sampling_rate));
-        int vrc = opus_encode(call->audio.second->encoder, pcm, sample_count,
-                              dest + sizeof(sampling_rate), SIZEOF_VLA(dest) - sizeof(sampling_rate));
+        /* The packet carries the rate of the encoder, not the one of the input */
+        const uint32_t encoded_rate = net_htonl(AUDIO_START_SAMPLING_RATE);
+        memcpy(dest, &encoded_rate, sizeof(encoded_rate));
+        int vrc = ac_encode_frame(call->audio.second, pcm, sample_count, channels, sampling_rate,
+                                  dest + sizeof(encoded_rate), SIZEOF_VLA(dest) - sizeof(encoded_rate));
 
         if (vrc < 0) {
             LOGGER_WARNING(av->m->log, "Failed to encode audio frame %s", opus_strerror(vrc));
@@ -1066,6 +1421,7 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
             if (rtp_send_data(call->audio.first, dest,
                               vrc + sizeof(sampling_rate),
                               false,
+                              0,
                               audio_frame_record_timestamp,
                               VIDEO_FRAGMENT_NUM_NO_FRAG,
                               0,
@@ -1082,6 +1438,7 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
             if (rtp_send_data(call->audio.first, dest,
                               vrc + sizeof(sampling_rate),
                               false,
+                              0,
                               audio_frame_record_timestamp,
                               VIDEO_FRAGMENT_NUM_NO_FRAG,
                               0,
@@ -1116,22 +1473,34 @@ END:
 /* --- VIDEO EN-CODING happens here --- */
 /* --- VIDEO EN-CODING happens here --- */
 /* --- VIDEO EN-CODING happens here --- */
-bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height, const uint8_t *y,
-                            const uint8_t *u, const uint8_t *v, TOXAV_ERR_SEND_FRAME *error)
+static bool video_planes_valid(uint16_t width, const VC_Frame_Planes *planes)
+{
+    if (planes->format == TOXAV_VIDEO_FORMAT_NV12) {
+        return planes->ystride >= width && planes->ustride >= 2 * (width / 2);
+    }
+
+    return planes->format == TOXAV_VIDEO_FORMAT_I420
+           && planes->ystride >= width && planes->ustride >= width / 2 && planes->vstride >= width / 2;
+}
+
+static bool video_send_frame_planes(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
+                                    const VC_Frame_Planes *planes, TOXAV_ERR_SEND_FRAME *error)
 {
     TOXAV_ERR_SEND_FRAME rc = TOXAV_ERR_SEND_FRAME_OK;
     ToxAVCall *call;
 
     // LOGGER_ERROR(av->m->log, "OMX:H:001");
 
-    uint64_t video_frame_record_timestamp = current_time_monotonic();
+    uint64_t video_frame_record_timestamp = current_time_monotonic(av->m->mono_time);
 
     if (m_friend_exists(av->m, friend_number) == 0) {
         rc = TOXAV_ERR_SEND_FRAME_FRIEND_NOT_FOUND;
         goto END;
     }
 
-    if (pthread_mutex_trylock(av->mutex) != 0) {
+    /* Only the call table is locked for the lookup, so that frames to
+     * different calls don't wait for each other to be encoded */
+    if (pthread_mutex_trylock(av->calls_lock) != 0) {
         rc = TOXAV_ERR_SEND_FRAME_SYNC;
         goto END;
     }
@@ -1139,16 +1508,26 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
     call = call_get(av, friend_number);
 
     if (call == NULL || !call->active || call->msi_call->state != msi_CallActive) {
-        pthread_mutex_unlock(av->mutex);
+        pthread_mutex_unlock(av->calls_lock);
         rc = TOXAV_ERR_SEND_FRAME_FRIEND_NOT_IN_CALL;
         goto END;
     }
 
+    if (call->video_bit_rate == 0 ||
+            !(call->msi_call->self_capabilities & msi_CapSVideo) ||
+            !(call->msi_call->peer_capabilities & msi_CapRVideo)) {
+        pthread_mutex_unlock(av->calls_lock);
+        rc = TOXAV_ERR_SEND_FRAME_PAYLOAD_TYPE_DISABLED;
+        goto END;
+    }
+
+    pthread_mutex_lock(call->mutex_video);
+    pthread_mutex_unlock(av->calls_lock);
 
     if (call->video.second->skip_fps != 0) {
         call->video.second->skip_fps_counter++;
 
-        if (call->video.second->skip_fps_duration_until_ts > current_time_monotonic()) {
+        if (call->video.second->skip_fps_duration_until_ts > video_frame_record_timestamp) {
             // HINT: ok stop skipping frames now, and reset the values
             call->video.second->skip_fps = 0;
             call->video.second->skip_fps_duration_until_ts = 0;
@@ -1160,7 +1539,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
                 // skip this video frame, receiver can't handle this many FPS
                 // rc = TOXAV_ERR_SEND_FRAME_INVALID; // should we tell the client? not sure about this
                 //                                     // client may try to resend the frame, which is not what we want
-                pthread_mutex_unlock(av->mutex);
+                pthread_mutex_unlock(call->mutex_video);
                 goto END;
             }
         }
@@ -1169,30 +1548,38 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
     uint64_t ms_to_last_frame = 1;
 
     if (call->video.second) {
-        ms_to_last_frame = current_time_monotonic() - call->video.second->last_encoded_frame_ts;
+        ms_to_last_frame = video_frame_record_timestamp - call->video.second->last_encoded_frame_ts;
 
         if (call->video.second->last_encoded_frame_ts == 0) {
             ms_to_last_frame = 1;
         }
     }
 
-    if (call->video_bit_rate == 0 ||
-            !(call->msi_call->self_capabilities & msi_CapSVideo) ||
-            !(call->msi_call->peer_capabilities & msi_CapRVideo)) {
-        pthread_mutex_unlock(av->mutex);
-        rc = TOXAV_ERR_SEND_FRAME_PAYLOAD_TYPE_DISABLED;
+    if (planes->y == NULL || planes->u == NULL || (planes->format == TOXAV_VIDEO_FORMAT_I420 && planes->v == NULL)) {
+        pthread_mutex_unlock(call->mutex_video);
+        rc = TOXAV_ERR_SEND_FRAME_NULL;
         goto END;
     }
 
-    pthread_mutex_lock(call->mutex_video);
-    pthread_mutex_unlock(av->mutex);
+    if (!video_planes_valid(width, planes)) {
+        pthread_mutex_unlock(call->mutex_video);
+        rc = TOXAV_ERR_SEND_FRAME_INVALID;
+        goto END;
+    }
 
-    if (y == NULL || u == NULL || v == NULL) {
+#ifdef RASPBERRY_PI_OMX
+
+    // HINT: the OMX encoder copies whole packed I420 planes into its input buffer
+    if (call->video.second->video_encoder_coded_used == TOXAV_ENCODER_CODEC_USED_H264
+            && (planes->format != TOXAV_VIDEO_FORMAT_I420 || planes->ystride != width
+                || planes->ustride != width / 2 || planes->vstride != width / 2)) {
         pthread_mutex_unlock(call->mutex_video);
-        rc = TOXAV_ERR_SEND_FRAME_NULL;
+        rc = TOXAV_ERR_SEND_FRAME_INVALID;
         goto END;
     }
 
+#endif
+
 
     // LOGGER_ERROR(av->m->log, "h264_video_capabilities_received=%d",
     //             (int)call->video.second->h264_video_capabilities_received);
@@ -1249,7 +1636,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
         }
     }
 
-    if ((call->video_bit_rate_last_last_changed_cb_ts + 2000) < current_time_monotonic()) {
+    if ((call->video_bit_rate_last_last_changed_cb_ts + 2000) < video_frame_record_timestamp) {
         if (call->video_bit_rate_last_last_changed != call->video_bit_rate) {
             if (av->call_comm_cb.first) {
                 av->call_comm_cb.first(av, friend_number,
@@ -1261,7 +1648,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
             call->video_bit_rate_last_last_changed = call->video_bit_rate;
         }
 
-        call->video_bit_rate_last_last_changed_cb_ts = current_time_monotonic();
+        call->video_bit_rate_last_last_changed_cb_ts = video_frame_record_timestamp;
     }
 
     int vpx_encode_flags = 0;
@@ -1313,7 +1700,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
     long encode_time_auto_tune = MAX_ENCODE_TIME_US;
 
     if (call->video.second->last_encoded_frame_ts > 0) {
-        encode_time_auto_tune = (current_time_monotonic() - call->video.second->last_encoded_frame_ts) * 1000;
+        encode_time_auto_tune = (video_frame_record_timestamp - call->video.second->last_encoded_frame_ts) * 1000;
 #ifdef VIDEO_CODEC_ENCODER_USE_FRAGMENTS
         encode_time_auto_tune = encode_time_auto_tune * VIDEO_CODEC_FRAGMENT_NUMS;
 #endif
@@ -1365,7 +1752,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
 
     // we start with I-frames (full frames) and then switch to normal mode later
 
-    call->video.second->last_encoded_frame_ts = current_time_monotonic();
+    call->video.second->last_encoded_frame_ts = video_frame_record_timestamp;
 
     if (call->video.second->send_keyframe_request_received == 1) {
         vpx_encode_flags = VPX_EFLAG_FORCE_KF;
@@ -1376,10 +1763,10 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
         LOGGER_DEBUG(av->m->log, "++++ FORCE KEYFRAME ++++:%d %d %d",
                      (int)call->video.second->last_sent_keyframe_ts,
                      (int)VIDEO_MIN_SEND_KEYFRAME_INTERVAL,
-                     (int)current_time_monotonic());
+                     (int)video_frame_record_timestamp);
 
         if ((call->video.second->last_sent_keyframe_ts + VIDEO_MIN_SEND_KEYFRAME_INTERVAL)
-                < current_time_monotonic()) {
+                < video_frame_record_timestamp) {
             // it's been x seconds without a keyframe, send one now
             vpx_encode_flags = VPX_EFLAG_FORCE_KF;
             vpx_encode_flags |= VP8_EFLAG_FORCE_GF;
@@ -1406,6 +1793,8 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
     // for the H264 encoder -------
 
 
+    const uint64_t encode_start = current_time_actual();
+
     { /* Encode */
 
 
@@ -1416,7 +1805,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
 
             // HINT: vp8
             uint32_t result = encode_frame_vpx(av, friend_number, width, height,
-                                               y, u, v, call,
+                                               planes, call,
                                                &video_frame_record_timestamp,
                                                vpx_encode_flags,
                                                &nal,
@@ -1435,14 +1824,14 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
             // HINT: H264
 #ifdef RASPBERRY_PI_OMX
             uint32_t result = encode_frame_h264_omx_raspi(av, friend_number, width, height,
-                              y, u, v, call,
+                              planes->y, planes->u, planes->v, call,
                               &video_frame_record_timestamp,
                               vpx_encode_flags,
                               &nal,
                               &i_frame_size);
 #else
             uint32_t result = encode_frame_h264(av, friend_number, width, height,
-                                                y, u, v, call,
+                                                planes, call,
                                                 &video_frame_record_timestamp,
                                                 vpx_encode_flags,
                                                 &nal,
@@ -1458,6 +1847,9 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
         }
     }
 
+    const uint64_t encode_end = current_time_actual();
+    call->video.second->encode_time_us += encode_end - encode_start;
+    media_sched_add_codec_time(&av->sched, encode_end, encode_end - encode_start);
     ++call->video.second->frame_counter;
 
     LOGGER_DEBUG(av->m->log, "VPXENC:======================\n");
@@ -1470,7 +1862,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
                 || (call->video.second->video_encoder_coded_used == TOXAV_ENCODER_CODEC_USED_VP9)) {
 
             uint32_t result = send_frames_vpx(av, friend_number, width, height,
-                                              y, u, v, call,
+                                              planes->y, planes->u, planes->v, call,
                                               &video_frame_record_timestamp,
                                               vpx_encode_flags,
                                               &nal,
@@ -1486,7 +1878,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
             // HINT: H264
 #ifdef RASPBERRY_PI_OMX
             uint32_t result = send_frames_h264_omx_raspi(av, friend_number, width, height,
-                              y, u, v, call,
+                              planes->y, planes->u, planes->v, call,
                               &video_frame_record_timestamp,
                               vpx_encode_flags,
                               &nal,
@@ -1495,7 +1887,7 @@ bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, u
 
 #else
             uint32_t result = send_frames_h264(av, friend_number, width, height,
-                                               y, u, v, call,
+                                               planes->y, planes->u, planes->v, call,
                                                &video_frame_record_timestamp,
                                                vpx_encode_flags,
                                                &nal,
@@ -1520,6 +1912,45 @@ END:
 
     return rc == TOXAV_ERR_SEND_FRAME_OK;
 }
+
+bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height, const uint8_t *y,
+                            const uint8_t *u, const uint8_t *v, TOXAV_ERR_SEND_FRAME *error)
+{
+    VC_Frame_Planes planes;
+    planes.format = TOXAV_VIDEO_FORMAT_I420;
+    planes.y = y;
+    planes.u = u;
+    planes.v = v;
+    planes.ystride = width;
+    planes.ustride = width / 2;
+    planes.vstride = width / 2;
+
+    return video_send_frame_planes(av, friend_number, width, height, &planes, error);
+}
+
+bool toxav_video_send_frame_ex(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
+                               TOXAV_VIDEO_FORMAT format, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               int32_t ystride, int32_t ustride, int32_t vstride,
+                               toxav_video_frame_release_cb *release_cb, void *frame_user_data,
+                               TOXAV_ERR_SEND_FRAME *error)
+{
+    VC_Frame_Planes planes;
+    planes.format = format;
+    planes.y = y;
+    planes.u = u;
+    planes.v = v;
+    planes.ystride = ystride;
+    planes.ustride = ustride;
+    planes.vstride = vstride;
+
+    const bool ret = video_send_frame_planes(av, friend_number, width, height, &planes, error);
+
+    if (release_cb) {
+        release_cb(av, friend_number, frame_user_data);
+    }
+
+    return ret;
+}
 /* --- VIDEO EN-CODING happens here --- */
 /* --- VIDEO EN-CODING happens here --- */
 /* --- VIDEO EN-CODING happens here --- */
@@ -1578,6 +2009,11 @@ void callback_bwc(BWController *bwc, uint32_t friend_number, float loss, void *u
         return;
     }
 
+    /* the encoder leaves out its upper temporal layer while there is loss */
+    pthread_mutex_lock(call->mutex_video);
+    temporal_layers_report_loss(&call->video.second->temporal_layers, loss);
+    pthread_mutex_unlock(call->mutex_video);
+
     if (call->video.second->video_bitrate_autoset == 0) {
         // HINT: client does not want bitrate autoset
         return;
@@ -1891,6 +2327,11 @@ ToxAVCall *call_new(ToxAV *av, uint32_t friend_number, TOXAV_ERR_CALL *error)
 
     call = (ToxAVCall *)calloc(sizeof(ToxAVCall), 1);
 
+    if (call == NULL) {
+        rc = TOXAV_ERR_CALL_MALLOC;
+        goto END;
+    }
+
     call->last_incoming_video_frame_rtimestamp = 0;
     call->last_incoming_video_frame_ltimestamp = 0;
 
@@ -1902,84 +2343,105 @@ ToxAVCall *call_new(ToxAV *av, uint32_t friend_number, TOXAV_ERR_CALL *error)
     call->reference_diff_timestamp = 0;
     call->reference_diff_timestamp_set = 0;
 
-    if (call == NULL) {
+    call->av = av;
+    call->friend_number = friend_number;
+
+    if (!calls_add(av, call)) {
+        free(call);
+        call = NULL;
         rc = TOXAV_ERR_CALL_MALLOC;
         goto END;
     }
 
-    call->av = av;
-    call->friend_number = friend_number;
+END:
 
-    if (av->calls == NULL) { /* Creating */
-        av->calls = (ToxAVCall **)calloc(sizeof(ToxAVCall *), friend_number + 1);
+    if (error) {
+        *error = rc;
+    }
 
-        if (av->calls == NULL) {
-            free(call);
-            call = NULL;
-            rc = TOXAV_ERR_CALL_MALLOC;
-            goto END;
-        }
+    return call;
+}
+
+/*
+ * Put a call into the call table. Calls take the first free slot, and the
+ * slots only grow when all of them are taken, so the table stays as large as
+ * the most calls at once rather than the highest friend number.
+ *
+ * Assumes mutex locked.
+ */
+static bool calls_add(ToxAV *av, ToxAVCall *call)
+{
+    uint8_t key[sizeof(uint32_t)];
+    memcpy(key, &call->friend_number, sizeof(key));
 
-        av->calls_tail = av->calls_head = friend_number;
-    } else if (av->calls_tail < friend_number) { /* Appending */
-        ToxAVCall **tmp = (ToxAVCall **)realloc(av->calls, sizeof(ToxAVCall *) * (friend_number + 1));
+    pthread_mutex_lock(av->calls_lock);
 
-        if (tmp == NULL) {
-            free(call);
-            call = NULL;
-            rc = TOXAV_ERR_CALL_MALLOC;
-            goto END;
-        }
+    uint32_t slot = 0;
 
-        av->calls = tmp;
+    while (slot < av->call_slots_size && av->call_slots[slot] != NULL) {
+        ++slot;
+    }
 
-        /* Set fields in between to null */
-        uint32_t i = av->calls_tail + 1;
+    if (slot == av->call_slots_size) {
+        const uint32_t size = av->call_slots_size == 0 ? 4 : av->call_slots_size * 2;
+        ToxAVCall **slots = (ToxAVCall **)realloc(av->call_slots, size * sizeof(ToxAVCall *));
 
-        for (; i < friend_number; i ++) {
-            av->calls[i] = NULL;
+        if (slots == NULL) {
+            pthread_mutex_unlock(av->calls_lock);
+            return false;
         }
 
-        call->prev = av->calls[av->calls_tail];
-        av->calls[av->calls_tail]->next = call;
+        memset(slots + av->call_slots_size, 0, (size - av->call_slots_size) * sizeof(ToxAVCall *));
+        av->call_slots = slots;
+        av->call_slots_size = size;
+    }
 
-        av->calls_tail = friend_number;
-    } else if (av->calls_head > friend_number) { /* Inserting at front */
-        call->next = av->calls[av->calls_head];
-        av->calls[av->calls_head]->prev = call;
-        av->calls_head = friend_number;
+    if (!hash_map_add(&av->call_index, key, (int)slot)) {
+        pthread_mutex_unlock(av->calls_lock);
+        return false;
     }
 
-    av->calls[friend_number] = call;
+    av->call_slots[slot] = call;
+    call->call_slot = slot;
+    call->iterate_shard = av->next_iterate_shard++;
 
-END:
+    call->prev = NULL;
+    call->next = av->calls;
 
-    if (error) {
-        *error = rc;
+    if (av->calls) {
+        av->calls->prev = call;
     }
 
-    return call;
+    av->calls = call;
+
+    pthread_mutex_unlock(av->calls_lock);
+    return true;
 }
 
 
 ToxAVCall *call_get(ToxAV *av, uint32_t friend_number)
 {
-    /* Assumes mutex locked */
-    if (av->calls == NULL || av->calls_tail < friend_number) {
+    /* Assumes mutex or calls_lock locked */
+    uint8_t key[sizeof(uint32_t)];
+    memcpy(key, &friend_number, sizeof(key));
+
+    const int slot = hash_map_find(&av->call_index, key);
+
+    if (slot < 0) {
         return NULL;
     }
 
-    return av->calls[friend_number];
+    return av->call_slots[slot];
 }
 
 
 ToxAVCall *call_remove(ToxAVCall *call)
 {
+    /* Assumes mutex locked */
     if (call == NULL) {
         return NULL;
     }
 
-    uint32_t friend_number = call->friend_number;
     ToxAV *av = call->av;
 
     ToxAVCall *prev = call->prev;
@@ -1992,33 +2454,34 @@ ToxAVCall *call_remove(ToxAVCall *call)
         call->msi_call->av_call = NULL;
     }
 
-    free(call);
+    uint8_t key[sizeof(uint32_t)];
+    memcpy(key, &call->friend_number, sizeof(key));
+
+    pthread_mutex_lock(av->calls_lock);
 
     if (prev) {
         prev->next = next;
-    } else if (next) {
-        av->calls_head = next->friend_number;
     } else {
-        goto CLEAR;
+        av->calls = next;
     }
 
     if (next) {
         next->prev = prev;
-    } else if (prev) {
-        av->calls_tail = prev->friend_number;
-    } else {
-        goto CLEAR;
     }
 
-    av->calls[friend_number] = NULL;
-    return next;
+    hash_map_remove(&av->call_index, key, (int)call->call_slot);
+    av->call_slots[call->call_slot] = NULL;
+
+    if (av->calls == NULL) {
+        free(av->call_slots);
+        av->call_slots = NULL;
+        av->call_slots_size = 0;
+    }
 
-CLEAR:
-    av->calls_head = av->calls_tail = 0;
-    free(av->calls);
-    av->calls = NULL;
+    pthread_mutex_unlock(av->calls_lock);
 
-    return NULL;
+    free(call);
+    return next;
 }
 
 
@@ -2054,11 +2517,19 @@ bool call_prepare_transmission(ToxAVCall *call)
         goto FAILURE_2;
     }
 
+    if (!playout_init(&call->playout)) {
+        goto FAILURE_1;
+    }
+
+    /* The new call's codecs are created with its share of the thread budget */
+    ++av->transmitting_calls;
+    calls_rebalance_threads(av);
+
     /* Prepare bwc */
     call->bwc = bwc_new(av->m, call->friend_number, callback_bwc, call);
 
     { /* Prepare audio */
-        call->audio.second = ac_new(av->m->log, av, call->friend_number, av->acb.first, av->acb.second);
+        call->audio.second = ac_new(av->m->mono_time, av->m->log, av, call->friend_number, av->acb.first, av->acb.second);
 
         if (!call->audio.second) {
             LOGGER_ERROR(av->m->log, "Failed to create audio codec session");
@@ -2075,7 +2546,7 @@ bool call_prepare_transmission(ToxAVCall *call)
     }
 
     { /* Prepare video */
-        call->video.second = vc_new(av->m->log, av, call->friend_number, av->vcb.first, av->vcb.second);
+        call->video.second = vc_new(av->m->mono_time, av->m->log, av, call->friend_number, av->vcb.first, av->vcb.second);
 
         if (!call->video.second) {
             LOGGER_ERROR(av->m->log, "Failed to create video codec session");
@@ -2091,10 +2562,14 @@ bool call_prepare_transmission(ToxAVCall *call)
         }
     }
 
+    pthread_mutex_lock(av->calls_lock);
     call->active = 1;
+    pthread_mutex_unlock(av->calls_lock);
     return true;
 
 FAILURE:
+    --av->transmitting_calls;
+    calls_rebalance_threads(av);
     bwc_kill(call->bwc);
     rtp_kill(call->audio.first);
     ac_kill(call->audio.second);
@@ -2104,6 +2579,8 @@ FAILURE:
     vc_kill(call->video.second);
     call->video.first = NULL;
     call->video.second = NULL;
+    playout_free(&call->playout);
+FAILURE_1:
     pthread_mutex_destroy(call->mutex);
 FAILURE_2:
     pthread_mutex_destroy(call->mutex_video);
@@ -2119,7 +2596,11 @@ void call_kill_transmission(ToxAVCall *call)
         return;
     }
 
+    /* Nobody who looks the call up from now on sees it active, and whoever
+     * did before holds one of its mutexes already */
+    pthread_mutex_lock(call->av->calls_lock);
     call->active = 0;
+    pthread_mutex_unlock(call->av->calls_lock);
 
     pthread_mutex_lock(call->mutex_audio);
     pthread_mutex_unlock(call->mutex_audio);
@@ -2143,6 +2624,49 @@ void call_kill_transmission(ToxAVCall *call)
     pthread_mutex_destroy(call->mutex_audio);
     pthread_mutex_destroy(call->mutex_video);
     pthread_mutex_destroy(call->mutex);
+    playout_free(&call->playout);
+
+    ToxAV *av = call->av;
+    --av->transmitting_calls;
+    calls_rebalance_threads(av);
+}
+
+/*
+ * Split the thread budget evenly over the calls that are transmitting. Each
+ * call gives the larger half of its share to the encoder and the rest to the
+ * decoder, but never less than one thread to either.
+ *
+ * Assumes av->mutex locked.
+ */
+static void calls_rebalance_threads(ToxAV *av)
+{
+    const uint32_t calls = av->transmitting_calls > 0 ? av->transmitting_calls : 1;
+    const uint32_t share = av->thread_budget / calls;
+
+    av->call_encoder_threads = share - share / 2;
+    av->call_decoder_threads = share / 2;
+
+    if (av->call_encoder_threads == 0) {
+        av->call_encoder_threads = 1;
+    }
+
+    if (av->call_decoder_threads == 0) {
+        av->call_decoder_threads = 1;
+    }
+
+    LOGGER_DEBUG(av->m->log, "thread budget %u over %u calls: encoder=%u decoder=%u",
+                 av->thread_budget, av->transmitting_calls, av->call_encoder_threads, av->call_decoder_threads);
+
+    for (ToxAVCall *it = av->calls; it; it = it->next) {
+        if (!it->active || it->video.second == NULL) {
+            continue;
+        }
+
+        pthread_mutex_lock(it->mutex_video);
+        it->video.second->encoder_threads = av->call_encoder_threads;
+        it->video.second->decoder_threads = av->call_decoder_threads;
+        pthread_mutex_unlock(it->mutex_video);
+    }
 }
 
 
@@ -161,9 +161,94 @@ uint32_t toxav_iteration_interval(const ToxAV *av);
  * Main loop for the session. This function needs to be called in intervals of
  * toxav_iteration_interval() milliseconds. It is best called in the separate
  * thread from tox_iterate.
+ *
+ * While iterate workers run, see toxav_set_iterate_workers(), this function
+ * does nothing.
  */
 void toxav_iterate(ToxAV *av);
 
+#define TOXAV_MAX_ITERATE_WORKERS 64
+
+/**
+ * Iterate the calls on threads of toxav's own instead of in toxav_iterate().
+ * The calls are dealt out to the workers, and each worker iterates its calls
+ * and sleeps for the iteration interval of just these calls, so a busy call
+ * doesn't hold up the others. New calls go to the workers in turn.
+ *
+ * Passing 0 stops the workers, and the application calls toxav_iterate()
+ * again. At most TOXAV_MAX_ITERATE_WORKERS workers can run. This function must
+ * not be called from a toxav callback.
+ *
+ * Returns false if the workers could not be started, in which case none run.
+ */
+bool toxav_set_iterate_workers(ToxAV *av, uint32_t workers);
+
+/**
+ * Returns the number of workers set with toxav_set_iterate_workers().
+ */
+uint32_t toxav_get_iterate_workers(const ToxAV *av);
+
+/**
+ * Set how many threads the video encoders and decoders of all calls may use
+ * together. Every call that is transmitting gets an equal share of the budget,
+ * split between its encoder and its decoder, with at least one thread for
+ * each. The shares are recomputed whenever a call starts or stops
+ * transmitting. Encoders pick up a new share with their next frame, decoders
+ * when they are next created.
+ *
+ * Passing 0 sets the budget to the number of online CPU cores, which is also
+ * the default.
+ */
+void toxav_set_thread_budget(ToxAV *av, uint32_t threads);
+
+/**
+ * Returns the thread budget set with toxav_set_thread_budget().
+ */
+uint32_t toxav_get_thread_budget(const ToxAV *av);
+
+/**
+ * Get the time that the video encoder and decoder of a call have spent on
+ * frames so far, in microseconds. This is wall clock time inside the codec
+ * calls, so with several codec threads it is less than the CPU time they use.
+ *
+ * Returns false if there is no active call with the friend.
+ */
+bool toxav_call_get_codec_time(ToxAV *av, uint32_t friend_number, uint64_t *encode_us, uint64_t *decode_us);
+
+/**
+ * Get the audio/video sync statistics of a call, all in milliseconds.
+ *
+ * Incoming audio and video frames are played out against one clock that runs
+ * a playout delay behind the friend's clock. The delay is sized from the
+ * measured round trip time and network jitter, and buffer_ms is its current
+ * value. audio_delay_ms and video_delay_ms are how long after it was recorded
+ * the last frame of each was handed to the application, 0 if that media is not
+ * being received. av_skew_ms is video_delay_ms minus audio_delay_ms, so a
+ * positive skew means video is behind audio; it is 0 unless both are received.
+ *
+ * Any of the out parameters may be NULL.
+ *
+ * Returns false if there is no active call with the friend.
+ */
+bool toxav_call_get_sync_stats(ToxAV *av, uint32_t friend_number, int32_t *av_skew_ms, int32_t *audio_delay_ms,
+                               int32_t *video_delay_ms, uint32_t *buffer_ms);
+
+/**
+ * Get the audio jitter buffer statistics of a call.
+ *
+ * concealment_permille is the share of the received audio frames, in 1/1000,
+ * that were lost and had to be recovered from the forward error correction of
+ * the next frame or concealed by the decoder. added_delay_ms is how much the
+ * jitter buffer delays playout beyond the network delay, audio is time
+ * stretched while that changes so that it does not jump.
+ *
+ * Any of the out parameters may be NULL.
+ *
+ * Returns false if there is no active call with the friend.
+ */
+bool toxav_call_get_audio_jitter_stats(ToxAV *av, uint32_t friend_number, uint32_t *concealment_permille,
+                                       uint32_t *added_delay_ms);
+
 
 /*******************************************************************************
  *
@@ -685,7 +770,8 @@ void toxav_callback_audio_bit_rate(ToxAV *av, toxav_audio_bit_rate_cb *callback,
  * 2.5, 5, 10, 20, 40 or 60 millseconds.
  * @param channels Number of audio channels. Supported values are 1 and 2.
  * @param sampling_rate Audio sampling rate used in this frame. Valid sampling
- * rates are 8000, 12000, 16000, 24000, or 48000.
+ * rates are 8000 to 48000, frames that are not at 48000 are resampled before
+ * encoding. The frame must be a whole number of samples at 48000.
  */
 bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pcm, size_t sample_count,
                             uint8_t channels, uint32_t sampling_rate, TOXAV_ERR_SEND_FRAME *error);
@@ -708,6 +794,54 @@ bool toxav_audio_send_frame(ToxAV *av, uint32_t friend_number, const int16_t *pc
 bool toxav_video_send_frame(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height, const uint8_t *y,
                             const uint8_t *u, const uint8_t *v, TOXAV_ERR_SEND_FRAME *error);
 
+typedef enum TOXAV_VIDEO_FORMAT {
+
+    /**
+     * Separate Y, U and V planes, U and V at half width and height.
+     */
+    TOXAV_VIDEO_FORMAT_I420 = 0,
+
+    /**
+     * A Y plane and one plane of interleaved U and V samples, at half width
+     * and height.
+     */
+    TOXAV_VIDEO_FORMAT_NV12 = 1,
+
+} TOXAV_VIDEO_FORMAT;
+
+/**
+ * The function type for the release callback of toxav_video_send_frame_ex.
+ *
+ * @param frame_user_data The frame_user_data passed with the frame.
+ */
+typedef void toxav_video_frame_release_cb(ToxAV *av, uint32_t friend_number, void *frame_user_data);
+
+/**
+ * Send a video frame to a friend, read from the caller's memory as it is laid
+ * out, without packing it first.
+ *
+ * The encoders read the planes through their strides, so frames from capture
+ * devices and decoders that pad their rows can be passed on as they are.
+ *
+ * @param format Layout of the planes. For NV12, u is the interleaved UV plane
+ * and v and vstride are ignored.
+ * @param ystride Bytes from the start of one row of the Y plane to the next,
+ * at least width.
+ * @param ustride Bytes between rows of the U plane, at least width / 2, or of
+ * the UV plane, at least width for NV12.
+ * @param vstride Bytes between rows of the V plane, at least width / 2.
+ * @param release_cb If not NULL, called exactly once, also if sending fails,
+ * when toxav no longer reads the planes. The encoders copy what they keep, so
+ * this happens before toxav_video_send_frame_ex returns; a capture pipeline
+ * can still use the callback to hand its buffers back in one place.
+ * @param frame_user_data Passed to release_cb.
+ */
+bool toxav_video_send_frame_ex(ToxAV *av, uint32_t friend_number, uint16_t width, uint16_t height,
+                               TOXAV_VIDEO_FORMAT format, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               int32_t ystride, int32_t ustride, int32_t vstride,
+                               toxav_video_frame_release_cb *release_cb, void *frame_user_data,
+                               TOXAV_ERR_SEND_FRAME *error);
+
 
 
 /**
@@ -903,6 +1037,18 @@ typedef enum TOXAV_OPTIONS_OPTION {
     TOXAV_ENCODER_KF_METHOD = 10,
     TOXAV_ENCODER_VIDEO_BITRATE_AUTOSET = 11,
     TOXAV_ENCODER_VIDEO_MAX_BITRATE = 12,
+    /** Gain applied to sent audio, in percent. 100 leaves it as it is. */
+    TOXAV_AUDIO_INPUT_GAIN = 13,
+    /** Gain applied to received audio, in percent. 100 leaves it as it is. */
+    TOXAV_AUDIO_OUTPUT_GAIN = 14,
+    /**
+     * Number of temporal layers of the sent VP8/VP9 video, 1 (the default) or
+     * 2. With 2 layers every other frame is not referred to by any other
+     * frame, and the receiver drops those frames first when it falls behind
+     * or loses parts of them, without asking for a keyframe. The sender does
+     * not encode them at all while the receiver reports loss.
+     */
+    TOXAV_ENCODER_TEMPORAL_LAYERS = 15,
 } TOXAV_OPTIONS_OPTION;
 
 
@@ -45,7 +45,8 @@
 // #define DEBUG_SHOW_H264_DECODING_TIME 1
 /* activate only for debugging!! */
 
-VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_receive_frame_cb *cb, void *cb_data)
+VCSession *vc_new(const Mono_Time *mono_time, Logger *log, ToxAV *av, uint32_t friend_number,
+                  toxav_video_receive_frame_cb *cb, void *cb_data)
 {
     VCSession *vc = (VCSession *)calloc(sizeof(VCSession), 1);
 
@@ -62,6 +63,8 @@ VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_re
 
     LOGGER_WARNING(log, "vc_new ...");
 
+    vc->mono_time = mono_time;
+
     // options ---
     vc->video_encoder_cpu_used = VP8E_SET_CPUUSED_VALUE;
     vc->video_encoder_cpu_used_prev = vc->video_encoder_cpu_used;
@@ -80,6 +83,9 @@ VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_re
 #endif
     vc->video_keyframe_method = TOXAV_ENCODER_KF_METHOD_NORMAL;
     vc->video_keyframe_method_prev = vc->video_keyframe_method;
+    vc->video_temporal_layers = 1;
+    vc->video_temporal_layers_prev = vc->video_temporal_layers;
+    temporal_layers_init(&vc->temporal_layers);
     vc->video_decoder_error_concealment = VIDEO__VP8_DECODER_ERROR_CONCEALMENT;
     vc->video_decoder_error_concealment_prev = vc->video_decoder_error_concealment;
     vc->video_decoder_codec_used = TOXAV_ENCODER_CODEC_USED_VP8; // DEFAULT: VP8 !!
@@ -103,7 +109,6 @@ VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_re
 
     vc->last_incoming_frame_ts = 0;
     vc->timestamp_difference_to_sender = 0;
-    vc->timestamp_difference_adjustment = -450;
     vc->tsb_range_ms = 60;
     vc->startup_video_timespan = 8000;
     vc->incoming_video_bitrate_last_changed = 0;
@@ -112,6 +117,11 @@ VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_re
     vc->last_requested_lower_fps_ts = 0;
     vc->encoder_frame_has_record_timestamp = 1;
     vc->video_max_bitrate = VIDEO_BITRATE_MAX_AUTO_VALUE_H264; // HINT: should probably be set to a higher value
+    vc->encoder_threads = av->call_encoder_threads;
+    vc->decoder_threads = av->call_decoder_threads;
+    vc->encode_time_us = 0;
+    vc->decode_time_us = 0;
+    vc->sched_wait_for_keyframe = 0;
     // options ---
 
     vc->incoming_video_frames_gap_ms_index = 0;
@@ -271,14 +281,130 @@ void video_switch_decoder(VCSession *vc, TOXAV_ENCODER_CODEC_USED_VALUE decoder_
 }
 
 
+/* Ask the sender to skip some of its video frames, at most every 10 seconds. */
+static void vc_request_lower_fps(VCSession *vc)
+{
+    if ((vc->last_requested_lower_fps_ts + 10000) < current_time_monotonic(vc->mono_time)) {
+
+
+        // HINT: tell sender to turn down video FPS -------------
+        uint32_t pkg_buf_len = 3;
+        uint8_t pkg_buf[pkg_buf_len];
+        pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
+        pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_LESS_VIDEO_FPS;
+
+        if ((vc->last_requested_lower_fps_ts + 12000) < current_time_monotonic(vc->mono_time)) {
+            pkg_buf[2] = 2;
+        } else {
+            pkg_buf[2] = 3; // skip every 3rd video frame and dont encode and dont sent it
+        }
+
+        int result = send_custom_lossless_packet(vc->av->m, vc->friend_number, pkg_buf, pkg_buf_len);
+        // HINT: tell sender to turn down video FPS -------------
+
+        vc->last_requested_lower_fps_ts = current_time_monotonic(vc->mono_time);
+
+        LOGGER_WARNING(vc->log, "request lower FPS from sender: skip every %d (%d)", (int)pkg_buf[2], result);
+    }
+}
+
+static void vc_request_keyframe(VCSession *vc, Messenger *m)
+{
+    if ((vc->last_requested_keyframe_ts + VIDEO_MIN_REQUEST_KEYFRAME_INTERVAL_MS_FOR_NF)
+            < current_time_monotonic(vc->mono_time)) {
+        uint32_t pkg_buf_len = 2;
+        uint8_t pkg_buf[pkg_buf_len];
+        pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
+        pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_REQUEST_KEYFRAME;
+
+        if (-1 == send_custom_lossless_packet(m, vc->friend_number, pkg_buf, pkg_buf_len)) {
+            LOGGER_WARNING(vc->log, "PACKET_TOXAV_COMM_CHANNEL_REQUEST_KEYFRAME:RTP send failed");
+        } else {
+            vc->last_requested_keyframe_ts = current_time_monotonic(vc->mono_time);
+        }
+    }
+}
+
+/*
+ * An H264 access unit that no later frame refers to: every slice in it has a
+ * nal_ref_idc of 0. Such frames can be dropped without breaking decoding.
+ */
+static bool h264_frame_is_non_reference(const uint8_t *data, uint32_t length)
+{
+    bool have_slice = false;
+
+    for (uint32_t i = 0; i + 3 < length; ++i) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            continue;
+        }
+
+        const uint8_t nal_header = data[i + 3];
+        const uint8_t nal_type = nal_header & 0x1f;
+
+        if (nal_type >= 1 && nal_type <= 5) {
+            if ((nal_header & 0x60) != 0) {
+                return false;
+            }
+
+            have_slice = true;
+        }
+
+        i += 3;
+    }
+
+    return have_slice;
+}
+
+/*
+ * Whether the media scheduler wants this frame dropped instead of decoded.
+ * Dropping a frame that later frames refer to breaks decoding until the next
+ * keyframe, so all frames up to that keyframe are dropped too, and one is
+ * requested as soon as the load allows decoding again. VP8 frames do not tell
+ * whether they are referenced without decoding their header, so under high
+ * load only H264 frames and frames above the temporal base layer are dropped.
+ */
+static bool vc_sched_drop_frame(VCSession *vc, Messenger *m, uint8_t data_type, uint8_t h264_encoded_video_frame,
+                                uint8_t temporal_layer, const uint8_t *data, uint32_t length)
+{
+    const Media_Load load = media_sched_load(&vc->av->sched);
+
+    if (load != MEDIA_LOAD_NORMAL) {
+        vc_request_lower_fps(vc);
+    }
+
+    if ((int)data_type == (int)video_frame_type_KEYFRAME) {
+        vc->sched_wait_for_keyframe = 0;
+        return false;
+    }
+
+    if (vc->sched_wait_for_keyframe == 1) {
+        if (load != MEDIA_LOAD_OVERLOAD) {
+            vc_request_keyframe(vc, m);
+        }
+
+        return true;
+    }
+
+    if (load == MEDIA_LOAD_OVERLOAD) {
+        LOGGER_DEBUG(vc->log, "overload: dropping video frames until the next keyframe");
+        vc->sched_wait_for_keyframe = 1;
+        return true;
+    }
+
+    if (load == MEDIA_LOAD_HIGH && temporal_layer > 0) {
+        return true;
+    }
+
+    return load == MEDIA_LOAD_HIGH && h264_encoded_video_frame == 1 && h264_frame_is_non_reference(data, length);
+}
+
 /* --- VIDEO DECODING happens here --- */
 /* --- VIDEO DECODING happens here --- */
 /* --- VIDEO DECODING happens here --- */
 uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_t *a_r_timestamp,
                    uint64_t *a_l_timestamp,
                    uint64_t *v_r_timestamp, uint64_t *v_l_timestamp, BWController *bwc,
-                   int64_t *timestamp_difference_adjustment_,
-                   int64_t *timestamp_difference_to_sender_)
+                   Playout_Clock *playout)
 {
 
     if (!vc) {
@@ -296,6 +422,7 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
     uint64_t frame_flags;
     uint8_t data_type;
     uint8_t h264_encoded_video_frame = 0;
+    uint8_t temporal_layer = 0;
 
     uint32_t full_data_len;
 
@@ -304,15 +431,12 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
     uint32_t timestamp_min = 0;
     uint32_t timestamp_max = 0;
 
-    *timestamp_difference_to_sender_ = vc->timestamp_difference_to_sender;
+    playout_set_offset(playout, vc->timestamp_difference_to_sender, vc->rountrip_time_ms);
+    playout_set_jitter(playout, PLAYOUT_VIDEO, playout_jitter_ms(&vc->jitter));
 
     tsb_get_range_in_buffer((TSBuffer *)vc->vbuf_raw, &timestamp_min, &timestamp_max);
 
-
-    int64_t want_remote_video_ts = (current_time_monotonic() + vc->timestamp_difference_to_sender +
-                                    vc->timestamp_difference_adjustment);
-
-    uint32_t timestamp_want_get = (uint32_t)want_remote_video_ts;
+    uint32_t timestamp_want_get = playout_want_ts(playout, current_time_monotonic(vc->mono_time));
 
 
     // HINT: compensate for older clients ----------------
@@ -328,13 +452,12 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 #if 0
 
     if ((int)tsb_size((TSBuffer *)vc->vbuf_raw) > 0) {
-        LOGGER_ERROR(vc->log, "FC:%d min=%ld max=%ld want=%d diff=%d adj=%d roundtrip=%d",
+        LOGGER_ERROR(vc->log, "FC:%d min=%ld max=%ld want=%d diff=%d roundtrip=%d",
                      (int)tsb_size((TSBuffer *)vc->vbuf_raw),
                      timestamp_min,
                      timestamp_max,
                      (int)timestamp_want_get,
                      (int)timestamp_want_get - (int)timestamp_max,
-                     (int)vc->timestamp_difference_adjustment,
                      (int)vc->rountrip_time_ms);
     }
 
@@ -345,25 +468,17 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
         // HINT: buffer with incoming video frames is very full
         if (timestamp_want_get > (timestamp_max + 100)) {
             // we wont get a frame like this
-            vc->timestamp_difference_adjustment = vc->timestamp_difference_adjustment -
-                                                  (timestamp_want_get - timestamp_max) - 10;
+            playout_correct(playout, -((int64_t)(timestamp_want_get - timestamp_max) + 10));
 
             LOGGER_ERROR(vc->log, "DEFF_CORR:--:%d", (int)((timestamp_want_get - timestamp_max) - 10));
 
-            want_remote_video_ts = (current_time_monotonic() + vc->timestamp_difference_to_sender +
-                                    vc->timestamp_difference_adjustment);
-
-            timestamp_want_get = (uint32_t)want_remote_video_ts;
+            timestamp_want_get = playout_want_ts(playout, current_time_monotonic(vc->mono_time));
         } else if ((timestamp_want_get + 100) < timestamp_min) {
-            vc->timestamp_difference_adjustment = vc->timestamp_difference_adjustment +
-                                                  (timestamp_min - timestamp_want_get) + 10;
+            playout_correct(playout, (int64_t)(timestamp_min - timestamp_want_get) + 10);
 
             LOGGER_ERROR(vc->log, "DEFF_CORR:++++:%d", (int)((timestamp_min - timestamp_want_get) + 10));
 
-            want_remote_video_ts = (current_time_monotonic() + vc->timestamp_difference_to_sender +
-                                    vc->timestamp_difference_adjustment);
-
-            timestamp_want_get = (uint32_t)want_remote_video_ts;
+            timestamp_want_get = playout_want_ts(playout, current_time_monotonic(vc->mono_time));
         }
     }
 
@@ -389,86 +504,32 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 #if 1
 
         if ((is_skipping > 0) && (removed_entries > 0)) {
-            if ((vc->last_requested_lower_fps_ts + 10000) < current_time_monotonic()) {
-
-
-                // HINT: tell sender to turn down video FPS -------------
-                uint32_t pkg_buf_len = 3;
-                uint8_t pkg_buf[pkg_buf_len];
-                pkg_buf[0] = PACKET_TOXAV_COMM_CHANNEL;
-                pkg_buf[1] = PACKET_TOXAV_COMM_CHANNEL_LESS_VIDEO_FPS;
-
-                if ((vc->last_requested_lower_fps_ts + 12000) < current_time_monotonic()) {
-                    pkg_buf[2] = 2;
-                } else {
-                    pkg_buf[2] = 3; // skip every 3rd video frame and dont encode and dont sent it
-                }
-
-                int result = send_custom_lossless_packet(vc->av->m, vc->friend_number, pkg_buf, pkg_buf_len);
-                // HINT: tell sender to turn down video FPS -------------
-
-                vc->last_requested_lower_fps_ts = current_time_monotonic();
-
-                LOGGER_WARNING(vc->log, "request lower FPS from sender: %d ms : skip every %d", (int)is_skipping, (int)pkg_buf[2]);
-            }
+            LOGGER_DEBUG(vc->log, "skipping video frames: %d ms", (int)is_skipping);
+            vc_request_lower_fps(vc);
         }
 
 #endif
 
 
 
-
-#if 1
-        LOGGER_DEBUG(vc->log, "rtt:drift:1:%d %d %d", (int)(vc->rountrip_time_ms),
-                     (int)(-vc->timestamp_difference_adjustment),
-                     (int)AV_ADJUSTMENT_BASE_MS);
-
-        if (vc->rountrip_time_ms > (-vc->timestamp_difference_adjustment - AV_ADJUSTMENT_BASE_MS)) {
-            // drift
-            LOGGER_DEBUG(vc->log, "rtt:drift:2:%d > %d", (int)(vc->rountrip_time_ms),
-                         (int)(-vc->timestamp_difference_adjustment - AV_ADJUSTMENT_BASE_MS));
-
-            LOGGER_DEBUG(vc->log, "rtt:drift:3:%d < %d", (int)(vc->timestamp_difference_adjustment),
-                         (int)(-MIN_AV_BUFFERING_MS));
-
-            if (tsb_size((TSBuffer *)vc->vbuf_raw) < 10) {
-                vc->timestamp_difference_adjustment = vc->timestamp_difference_adjustment - 1;
-                LOGGER_DEBUG(vc->log, "rtt:drift:4:---1:%d", (int)(vc->timestamp_difference_adjustment));
-            } else {
-                vc->timestamp_difference_adjustment = vc->timestamp_difference_adjustment + 1;
-            }
-        } else if (vc->rountrip_time_ms < (-vc->timestamp_difference_adjustment - AV_ADJUSTMENT_BASE_MS)) {
-            // drift
-            LOGGER_DEBUG(vc->log, "rtt:drift:5:%d << %d", (int)(vc->rountrip_time_ms),
-                         (int)(-vc->timestamp_difference_adjustment - AV_ADJUSTMENT_BASE_MS));
-
-            if (vc->timestamp_difference_adjustment <= -MIN_AV_BUFFERING_MS) {
-                LOGGER_DEBUG(vc->log, "rtt:drift:6:%d < %d", (int)(vc->timestamp_difference_adjustment),
-                             (int)(-MIN_AV_BUFFERING_MS));
-
-                vc->timestamp_difference_adjustment = vc->timestamp_difference_adjustment + 1;
-                LOGGER_DEBUG(vc->log, "rtt:drift:7:+1:%d", (int)(vc->timestamp_difference_adjustment));
-            }
-        }
-
-#endif
-
-
-
-
-
-
         LOGGER_DEBUG(vc->log, "XLS01:%d,%d",
-                     (int)(timestamp_want_get - current_time_monotonic()),
-                     (int)(timestamp_out_ - current_time_monotonic())
+                     (int)(timestamp_want_get - current_time_monotonic(vc->mono_time)),
+                     (int)(timestamp_out_ - current_time_monotonic(vc->mono_time))
                     );
 
         const struct RTPHeader *header_v3_0 = (void *) & (p->header);
 
-        vc->video_play_delay = ((current_time_monotonic() + vc->timestamp_difference_to_sender) - timestamp_out_);
+        if (vc->encoder_frame_has_record_timestamp == 1) {
+            vc->video_play_delay = playout_played(playout, PLAYOUT_VIDEO, timestamp_out_,
+                                                  current_time_monotonic(vc->mono_time));
+        } else {
+            vc->video_play_delay = ((current_time_monotonic(vc->mono_time) + vc->timestamp_difference_to_sender) -
+                                    timestamp_out_);
+        }
+
         vc->video_frame_buffer_entries = (uint32_t)tsb_size((TSBuffer *)vc->vbuf_raw);
 
-        LOGGER_DEBUG(vc->log, "seq:%d FC:%d min=%d max=%d want=%d got=%d diff=%d rm=%d pdelay=%d adj=%d dts=%d rtt=%d",
+        LOGGER_DEBUG(vc->log, "seq:%d FC:%d min=%d max=%d want=%d got=%d diff=%d rm=%d pdelay=%d dts=%d rtt=%d",
                      (int)header_v3_0->sequnum,
                      (int)tsb_size((TSBuffer *)vc->vbuf_raw),
                      timestamp_min,
@@ -478,7 +539,6 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
                      ((int)timestamp_want_get - (int)timestamp_out_),
                      (int)removed_entries,
                      (int)vc->video_play_delay,
-                     (int)vc->timestamp_difference_adjustment,
                      (int)vc->timestamp_difference_to_sender,
                      (int)vc->rountrip_time_ms);
 
@@ -486,8 +546,8 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
         int32_t diff_want_to_got = (int)timestamp_want_get - (int)timestamp_out_;
 
 
-        LOGGER_DEBUG(vc->log, "values:diff_to_sender=%d adj=%d tsb_range=%d bufsize=%d",
-                     (int)vc->timestamp_difference_to_sender, (int)vc->timestamp_difference_adjustment,
+        LOGGER_DEBUG(vc->log, "values:diff_to_sender=%d tsb_range=%d bufsize=%d",
+                     (int)vc->timestamp_difference_to_sender,
                      (int)vc->tsb_range_ms,
                      (int)buf_size);
 
@@ -498,15 +558,11 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 
 
 
-        // TODO: make it available to the audio session
-        // bad hack -> make better!
-        *timestamp_difference_adjustment_ = vc->timestamp_difference_adjustment;
-
-
         LOGGER_DEBUG(vc->log, "--VSEQ:%d", (int)header_v3_0->sequnum);
 
         data_type = (uint8_t)((frame_flags & RTP_KEY_FRAME) != 0);
         h264_encoded_video_frame = (uint8_t)((frame_flags & RTP_ENCODER_IS_H264) != 0);
+        temporal_layer = RTP_TEMPORAL_LAYER(frame_flags);
 
         bwc_add_recv(bwc, header_v3_0->data_length_full);
 
@@ -623,6 +679,11 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 
 
 
+        if (vc_sched_drop_frame(vc, m, data_type, h264_encoded_video_frame, temporal_layer, p->data, full_data_len)) {
+            free(p);
+            return 0;
+        }
+
         // HINT: give feedback that we lost some bytes
         if (header_v3->received_length_full < full_data_len) {
             // const Messenger *mm = (Messenger *)(vc->av->m);
@@ -630,6 +691,13 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 
             bwc_add_lost_v3(bwc, (full_data_len - header_v3->received_length_full), false);
             LOGGER_ERROR(vc->log, "BWC:lost:004:lost bytes=%d", (int)(full_data_len - header_v3->received_length_full));
+
+            if (temporal_layer > 0 && (int)data_type != (int)video_frame_type_KEYFRAME) {
+                // no frame refers to it, dropping it leaves the decoder intact
+                LOGGER_DEBUG(vc->log, "dropping incomplete frame of temporal layer %d", (int)temporal_layer);
+                free(p);
+                return 0;
+            }
         }
 
 
@@ -665,7 +733,7 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 
             if ((percent_recvd < 100) && (have_requested_index_frame == false)) {
                 if ((vc->last_requested_keyframe_ts + VIDEO_MIN_REQUEST_KEYFRAME_INTERVAL_MS_FOR_KF)
-                        < current_time_monotonic()) {
+                        < current_time_monotonic(vc->mono_time)) {
                     // if keyframe received has less than 100% of the data, request a new keyframe
                     // from the sender
                     uint32_t pkg_buf_len = 2;
@@ -679,7 +747,7 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
                     } else {
                         LOGGER_WARNING(vc->log,
                                        "PACKET_TOXAV_COMM_CHANNEL_REQUEST_KEYFRAME:RTP Sent.");
-                        vc->last_requested_keyframe_ts = current_time_monotonic();
+                        vc->last_requested_keyframe_ts = current_time_monotonic(vc->mono_time);
                     }
                 }
             }
@@ -732,6 +800,8 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 
         }
 
+        const uint64_t decode_start = current_time_actual();
+
         if (vc->video_decoder_codec_used != TOXAV_ENCODER_CODEC_USED_H264) {
             // LOGGER_ERROR(vc->log, "DEC:VP8------------");
             decode_frame_vpx(vc, m, skip_video_flag, a_r_timestamp,
@@ -752,7 +822,7 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 #else
 
 #ifdef DEBUG_SHOW_H264_DECODING_TIME
-            uint32_t start_time_ms = current_time_monotonic();
+            uint32_t start_time_ms = current_time_monotonic(vc->mono_time);
 #endif
             decode_frame_h264(vc, m, skip_video_flag, a_r_timestamp,
                               a_l_timestamp,
@@ -762,7 +832,7 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
                               &ret_value);
 
 #ifdef DEBUG_SHOW_H264_DECODING_TIME
-            uint32_t end_time_ms = current_time_monotonic();
+            uint32_t end_time_ms = current_time_monotonic(vc->mono_time);
 
             if ((int)(end_time_ms - start_time_ms) > 4) {
                 LOGGER_WARNING(vc->log, "decode_frame_h264: %d ms", (int)(end_time_ms - start_time_ms));
@@ -773,6 +843,10 @@ uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_
 #endif
         }
 
+        const uint64_t decode_end = current_time_actual();
+        vc->decode_time_us += decode_end - decode_start;
+        media_sched_add_codec_time(&vc->av->sched, decode_end, decode_end - decode_start);
+
         return ret_value;
     } else {
         // no frame data available
@@ -822,7 +896,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 
     // calculate mean "frame incoming every x milliseconds" --------------
     if (vc->incoming_video_frames_gap_last_ts > 0) {
-        uint32_t curent_gap = current_time_monotonic() - vc->incoming_video_frames_gap_last_ts;
+        uint32_t curent_gap = current_time_monotonic(vc->mono_time) - vc->incoming_video_frames_gap_last_ts;
 
         vc->incoming_video_frames_gap_ms[vc->incoming_video_frames_gap_ms_index] = curent_gap;
         vc->incoming_video_frames_gap_ms_index = (vc->incoming_video_frames_gap_ms_index + 1) %
@@ -849,7 +923,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 #endif
     }
 
-    vc->incoming_video_frames_gap_last_ts = current_time_monotonic();
+    vc->incoming_video_frames_gap_last_ts = current_time_monotonic(vc->mono_time);
     // calculate mean "frame incoming every x milliseconds" --------------
 
     pthread_mutex_lock(vc->queue_mutex);
@@ -872,7 +946,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 
         // give COMM data to client -------
 
-        if ((vc->network_round_trip_time_last_cb_ts + 2000) < current_time_monotonic()) {
+        if ((vc->network_round_trip_time_last_cb_ts + 2000) < current_time_monotonic(vc->mono_time)) {
             if (vc->av) {
                 if (vc->av->call_comm_cb.first) {
                     vc->av->call_comm_cb.first(vc->av, vc->friend_number,
@@ -905,7 +979,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 
             }
 
-            vc->network_round_trip_time_last_cb_ts = current_time_monotonic();
+            vc->network_round_trip_time_last_cb_ts = current_time_monotonic(vc->mono_time);
         }
 
         // give COMM data to client -------
@@ -914,7 +988,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
         if (vc->show_own_video == 0) {
 
 
-            if ((vc->incoming_video_bitrate_last_cb_ts + 2000) < current_time_monotonic()) {
+            if ((vc->incoming_video_bitrate_last_cb_ts + 2000) < current_time_monotonic(vc->mono_time)) {
                 if (vc->incoming_video_bitrate_last_changed != header->encoder_bit_rate_used) {
                     if (vc->av) {
                         if (vc->av->call_comm_cb.first) {
@@ -928,10 +1002,12 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
                     vc->incoming_video_bitrate_last_changed = header->encoder_bit_rate_used;
                 }
 
-                vc->incoming_video_bitrate_last_cb_ts = current_time_monotonic();
+                vc->incoming_video_bitrate_last_cb_ts = current_time_monotonic(vc->mono_time);
             }
 
 
+            playout_jitter_update(&vc->jitter, current_time_monotonic(vc->mono_time), header->frame_record_timestamp);
+
 #ifdef USE_TS_BUFFER_FOR_VIDEO
             struct RTPMessage *msg_old = tsb_write((TSBuffer *)vc->vbuf_raw, msg,
                                                    (uint64_t)header->flags,
@@ -965,7 +1041,7 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
         }
     } else {
 #ifdef USE_TS_BUFFER_FOR_VIDEO
-        free(tsb_write((TSBuffer *)vc->vbuf_raw, msg, 0, current_time_monotonic()));
+        free(tsb_write((TSBuffer *)vc->vbuf_raw, msg, 0, current_time_monotonic(vc->mono_time)));
 #else
         free(rb_write((RingBuffer *)vc->vbuf_raw, msg, 0));
 #endif
@@ -974,14 +1050,14 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 
     /* Calculate time since we received the last video frame */
     // use 5ms less than the actual time, to give some free room
-    uint32_t t_lcfd = (current_time_monotonic() - vc->linfts) - 5;
+    uint32_t t_lcfd = (current_time_monotonic(vc->mono_time) - vc->linfts) - 5;
     vc->lcfd = t_lcfd > 100 ? vc->lcfd : t_lcfd;
 
 #ifdef VIDEO_DECODER_SOFT_DEADLINE_AUTOTUNE
 
     // Autotune decoder softdeadline here ----------
     if (vc->last_decoded_frame_ts > 0) {
-        long decode_time_auto_tune = (current_time_monotonic() - vc->last_decoded_frame_ts) * 1000;
+        long decode_time_auto_tune = (current_time_monotonic(vc->mono_time) - vc->last_decoded_frame_ts) * 1000;
 
         if (decode_time_auto_tune == 0) {
             decode_time_auto_tune = 1; // 0 means infinite long softdeadline!
@@ -997,11 +1073,11 @@ int vc_queue_message(void *vcp, struct RTPMessage *msg)
 
     }
 
-    vc->last_decoded_frame_ts = current_time_monotonic();
+    vc->last_decoded_frame_ts = current_time_monotonic(vc->mono_time);
     // Autotune decoder softdeadline here ----------
 #endif
 
-    vc->linfts = current_time_monotonic();
+    vc->linfts = current_time_monotonic(vc->mono_time);
 
     pthread_mutex_unlock(vc->queue_mutex);
 
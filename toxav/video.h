@@ -29,6 +29,8 @@
 
 #include "bwcontroller.h"
 #include "pair.h"
+#include "playout.h"
+#include "temporal_layers.h"
 
 // for VPX ----------
 #include <vpx/vpx_decoder.h>
@@ -57,16 +59,13 @@ VPX_DL_BEST_QUALITY   (0)       deadline parameter analogous to VPx BEST QUALITY
 */
 
 
-#define MIN_AV_BUFFERING_MS (80) // ORIG: 250
-#define AV_ADJUSTMENT_BASE_MS (MIN_AV_BUFFERING_MS - 30) // ORIG: (MIN_AV_BUFFERING_MS - 130)
-
-
 typedef enum PACKET_TOXAV_COMM_CHANNEL_FUNCTION {
     PACKET_TOXAV_COMM_CHANNEL_REQUEST_KEYFRAME = 0,
     PACKET_TOXAV_COMM_CHANNEL_HAVE_H264_VIDEO = 1,
     PACKET_TOXAV_COMM_CHANNEL_LESS_VIDEO_FPS = 2,
     PACKET_TOXAV_COMM_CHANNEL_DUMMY_NTP_REQUEST = 3,
     PACKET_TOXAV_COMM_CHANNEL_DUMMY_NTP_ANSWER = 4,
+    PACKET_TOXAV_COMM_CHANNEL_NACK = 5,
 } PACKET_TOXAV_COMM_CHANNEL_FUNCTION;
 
 
@@ -106,6 +105,8 @@ typedef enum PACKET_TOXAV_COMM_CHANNEL_FUNCTION {
 
 #define VIDEO_SEND_X_KEYFRAMES_FIRST (10) // force the first n frames to be keyframes!
 #define VPX_MAX_DIST_START (100)
+#define VIDEO_MAX_TEMPORAL_LAYERS (2)
+#define VIDEO_BASE_LAYER_BITRATE_PERCENT (60) // share of the bitrate spent on the temporal base layer
 
 
 #ifdef VIDEO_CODEC_ENCODER_USE_FRAGMENTS
@@ -145,6 +146,18 @@ struct TSBuffer;
 
 struct OMXContext;
 
+/* The planes of a frame to encode, in the memory of the caller. For NV12, u is
+ * the interleaved UV plane and v is unused. */
+typedef struct VC_Frame_Planes {
+    TOXAV_VIDEO_FORMAT format;
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+    int32_t ystride;
+    int32_t ustride;
+    int32_t vstride;
+} VC_Frame_Planes;
+
 typedef struct VCSession_s {
     /* encoding */
     vpx_codec_ctx_t encoder[1];
@@ -155,14 +168,36 @@ typedef struct VCSession_s {
     int h264_enc_width;
     int h264_enc_height;
     uint32_t h264_enc_bitrate;
+    int h264_enc_threads;
+    /* temporal layer pattern of the frames given to the VPX encoder */
+    Temporal_Layers temporal_layers;
+    /* U and V planes for VPX of NV12 frames and of frames with odd sizes */
+    uint8_t *vpx_chroma_buf;
+    size_t vpx_chroma_buf_size;
 
 #ifdef RASPBERRY_PI_OMX
     struct OMXContext *omx_ctx;
 #endif
 
+    /* threads from the toxav thread budget; the codecs cap them further */
+    uint32_t encoder_threads;
+    uint32_t decoder_threads;
+    /* wall clock time spent in the encoder and the decoder, in microseconds */
+    uint64_t encode_time_us;
+    uint64_t decode_time_us;
+    /* the media scheduler dropped a referenced frame, drop until the next keyframe */
+    uint8_t sched_wait_for_keyframe;
+
     /* decoding */
     vpx_codec_ctx_t decoder[1];
     AVCodecContext *h264_decoder;
+    /* H264 decode state kept between frames. The input buffer is refcounted,
+     * so libavcodec references it instead of copying every frame. */
+    AVPacket *h264_in_pkt;
+    AVFrame *h264_out_frame;
+    AVBufferRef *h264_in_buf;
+    uint64_t h264_decoded_frames;
+    uint64_t h264_decode_allocs; /* input buffers allocated for those frames */
 #ifdef USE_TS_BUFFER_FOR_VIDEO
     struct TSBuffer *vbuf_raw; /* Un-decoded data */
 #else
@@ -199,8 +234,8 @@ typedef struct VCSession_s {
     uint8_t skip_fps_counter;
 
     int64_t timestamp_difference_to_sender;
-    int64_t timestamp_difference_adjustment;
     uint32_t rountrip_time_ms;
+    Playout_Jitter jitter; /* of complete incoming frames */
     int32_t video_play_delay;
     int32_t video_play_delay_real;
     uint32_t video_frame_buffer_entries;
@@ -222,6 +257,8 @@ typedef struct VCSession_s {
     int32_t video_rc_min_quantizer_prev;
     int32_t video_keyframe_method;
     int32_t video_keyframe_method_prev;
+    uint8_t video_temporal_layers;
+    uint8_t video_temporal_layers_prev;
     uint8_t video_bitrate_autoset;
     int32_t video_max_bitrate;
     int32_t video_encoder_coded_used;
@@ -237,6 +274,7 @@ typedef struct VCSession_s {
     void *vpx_frames_buf_list[VIDEO_MAX_FRAGMENT_BUFFER_COUNT];
     uint16_t fragment_buf_counter;
 
+    const Mono_Time *mono_time;
     Logger *log;
     ToxAV *av;
     uint32_t friend_number;
@@ -252,13 +290,13 @@ typedef struct VCSession_s {
 
 
 
-VCSession *vc_new(Logger *log, ToxAV *av, uint32_t friend_number, toxav_video_receive_frame_cb *cb, void *cb_data);
+VCSession *vc_new(const Mono_Time *mono_time, Logger *log, ToxAV *av, uint32_t friend_number,
+                  toxav_video_receive_frame_cb *cb, void *cb_data);
 void vc_kill(VCSession *vc);
 uint8_t vc_iterate(VCSession *vc, Messenger *m, uint8_t skip_video_flag, uint64_t *a_r_timestamp,
                    uint64_t *a_l_timestamp,
                    uint64_t *v_r_timestamp, uint64_t *v_l_timestamp, BWController *bwc,
-                   int64_t *timestamp_difference_adjustment_,
-                   int64_t *timestamp_difference_to_sender_);
+                   Playout_Clock *playout);
 int vc_queue_message(void *vcp, struct RTPMessage *msg);
 int vc_reconfigure_encoder(Logger *log, VCSession *vc, uint32_t bit_rate, uint16_t width, uint16_t height,
                            int16_t kf_max_dist);
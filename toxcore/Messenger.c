@@ -2068,9 +2068,17 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         return nullptr;
     }
 
+    m->mono_time = mono_time_new();
+
+    if (m->mono_time == nullptr) {
+        free(m);
+        return nullptr;
+    }
+
     m->fr = friendreq_new();
 
     if (!m->fr) {
+        mono_time_free(m->mono_time);
         free(m);
         return nullptr;
     }
@@ -2079,6 +2087,7 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
 
     if (m->log == nullptr) {
         friendreq_kill(m->fr);
+        mono_time_free(m->mono_time);
         free(m);
         return nullptr;
     }
@@ -2095,6 +2104,9 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
 
     if (options->udp_disabled) {
         m->net = new_networking_no_udp(m->log);
+    } else if (options->host_net != nullptr) {
+        m->net = new_networking_tenant(m->log, options->host_net);
+        net_err = 1;
     } else {
         IP ip;
         ip_init(&ip, options->ipv6enabled);
@@ -2104,6 +2116,7 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
     if (m->net == nullptr) {
         friendreq_kill(m->fr);
         logger_kill(m->log);
+        mono_time_free(m->mono_time);
         free(m);
 
         if (error && net_err == 1) {
@@ -2113,31 +2126,33 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         return nullptr;
     }
 
-    m->dht = new_dht(m->log, m->net, options->hole_punching_enabled);
+    m->dht = new_dht(m->log, m->mono_time, m->net, options->hole_punching_enabled);
 
     if (m->dht == nullptr) {
         kill_networking(m->net);
         friendreq_kill(m->fr);
         logger_kill(m->log);
+        mono_time_free(m->mono_time);
         free(m);
         return nullptr;
     }
 
-    m->net_crypto = new_net_crypto(m->log, m->dht, &options->proxy_info);
+    m->net_crypto = new_net_crypto(m->log, m->mono_time, m->dht, &options->proxy_info);
 
     if (m->net_crypto == nullptr) {
         kill_networking(m->net);
         kill_dht(m->dht);
         friendreq_kill(m->fr);
         logger_kill(m->log);
+        mono_time_free(m->mono_time);
         free(m);
         return nullptr;
     }
 
-    m->onion = new_onion(m->dht);
-    m->onion_a = new_onion_announce(m->dht);
-    m->onion_c =  new_onion_client(m->net_crypto);
-    m->fr_c = new_friend_connections(m->onion_c, options->local_discovery_enabled);
+    m->onion = new_onion(m->mono_time, m->dht);
+    m->onion_a = new_onion_announce(m->mono_time, m->dht);
+    m->onion_c =  new_onion_client(m->mono_time, m->net_crypto);
+    m->fr_c = new_friend_connections(m->mono_time, m->onion_c, options->local_discovery_enabled);
 
     if (!(m->onion && m->onion_a && m->onion_c)) {
         kill_friend_connections(m->fr_c);
@@ -2149,13 +2164,14 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
         kill_networking(m->net);
         friendreq_kill(m->fr);
         logger_kill(m->log);
+        mono_time_free(m->mono_time);
         free(m);
         return nullptr;
     }
 
     if (options->tcp_server_port) {
-        m->tcp_server = new_TCP_server(options->ipv6enabled, 1, &options->tcp_server_port, dht_get_self_secret_key(m->dht),
-                                       m->onion);
+        m->tcp_server = new_TCP_server(m->mono_time, options->ipv6enabled, 1, &options->tcp_server_port,
+                                       dht_get_self_secret_key(m->dht), m->onion);
 
         if (m->tcp_server == nullptr) {
             kill_friend_connections(m->fr_c);
@@ -2167,7 +2183,8 @@ Messenger *new_messenger(Messenger_Options *options, unsigned int *error)
             kill_networking(m->net);
             friendreq_kill(m->fr);
             logger_kill(m->log);
-            free(m);
+            mono_time_free(m->mono_time);
+        free(m);
 
             if (error) {
                 *error = MESSENGER_ERROR_TCP_SERVER;
@@ -2218,9 +2235,13 @@ void kill_messenger(Messenger *m)
         }
     }
 
+    event_loop_kill(m->event_loop);
+    free(m->event_socks);
+
     logger_kill(m->log);
     free(m->friendlist);
     friendreq_kill(m->fr);
+    mono_time_free(m->mono_time);
     free(m);
 }
 
@@ -2588,7 +2609,7 @@ static int m_handle_packet(void *object, int i, const uint8_t *temp, uint16_t le
 static void do_friends(Messenger *m, void *userdata)
 {
     uint32_t i;
-    uint64_t temp_time = unix_time();
+    uint64_t temp_time = mono_time_get(m->mono_time);
 
     for (i = 0; i < m->numfriends; ++i) {
         if (m->friendlist[i].status == FRIEND_ADDED) {
@@ -2699,6 +2720,85 @@ uint32_t messenger_run_interval(const Messenger *m)
     return crypto_interval;
 }
 
+uint32_t m_copy_sockets(const Messenger *m, Socket *socks, uint32_t max_num)
+{
+    uint32_t copied = 0;
+
+    if (!m->options.udp_disabled && !net_is_tenant(m->net)) {
+        if (socks != nullptr && max_num > 0) {
+            socks[0] = net_sock(m->net);
+        }
+
+        ++copied;
+    }
+
+    if (m->tcp_server) {
+        copied += tcp_server_copy_sockets(m->tcp_server, socks ? socks + min_u32(copied, max_num) : nullptr,
+                                          max_num - min_u32(copied, max_num));
+    }
+
+    copied += tcp_copy_sockets(nc_get_tcp_c(m->net_crypto), socks ? socks + min_u32(copied, max_num) : nullptr,
+                               max_num - min_u32(copied, max_num));
+
+    if (socks != nullptr) {
+        return min_u32(copied, max_num);
+    }
+
+    return copied;
+}
+
+/* Return the time in milliseconds until do_messenger() has work to do.
+ *
+ * The DHT, onion, friend connection and TCP relay timers all count whole seconds of mono_time, and
+ * each of them runs at most once per second, so none can come due before the next second starts.
+ * Only net_crypto, relay connections that are being set up or have data queued and the TCP server,
+ * which finishes handshakes on its worker threads, need an earlier run.
+ */
+static uint32_t messenger_event_interval(const Messenger *m)
+{
+    if (m->tcp_server != nullptr || tcp_connections_pending(nc_get_tcp_c(m->net_crypto))) {
+        return messenger_run_interval(m);
+    }
+
+    const uint32_t next_second = 1000 - (uint32_t)(mono_time_get_ms(m->mono_time) % 1000);
+    return min_u32(crypto_run_interval(m->net_crypto), next_second);
+}
+
+/* Hand the current set of sockets and the time until the next do_messenger() to the event loop. */
+static void update_event_loop(Messenger *m)
+{
+    const uint32_t num_socks = m_copy_sockets(m, nullptr, 0);
+
+    if (num_socks > m->event_socks_size) {
+        Socket *new_socks = (Socket *)realloc(m->event_socks, num_socks * sizeof(Socket));
+
+        if (new_socks == nullptr) {
+            return;
+        }
+
+        m->event_socks = new_socks;
+        m->event_socks_size = num_socks;
+    }
+
+    const uint32_t copied = m_copy_sockets(m, m->event_socks, num_socks);
+    event_loop_update(m->event_loop, m->event_socks, copied, messenger_event_interval(m));
+}
+
+int m_get_event_fd(Messenger *m)
+{
+    if (m->event_loop == nullptr) {
+        m->event_loop = event_loop_new(m->log);
+
+        if (m->event_loop == nullptr) {
+            return -1;
+        }
+
+        update_event_loop(m);
+    }
+
+    return event_loop_fd(m->event_loop);
+}
+
 /* The main loop that needs to be run at least 20 times per second. */
 void do_messenger(Messenger *m, void *userdata)
 {
@@ -2723,7 +2823,7 @@ void do_messenger(Messenger *m, void *userdata)
         }
     }
 
-    unix_time_update();
+    mono_time_update(m->mono_time);
 
     if (!m->options.udp_disabled) {
         networking_poll(m->net, userdata);
@@ -2740,8 +2840,8 @@ void do_messenger(Messenger *m, void *userdata)
     do_friends(m, userdata);
     connection_status_callback(m, userdata);
 
-    if (unix_time() > m->lastdump + DUMPING_CLIENTS_FRIENDS_EVERY_N_SECONDS) {
-        m->lastdump = unix_time();
+    if (mono_time_get(m->mono_time) > m->lastdump + DUMPING_CLIENTS_FRIENDS_EVERY_N_SECONDS) {
+        m->lastdump = mono_time_get(m->mono_time);
         uint32_t client, last_pinged;
 
         for (client = 0; client < LCLIENT_LIST; ++client) {
@@ -2849,6 +2949,10 @@ void do_messenger(Messenger *m, void *userdata)
             }
         }
     }
+
+    if (m->event_loop) {
+        update_event_loop(m);
+    }
 }
 
 /* new messenger format for load/save, more robust and forward compatible */
@@ -25,6 +25,7 @@
 #ifndef MESSENGER_H
 #define MESSENGER_H
 
+#include "event_loop.h"
 #include "friend_connection.h"
 #include "friend_requests.h"
 #include "logger.h"
@@ -89,6 +90,9 @@ typedef struct Messenger_Options {
 
     logger_cb *log_callback;
     void *log_user_data;
+
+    /* If set, share the UDP socket of this instance instead of opening one. */
+    Networking_Core *host_net;
 } Messenger_Options;
 
 
@@ -259,6 +263,7 @@ typedef struct Friend {
 
 struct Messenger {
     Logger *log;
+    Mono_Time *mono_time;
 
     Networking_Core *net;
     Net_Crypto *net_crypto;
@@ -316,6 +321,10 @@ struct Messenger {
     unsigned int last_connection_status;
 
     Messenger_Options options;
+
+    Event_Loop *event_loop;
+    Socket *event_socks;
+    uint32_t event_socks_size;
 };
 
 /* Format: [real_pk (32 bytes)][nospam number (4 bytes)][checksum (2 bytes)]
@@ -785,6 +794,22 @@ void do_messenger(Messenger *m, void *userdata);
  */
 uint32_t messenger_run_interval(const Messenger *m);
 
+/* Copy a maximum of max_num sockets that do_messenger() reads from to socks.
+ * If socks is NULL, nothing is copied and the number of sockets is returned.
+ *
+ * return number of sockets copied to socks.
+ */
+uint32_t m_copy_sockets(const Messenger *m, Socket *socks, uint32_t max_num);
+
+/* Return a descriptor that becomes readable when do_messenger() should be
+ * called, either because a socket has data or because one of its timers is due.
+ * An idle instance only wakes up once per second. The descriptor is created on first use and
+ * kept up to date by do_messenger().
+ *
+ * return -1 if the platform does not support it or on allocation failure.
+ */
+int m_get_event_fd(Messenger *m);
+
 /* SAVING AND LOADING FUNCTIONS: */
 
 /* return size of the messenger data (for saving). */
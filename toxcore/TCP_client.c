@@ -42,6 +42,7 @@ typedef struct TCP_Client_Conn {
 } TCP_Client_Conn;
 
 struct TCP_Client_Connection {
+    const Mono_Time *mono_time;
     TCP_Client_Status status;
     Socket sock;
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE]; /* our public key */
@@ -51,7 +52,7 @@ struct TCP_Client_Connection {
     uint8_t recv_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of received packets. */
     uint8_t sent_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of sent packets. */
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
-    uint16_t next_packet_length;
+    TCP_Recv_Buffer recv_buffer;
 
     uint8_t temp_secret_key[CRYPTO_SECRET_KEY_SIZE];
 
@@ -59,14 +60,18 @@ struct TCP_Client_Connection {
     uint16_t last_packet_length;
     uint16_t last_packet_sent;
 
-    TCP_Priority_List *priority_queue_start;
-    TCP_Priority_List *priority_queue_end;
+    TCP_Send_Queue send_queue;
 
     uint64_t kill_at;
 
     uint64_t last_pinged;
     uint64_t ping_id;
 
+    /* When the ping with ping_id was made, and the smoothed round trip time
+     * of pings in milliseconds, 0 until the first pong. */
+    uint64_t ping_sent_time;
+    uint32_t rtt;
+
     uint64_t ping_response_id;
     uint64_t ping_request_id;
 
@@ -102,6 +107,21 @@ TCP_Client_Status tcp_con_status(const TCP_Client_Connection *con)
 {
     return con->status;
 }
+
+uint32_t tcp_con_rtt(const TCP_Client_Connection *con)
+{
+    return con->rtt;
+}
+
+uint32_t tcp_con_queued_bytes(const TCP_Client_Connection *con)
+{
+    return tcp_send_queue_length(&con->send_queue);
+}
+
+Socket tcp_con_sock(const TCP_Client_Connection *con)
+{
+    return con->sock;
+}
 void *tcp_con_custom_object(const TCP_Client_Connection *con)
 {
     return con->custom_object;
@@ -358,76 +378,56 @@ static int client_send_pending_data_nonpriority(TCP_Client_Connection *con)
  */
 static int client_send_pending_data(TCP_Client_Connection *con)
 {
-    /* finish sending current non-priority packet */
+    /* finish sending the handshake */
     if (client_send_pending_data_nonpriority(con) == -1) {
         return -1;
     }
 
-    TCP_Priority_List *p = con->priority_queue_start;
-
-    while (p) {
-        const uint16_t left = p->size - p->sent;
-        const int len = net_send(con->sock, p->data + p->sent, left);
-
-        if (len != left) {
-            if (len > 0) {
-                p->sent += len;
-            }
-
-            break;
-        }
+    return tcp_send_queue_flush(&con->send_queue, con->sock) ? 0 : -1;
+}
 
-        TCP_Priority_List *pp = p;
-        p = p->next;
-        free(pp);
+/* Encrypt a packet whose length bytes of plain text were written at packet + TCP_PACKET_PLAIN_OFFSET
+ * where they are, and send or queue it. packet must hold TCP_PACKET_WIRE_SIZE(length) bytes.
+ *
+ * return 1 on success.
+ * return 0 if could not send packet.
+ * return -1 on failure (connection must be killed).
+ */
+static int write_packet_TCP_client_secure_connection_inplace(TCP_Client_Connection *con, uint8_t *packet,
+        uint16_t length, bool priority)
+{
+    if (length + CRYPTO_MAC_SIZE > MAX_PACKET_SIZE) {
+        return -1;
     }
 
-    con->priority_queue_start = p;
+    const uint16_t packet_length = TCP_PACKET_WIRE_SIZE(length);
+    const bool queue_empty = client_send_pending_data(con) == 0;
 
-    if (!p) {
-        con->priority_queue_end = nullptr;
+    if (!tcp_send_queue_has_room(&con->send_queue, priority, packet_length)) {
         return 0;
     }
 
-    return -1;
-}
-
-/* return 0 on failure (only if malloc fails)
- * return 1 on success
- */
-static bool client_add_priority(TCP_Client_Connection *con, const uint8_t *packet, uint16_t size, uint16_t sent)
-{
-    TCP_Priority_List *p = con->priority_queue_end;
-    TCP_Priority_List *new_list = (TCP_Priority_List *)malloc(sizeof(TCP_Priority_List) + size);
+    const uint16_t c_length = net_htons(length + CRYPTO_MAC_SIZE);
+    memcpy(packet, &c_length, sizeof(uint16_t));
+    int len = encrypt_data_symmetric_inplace(con->shared_key, con->sent_nonce, packet + sizeof(uint16_t), length);
 
-    if (!new_list) {
-        return 0;
+    if ((unsigned int)len != packet_length - sizeof(uint16_t)) {
+        return -1;
     }
 
-    new_list->next = nullptr;
-    new_list->size = size;
-    new_list->sent = sent;
-    memcpy(new_list->data, packet, size);
+    len = queue_empty ? net_send(con->sock, packet, packet_length) : 0;
 
-    if (p) {
-        p->next = new_list;
-    } else {
-        con->priority_queue_start = new_list;
+    if (len <= 0) {
+        len = 0;
     }
 
-    con->priority_queue_end = new_list;
-    return 1;
-}
-
-static void wipe_priority_list(TCP_Client_Connection *con)
-{
-    TCP_Priority_List *p = con->priority_queue_start;
+    increment_nonce(con->sent_nonce);
 
-    while (p) {
-        TCP_Priority_List *pp = p;
-        p = p->next;
-        free(pp);
+    if ((unsigned int)len == packet_length) {
+        return 1;
     }
+
+    return tcp_send_queue_add(&con->send_queue, priority, packet, packet_length, len);
 }
 
 /* return 1 on success.
@@ -441,58 +441,9 @@ static int write_packet_TCP_client_secure_connection(TCP_Client_Connection *con,
         return -1;
     }
 
-    bool sendpriority = 1;
-
-    if (client_send_pending_data(con) == -1) {
-        if (priority) {
-            sendpriority = 0;
-        } else {
-            return 0;
-        }
-    }
-
-    VLA(uint8_t, packet, sizeof(uint16_t) + length + CRYPTO_MAC_SIZE);
-
-    uint16_t c_length = net_htons(length + CRYPTO_MAC_SIZE);
-    memcpy(packet, &c_length, sizeof(uint16_t));
-    int len = encrypt_data_symmetric(con->shared_key, con->sent_nonce, data, length, packet + sizeof(uint16_t));
-
-    if ((unsigned int)len != (SIZEOF_VLA(packet) - sizeof(uint16_t))) {
-        return -1;
-    }
-
-    if (priority) {
-        len = sendpriority ? net_send(con->sock, packet, SIZEOF_VLA(packet)) : 0;
-
-        if (len <= 0) {
-            len = 0;
-        }
-
-        increment_nonce(con->sent_nonce);
-
-        if ((unsigned int)len == SIZEOF_VLA(packet)) {
-            return 1;
-        }
-
-        return client_add_priority(con, packet, SIZEOF_VLA(packet), len);
-    }
-
-    len = net_send(con->sock, packet, SIZEOF_VLA(packet));
-
-    if (len <= 0) {
-        return 0;
-    }
-
-    increment_nonce(con->sent_nonce);
-
-    if ((unsigned int)len == SIZEOF_VLA(packet)) {
-        return 1;
-    }
-
-    memcpy(con->last_packet, packet, SIZEOF_VLA(packet));
-    con->last_packet_length = SIZEOF_VLA(packet);
-    con->last_packet_sent = len;
-    return 1;
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(length));
+    memcpy(packet + TCP_PACKET_PLAIN_OFFSET, data, length);
+    return write_packet_TCP_client_secure_connection_inplace(con, packet, length, priority);
 }
 
 /* return 1 on success.
@@ -540,10 +491,10 @@ int send_data(TCP_Client_Connection *con, uint8_t con_id, const uint8_t *data, u
         return 0;
     }
 
-    VLA(uint8_t, packet, 1 + length);
-    packet[0] = con_id + NUM_RESERVED_PORTS;
-    memcpy(packet + 1, data, length);
-    return write_packet_TCP_client_secure_connection(con, packet, SIZEOF_VLA(packet), 0);
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(1 + length));
+    packet[TCP_PACKET_PLAIN_OFFSET] = con_id + NUM_RESERVED_PORTS;
+    memcpy(packet + TCP_PACKET_PLAIN_OFFSET + 1, data, length);
+    return write_packet_TCP_client_secure_connection_inplace(con, packet, 1 + length, 0);
 }
 
 /* return 1 on success.
@@ -556,11 +507,12 @@ int send_oob_packet(TCP_Client_Connection *con, const uint8_t *public_key, const
         return -1;
     }
 
-    VLA(uint8_t, packet, 1 + CRYPTO_PUBLIC_KEY_SIZE + length);
-    packet[0] = TCP_PACKET_OOB_SEND;
-    memcpy(packet + 1, public_key, CRYPTO_PUBLIC_KEY_SIZE);
-    memcpy(packet + 1 + CRYPTO_PUBLIC_KEY_SIZE, data, length);
-    return write_packet_TCP_client_secure_connection(con, packet, SIZEOF_VLA(packet), 0);
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(1 + CRYPTO_PUBLIC_KEY_SIZE + length));
+    uint8_t *plain = packet + TCP_PACKET_PLAIN_OFFSET;
+    plain[0] = TCP_PACKET_OOB_SEND;
+    memcpy(plain + 1, public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(plain + 1 + CRYPTO_PUBLIC_KEY_SIZE, data, length);
+    return write_packet_TCP_client_secure_connection_inplace(con, packet, 1 + CRYPTO_PUBLIC_KEY_SIZE + length, 0);
 }
 
 
@@ -674,10 +626,10 @@ int send_disconnect_request(TCP_Client_Connection *con, uint8_t con_id)
  */
 int send_onion_request(TCP_Client_Connection *con, const uint8_t *data, uint16_t length)
 {
-    VLA(uint8_t, packet, 1 + length);
-    packet[0] = TCP_PACKET_ONION_REQUEST;
-    memcpy(packet + 1, data, length);
-    return write_packet_TCP_client_secure_connection(con, packet, SIZEOF_VLA(packet), 0);
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(1 + length));
+    packet[TCP_PACKET_PLAIN_OFFSET] = TCP_PACKET_ONION_REQUEST;
+    memcpy(packet + TCP_PACKET_PLAIN_OFFSET + 1, data, length);
+    return write_packet_TCP_client_secure_connection_inplace(con, packet, 1 + length, 0);
 }
 
 void onion_response_handler(TCP_Client_Connection *con, tcp_onion_response_cb *onion_callback, void *object)
@@ -688,8 +640,8 @@ void onion_response_handler(TCP_Client_Connection *con, tcp_onion_response_cb *o
 
 /* Create new TCP connection to ip_port/public_key
  */
-TCP_Client_Connection *new_TCP_connection(IP_Port ip_port, const uint8_t *public_key, const uint8_t *self_public_key,
-        const uint8_t *self_secret_key, TCP_Proxy_Info *proxy_info)
+TCP_Client_Connection *new_TCP_connection(const Mono_Time *mono_time, IP_Port ip_port, const uint8_t *public_key,
+        const uint8_t *self_public_key, const uint8_t *self_secret_key, TCP_Proxy_Info *proxy_info)
 {
     if (networking_at_startup() != 0) {
         return nullptr;
@@ -735,7 +687,9 @@ TCP_Client_Connection *new_TCP_connection(IP_Port ip_port, const uint8_t *public
         return nullptr;
     }
 
+    temp->mono_time = mono_time;
     temp->sock = sock;
+    tcp_send_queue_init(&temp->send_queue, TCP_SEND_QUEUE_MAX_SIZE, nullptr);
     memcpy(temp->public_key, public_key, CRYPTO_PUBLIC_KEY_SIZE);
     memcpy(temp->self_public_key, self_public_key, CRYPTO_PUBLIC_KEY_SIZE);
     encrypt_precompute(temp->public_key, self_secret_key, temp->shared_key);
@@ -765,7 +719,7 @@ TCP_Client_Connection *new_TCP_connection(IP_Port ip_port, const uint8_t *public
             break;
     }
 
-    temp->kill_at = unix_time() + TCP_CONNECTION_TIMEOUT;
+    temp->kill_at = mono_time_get(mono_time) + TCP_CONNECTION_TIMEOUT;
 
     return temp;
 }
@@ -883,6 +837,9 @@ static int handle_TCP_client_packet(TCP_Client_Connection *conn, const uint8_t *
             if (ping_id) {
                 if (ping_id == conn->ping_id) {
                     conn->ping_id = 0;
+
+                    const uint32_t rtt = (uint32_t)(current_time_monotonic(conn->mono_time) - conn->ping_sent_time);
+                    conn->rtt = conn->rtt == 0 ? rtt : (conn->rtt * 7 + rtt) / 8;
                 }
 
                 return 0;
@@ -929,7 +886,7 @@ static int handle_TCP_client_packet(TCP_Client_Connection *conn, const uint8_t *
 static bool tcp_process_packet(TCP_Client_Connection *conn, void *userdata)
 {
     uint8_t packet[MAX_PACKET_SIZE];
-    const int len = read_packet_TCP_secure_connection(conn->sock, &conn->next_packet_length, conn->shared_key,
+    const int len = read_packet_TCP_secure_connection(conn->sock, &conn->recv_buffer, conn->shared_key,
                     conn->recv_nonce, packet, sizeof(packet));
 
     if (len == 0) {
@@ -955,7 +912,7 @@ static int do_confirmed_TCP(TCP_Client_Connection *conn, void *userdata)
     tcp_send_ping_response(conn);
     tcp_send_ping_request(conn);
 
-    if (is_timeout(conn->last_pinged, TCP_PING_FREQUENCY)) {
+    if (mono_time_is_timeout(conn->mono_time, conn->last_pinged, TCP_PING_FREQUENCY)) {
         uint64_t ping_id = random_u64();
 
         if (!ping_id) {
@@ -964,11 +921,12 @@ static int do_confirmed_TCP(TCP_Client_Connection *conn, void *userdata)
 
         conn->ping_request_id = ping_id;
         conn->ping_id = ping_id;
+        conn->ping_sent_time = current_time_monotonic(conn->mono_time);
         tcp_send_ping_request(conn);
-        conn->last_pinged = unix_time();
+        conn->last_pinged = mono_time_get(conn->mono_time);
     }
 
-    if (conn->ping_id && is_timeout(conn->last_pinged, TCP_PING_TIMEOUT)) {
+    if (conn->ping_id && mono_time_is_timeout(conn->mono_time, conn->last_pinged, TCP_PING_TIMEOUT)) {
         conn->status = TCP_CLIENT_DISCONNECTED;
         return 0;
     }
@@ -985,8 +943,6 @@ static int do_confirmed_TCP(TCP_Client_Connection *conn, void *userdata)
  */
 void do_TCP_connection(TCP_Client_Connection *tcp_connection, void *userdata)
 {
-    unix_time_update();
-
     if (tcp_connection->status == TCP_CLIENT_DISCONNECTED) {
         return;
     }
@@ -1064,7 +1020,7 @@ void do_TCP_connection(TCP_Client_Connection *tcp_connection, void *userdata)
         do_confirmed_TCP(tcp_connection, userdata);
     }
 
-    if (tcp_connection->kill_at <= unix_time()) {
+    if (tcp_connection->kill_at <= mono_time_get(tcp_connection->mono_time)) {
         tcp_connection->status = TCP_CLIENT_DISCONNECTED;
     }
 }
@@ -1077,7 +1033,7 @@ void kill_TCP_connection(TCP_Client_Connection *tcp_connection)
         return;
     }
 
-    wipe_priority_list(tcp_connection);
+    tcp_send_queue_free(&tcp_connection->send_queue);
     kill_sock(tcp_connection->sock);
     crypto_memzero(tcp_connection, sizeof(TCP_Client_Connection));
     free(tcp_connection);
@@ -56,6 +56,12 @@ typedef struct TCP_Client_Connection TCP_Client_Connection;
 const uint8_t *tcp_con_public_key(const TCP_Client_Connection *con);
 IP_Port tcp_con_ip_port(const TCP_Client_Connection *con);
 TCP_Client_Status tcp_con_status(const TCP_Client_Connection *con);
+Socket tcp_con_sock(const TCP_Client_Connection *con);
+
+/* Smoothed round trip time of pings to the relay in milliseconds, 0 until the first pong. */
+uint32_t tcp_con_rtt(const TCP_Client_Connection *con);
+/* Bytes waiting in the send queue of the connection. */
+uint32_t tcp_con_queued_bytes(const TCP_Client_Connection *con);
 
 void *tcp_con_custom_object(const TCP_Client_Connection *con);
 uint32_t tcp_con_custom_uint(const TCP_Client_Connection *con);
@@ -64,8 +70,8 @@ void tcp_con_set_custom_uint(TCP_Client_Connection *con, uint32_t uint);
 
 /* Create new TCP connection to ip_port/public_key
  */
-TCP_Client_Connection *new_TCP_connection(IP_Port ip_port, const uint8_t *public_key, const uint8_t *self_public_key,
-        const uint8_t *self_secret_key, TCP_Proxy_Info *proxy_info);
+TCP_Client_Connection *new_TCP_connection(const Mono_Time *mono_time, IP_Port ip_port, const uint8_t *public_key,
+        const uint8_t *self_public_key, const uint8_t *self_secret_key, TCP_Proxy_Info *proxy_info);
 
 /* Run the TCP connection
  */
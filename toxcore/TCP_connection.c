@@ -36,6 +36,7 @@
 
 
 struct TCP_Connections {
+    const Mono_Time *mono_time;
     DHT *dht;
 
     uint8_t self_public_key[CRYPTO_PUBLIC_KEY_SIZE];
@@ -280,12 +281,19 @@ static TCP_con *get_tcp_connection(const TCP_Connections *tcp_c, int tcp_connect
     return &tcp_c->tcp_connections[tcp_connections_number];
 }
 
+/* Time in ms a packet sent through the relay can be expected to take. */
+static uint32_t tcp_relay_cost(const TCP_con *tcp_con)
+{
+    return tcp_con_rtt(tcp_con->connection) + tcp_con_queued_bytes(tcp_con->connection) / TCP_RELAY_QUEUE_BYTES_PER_MS;
+}
+
 /* Send a packet to the TCP connection.
  *
  * return -1 on failure.
  * return 0 on success.
  */
-int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, const uint8_t *packet, uint16_t length)
+int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, const uint8_t *packet, uint16_t length,
+                               bool lossy)
 {
     TCP_Connection_to *con_to = get_connection(tcp_c, connections_number);
 
@@ -300,28 +308,58 @@ int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, c
 
     bool limit_reached = 0;
 
+    /* Indexes of the online routes in con_to->connections, cheapest first. */
+    unsigned int routes[MAX_FRIEND_TCP_CONNECTIONS];
+    uint32_t costs[MAX_FRIEND_TCP_CONNECTIONS];
+    unsigned int num_routes = 0;
+
     for (i = 0; i < MAX_FRIEND_TCP_CONNECTIONS; ++i) {
         uint32_t tcp_con_num = con_to->connections[i].tcp_connection;
         uint8_t status = con_to->connections[i].status;
-        uint8_t connection_id = con_to->connections[i].connection_id;
 
         if (tcp_con_num && status == TCP_CONNECTIONS_STATUS_ONLINE) {
-            tcp_con_num -= 1;
-            TCP_con *tcp_con = get_tcp_connection(tcp_c, tcp_con_num);
+            TCP_con *tcp_con = get_tcp_connection(tcp_c, tcp_con_num - 1);
 
             if (!tcp_con) {
                 continue;
             }
 
-            ret = send_data(tcp_con->connection, connection_id, packet, length);
-
-            if (ret == 0) {
+            if (lossy && tcp_con_queued_bytes(tcp_con->connection) >= TCP_RELAY_LOSSY_QUEUE_LIMIT) {
+                ++tcp_con->packets_dropped;
                 limit_reached = 1;
+                continue;
             }
 
-            if (ret == 1) {
-                break;
+            const uint32_t cost = tcp_relay_cost(tcp_con);
+            unsigned int j = num_routes;
+
+            while (j > 0 && costs[j - 1] > cost) {
+                routes[j] = routes[j - 1];
+                costs[j] = costs[j - 1];
+                --j;
             }
+
+            routes[j] = i;
+            costs[j] = cost;
+            ++num_routes;
+        }
+    }
+
+    for (i = 0; i < num_routes; ++i) {
+        TCP_con *tcp_con = get_tcp_connection(tcp_c, con_to->connections[routes[i]].tcp_connection - 1);
+        uint8_t connection_id = con_to->connections[routes[i]].connection_id;
+
+        ret = send_data(tcp_con->connection, connection_id, packet, length);
+
+        if (ret == 0) {
+            ++tcp_con->packets_dropped;
+            limit_reached = 1;
+        }
+
+        if (ret == 1) {
+            ++tcp_con->packets_sent;
+            tcp_con->bytes_sent += length;
+            break;
         }
     }
 
@@ -346,6 +384,8 @@ int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, c
                 }
 
                 if (send_oob_packet(tcp_con->connection, con_to->public_key, packet, length) == 1) {
+                    ++tcp_con->packets_sent;
+                    tcp_con->bytes_sent += length;
                     ret += 1;
                 }
             }
@@ -722,6 +762,36 @@ static unsigned int online_tcp_connection_from_conn(TCP_Connection_to *con_to)
     return count;
 }
 
+/* return number of relays tied to the connection, online or not. */
+static unsigned int tcp_connections_of_conn(const TCP_Connection_to *con_to)
+{
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < MAX_FRIEND_TCP_CONNECTIONS; ++i) {
+        if (con_to->connections[i].tcp_connection) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/* return number of relay connections that are not sleeping. */
+static uint32_t num_active_tcp_relays(const TCP_Connections *tcp_c)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < tcp_c->tcp_connections_length; ++i) {
+        const TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
+
+        if (tcp_con && tcp_con->status != TCP_CONN_SLEEPING) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
 /* return index on success.
  * return -1 on failure.
  */
@@ -794,8 +864,8 @@ static int reconnect_tcp_relay_connection(TCP_Connections *tcp_c, int tcp_connec
     uint8_t relay_pk[CRYPTO_PUBLIC_KEY_SIZE];
     memcpy(relay_pk, tcp_con_public_key(tcp_con->connection), CRYPTO_PUBLIC_KEY_SIZE);
     kill_TCP_connection(tcp_con->connection);
-    tcp_con->connection = new_TCP_connection(ip_port, relay_pk, tcp_c->self_public_key, tcp_c->self_secret_key,
-                          &tcp_c->proxy_info);
+    tcp_con->connection = new_TCP_connection(tcp_c->mono_time, ip_port, relay_pk, tcp_c->self_public_key,
+                          tcp_c->self_secret_key, &tcp_c->proxy_info);
 
     if (!tcp_con->connection) {
         kill_tcp_relay_connection(tcp_c, tcp_connections_number);
@@ -884,8 +954,8 @@ static int unsleep_tcp_relay_connection(TCP_Connections *tcp_c, int tcp_connecti
         return -1;
     }
 
-    tcp_con->connection = new_TCP_connection(tcp_con->ip_port, tcp_con->relay_pk, tcp_c->self_public_key,
-                          tcp_c->self_secret_key, &tcp_c->proxy_info);
+    tcp_con->connection = new_TCP_connection(tcp_c->mono_time, tcp_con->ip_port, tcp_con->relay_pk,
+                          tcp_c->self_public_key, tcp_c->self_secret_key, &tcp_c->proxy_info);
 
     if (!tcp_con->connection) {
         kill_tcp_relay_connection(tcp_c, tcp_connections_number);
@@ -1122,7 +1192,7 @@ static int tcp_relay_on_online(TCP_Connections *tcp_c, int tcp_connections_numbe
 
     /* If this connection isn't used by any connection, we don't need to wait for them to come online. */
     if (sent) {
-        tcp_con->connected_time = unix_time();
+        tcp_con->connected_time = mono_time_get(tcp_c->mono_time);
     } else {
         tcp_con->connected_time = 0;
     }
@@ -1155,8 +1225,8 @@ static int add_tcp_relay_instance(TCP_Connections *tcp_c, IP_Port ip_port, const
 
     TCP_con *tcp_con = &tcp_c->tcp_connections[tcp_connections_number];
 
-    tcp_con->connection = new_TCP_connection(ip_port, relay_pk, tcp_c->self_public_key, tcp_c->self_secret_key,
-                          &tcp_c->proxy_info);
+    tcp_con->connection = new_TCP_connection(tcp_c->mono_time, ip_port, relay_pk, tcp_c->self_public_key,
+                          tcp_c->self_secret_key, &tcp_c->proxy_info);
 
     if (!tcp_con->connection) {
         return -1;
@@ -1216,7 +1286,7 @@ int add_tcp_number_relay_connection(TCP_Connections *tcp_c, int connections_numb
 
     if (tcp_con->status == TCP_CONN_CONNECTED) {
         if (send_tcp_relay_routing_request(tcp_c, tcp_connections_number, con_to->public_key) == 0) {
-            tcp_con->connected_time = unix_time();
+            tcp_con->connected_time = mono_time_get(tcp_c->mono_time);
         }
     }
 
@@ -1248,6 +1318,12 @@ int add_tcp_relay_connection(TCP_Connections *tcp_c, int connections_number, IP_
         return -1;
     }
 
+    /* Once the pool is full, friends share the relays we are connected to. They
+     * can still reach us through the relays we tell them about. */
+    if (num_active_tcp_relays(tcp_c) >= MAX_ACTIVE_TCP_RELAYS) {
+        return -1;
+    }
+
     tcp_connections_number = add_tcp_relay_instance(tcp_c, ip_port, relay_pk);
 
     TCP_con *tcp_con = get_tcp_connection(tcp_c, tcp_connections_number);
@@ -1313,6 +1389,93 @@ unsigned int tcp_copy_connected_relays(TCP_Connections *tcp_c, Node_format *tcp_
     return copied;
 }
 
+uint32_t tcp_copy_sockets(const TCP_Connections *tcp_c, Socket *socks, uint32_t max_num)
+{
+    uint32_t copied = 0;
+
+    for (uint32_t i = 0; i < tcp_c->tcp_connections_length; ++i) {
+        const TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
+
+        if (!tcp_con || tcp_con->status == TCP_CONN_SLEEPING) {
+            continue;
+        }
+
+        if (socks != nullptr) {
+            if (copied >= max_num) {
+                break;
+            }
+
+            socks[copied] = tcp_con_sock(tcp_con->connection);
+        }
+
+        ++copied;
+    }
+
+    return copied;
+}
+
+bool tcp_connections_pending(const TCP_Connections *tcp_c)
+{
+    for (uint32_t i = 0; i < tcp_c->tcp_connections_length; ++i) {
+        const TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
+
+        if (!tcp_con || tcp_con->status == TCP_CONN_SLEEPING) {
+            continue;
+        }
+
+        const TCP_Client_Status status = tcp_con_status(tcp_con->connection);
+
+        if ((status != TCP_CLIENT_CONFIRMED && status != TCP_CLIENT_UNCONFIRMED && status != TCP_CLIENT_DISCONNECTED)
+                || tcp_con_queued_bytes(tcp_con->connection) > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Fill in the statistics of each relay that is not sleeping, counting the friends online through it. */
+uint32_t tcp_copy_relay_stats(const TCP_Connections *tcp_c, TCP_Relay_Stats *stats, uint32_t max_num)
+{
+    uint32_t copied = 0;
+
+    for (uint32_t i = 0; i < tcp_c->tcp_connections_length && copied < max_num; ++i) {
+        const TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
+
+        if (!tcp_con || tcp_con->status == TCP_CONN_SLEEPING) {
+            continue;
+        }
+
+        TCP_Relay_Stats *relay = &stats[copied];
+        memcpy(relay->public_key, tcp_con_public_key(tcp_con->connection), CRYPTO_PUBLIC_KEY_SIZE);
+        relay->rtt = tcp_con_rtt(tcp_con->connection);
+        relay->queued_bytes = tcp_con_queued_bytes(tcp_con->connection);
+        relay->packets_sent = tcp_con->packets_sent;
+        relay->bytes_sent = tcp_con->bytes_sent;
+        relay->packets_dropped = tcp_con->packets_dropped;
+        relay->friends = 0;
+
+        for (uint32_t j = 0; j < tcp_c->connections_length; ++j) {
+            const TCP_Connection_to *con_to = get_connection(tcp_c, j);
+
+            if (!con_to) {
+                continue;
+            }
+
+            for (unsigned int k = 0; k < MAX_FRIEND_TCP_CONNECTIONS; ++k) {
+                if (con_to->connections[k].tcp_connection == i + 1
+                        && con_to->connections[k].status == TCP_CONNECTIONS_STATUS_ONLINE) {
+                    ++relay->friends;
+                }
+            }
+        }
+
+        ++copied;
+    }
+
+    return copied;
+}
+
 /* Set if we want TCP_connection to allocate some connection for onion use.
  *
  * If status is 1, allocate some connections. if status is 0, don't.
@@ -1390,7 +1553,7 @@ int set_tcp_onion_status(TCP_Connections *tcp_c, bool status)
  *
  * Returns NULL on failure.
  */
-TCP_Connections *new_tcp_connections(const uint8_t *secret_key, TCP_Proxy_Info *proxy_info)
+TCP_Connections *new_tcp_connections(const Mono_Time *mono_time, const uint8_t *secret_key, TCP_Proxy_Info *proxy_info)
 {
     if (secret_key == nullptr) {
         return nullptr;
@@ -1402,6 +1565,7 @@ TCP_Connections *new_tcp_connections(const uint8_t *secret_key, TCP_Proxy_Info *
         return nullptr;
     }
 
+    temp->mono_time = mono_time;
     memcpy(temp->self_secret_key, secret_key, CRYPTO_SECRET_KEY_SIZE);
     crypto_derive_public_key(temp->self_public_key, temp->self_secret_key);
     temp->proxy_info = *proxy_info;
@@ -1442,7 +1606,8 @@ static void do_tcp_conns(TCP_Connections *tcp_c, void *userdata)
 
                 if (tcp_con->status == TCP_CONN_CONNECTED && !tcp_con->onion && tcp_con->lock_count
                         && tcp_con->lock_count == tcp_con->sleep_count
-                        && is_timeout(tcp_con->connected_time, TCP_CONNECTION_ANNOUNCE_TIMEOUT)) {
+                        && mono_time_is_timeout(tcp_c->mono_time, tcp_con->connected_time,
+                                                TCP_CONNECTION_ANNOUNCE_TIMEOUT)) {
                     sleep_tcp_relay_connection(tcp_c, i);
                 }
             }
@@ -1464,13 +1629,37 @@ static void kill_nonused_tcp(TCP_Connections *tcp_c)
     unsigned int num_online = 0;
     unsigned int num_kill = 0;
     VLA(unsigned int, to_kill, tcp_c->tcp_connections_length);
+    VLA(unsigned int, num_refs, tcp_c->tcp_connections_length);
+    memset(num_refs, 0, tcp_c->tcp_connections_length * sizeof(unsigned int));
+
+    /* Relays a friend was given stay around while the pool has room, so they are
+     * not killed and added again each time the friend shares its relays. A
+     * friend without free slots doesn't keep its relays, or it could never get
+     * a working one. */
+    for (i = 0; i < tcp_c->connections_length; ++i) {
+        const TCP_Connection_to *con_to = get_connection(tcp_c, i);
+
+        if (!con_to || tcp_connections_of_conn(con_to) >= MAX_FRIEND_TCP_CONNECTIONS) {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < MAX_FRIEND_TCP_CONNECTIONS; ++j) {
+            if (con_to->connections[j].tcp_connection) {
+                ++num_refs[con_to->connections[j].tcp_connection - 1];
+            }
+        }
+    }
+
+    const bool pool_full = num_active_tcp_relays(tcp_c) >= MAX_ACTIVE_TCP_RELAYS;
 
     for (i = 0; i < tcp_c->tcp_connections_length; ++i) {
         TCP_con *tcp_con = get_tcp_connection(tcp_c, i);
 
         if (tcp_con) {
             if (tcp_con->status == TCP_CONN_CONNECTED) {
-                if (!tcp_con->onion && !tcp_con->lock_count && is_timeout(tcp_con->connected_time, TCP_CONNECTION_ANNOUNCE_TIMEOUT)) {
+                if (!tcp_con->onion && !tcp_con->lock_count && (pool_full || num_refs[i] == 0)
+                        && mono_time_is_timeout(tcp_c->mono_time, tcp_con->connected_time,
+                                                TCP_CONNECTION_ANNOUNCE_TIMEOUT)) {
                     to_kill[num_kill] = i;
                     ++num_kill;
                 }
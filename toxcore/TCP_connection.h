@@ -51,6 +51,19 @@
 /* Number of TCP connections used for onion purposes. */
 #define NUM_ONION_TCP_CONNECTIONS RECOMMENDED_FRIEND_TCP_CONNECTIONS
 
+/* Relays connected to (and not sleeping) at which no new relays are added for
+   friends. Friends then only share the relays we are connected to, and relays
+   no friend is online through are killed to make room. */
+#define MAX_ACTIVE_TCP_RELAYS 32
+
+/* Queued bytes at which a relay stops taking lossy packets, which leaves the
+   rest of its send queue to lossless packets. */
+#define TCP_RELAY_LOSSY_QUEUE_LIMIT (16 * 1024)
+
+/* Queued bytes that count as one millisecond of delay when picking the relay
+   to send a packet through. */
+#define TCP_RELAY_QUEUE_BYTES_PER_MS 1024
+
 typedef struct TCP_Conn_to {
     uint32_t tcp_connection;
     unsigned int status;
@@ -78,18 +91,37 @@ typedef struct TCP_con {
     IP_Port ip_port;
     uint8_t relay_pk[CRYPTO_PUBLIC_KEY_SIZE];
     bool unsleep; /* set to 1 to unsleep connection. */
+
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_dropped;
 } TCP_con;
 
+typedef struct TCP_Relay_Stats {
+    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint32_t rtt; /* Smoothed ping round trip time in ms, 0 if not known yet. */
+    uint32_t queued_bytes;
+    uint32_t friends; /* Connections online through the relay. */
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_dropped; /* Packets the relay did not take because its queue was too long. */
+} TCP_Relay_Stats;
+
 typedef struct TCP_Connections TCP_Connections;
 
 const uint8_t *tcp_connections_public_key(const TCP_Connections *tcp_c);
 
 /* Send a packet to the TCP connection.
+ *
+ * The packet goes through the online relay with the lowest round trip time
+ * plus queueing delay. Lossy packets are not sent through relays with more
+ * than TCP_RELAY_LOSSY_QUEUE_LIMIT bytes queued.
  *
  * return -1 on failure.
  * return 0 on success.
  */
-int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, const uint8_t *packet, uint16_t length);
+int send_packet_tcp_connection(TCP_Connections *tcp_c, int connections_number, const uint8_t *packet, uint16_t length,
+                               bool lossy);
 
 /* Return a random TCP connection number for use in send_tcp_onion_request.
  *
@@ -212,6 +244,24 @@ int add_tcp_relay_global(TCP_Connections *tcp_c, IP_Port ip_port, const uint8_t
  */
 unsigned int tcp_copy_connected_relays(TCP_Connections *tcp_c, Node_format *tcp_relays, uint16_t max_num);
 
+/* Copy a maximum of max_num sockets of relay connections that are not sleeping to socks.
+ * If socks is NULL, nothing is copied and the number of such sockets is returned.
+ *
+ * return number of sockets copied to socks.
+ */
+uint32_t tcp_copy_sockets(const TCP_Connections *tcp_c, Socket *socks, uint32_t max_num);
+
+/* return true if a relay connection that is not sleeping is still being set up or has data queued
+ * that could not be written yet. Neither makes its socket readable, so they must be polled.
+ */
+bool tcp_connections_pending(const TCP_Connections *tcp_c);
+
+/* Copy the statistics of at most max_num relays that are not sleeping to stats.
+ *
+ * return number of relays copied.
+ */
+uint32_t tcp_copy_relay_stats(const TCP_Connections *tcp_c, TCP_Relay_Stats *stats, uint32_t max_num);
+
 /* Returns a new TCP_Connections object associated with the secret_key.
  *
  * In order for others to connect to this instance new_tcp_connection_to() must be called with the
@@ -219,7 +269,7 @@ unsigned int tcp_copy_connected_relays(TCP_Connections *tcp_c, Node_format *tcp_
  *
  * Returns NULL on failure.
  */
-TCP_Connections *new_tcp_connections(const uint8_t *secret_key, TCP_Proxy_Info *proxy_info);
+TCP_Connections *new_tcp_connections(const Mono_Time *mono_time, const uint8_t *secret_key, TCP_Proxy_Info *proxy_info);
 
 void do_tcp_connections(TCP_Connections *tcp_c, void *userdata);
 void kill_tcp_connections(TCP_Connections *tcp_c);
@@ -0,0 +1,239 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "TCP_handshake_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+
+bool tcp_handshake_process(TCP_Handshake *handshake, const uint8_t *self_secret_key)
+{
+    const uint8_t *data = handshake->data;
+    handshake->ok = false;
+
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    encrypt_precompute(data, self_secret_key, shared_key);
+    uint8_t plain[TCP_HANDSHAKE_PLAIN_SIZE];
+    int len = decrypt_data_symmetric(shared_key, data + CRYPTO_PUBLIC_KEY_SIZE,
+                                     data + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE, TCP_HANDSHAKE_PLAIN_SIZE + CRYPTO_MAC_SIZE, plain);
+
+    if (len != TCP_HANDSHAKE_PLAIN_SIZE) {
+        crypto_memzero(shared_key, sizeof(shared_key));
+        return false;
+    }
+
+    memcpy(handshake->public_key, data, CRYPTO_PUBLIC_KEY_SIZE);
+    uint8_t temp_secret_key[CRYPTO_SECRET_KEY_SIZE];
+    uint8_t resp_plain[TCP_HANDSHAKE_PLAIN_SIZE];
+    crypto_new_keypair(resp_plain, temp_secret_key);
+    random_nonce(handshake->sent_nonce);
+    memcpy(resp_plain + CRYPTO_PUBLIC_KEY_SIZE, handshake->sent_nonce, CRYPTO_NONCE_SIZE);
+    memcpy(handshake->recv_nonce, plain + CRYPTO_PUBLIC_KEY_SIZE, CRYPTO_NONCE_SIZE);
+
+    random_nonce(handshake->response);
+
+    len = encrypt_data_symmetric(shared_key, handshake->response, resp_plain, TCP_HANDSHAKE_PLAIN_SIZE,
+                                 handshake->response + CRYPTO_NONCE_SIZE);
+    crypto_memzero(shared_key, sizeof(shared_key));
+
+    if (len != TCP_HANDSHAKE_PLAIN_SIZE + CRYPTO_MAC_SIZE) {
+        crypto_memzero(temp_secret_key, sizeof(temp_secret_key));
+        return false;
+    }
+
+    encrypt_precompute(plain, temp_secret_key, handshake->shared_key);
+    crypto_memzero(temp_secret_key, sizeof(temp_secret_key));
+    handshake->ok = true;
+    return true;
+}
+
+/* Ring of handshakes {start, start + num). */
+typedef struct TCP_Handshake_Queue {
+    TCP_Handshake *handshakes;
+    uint32_t start;
+    uint32_t num;
+} TCP_Handshake_Queue;
+
+struct TCP_Handshake_Pool {
+    uint8_t secret_key[CRYPTO_SECRET_KEY_SIZE];
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    bool stop;
+
+    /* Both queues have room for max_handshakes, which bounds the number of
+     * handshakes submitted but not yet polled. */
+    uint32_t max_handshakes;
+    uint32_t num_handshakes;
+    TCP_Handshake_Queue jobs;
+    TCP_Handshake_Queue results;
+
+    pthread_t *threads;
+    uint16_t num_threads;
+};
+
+static void tcp_handshake_queue_push(TCP_Handshake_Queue *queue, uint32_t size, const TCP_Handshake *handshake)
+{
+    queue->handshakes[(queue->start + queue->num) % size] = *handshake;
+    ++queue->num;
+}
+
+static void tcp_handshake_queue_pop(TCP_Handshake_Queue *queue, uint32_t size, TCP_Handshake *handshake)
+{
+    *handshake = queue->handshakes[queue->start];
+    queue->start = (queue->start + 1) % size;
+    --queue->num;
+}
+
+static void *tcp_handshake_worker(void *arg)
+{
+    TCP_Handshake_Pool *pool = (TCP_Handshake_Pool *)arg;
+    TCP_Handshake handshake;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (true) {
+        while (!pool->stop && pool->jobs.num == 0) {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+
+        if (pool->stop) {
+            break;
+        }
+
+        tcp_handshake_queue_pop(&pool->jobs, pool->max_handshakes, &handshake);
+        pthread_mutex_unlock(&pool->mutex);
+
+        tcp_handshake_process(&handshake, pool->secret_key);
+
+        pthread_mutex_lock(&pool->mutex);
+        tcp_handshake_queue_push(&pool->results, pool->max_handshakes, &handshake);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    crypto_memzero(&handshake, sizeof(handshake));
+    return nullptr;
+}
+
+static void tcp_handshake_pool_free(TCP_Handshake_Pool *pool)
+{
+    if (pool->jobs.handshakes != nullptr) {
+        crypto_memzero(pool->jobs.handshakes, pool->max_handshakes * sizeof(TCP_Handshake));
+    }
+
+    if (pool->results.handshakes != nullptr) {
+        crypto_memzero(pool->results.handshakes, pool->max_handshakes * sizeof(TCP_Handshake));
+    }
+
+    free(pool->jobs.handshakes);
+    free(pool->results.handshakes);
+    free(pool->threads);
+    crypto_memzero(pool, sizeof(TCP_Handshake_Pool));
+    free(pool);
+}
+
+TCP_Handshake_Pool *tcp_handshake_pool_new(const uint8_t *self_secret_key, uint16_t num_threads,
+        uint32_t max_handshakes)
+{
+    if (num_threads == 0 || max_handshakes == 0) {
+        return nullptr;
+    }
+
+    TCP_Handshake_Pool *pool = (TCP_Handshake_Pool *)calloc(1, sizeof(TCP_Handshake_Pool));
+
+    if (pool == nullptr) {
+        return nullptr;
+    }
+
+    memcpy(pool->secret_key, self_secret_key, CRYPTO_SECRET_KEY_SIZE);
+    pool->max_handshakes = max_handshakes;
+    pool->jobs.handshakes = (TCP_Handshake *)calloc(max_handshakes, sizeof(TCP_Handshake));
+    pool->results.handshakes = (TCP_Handshake *)calloc(max_handshakes, sizeof(TCP_Handshake));
+    pool->threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+
+    if (pool->jobs.handshakes == nullptr || pool->results.handshakes == nullptr || pool->threads == nullptr) {
+        tcp_handshake_pool_free(pool);
+        return nullptr;
+    }
+
+    if (pthread_mutex_init(&pool->mutex, nullptr) != 0) {
+        tcp_handshake_pool_free(pool);
+        return nullptr;
+    }
+
+    if (pthread_cond_init(&pool->work, nullptr) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        tcp_handshake_pool_free(pool);
+        return nullptr;
+    }
+
+    for (uint16_t i = 0; i < num_threads; ++i) {
+        if (pthread_create(&pool->threads[i], nullptr, &tcp_handshake_worker, pool) != 0) {
+            break;
+        }
+
+        ++pool->num_threads;
+    }
+
+    if (pool->num_threads == 0) {
+        tcp_handshake_pool_kill(pool);
+        return nullptr;
+    }
+
+    return pool;
+}
+
+void tcp_handshake_pool_kill(TCP_Handshake_Pool *pool)
+{
+    if (pool == nullptr) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint16_t i = 0; i < pool->num_threads; ++i) {
+        pthread_join(pool->threads[i], nullptr);
+    }
+
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    tcp_handshake_pool_free(pool);
+}
+
+bool tcp_handshake_pool_submit(TCP_Handshake_Pool *pool, const TCP_Handshake *handshake)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->num_handshakes == pool->max_handshakes) {
+        pthread_mutex_unlock(&pool->mutex);
+        return false;
+    }
+
+    ++pool->num_handshakes;
+    tcp_handshake_queue_push(&pool->jobs, pool->max_handshakes, handshake);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+bool tcp_handshake_pool_poll(TCP_Handshake_Pool *pool, TCP_Handshake *handshake)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->results.num == 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        return false;
+    }
+
+    tcp_handshake_queue_pop(&pool->results, pool->max_handshakes, handshake);
+    --pool->num_handshakes;
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ * Worker threads doing the crypto of TCP relay handshakes.
+ *
+ * Every handshake a TCP server accepts costs a few Curve25519 operations. A
+ * pool lets the server hand them to worker threads so that a storm of new
+ * connections doesn't hold up forwarding for established ones. Only the
+ * crypto runs on the workers: the server reads the handshake, submits it, and
+ * later polls for the finished result, which holds everything it needs to send
+ * the response and set up the connection.
+ */
+#ifndef C_TOXCORE_TOXCORE_TCP_HANDSHAKE_POOL_H
+#define C_TOXCORE_TOXCORE_TCP_HANDSHAKE_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "TCP_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TCP_Handshake {
+    /* Set by the caller and returned unchanged. */
+    uint8_t data[TCP_CLIENT_HANDSHAKE_SIZE];
+    uint32_t index;
+    uint64_t id;
+
+    /* Results, valid if ok is true. */
+    bool ok;
+    uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
+    uint8_t recv_nonce[CRYPTO_NONCE_SIZE];
+    uint8_t sent_nonce[CRYPTO_NONCE_SIZE];
+    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
+    uint8_t response[TCP_SERVER_HANDSHAKE_SIZE];
+} TCP_Handshake;
+
+/**
+ * Check the client handshake in data and compute the keys, nonces and
+ * response of the connection.
+ *
+ * @return the value of handshake->ok: false if the handshake is invalid.
+ */
+bool tcp_handshake_process(TCP_Handshake *handshake, const uint8_t *self_secret_key);
+
+typedef struct TCP_Handshake_Pool TCP_Handshake_Pool;
+
+/**
+ * Start num_threads workers processing handshakes with self_secret_key. At
+ * most max_handshakes can be submitted and not yet polled at the same time.
+ *
+ * @return NULL on failure.
+ */
+TCP_Handshake_Pool *tcp_handshake_pool_new(const uint8_t *self_secret_key, uint16_t num_threads,
+        uint32_t max_handshakes);
+
+/**
+ * Stop the workers and free the pool. Unfinished handshakes are dropped.
+ */
+void tcp_handshake_pool_kill(TCP_Handshake_Pool *pool);
+
+/**
+ * Queue a handshake for processing.
+ *
+ * @return false if the pool already holds max_handshakes handshakes.
+ */
+bool tcp_handshake_pool_submit(TCP_Handshake_Pool *pool, const TCP_Handshake *handshake);
+
+/**
+ * Take a processed handshake out of the pool.
+ *
+ * @return false if none is finished yet.
+ */
+bool tcp_handshake_pool_poll(TCP_Handshake_Pool *pool, TCP_Handshake *handshake);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_TCP_HANDSHAKE_POOL_H
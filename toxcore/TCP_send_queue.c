@@ -0,0 +1,237 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "TCP_send_queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+
+void tcp_send_queue_init(TCP_Send_Queue *queue, uint32_t limit, TCP_Send_Budget *budget)
+{
+    memset(queue, 0, sizeof(TCP_Send_Queue));
+    queue->limit = limit;
+    queue->budget = budget;
+}
+
+static void tcp_send_lane_free(TCP_Send_Queue *queue, TCP_Send_Lane *lane)
+{
+    if (queue->budget != nullptr) {
+        queue->budget->used -= lane->capacity;
+    }
+
+    free(lane->data);
+    memset(lane, 0, sizeof(TCP_Send_Lane));
+}
+
+void tcp_send_queue_free(TCP_Send_Queue *queue)
+{
+    tcp_send_lane_free(queue, &queue->priority);
+    tcp_send_lane_free(queue, &queue->normal);
+}
+
+bool tcp_send_queue_empty(const TCP_Send_Queue *queue)
+{
+    return queue->priority.length == 0 && queue->normal.length == 0;
+}
+
+uint32_t tcp_send_queue_length(const TCP_Send_Queue *queue)
+{
+    return queue->priority.length + queue->normal.length;
+}
+
+/* Return the lane a packet goes into. Priority packets can't overtake whole
+ * normal packets, which were encrypted with earlier nonces.
+ */
+static TCP_Send_Lane *tcp_send_queue_lane(TCP_Send_Queue *queue, bool priority)
+{
+    if (priority && queue->normal.length == queue->normal.head_left) {
+        return &queue->priority;
+    }
+
+    return &queue->normal;
+}
+
+/* return the capacity the lane must grow to so that length more bytes fit.
+ * return 0 if that would exceed the queue or budget limits.
+ */
+static uint32_t tcp_send_lane_grow_size(const TCP_Send_Queue *queue, const TCP_Send_Lane *lane, uint32_t length)
+{
+    uint32_t capacity = lane->capacity != 0 ? lane->capacity : TCP_SEND_QUEUE_INITIAL_SIZE;
+
+    while (capacity - lane->length < length) {
+        capacity *= 2;
+    }
+
+    const uint32_t total = queue->priority.capacity + queue->normal.capacity - lane->capacity + capacity;
+
+    if (total > queue->limit) {
+        return 0;
+    }
+
+    if (queue->budget != nullptr && queue->budget->used + (capacity - lane->capacity) > queue->budget->limit) {
+        return 0;
+    }
+
+    return capacity;
+}
+
+static bool tcp_send_lane_reserve(TCP_Send_Queue *queue, TCP_Send_Lane *lane, uint32_t length)
+{
+    if (lane->capacity - lane->length >= length) {
+        return true;
+    }
+
+    const uint32_t capacity = tcp_send_lane_grow_size(queue, lane, length);
+
+    if (capacity == 0) {
+        return false;
+    }
+
+    uint8_t *data = (uint8_t *)malloc(capacity);
+
+    if (data == nullptr) {
+        return false;
+    }
+
+    /* Move the data to the front of the new ring. */
+    const uint32_t first = lane->capacity - lane->start < lane->length ? lane->capacity - lane->start : lane->length;
+
+    if (lane->length != 0) {
+        memcpy(data, lane->data + lane->start, first);
+        memcpy(data + first, lane->data, lane->length - first);
+    }
+
+    if (queue->budget != nullptr) {
+        queue->budget->used += capacity - lane->capacity;
+    }
+
+    free(lane->data);
+    lane->data = data;
+    lane->capacity = capacity;
+    lane->start = 0;
+    return true;
+}
+
+bool tcp_send_queue_has_room(TCP_Send_Queue *queue, bool priority, uint16_t length)
+{
+    const TCP_Send_Lane *lane = tcp_send_queue_lane(queue, priority);
+    return lane->capacity - lane->length >= length || tcp_send_lane_grow_size(queue, lane, length) != 0;
+}
+
+bool tcp_send_queue_add(TCP_Send_Queue *queue, bool priority, const uint8_t *packet, uint16_t length,
+                        uint16_t sent)
+{
+    TCP_Send_Lane *lane = tcp_send_queue_lane(queue, priority);
+    const uint32_t left = length - sent;
+
+    if (!tcp_send_lane_reserve(queue, lane, left)) {
+        return false;
+    }
+
+    /* Bytes of the packet only get sent when everything before them was, so
+     * a partly sent one is always the only one in its lane. */
+    if (sent != 0) {
+        lane->head_left = left;
+    }
+
+    const uint32_t end = (lane->start + lane->length) % lane->capacity;
+    const uint32_t first = lane->capacity - end < left ? lane->capacity - end : left;
+    memcpy(lane->data + end, packet + sent, first);
+    memcpy(lane->data, packet + sent + first, left - first);
+    lane->length += left;
+    return true;
+}
+
+/* Add the chunks for length bytes of the lane starting offset bytes after its start. */
+static uint16_t tcp_send_lane_chunks(const TCP_Send_Lane *lane, uint32_t offset, uint32_t length,
+                                     Net_Send_Chunk *chunks, uint16_t max_chunks)
+{
+    uint16_t num = 0;
+
+    while (length != 0 && num < max_chunks) {
+        const uint32_t pos = (lane->start + offset) % lane->capacity;
+        const uint32_t size = lane->capacity - pos < length ? lane->capacity - pos : length;
+        chunks[num].data = lane->data + pos;
+        chunks[num].length = size;
+        ++num;
+        offset += size;
+        length -= size;
+    }
+
+    return num;
+}
+
+uint16_t tcp_send_queue_chunks(const TCP_Send_Queue *queue, Net_Send_Chunk *chunks, uint16_t max_chunks)
+{
+    const TCP_Send_Lane *normal = &queue->normal;
+    uint16_t num = 0;
+
+    /* A partly sent normal packet must be finished before any priority one goes out. */
+    num += tcp_send_lane_chunks(normal, 0, normal->head_left, chunks + num, max_chunks - num);
+    num += tcp_send_lane_chunks(&queue->priority, 0, queue->priority.length, chunks + num, max_chunks - num);
+    num += tcp_send_lane_chunks(normal, normal->head_left, normal->length - normal->head_left, chunks + num,
+                                max_chunks - num);
+    return num;
+}
+
+/* return the number of bytes of the packet at the start of the lane, including its length. */
+static uint32_t tcp_send_lane_head_size(const TCP_Send_Lane *lane)
+{
+    const uint8_t high = lane->data[lane->start];
+    const uint8_t low = lane->data[(lane->start + 1) % lane->capacity];
+    return sizeof(uint16_t) + (((uint32_t)high << 8) | low);
+}
+
+/* Remove length bytes from the start of the lane.
+ *
+ * return the number of bytes removed.
+ */
+static uint32_t tcp_send_lane_consume(TCP_Send_Lane *lane, uint32_t length)
+{
+    uint32_t consumed = 0;
+
+    while (consumed < length && lane->length != 0) {
+        if (lane->head_left == 0) {
+            lane->head_left = tcp_send_lane_head_size(lane);
+        }
+
+        const uint32_t size = length - consumed < lane->head_left ? length - consumed : lane->head_left;
+        lane->start = (lane->start + size) % lane->capacity;
+        lane->length -= size;
+        lane->head_left -= size;
+        consumed += size;
+    }
+
+    return consumed;
+}
+
+void tcp_send_queue_consume(TCP_Send_Queue *queue, uint32_t length)
+{
+    if (queue->normal.head_left != 0) {
+        const uint32_t head_left = queue->normal.head_left;
+        length -= tcp_send_lane_consume(&queue->normal, length < head_left ? length : head_left);
+    }
+
+    length -= tcp_send_lane_consume(&queue->priority, length);
+    tcp_send_lane_consume(&queue->normal, length);
+}
+
+bool tcp_send_queue_flush(TCP_Send_Queue *queue, Socket sock)
+{
+    if (tcp_send_queue_empty(queue)) {
+        return true;
+    }
+
+    Net_Send_Chunk chunks[NET_SEND_MAX_CHUNKS];
+    const uint16_t num = tcp_send_queue_chunks(queue, chunks, NET_SEND_MAX_CHUNKS);
+    const int len = net_send_gather(sock, chunks, num);
+
+    if (len > 0) {
+        tcp_send_queue_consume(queue, len);
+    }
+
+    return tcp_send_queue_empty(queue);
+}
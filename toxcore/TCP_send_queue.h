@@ -0,0 +1,119 @@
+/**
+ * Send queue of a TCP relay connection.
+ *
+ * Packets that could not be written to the socket right away are queued as
+ * they go on the wire (length prefix and encrypted data) in one of two byte
+ * rings: the priority lane, which is always sent first, and the normal lane.
+ * A packet that was partly written is always finished before anything else.
+ * Both lanes are flushed with a single gather write.
+ *
+ * Packets are encrypted with consecutive nonces before they are queued, so
+ * they must go out in the order they were added. A priority packet only goes
+ * into the priority lane while no whole normal packet is waiting, otherwise
+ * it is queued behind them in the normal lane.
+ *
+ * Ring memory is allocated on demand and kept until the queue is freed. Each
+ * queue has a size limit, and queues can share a Send_Budget that limits the
+ * memory all of them use together.
+ */
+#ifndef C_TOXCORE_TOXCORE_TCP_SEND_QUEUE_H
+#define C_TOXCORE_TOXCORE_TCP_SEND_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Ring size each lane starts out with. */
+#define TCP_SEND_QUEUE_INITIAL_SIZE 4096
+
+/* Default limit of the memory used by a single queue. */
+#define TCP_SEND_QUEUE_MAX_SIZE (64 * 1024)
+
+/* Memory shared by a group of send queues. */
+typedef struct TCP_Send_Budget {
+    uint64_t used;
+    uint64_t limit;
+} TCP_Send_Budget;
+
+typedef struct TCP_Send_Lane {
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t start;
+    uint32_t length;
+    /* Bytes of the packet at the start of the ring that are still to be sent, 0 if no byte
+     * of it has been sent yet. */
+    uint32_t head_left;
+} TCP_Send_Lane;
+
+typedef struct TCP_Send_Queue {
+    TCP_Send_Lane priority;
+    TCP_Send_Lane normal;
+    uint32_t limit;
+    TCP_Send_Budget *budget;
+} TCP_Send_Queue;
+
+/**
+ * Set up an empty queue using at most limit bytes, and if budget is not NULL,
+ * also charging its memory to budget.
+ */
+void tcp_send_queue_init(TCP_Send_Queue *queue, uint32_t limit, TCP_Send_Budget *budget);
+
+/**
+ * Free the memory of the queue and drop all packets in it.
+ */
+void tcp_send_queue_free(TCP_Send_Queue *queue);
+
+/**
+ * Return true if no data is queued.
+ */
+bool tcp_send_queue_empty(const TCP_Send_Queue *queue);
+
+/**
+ * Return the number of bytes queued.
+ */
+uint32_t tcp_send_queue_length(const TCP_Send_Queue *queue);
+
+/**
+ * Return true if a packet of length bytes can be added to the lane.
+ */
+bool tcp_send_queue_has_room(TCP_Send_Queue *queue, bool priority, uint16_t length);
+
+/**
+ * Add a packet that starts with its 16 bit length prefix to a lane. The first
+ * sent bytes of it were already written to the socket.
+ *
+ * @return false if there is no room for it.
+ */
+bool tcp_send_queue_add(TCP_Send_Queue *queue, bool priority, const uint8_t *packet, uint16_t length,
+                        uint16_t sent);
+
+/**
+ * Fill chunks with the queued data in the order it must be sent.
+ *
+ * @return the number of chunks used.
+ */
+uint16_t tcp_send_queue_chunks(const TCP_Send_Queue *queue, Net_Send_Chunk *chunks, uint16_t max_chunks);
+
+/**
+ * Remove the first length bytes returned by tcp_send_queue_chunks after they
+ * were written to the socket.
+ */
+void tcp_send_queue_consume(TCP_Send_Queue *queue, uint32_t length);
+
+/**
+ * Write as much of the queue to the socket as it takes.
+ *
+ * @return true if the queue is empty afterwards.
+ */
+bool tcp_send_queue_flush(TCP_Send_Queue *queue, Socket sock);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_TCP_SEND_QUEUE_H
@@ -0,0 +1,150 @@
+#include "TCP_send_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+// A packet as it goes on the wire: 16 bit big endian length, then the data.
+std::vector<uint8_t> make_packet(uint16_t length, uint8_t fill) {
+  std::vector<uint8_t> packet(2 + length, fill);
+  packet[0] = length >> 8;
+  packet[1] = length & 0xff;
+  return packet;
+}
+
+std::vector<uint8_t> queued_bytes(const TCP_Send_Queue &queue) {
+  Net_Send_Chunk chunks[NET_SEND_MAX_CHUNKS];
+  const uint16_t num = tcp_send_queue_chunks(&queue, chunks, NET_SEND_MAX_CHUNKS);
+  std::vector<uint8_t> bytes;
+
+  for (uint16_t i = 0; i < num; ++i) {
+    bytes.insert(bytes.end(), chunks[i].data, chunks[i].data + chunks[i].length);
+  }
+
+  return bytes;
+}
+
+std::vector<uint8_t> concat(std::initializer_list<std::vector<uint8_t>> parts) {
+  std::vector<uint8_t> result;
+
+  for (const std::vector<uint8_t> &part : parts) {
+    result.insert(result.end(), part.begin(), part.end());
+  }
+
+  return result;
+}
+
+TEST(TCP_Send_Queue, PacketsKeepTheirOrder) {
+  TCP_Send_Queue queue;
+  tcp_send_queue_init(&queue, TCP_SEND_QUEUE_MAX_SIZE, nullptr);
+
+  // Packets carry consecutive nonces, so priority ones can't overtake normal ones.
+  const std::vector<uint8_t> priority1 = make_packet(5, 3);
+  const std::vector<uint8_t> normal1 = make_packet(10, 1);
+  const std::vector<uint8_t> normal2 = make_packet(20, 2);
+  const std::vector<uint8_t> priority2 = make_packet(5, 4);
+  ASSERT_TRUE(tcp_send_queue_add(&queue, true, priority1.data(), priority1.size(), 0));
+  ASSERT_TRUE(tcp_send_queue_add(&queue, false, normal1.data(), normal1.size(), 0));
+  ASSERT_TRUE(tcp_send_queue_add(&queue, false, normal2.data(), normal2.size(), 0));
+  ASSERT_TRUE(tcp_send_queue_add(&queue, true, priority2.data(), priority2.size(), 0));
+
+  EXPECT_EQ(queued_bytes(queue), concat({priority1, normal1, normal2, priority2}));
+  EXPECT_EQ(tcp_send_queue_length(&queue), priority1.size() + normal1.size() + normal2.size() + priority2.size());
+
+  tcp_send_queue_free(&queue);
+}
+
+TEST(TCP_Send_Queue, PartlySentPacketIsFinishedFirst) {
+  TCP_Send_Queue queue;
+  tcp_send_queue_init(&queue, TCP_SEND_QUEUE_MAX_SIZE, nullptr);
+
+  const std::vector<uint8_t> normal1 = make_packet(10, 1);
+  const std::vector<uint8_t> normal2 = make_packet(20, 2);
+  ASSERT_TRUE(tcp_send_queue_add(&queue, false, normal1.data(), normal1.size(), 0));
+  ASSERT_TRUE(tcp_send_queue_add(&queue, false, normal2.data(), normal2.size(), 0));
+
+  // Send part of the second normal packet.
+  tcp_send_queue_consume(&queue, normal1.size() + 4);
+
+  const std::vector<uint8_t> priority = make_packet(5, 3);
+  ASSERT_TRUE(tcp_send_queue_add(&queue, true, priority.data(), priority.size(), 0));
+
+  const std::vector<uint8_t> rest(normal2.begin() + 4, normal2.end());
+  EXPECT_EQ(queued_bytes(queue), concat({rest, priority}));
+
+  tcp_send_queue_consume(&queue, rest.size() + priority.size());
+  EXPECT_TRUE(tcp_send_queue_empty(&queue));
+
+  tcp_send_queue_free(&queue);
+}
+
+TEST(TCP_Send_Queue, AddsPartlySentPacket) {
+  TCP_Send_Queue queue;
+  tcp_send_queue_init(&queue, TCP_SEND_QUEUE_MAX_SIZE, nullptr);
+
+  const std::vector<uint8_t> normal = make_packet(100, 1);
+  ASSERT_TRUE(tcp_send_queue_add(&queue, false, normal.data(), normal.size(), 30));
+
+  const std::vector<uint8_t> priority = make_packet(5, 3);
+  ASSERT_TRUE(tcp_send_queue_add(&queue, true, priority.data(), priority.size(), 0));
+
+  const std::vector<uint8_t> rest(normal.begin() + 30, normal.end());
+  EXPECT_EQ(queued_bytes(queue), concat({rest, priority}));
+
+  tcp_send_queue_free(&queue);
+}
+
+TEST(TCP_Send_Queue, WrapsAroundTheRing) {
+  TCP_Send_Queue queue;
+  tcp_send_queue_init(&queue, TCP_SEND_QUEUE_INITIAL_SIZE, nullptr);
+
+  const std::vector<uint8_t> packet = make_packet(1000, 7);
+
+  // Keep the ring about half full while adding many packets so the data wraps.
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(tcp_send_queue_add(&queue, false, packet.data(), packet.size(), 0)) << i;
+
+    if (i >= 1) {
+      tcp_send_queue_consume(&queue, packet.size());
+    }
+  }
+
+  EXPECT_EQ(queued_bytes(queue), packet);
+  tcp_send_queue_free(&queue);
+}
+
+TEST(TCP_Send_Queue, RespectsQueueAndBudgetLimits) {
+  TCP_Send_Budget budget = {0, 3 * TCP_SEND_QUEUE_INITIAL_SIZE};
+  TCP_Send_Queue queue1;
+  TCP_Send_Queue queue2;
+  tcp_send_queue_init(&queue1, 2 * TCP_SEND_QUEUE_INITIAL_SIZE, &budget);
+  tcp_send_queue_init(&queue2, 2 * TCP_SEND_QUEUE_INITIAL_SIZE, &budget);
+
+  const std::vector<uint8_t> packet = make_packet(1000, 7);
+
+  // The queue limit stops the first queue at two initial size rings.
+  int added = 0;
+
+  while (tcp_send_queue_add(&queue1, false, packet.data(), packet.size(), 0)) {
+    ++added;
+  }
+
+  EXPECT_EQ(added, 2 * TCP_SEND_QUEUE_INITIAL_SIZE / packet.size());
+  EXPECT_FALSE(tcp_send_queue_has_room(&queue1, true, packet.size()));
+  EXPECT_EQ(budget.used, 2u * TCP_SEND_QUEUE_INITIAL_SIZE);
+
+  // The budget leaves the second queue only one ring.
+  ASSERT_TRUE(tcp_send_queue_add(&queue2, false, packet.data(), packet.size(), 0));
+  EXPECT_FALSE(tcp_send_queue_has_room(&queue2, false, TCP_SEND_QUEUE_INITIAL_SIZE));
+
+  tcp_send_queue_free(&queue1);
+  EXPECT_EQ(budget.used, uint64_t(TCP_SEND_QUEUE_INITIAL_SIZE));
+  EXPECT_TRUE(tcp_send_queue_has_room(&queue2, false, TCP_SEND_QUEUE_INITIAL_SIZE));
+
+  tcp_send_queue_free(&queue2);
+  EXPECT_EQ(budget.used, 0u);
+}
+
+}  // namespace
@@ -39,6 +39,8 @@
 #include <unistd.h>
 #endif
 
+#include "TCP_handshake_pool.h"
+#include "hash_map.h"
 #include "mono_time.h"
 #include "util.h"
 
@@ -63,24 +65,24 @@ typedef struct TCP_Secure_Connection {
     uint8_t recv_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of received packets. */
     uint8_t sent_nonce[CRYPTO_NONCE_SIZE]; /* Nonce of sent packets. */
     uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
-    uint16_t next_packet_length;
+    TCP_Recv_Buffer recv_buffer;
     TCP_Secure_Conn connections[NUM_CLIENT_CONNECTIONS];
-    uint8_t last_packet[2 + MAX_PACKET_SIZE];
     uint8_t status;
-    uint16_t last_packet_length;
-    uint16_t last_packet_sent;
 
-    TCP_Priority_List *priority_queue_start;
-    TCP_Priority_List *priority_queue_end;
+    TCP_Send_Queue send_queue;
 
     uint64_t identifier;
 
     uint64_t last_pinged;
     uint64_t ping_id;
+
+    /* Id of the handshake submitted to the handshake pool, 0 if none is. */
+    uint64_t handshake_id;
 } TCP_Secure_Connection;
 
 
 struct TCP_Server {
+    const Mono_Time *mono_time;
     Onion *onion;
 
 #ifdef TCP_SERVER_USE_EPOLL
@@ -92,10 +94,14 @@ struct TCP_Server {
 
     uint8_t public_key[CRYPTO_PUBLIC_KEY_SIZE];
     uint8_t secret_key[CRYPTO_SECRET_KEY_SIZE];
-    TCP_Secure_Connection incoming_connection_queue[MAX_INCOMING_CONNECTIONS];
-    uint16_t incoming_connection_queue_index;
-    TCP_Secure_Connection unconfirmed_connection_queue[MAX_INCOMING_CONNECTIONS];
-    uint16_t unconfirmed_connection_queue_index;
+    uint16_t max_incoming_connections;
+    TCP_Secure_Connection *incoming_connection_queue;
+    uint32_t incoming_connection_queue_index;
+    TCP_Secure_Connection *unconfirmed_connection_queue;
+    uint32_t unconfirmed_connection_queue_index;
+
+    TCP_Handshake_Pool *handshake_pool;
+    uint64_t last_handshake_id;
 
     TCP_Secure_Connection *accepted_connection_array;
     uint32_t size_accepted_connections;
@@ -103,7 +109,11 @@ struct TCP_Server {
 
     uint64_t counter;
 
-    BS_List accepted_key_list;
+    /* Index of the accepted connection of each public key. */
+    Hash_Map accepted_key_map;
+
+    /* Memory used by the send queues of all connections. */
+    TCP_Send_Budget send_budget;
 };
 
 const uint8_t *tcp_server_public_key(const TCP_Server *tcp_server)
@@ -116,6 +126,55 @@ size_t tcp_server_listen_count(const TCP_Server *tcp_server)
     return tcp_server->num_listening_socks;
 }
 
+static uint32_t copy_socket(Socket sock, Socket *socks, uint32_t max_num, uint32_t copied)
+{
+    if (socks != nullptr && copied < max_num) {
+        socks[copied] = sock;
+    }
+
+    return copied + 1;
+}
+
+uint32_t tcp_server_copy_sockets(const TCP_Server *tcp_server, Socket *socks, uint32_t max_num)
+{
+    uint32_t copied = 0;
+
+#ifdef TCP_SERVER_USE_EPOLL
+    /* The epoll descriptor becomes readable whenever any of the sockets it watches does. */
+    Socket efd;
+    efd.socket = tcp_server->efd;
+    copied = copy_socket(efd, socks, max_num, copied);
+#else
+
+    for (uint32_t i = 0; i < tcp_server->num_listening_socks; ++i) {
+        copied = copy_socket(tcp_server->socks_listening[i], socks, max_num, copied);
+    }
+
+    for (uint32_t i = 0; i < tcp_server->max_incoming_connections; ++i) {
+        if (tcp_server->incoming_connection_queue[i].status != TCP_STATUS_NO_STATUS) {
+            copied = copy_socket(tcp_server->incoming_connection_queue[i].sock, socks, max_num, copied);
+        }
+
+        if (tcp_server->unconfirmed_connection_queue[i].status != TCP_STATUS_NO_STATUS) {
+            copied = copy_socket(tcp_server->unconfirmed_connection_queue[i].sock, socks, max_num, copied);
+        }
+    }
+
+    for (uint32_t i = 0; i < tcp_server->size_accepted_connections; ++i) {
+        if (tcp_server->accepted_connection_array[i].status != TCP_STATUS_NO_STATUS) {
+            copied = copy_socket(tcp_server->accepted_connection_array[i].sock, socks, max_num, copied);
+        }
+    }
+
+#endif
+
+    if (socks != nullptr && copied > max_num) {
+        return max_num;
+    }
+
+    return copied;
+}
+
 /* This is needed to compile on Android below API 21
  */
 #ifdef TCP_SERVER_USE_EPOLL
@@ -166,7 +225,7 @@ static int realloc_connection(TCP_Server *tcp_server, uint32_t num)
  */
 static int get_TCP_connection_index(const TCP_Server *tcp_server, const uint8_t *public_key)
 {
-    return bs_list_find(&tcp_server->accepted_key_list, public_key);
+    return hash_map_find(&tcp_server->accepted_key_map, public_key);
 }
 
 
@@ -208,7 +267,7 @@ static int add_accepted(TCP_Server *tcp_server, const TCP_Secure_Connection *con
         return -1;
     }
 
-    if (!bs_list_add(&tcp_server->accepted_key_list, con->public_key, index)) {
+    if (!hash_map_add(&tcp_server->accepted_key_map, con->public_key, index)) {
         return -1;
     }
 
@@ -216,7 +275,7 @@ static int add_accepted(TCP_Server *tcp_server, const TCP_Secure_Connection *con
     tcp_server->accepted_connection_array[index].status = TCP_STATUS_CONFIRMED;
     ++tcp_server->num_accepted_connections;
     tcp_server->accepted_connection_array[index].identifier = ++tcp_server->counter;
-    tcp_server->accepted_connection_array[index].last_pinged = unix_time();
+    tcp_server->accepted_connection_array[index].last_pinged = mono_time_get(tcp_server->mono_time);
     tcp_server->accepted_connection_array[index].ping_id = 0;
 
     return index;
@@ -237,10 +296,11 @@ static int del_accepted(TCP_Server *tcp_server, int index)
         return -1;
     }
 
-    if (!bs_list_remove(&tcp_server->accepted_key_list, tcp_server->accepted_connection_array[index].public_key, index)) {
+    if (!hash_map_remove(&tcp_server->accepted_key_map, tcp_server->accepted_connection_array[index].public_key, index)) {
         return -1;
     }
 
+    tcp_send_queue_free(&tcp_server->accepted_connection_array[index].send_queue);
     crypto_memzero(&tcp_server->accepted_connection_array[index], sizeof(TCP_Secure_Connection));
     --tcp_server->num_accepted_connections;
 
@@ -251,38 +311,6 @@ static int del_accepted(TCP_Server *tcp_server, int index)
     return 0;
 }
 
-/* Read the next two bytes in TCP stream then convert them to
- * length (host byte order).
- *
- * return length on success
- * return 0 if nothing has been read from socket.
- * return ~0 on failure.
- */
-uint16_t read_TCP_length(Socket sock)
-{
-    const unsigned int count = net_socket_data_recv_buffer(sock);
-
-    if (count >= sizeof(uint16_t)) {
-        uint16_t length;
-        const int len = net_recv(sock, &length, sizeof(uint16_t));
-
-        if (len != sizeof(uint16_t)) {
-            fprintf(stderr, "FAIL recv packet\n");
-            return 0;
-        }
-
-        length = net_ntohs(length);
-
-        if (length > MAX_PACKET_SIZE) {
-            return ~0;
-        }
-
-        return length;
-    }
-
-    return 0;
-}
-
 /* Read length bytes from socket.
  *
  * return length on success
@@ -306,43 +334,77 @@ int read_TCP_packet(Socket sock, uint8_t *data, uint16_t length)
     return -1;
 }
 
-/* return length of received packet on success.
- * return 0 if could not read any packet.
- * return -1 on failure (connection must be killed).
+/* Read as much as is available from the socket into the free space of the buffer, moving the
+ * data it still holds to the front first.
  */
-int read_packet_TCP_secure_connection(Socket sock, uint16_t *next_packet_length, const uint8_t *shared_key,
+static void tcp_recv_buffer_fill(Socket sock, TCP_Recv_Buffer *buffer)
+{
+    if (buffer->start != 0) {
+        memmove(buffer->data, buffer->data + buffer->start, buffer->end - buffer->start);
+        buffer->end -= buffer->start;
+        buffer->start = 0;
+    }
+
+    const int len = net_recv(sock, buffer->data + buffer->end, sizeof(buffer->data) - buffer->end);
+
+    if (len > 0) {
+        buffer->end += len;
+    }
+}
+
+/* Get the length of the next packet in the buffer.
+ *
+ * return false if the buffer doesn't hold its length yet.
+ */
+static bool tcp_recv_buffer_next_length(const TCP_Recv_Buffer *buffer, uint16_t *length)
+{
+    if ((size_t)(buffer->end - buffer->start) < sizeof(uint16_t)) {
+        return false;
+    }
+
+    memcpy(length, buffer->data + buffer->start, sizeof(uint16_t));
+    *length = net_ntohs(*length);
+    return true;
+}
+
+/* return true if the buffer holds a whole packet of length. */
+static bool tcp_recv_buffer_has_packet(const TCP_Recv_Buffer *buffer, uint16_t length)
+{
+    return (size_t)(buffer->end - buffer->start) >= sizeof(uint16_t) + length;
+}
+
+int read_packet_TCP_secure_connection(Socket sock, TCP_Recv_Buffer *buffer, const uint8_t *shared_key,
                                       uint8_t *recv_nonce, uint8_t *data, uint16_t max_len)
 {
-    if (*next_packet_length == 0) {
-        uint16_t len = read_TCP_length(sock);
+    uint16_t length;
 
-        if (len == (uint16_t)~0) {
-            return -1;
-        }
+    if (!tcp_recv_buffer_next_length(buffer, &length) || !tcp_recv_buffer_has_packet(buffer, length)) {
+        tcp_recv_buffer_fill(sock, buffer);
 
-        if (len == 0) {
+        if (!tcp_recv_buffer_next_length(buffer, &length)) {
             return 0;
         }
-
-        *next_packet_length = len;
     }
 
-    if (max_len + CRYPTO_MAC_SIZE < *next_packet_length) {
+    if (length > MAX_PACKET_SIZE || max_len + CRYPTO_MAC_SIZE < length) {
         return -1;
     }
 
-    VLA(uint8_t, data_encrypted, *next_packet_length);
-    int len_packet = read_TCP_packet(sock, data_encrypted, *next_packet_length);
-
-    if (len_packet != *next_packet_length) {
+    if (!tcp_recv_buffer_has_packet(buffer, length)) {
         return 0;
     }
 
-    *next_packet_length = 0;
+    const uint8_t *data_encrypted = buffer->data + buffer->start + sizeof(uint16_t);
+    buffer->start += sizeof(uint16_t) + length;
+
+    if (buffer->start == buffer->end) {
+        buffer->start = 0;
+        buffer->end = 0;
+    }
 
-    int len = decrypt_data_symmetric(shared_key, recv_nonce, data_encrypted, len_packet, data);
+    int len = decrypt_data_symmetric(shared_key, recv_nonce, data_encrypted, length, data);
 
-    if (len + CRYPTO_MAC_SIZE != len_packet) {
+    if (len + CRYPTO_MAC_SIZE != length) {
         return -1;
     }
 
@@ -354,93 +416,53 @@ int read_packet_TCP_secure_connection(Socket sock, uint16_t *next_packet_length,
 /* return 0 if pending data was sent completely
  * return -1 if it wasn't
  */
-static int send_pending_data_nonpriority(TCP_Secure_Connection *con)
+static int send_pending_data(TCP_Secure_Connection *con)
 {
-    if (con->last_packet_length == 0) {
-        return 0;
-    }
-
-    const uint16_t left = con->last_packet_length - con->last_packet_sent;
-    const int len = net_send(con->sock, con->last_packet + con->last_packet_sent, left);
-
-    if (len <= 0) {
-        return -1;
-    }
-
-    if (len == left) {
-        con->last_packet_length = 0;
-        con->last_packet_sent = 0;
-        return 0;
-    }
-
-    con->last_packet_sent += len;
-    return -1;
+    return tcp_send_queue_flush(&con->send_queue, con->sock) ? 0 : -1;
 }
 
-/* return 0 if pending data was sent completely
- * return -1 if it wasn't
+/* Encrypt a packet whose length bytes of plain text were written at packet + TCP_PACKET_PLAIN_OFFSET
+ * where they are, and send or queue it. packet must hold TCP_PACKET_WIRE_SIZE(length) bytes.
+ *
+ * return 1 on success.
+ * return 0 if could not send packet.
+ * return -1 on failure (connection must be killed).
  */
-static int send_pending_data(TCP_Secure_Connection *con)
+static int write_packet_TCP_secure_connection_inplace(TCP_Secure_Connection *con, uint8_t *packet,
+        uint16_t length, bool priority)
 {
-    /* finish sending current non-priority packet */
-    if (send_pending_data_nonpriority(con) == -1) {
+    if (length + CRYPTO_MAC_SIZE > MAX_PACKET_SIZE) {
         return -1;
     }
 
-    TCP_Priority_List *p = con->priority_queue_start;
-
-    while (p) {
-        const uint16_t left = p->size - p->sent;
-        const int len = net_send(con->sock, p->data + p->sent, left);
-
-        if (len != left) {
-            if (len > 0) {
-                p->sent += len;
-            }
+    const uint16_t packet_length = TCP_PACKET_WIRE_SIZE(length);
+    const bool queue_empty = send_pending_data(con) == 0;
 
-            break;
-        }
-
-        TCP_Priority_List *pp = p;
-        p = p->next;
-        free(pp);
+    if (!tcp_send_queue_has_room(&con->send_queue, priority, packet_length)) {
+        return 0;
     }
 
-    con->priority_queue_start = p;
+    const uint16_t c_length = net_htons(length + CRYPTO_MAC_SIZE);
+    memcpy(packet, &c_length, sizeof(uint16_t));
+    int len = encrypt_data_symmetric_inplace(con->shared_key, con->sent_nonce, packet + sizeof(uint16_t), length);
 
-    if (!p) {
-        con->priority_queue_end = nullptr;
-        return 0;
+    if ((unsigned int)len != packet_length - sizeof(uint16_t)) {
+        return -1;
     }
 
-    return -1;
-}
-
-/* return 0 on failure (only if malloc fails)
- * return 1 on success
- */
-static bool add_priority(TCP_Secure_Connection *con, const uint8_t *packet, uint16_t size, uint16_t sent)
-{
-    TCP_Priority_List *p = con->priority_queue_end;
-    TCP_Priority_List *new_list = (TCP_Priority_List *)malloc(sizeof(TCP_Priority_List) + size);
+    len = queue_empty ? net_send(con->sock, packet, packet_length) : 0;
 
-    if (!new_list) {
-        return 0;
+    if (len <= 0) {
+        len = 0;
     }
 
-    new_list->next = nullptr;
-    new_list->size = size;
-    new_list->sent = sent;
-    memcpy(new_list->data, packet, size);
+    increment_nonce(con->sent_nonce);
 
-    if (p) {
-        p->next = new_list;
-    } else {
-        con->priority_queue_start = new_list;
+    if ((unsigned int)len == packet_length) {
+        return 1;
     }
 
-    con->priority_queue_end = new_list;
-    return 1;
+    return tcp_send_queue_add(&con->send_queue, priority, packet, packet_length, len);
 }
 
 /* return 1 on success.
@@ -454,64 +476,16 @@ static int write_packet_TCP_secure_connection(TCP_Secure_Connection *con, const
         return -1;
     }
 
-    bool sendpriority = 1;
-
-    if (send_pending_data(con) == -1) {
-        if (priority) {
-            sendpriority = 0;
-        } else {
-            return 0;
-        }
-    }
-
-    VLA(uint8_t, packet, sizeof(uint16_t) + length + CRYPTO_MAC_SIZE);
-
-    const uint16_t c_length = net_htons(length + CRYPTO_MAC_SIZE);
-    memcpy(packet, &c_length, sizeof(uint16_t));
-    int len = encrypt_data_symmetric(con->shared_key, con->sent_nonce, data, length, packet + sizeof(uint16_t));
-
-    if ((unsigned int)len != (SIZEOF_VLA(packet) - sizeof(uint16_t))) {
-        return -1;
-    }
-
-    if (priority) {
-        len = sendpriority ? net_send(con->sock, packet, SIZEOF_VLA(packet)) : 0;
-
-        if (len <= 0) {
-            len = 0;
-        }
-
-        increment_nonce(con->sent_nonce);
-
-        if ((unsigned int)len == SIZEOF_VLA(packet)) {
-            return 1;
-        }
-
-        return add_priority(con, packet, SIZEOF_VLA(packet), len);
-    }
-
-    len = net_send(con->sock, packet, SIZEOF_VLA(packet));
-
-    if (len <= 0) {
-        return 0;
-    }
-
-    increment_nonce(con->sent_nonce);
-
-    if ((unsigned int)len == SIZEOF_VLA(packet)) {
-        return 1;
-    }
-
-    memcpy(con->last_packet, packet, SIZEOF_VLA(packet));
-    con->last_packet_length = SIZEOF_VLA(packet);
-    con->last_packet_sent = len;
-    return 1;
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(length));
+    memcpy(packet + TCP_PACKET_PLAIN_OFFSET, data, length);
+    return write_packet_TCP_secure_connection_inplace(con, packet, length, priority);
 }
 
 /* Kill a TCP_Secure_Connection
  */
 static void kill_TCP_secure_connection(TCP_Secure_Connection *con)
 {
+    tcp_send_queue_free(&con->send_queue);
     kill_sock(con->sock);
     crypto_memzero(con, sizeof(TCP_Secure_Connection));
 }
@@ -545,55 +519,49 @@ static int kill_accepted(TCP_Server *tcp_server, int index)
     return 0;
 }
 
-/* return 1 if everything went well.
+/* Send the response of a processed handshake and set up the connection with its keys.
+ *
+ * return 1 if everything went well.
  * return -1 if the connection must be killed.
  */
-static int handle_TCP_handshake(TCP_Secure_Connection *con, const uint8_t *data, uint16_t length,
-                                const uint8_t *self_secret_key)
+static int finish_TCP_handshake(TCP_Secure_Connection *con, const TCP_Handshake *handshake)
 {
-    if (length != TCP_CLIENT_HANDSHAKE_SIZE) {
+    if (!handshake->ok) {
         return -1;
     }
 
-    if (con->status != TCP_STATUS_CONNECTED) {
-        return -1;
-    }
-
-    uint8_t shared_key[CRYPTO_SHARED_KEY_SIZE];
-    encrypt_precompute(data, self_secret_key, shared_key);
-    uint8_t plain[TCP_HANDSHAKE_PLAIN_SIZE];
-    int len = decrypt_data_symmetric(shared_key, data + CRYPTO_PUBLIC_KEY_SIZE,
-                                     data + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE, TCP_HANDSHAKE_PLAIN_SIZE + CRYPTO_MAC_SIZE, plain);
-
-    if (len != TCP_HANDSHAKE_PLAIN_SIZE) {
+    if (TCP_SERVER_HANDSHAKE_SIZE != net_send(con->sock, handshake->response, TCP_SERVER_HANDSHAKE_SIZE)) {
         return -1;
     }
 
-    memcpy(con->public_key, data, CRYPTO_PUBLIC_KEY_SIZE);
-    uint8_t temp_secret_key[CRYPTO_SECRET_KEY_SIZE];
-    uint8_t resp_plain[TCP_HANDSHAKE_PLAIN_SIZE];
-    crypto_new_keypair(resp_plain, temp_secret_key);
-    random_nonce(con->sent_nonce);
-    memcpy(resp_plain + CRYPTO_PUBLIC_KEY_SIZE, con->sent_nonce, CRYPTO_NONCE_SIZE);
-    memcpy(con->recv_nonce, plain + CRYPTO_PUBLIC_KEY_SIZE, CRYPTO_NONCE_SIZE);
-
-    uint8_t response[TCP_SERVER_HANDSHAKE_SIZE];
-    random_nonce(response);
-
-    len = encrypt_data_symmetric(shared_key, response, resp_plain, TCP_HANDSHAKE_PLAIN_SIZE,
-                                 response + CRYPTO_NONCE_SIZE);
+    memcpy(con->public_key, handshake->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+    memcpy(con->recv_nonce, handshake->recv_nonce, CRYPTO_NONCE_SIZE);
+    memcpy(con->sent_nonce, handshake->sent_nonce, CRYPTO_NONCE_SIZE);
+    memcpy(con->shared_key, handshake->shared_key, CRYPTO_SHARED_KEY_SIZE);
+    con->status = TCP_STATUS_UNCONFIRMED;
+    return 1;
+}
 
-    if (len != TCP_HANDSHAKE_PLAIN_SIZE + CRYPTO_MAC_SIZE) {
+/* return 1 if everything went well.
+ * return -1 if the connection must be killed.
+ */
+static int handle_TCP_handshake(TCP_Secure_Connection *con, const uint8_t *data, uint16_t length,
+                                const uint8_t *self_secret_key)
+{
+    if (length != TCP_CLIENT_HANDSHAKE_SIZE) {
         return -1;
     }
 
-    if (TCP_SERVER_HANDSHAKE_SIZE != net_send(con->sock, response, TCP_SERVER_HANDSHAKE_SIZE)) {
+    if (con->status != TCP_STATUS_CONNECTED) {
         return -1;
     }
 
-    encrypt_precompute(plain, temp_secret_key, con->shared_key);
-    con->status = TCP_STATUS_UNCONFIRMED;
-    return 1;
+    TCP_Handshake handshake;
+    memcpy(handshake.data, data, TCP_CLIENT_HANDSHAKE_SIZE);
+    tcp_handshake_process(&handshake, self_secret_key);
+    const int ret = finish_TCP_handshake(con, &handshake);
+    crypto_memzero(&handshake, sizeof(handshake));
+    return ret;
 }
 
 /* return 1 if connection handshake was handled correctly.
@@ -743,12 +711,13 @@ static int handle_TCP_oob_send(TCP_Server *tcp_server, uint32_t con_id, const ui
     int other_index = get_TCP_connection_index(tcp_server, public_key);
 
     if (other_index != -1) {
-        VLA(uint8_t, resp_packet, 1 + CRYPTO_PUBLIC_KEY_SIZE + length);
-        resp_packet[0] = TCP_PACKET_OOB_RECV;
-        memcpy(resp_packet + 1, con->public_key, CRYPTO_PUBLIC_KEY_SIZE);
-        memcpy(resp_packet + 1 + CRYPTO_PUBLIC_KEY_SIZE, data, length);
-        write_packet_TCP_secure_connection(&tcp_server->accepted_connection_array[other_index], resp_packet,
-                                           SIZEOF_VLA(resp_packet), 0);
+        VLA(uint8_t, resp_packet, TCP_PACKET_WIRE_SIZE(1 + CRYPTO_PUBLIC_KEY_SIZE + length));
+        uint8_t *plain = resp_packet + TCP_PACKET_PLAIN_OFFSET;
+        plain[0] = TCP_PACKET_OOB_RECV;
+        memcpy(plain + 1, con->public_key, CRYPTO_PUBLIC_KEY_SIZE);
+        memcpy(plain + 1 + CRYPTO_PUBLIC_KEY_SIZE, data, length);
+        write_packet_TCP_secure_connection_inplace(&tcp_server->accepted_connection_array[other_index], resp_packet,
+                1 + CRYPTO_PUBLIC_KEY_SIZE + length, 0);
     }
 
     return 0;
@@ -806,11 +775,11 @@ static int handle_onion_recv_1(void *object, IP_Port dest, const uint8_t *data,
         return 1;
     }
 
-    VLA(uint8_t, packet, 1 + length);
-    memcpy(packet + 1, data, length);
-    packet[0] = TCP_PACKET_ONION_RESPONSE;
+    VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(1 + length));
+    packet[TCP_PACKET_PLAIN_OFFSET] = TCP_PACKET_ONION_RESPONSE;
+    memcpy(packet + TCP_PACKET_PLAIN_OFFSET + 1, data, length);
 
-    if (write_packet_TCP_secure_connection(con, packet, SIZEOF_VLA(packet), 0) != 1) {
+    if (write_packet_TCP_secure_connection_inplace(con, packet, 1 + length, 0) != 1) {
         return 1;
     }
 
@@ -937,10 +906,12 @@ static int handle_TCP_packet(TCP_Server *tcp_server, uint32_t con_id, const uint
 
             uint32_t index = con->connections[c_id].index;
             uint8_t other_c_id = con->connections[c_id].other_id + NUM_RESERVED_PORTS;
-            VLA(uint8_t, new_data, length);
-            memcpy(new_data, data, length);
-            new_data[0] = other_c_id;
-            int ret = write_packet_TCP_secure_connection(&tcp_server->accepted_connection_array[index], new_data, length, 0);
+            /* The data goes out with one copy into the packet, which is encrypted where it is. */
+            VLA(uint8_t, packet, TCP_PACKET_WIRE_SIZE(length));
+            memcpy(packet + TCP_PACKET_PLAIN_OFFSET, data, length);
+            packet[TCP_PACKET_PLAIN_OFFSET] = other_c_id;
+            int ret = write_packet_TCP_secure_connection_inplace(&tcp_server->accepted_connection_array[index], packet,
+                      length, 0);
 
             if (ret == -1) {
                 return -1;
@@ -993,7 +964,7 @@ static int accept_connection(TCP_Server *tcp_server, Socket sock)
         return -1;
     }
 
-    uint16_t index = tcp_server->incoming_connection_queue_index % MAX_INCOMING_CONNECTIONS;
+    const uint32_t index = tcp_server->incoming_connection_queue_index % tcp_server->max_incoming_connections;
 
     TCP_Secure_Connection *conn = &tcp_server->incoming_connection_queue[index];
 
@@ -1003,7 +974,9 @@ static int accept_connection(TCP_Server *tcp_server, Socket sock)
 
     conn->status = TCP_STATUS_CONNECTED;
     conn->sock = sock;
-    conn->next_packet_length = 0;
+    conn->recv_buffer.start = 0;
+    conn->recv_buffer.end = 0;
+    tcp_send_queue_init(&conn->send_queue, TCP_SEND_QUEUE_MAX_SIZE, &tcp_server->send_budget);
 
     ++tcp_server->incoming_connection_queue_index;
     return index;
@@ -1037,10 +1010,36 @@ static Socket new_listening_TCP_socket(Family family, uint16_t port)
     return sock;
 }
 
-TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uint16_t *ports, const uint8_t *secret_key,
-                           Onion *onion)
+void tcp_server_options_default(TCP_Server_Options *options)
+{
+    options->max_incoming_connections = MAX_INCOMING_CONNECTIONS;
+    options->handshake_threads = 0;
+}
+
+static void free_TCP_server(TCP_Server *tcp_server)
 {
-    if (num_sockets == 0 || ports == nullptr) {
+    tcp_handshake_pool_kill(tcp_server->handshake_pool);
+    free(tcp_server->incoming_connection_queue);
+    free(tcp_server->unconfirmed_connection_queue);
+    free(tcp_server->socks_listening);
+    free(tcp_server->accepted_connection_array);
+    hash_map_free(&tcp_server->accepted_key_map);
+    free(tcp_server);
+}
+
+TCP_Server *new_TCP_server(const Mono_Time *mono_time, uint8_t ipv6_enabled, uint16_t num_sockets,
+                           const uint16_t *ports, const uint8_t *secret_key, Onion *onion)
+{
+    TCP_Server_Options options;
+    tcp_server_options_default(&options);
+    return new_TCP_server_options(mono_time, ipv6_enabled, num_sockets, ports, secret_key, onion, &options);
+}
+
+TCP_Server *new_TCP_server_options(const Mono_Time *mono_time, uint8_t ipv6_enabled, uint16_t num_sockets,
+                                   const uint16_t *ports, const uint8_t *secret_key, Onion *onion,
+                                   const TCP_Server_Options *options)
+{
+    if (num_sockets == 0 || ports == nullptr || options->max_incoming_connections == 0) {
         return nullptr;
     }
 
@@ -1054,19 +1053,39 @@ TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uin
         return nullptr;
     }
 
-    temp->socks_listening = (Socket *)calloc(num_sockets, sizeof(Socket));
+    temp->mono_time = mono_time;
+    temp->send_budget.limit = TCP_SERVER_SEND_BUDGET;
+    temp->max_incoming_connections = options->max_incoming_connections;
 
-    if (temp->socks_listening == nullptr) {
-        free(temp);
+    temp->socks_listening = (Socket *)calloc(num_sockets, sizeof(Socket));
+    temp->incoming_connection_queue = (TCP_Secure_Connection *)calloc(options->max_incoming_connections,
+                                      sizeof(TCP_Secure_Connection));
+    temp->unconfirmed_connection_queue = (TCP_Secure_Connection *)calloc(options->max_incoming_connections,
+                                         sizeof(TCP_Secure_Connection));
+
+    if (temp->socks_listening == nullptr || temp->incoming_connection_queue == nullptr
+            || temp->unconfirmed_connection_queue == nullptr
+            || !hash_map_init(&temp->accepted_key_map, CRYPTO_PUBLIC_KEY_SIZE, 8)) {
+        free_TCP_server(temp);
         return nullptr;
     }
 
+    if (options->handshake_threads != 0) {
+        /* Slots reused while their handshake is processed can have a second one in flight. */
+        temp->handshake_pool = tcp_handshake_pool_new(secret_key, options->handshake_threads,
+                               2 * (uint32_t)options->max_incoming_connections);
+
+        if (temp->handshake_pool == nullptr) {
+            free_TCP_server(temp);
+            return nullptr;
+        }
+    }
+
 #ifdef TCP_SERVER_USE_EPOLL
     temp->efd = epoll_create(8);
 
     if (temp->efd == -1) {
-        free(temp->socks_listening);
-        free(temp);
+        free_TCP_server(temp);
         return nullptr;
     }
 
@@ -1099,8 +1118,10 @@ TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uin
     }
 
     if (temp->num_listening_socks == 0) {
-        free(temp->socks_listening);
-        free(temp);
+#ifdef TCP_SERVER_USE_EPOLL
+        close(temp->efd);
+#endif
+        free_TCP_server(temp);
         return nullptr;
     }
 
@@ -1112,8 +1133,6 @@ TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uin
     memcpy(temp->secret_key, secret_key, CRYPTO_SECRET_KEY_SIZE);
     crypto_derive_public_key(temp->public_key, temp->secret_key);
 
-    bs_list_init(&temp->accepted_key_list, CRYPTO_PUBLIC_KEY_SIZE, 8);
-
     return temp;
 }
 
@@ -1132,9 +1151,59 @@ static void do_TCP_accept_new(TCP_Server *tcp_server)
 }
 #endif
 
+/* Move an incoming connection that completed its handshake to the unconfirmed queue.
+ *
+ * return index in the unconfirmed queue.
+ */
+static int move_to_unconfirmed(TCP_Server *tcp_server, uint32_t i)
+{
+    const int index_new = tcp_server->unconfirmed_connection_queue_index % tcp_server->max_incoming_connections;
+    TCP_Secure_Connection *conn_old = &tcp_server->incoming_connection_queue[i];
+    TCP_Secure_Connection *conn_new = &tcp_server->unconfirmed_connection_queue[index_new];
+
+    if (conn_new->status != TCP_STATUS_NO_STATUS) {
+        kill_TCP_secure_connection(conn_new);
+    }
+
+    memcpy(conn_new, conn_old, sizeof(TCP_Secure_Connection));
+    crypto_memzero(conn_old, sizeof(TCP_Secure_Connection));
+    ++tcp_server->unconfirmed_connection_queue_index;
+
+    return index_new;
+}
+
+/* Read the handshake of an incoming connection and hand it to the handshake pool.
+ * do_TCP_handshakes picks up the result.
+ */
+static void submit_connection_handshake(TCP_Server *tcp_server, uint32_t i)
+{
+    TCP_Secure_Connection *conn = &tcp_server->incoming_connection_queue[i];
+    TCP_Handshake handshake;
+
+    if (read_TCP_packet(conn->sock, handshake.data, TCP_CLIENT_HANDSHAKE_SIZE) == -1) {
+        return;
+    }
+
+    handshake.index = i;
+    handshake.id = ++tcp_server->last_handshake_id;
+
+    if (!tcp_handshake_pool_submit(tcp_server->handshake_pool, &handshake)) {
+        kill_TCP_secure_connection(conn);
+        return;
+    }
+
+    conn->handshake_id = handshake.id;
+}
+
 static int do_incoming(TCP_Server *tcp_server, uint32_t i)
 {
-    if (tcp_server->incoming_connection_queue[i].status != TCP_STATUS_CONNECTED) {
+    if (tcp_server->incoming_connection_queue[i].status != TCP_STATUS_CONNECTED
+            || tcp_server->incoming_connection_queue[i].handshake_id != 0) {
+        return -1;
+    }
+
+    if (tcp_server->handshake_pool != nullptr) {
+        submit_connection_handshake(tcp_server, i);
         return -1;
     }
 
@@ -1143,19 +1212,7 @@ static int do_incoming(TCP_Server *tcp_server, uint32_t i)
     if (ret == -1) {
         kill_TCP_secure_connection(&tcp_server->incoming_connection_queue[i]);
     } else if (ret == 1) {
-        int index_new = tcp_server->unconfirmed_connection_queue_index % MAX_INCOMING_CONNECTIONS;
-        TCP_Secure_Connection *conn_old = &tcp_server->incoming_connection_queue[i];
-        TCP_Secure_Connection *conn_new = &tcp_server->unconfirmed_connection_queue[index_new];
-
-        if (conn_new->status != TCP_STATUS_NO_STATUS) {
-            kill_TCP_secure_connection(conn_new);
-        }
-
-        memcpy(conn_new, conn_old, sizeof(TCP_Secure_Connection));
-        crypto_memzero(conn_old, sizeof(TCP_Secure_Connection));
-        ++tcp_server->unconfirmed_connection_queue_index;
-
-        return index_new;
+        return move_to_unconfirmed(tcp_server, i);
     }
 
     return -1;
@@ -1170,7 +1227,7 @@ static int do_unconfirmed(TCP_Server *tcp_server, uint32_t i)
     }
 
     uint8_t packet[MAX_PACKET_SIZE];
-    int len = read_packet_TCP_secure_connection(conn->sock, &conn->next_packet_length, conn->shared_key, conn->recv_nonce,
+    int len = read_packet_TCP_secure_connection(conn->sock, &conn->recv_buffer, conn->shared_key, conn->recv_nonce,
               packet, sizeof(packet));
 
     if (len == 0) {
@@ -1190,7 +1247,7 @@ static bool tcp_process_secure_packet(TCP_Server *tcp_server, uint32_t i)
     TCP_Secure_Connection *const conn = &tcp_server->accepted_connection_array[i];
 
     uint8_t packet[MAX_PACKET_SIZE];
-    int len = read_packet_TCP_secure_connection(conn->sock, &conn->next_packet_length, conn->shared_key,
+    int len = read_packet_TCP_secure_connection(conn->sock, &conn->recv_buffer, conn->shared_key,
               conn->recv_nonce, packet, sizeof(packet));
 
     if (len == 0) {
@@ -1223,7 +1280,7 @@ static void do_TCP_incoming(TCP_Server *tcp_server)
 {
     uint32_t i;
 
-    for (i = 0; i < MAX_INCOMING_CONNECTIONS; ++i) {
+    for (i = 0; i < tcp_server->max_incoming_connections; ++i) {
         do_incoming(tcp_server, i);
     }
 }
@@ -1232,7 +1289,7 @@ static void do_TCP_unconfirmed(TCP_Server *tcp_server)
 {
     uint32_t i;
 
-    for (i = 0; i < MAX_INCOMING_CONNECTIONS; ++i) {
+    for (i = 0; i < tcp_server->max_incoming_connections; ++i) {
         do_unconfirmed(tcp_server, i);
     }
 }
@@ -1242,11 +1299,11 @@ static void do_TCP_confirmed(TCP_Server *tcp_server)
 {
 #ifdef TCP_SERVER_USE_EPOLL
 
-    if (tcp_server->last_run_pinged == unix_time()) {
+    if (tcp_server->last_run_pinged == mono_time_get(tcp_server->mono_time)) {
         return;
     }
 
-    tcp_server->last_run_pinged = unix_time();
+    tcp_server->last_run_pinged = mono_time_get(tcp_server->mono_time);
 #endif
     uint32_t i;
 
@@ -1257,7 +1314,7 @@ static void do_TCP_confirmed(TCP_Server *tcp_server)
             continue;
         }
 
-        if (is_timeout(conn->last_pinged, TCP_PING_FREQUENCY)) {
+        if (mono_time_is_timeout(tcp_server->mono_time, conn->last_pinged, TCP_PING_FREQUENCY)) {
             uint8_t ping[1 + sizeof(uint64_t)];
             ping[0] = TCP_PACKET_PING;
             uint64_t ping_id = random_u64();
@@ -1270,17 +1327,18 @@ static void do_TCP_confirmed(TCP_Server *tcp_server)
             int ret = write_packet_TCP_secure_connection(conn, ping, sizeof(ping), 1);
 
             if (ret == 1) {
-                conn->last_pinged = unix_time();
+                conn->last_pinged = mono_time_get(tcp_server->mono_time);
                 conn->ping_id = ping_id;
             } else {
-                if (is_timeout(conn->last_pinged, TCP_PING_FREQUENCY + TCP_PING_TIMEOUT)) {
+                if (mono_time_is_timeout(tcp_server->mono_time, conn->last_pinged,
+                                         TCP_PING_FREQUENCY + TCP_PING_TIMEOUT)) {
                     kill_accepted(tcp_server, i);
                     continue;
                 }
             }
         }
 
-        if (conn->ping_id && is_timeout(conn->last_pinged, TCP_PING_TIMEOUT)) {
+        if (conn->ping_id && mono_time_is_timeout(tcp_server->mono_time, conn->last_pinged, TCP_PING_TIMEOUT)) {
             kill_accepted(tcp_server, i);
             continue;
         }
@@ -1295,6 +1353,50 @@ static void do_TCP_confirmed(TCP_Server *tcp_server)
     }
 }
 
+/* Finish the connections whose handshake the handshake pool has processed. */
+static void do_TCP_handshakes(TCP_Server *tcp_server)
+{
+    if (tcp_server->handshake_pool == nullptr) {
+        return;
+    }
+
+    TCP_Handshake handshake;
+
+    while (tcp_handshake_pool_poll(tcp_server->handshake_pool, &handshake)) {
+        TCP_Secure_Connection *conn = &tcp_server->incoming_connection_queue[handshake.index];
+
+        /* The connection was killed, and maybe replaced, while the handshake was processed. */
+        if (conn->status != TCP_STATUS_CONNECTED || conn->handshake_id != handshake.id) {
+            continue;
+        }
+
+        conn->handshake_id = 0;
+
+        if (finish_TCP_handshake(conn, &handshake) != 1) {
+            kill_TCP_secure_connection(conn);
+            continue;
+        }
+
+#ifdef TCP_SERVER_USE_EPOLL
+        const Socket sock = conn->sock;
+        const int index_new = move_to_unconfirmed(tcp_server, handshake.index);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        ev.data.u64 = sock.socket | ((uint64_t)TCP_SOCKET_UNCONFIRMED << 32) | ((uint64_t)index_new << 40);
+
+        if (epoll_ctl(tcp_server->efd, EPOLL_CTL_MOD, sock.socket, &ev) == -1) {
+            kill_TCP_secure_connection(&tcp_server->unconfirmed_connection_queue[index_new]);
+        }
+
+#else
+        move_to_unconfirmed(tcp_server, handshake.index);
+#endif
+    }
+
+    crypto_memzero(&handshake, sizeof(handshake));
+}
+
 #ifdef TCP_SERVER_USE_EPOLL
 static bool tcp_epoll_process(TCP_Server *tcp_server)
 {
@@ -1398,6 +1500,10 @@ static bool tcp_epoll_process(TCP_Server *tcp_server)
                         kill_accepted(tcp_server, index_new);
                         break;
                     }
+
+                    // Packets that arrived together with the confirmation are already in the
+                    // receive buffer, so the socket won't report them again.
+                    do_confirmed_recv(tcp_server, index_new);
                 }
 
                 break;
@@ -1424,8 +1530,6 @@ static void do_TCP_epoll(TCP_Server *tcp_server)
 
 void do_TCP_server(TCP_Server *tcp_server)
 {
-    unix_time_update();
-
 #ifdef TCP_SERVER_USE_EPOLL
     do_TCP_epoll(tcp_server);
 
@@ -1435,6 +1539,7 @@ void do_TCP_server(TCP_Server *tcp_server)
     do_TCP_unconfirmed(tcp_server);
 #endif
 
+    do_TCP_handshakes(tcp_server);
     do_TCP_confirmed(tcp_server);
 }
 
@@ -1450,13 +1555,13 @@ void kill_TCP_server(TCP_Server *tcp_server)
         set_callback_handle_recv_1(tcp_server->onion, nullptr, nullptr);
     }
 
-    bs_list_free(&tcp_server->accepted_key_list);
+    for (i = 0; i < tcp_server->size_accepted_connections; ++i) {
+        tcp_send_queue_free(&tcp_server->accepted_connection_array[i].send_queue);
+    }
 
 #ifdef TCP_SERVER_USE_EPOLL
     close(tcp_server->efd);
 #endif
 
-    free(tcp_server->socks_listening);
-    free(tcp_server->accepted_connection_array);
-    free(tcp_server);
+    free_TCP_server(tcp_server);
 }
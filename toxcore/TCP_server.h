@@ -24,8 +24,8 @@
 #ifndef TCP_SERVER_H
 #define TCP_SERVER_H
 
+#include "TCP_send_queue.h"
 #include "crypto_core.h"
-#include "list.h"
 #include "onion.h"
 
 #define MAX_INCOMING_CONNECTIONS 256
@@ -34,11 +34,20 @@
 
 #define MAX_PACKET_SIZE 2048
 
+/* Memory the send queues of all connections to a TCP server may use together. */
+#define TCP_SERVER_SEND_BUDGET (64 * 1024 * 1024)
+
 #define TCP_HANDSHAKE_PLAIN_SIZE (CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_NONCE_SIZE)
 #define TCP_SERVER_HANDSHAKE_SIZE (CRYPTO_NONCE_SIZE + TCP_HANDSHAKE_PLAIN_SIZE + CRYPTO_MAC_SIZE)
 #define TCP_CLIENT_HANDSHAKE_SIZE (CRYPTO_PUBLIC_KEY_SIZE + TCP_SERVER_HANDSHAKE_SIZE)
 #define TCP_MAX_OOB_DATA_LENGTH 1024
 
+/* An encrypted packet on the wire is its 16 bit length, the MAC and the cipher text. Senders
+ * write the plain text at TCP_PACKET_PLAIN_OFFSET and encrypt it where it is.
+ */
+#define TCP_PACKET_PLAIN_OFFSET (sizeof(uint16_t) + CRYPTO_MAC_SIZE)
+#define TCP_PACKET_WIRE_SIZE(plain_length) (TCP_PACKET_PLAIN_OFFSET + (plain_length))
+
 #define NUM_RESERVED_PORTS 16
 #define NUM_CLIENT_CONNECTIONS (256 - NUM_RESERVED_PORTS)
 
@@ -66,24 +75,39 @@ typedef enum TCP_Status {
     TCP_STATUS_CONFIRMED,
 } TCP_Status;
 
-typedef struct TCP_Priority_List TCP_Priority_List;
-
-struct TCP_Priority_List {
-    TCP_Priority_List *next;
-    uint16_t size;
-    uint16_t sent;
-    uint8_t data[];
-};
-
 typedef struct TCP_Server TCP_Server;
 
 const uint8_t *tcp_server_public_key(const TCP_Server *tcp_server);
 size_t tcp_server_listen_count(const TCP_Server *tcp_server);
 
+/* Copy a maximum of max_num sockets the server needs to be woken up for to socks.
+ * If socks is NULL, nothing is copied and the number of such sockets is returned.
+ *
+ * return number of sockets copied to socks.
+ */
+uint32_t tcp_server_copy_sockets(const TCP_Server *tcp_server, Socket *socks, uint32_t max_num);
+
 /* Create new TCP server instance.
  */
-TCP_Server *new_TCP_server(uint8_t ipv6_enabled, uint16_t num_sockets, const uint16_t *ports, const uint8_t *secret_key,
-                           Onion *onion);
+TCP_Server *new_TCP_server(const Mono_Time *mono_time, uint8_t ipv6_enabled, uint16_t num_sockets,
+                           const uint16_t *ports, const uint8_t *secret_key, Onion *onion);
+
+typedef struct TCP_Server_Options {
+    /* Number of connections that can be waiting for their handshake or confirmation at once. */
+    uint16_t max_incoming_connections;
+    /* Number of threads doing the handshake crypto, 0 to do it in do_TCP_server. */
+    uint16_t handshake_threads;
+} TCP_Server_Options;
+
+/* Set options to the values new_TCP_server uses.
+ */
+void tcp_server_options_default(TCP_Server_Options *options);
+
+/* Create new TCP server instance with options.
+ */
+TCP_Server *new_TCP_server_options(const Mono_Time *mono_time, uint8_t ipv6_enabled, uint16_t num_sockets,
+                                   const uint16_t *ports, const uint8_t *secret_key, Onion *onion,
+                                   const TCP_Server_Options *options);
 
 /* Run the TCP_server
  */
@@ -93,15 +117,6 @@ void do_TCP_server(TCP_Server *tcp_server);
  */
 void kill_TCP_server(TCP_Server *tcp_server);
 
-/* Read the next two bytes in TCP stream then convert them to
- * length (host byte order).
- *
- * return length on success
- * return 0 if nothing has been read from socket.
- * return ~0 on failure.
- */
-uint16_t read_TCP_length(Socket sock);
-
 /* Read length bytes from socket.
  *
  * return length on success
@@ -109,11 +124,27 @@ uint16_t read_TCP_length(Socket sock);
  */
 int read_TCP_packet(Socket sock, uint8_t *data, uint16_t length);
 
-/* return length of received packet on success.
+/* Size of a receive buffer. It holds a few full packets so that one recv call picks up a
+ * whole burst of them. */
+#define TCP_RECV_BUFFER_SIZE (4 * (2 + MAX_PACKET_SIZE))
+
+/* Data read from a socket but not yet parsed into packets: bytes {start, end) of data. */
+typedef struct TCP_Recv_Buffer {
+    uint8_t data[TCP_RECV_BUFFER_SIZE];
+    uint16_t start;
+    uint16_t end;
+} TCP_Recv_Buffer;
+
+/* Parse the next length prefixed packet out of buffer, reading as much as is available from
+ * the socket in one call first if buffer doesn't hold a whole one.
+ *
+ * Once the handshake is done, this must be the only function reading from the socket.
+ *
+ * return length of received packet on success.
  * return 0 if could not read any packet.
  * return -1 on failure (connection must be killed).
  */
-int read_packet_TCP_secure_connection(Socket sock, uint16_t *next_packet_length, const uint8_t *shared_key,
+int read_packet_TCP_secure_connection(Socket sock, TCP_Recv_Buffer *buffer, const uint8_t *shared_key,
                                       uint8_t *recv_nonce, uint8_t *data, uint16_t max_len);
 
 
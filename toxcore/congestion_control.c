@@ -0,0 +1,560 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "congestion_control.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "ccompat.h"
+
+/* If the send queue is more than SEND_QUEUE_RATIO times larger than the
+ * calculated link speed the packet send speed will be reduced
+ * by a value depending on this number.
+ */
+#define SEND_QUEUE_RATIO 2.0
+
+/* Rate the model based algorithms start at before they have any samples. */
+#define CONGESTION_INITIAL_RATE 64.0
+
+/* Shortest round trip time the model based algorithms use. Acknowledgements
+ * don't arrive more often than this, so shorter times overestimate the rate. */
+#define CONGESTION_MIN_RTT PACKET_COUNTER_AVERAGE_INTERVAL
+
+/* How long after the last congestion event a connection counts as limited by
+ * its send rate rather than by the application. */
+#define CONGESTION_LIMITED_TIMEOUT CONGESTION_EVENT_TIMEOUT
+
+#define BBR_STARTUP_GAIN 2.885
+#define BBR_BW_FILTER_SIZE 10
+#define BBR_FULL_BW_THRESHOLD 1.25
+#define BBR_FULL_BW_ROUNDS 3
+#define BBR_GAIN_CYCLE_LENGTH 8
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+#define CUBIC_INITIAL_WINDOW 10.0
+#define CUBIC_MIN_WINDOW 2.0
+
+typedef struct Tox_Congestion_State {
+    uint32_t last_sendqueue_size[CONGESTION_QUEUE_ARRAY_SIZE];
+    uint32_t last_sendqueue_counter;
+    long signed int last_num_packets_sent[CONGESTION_LAST_SENT_ARRAY_SIZE];
+    long signed int last_num_packets_resent[CONGESTION_LAST_SENT_ARRAY_SIZE];
+    uint64_t last_congestion_event;
+} Tox_Congestion_State;
+
+typedef enum Bbr_Mode {
+    BBR_STARTUP,
+    BBR_DRAIN,
+    BBR_PROBE_BW,
+} Bbr_Mode;
+
+typedef struct Bbr_State {
+    Bbr_Mode mode;
+
+    /* Delivery rate samples, one per round trip. */
+    double bw_samples[BBR_BW_FILTER_SIZE];
+    uint32_t bw_index;
+    double btl_bw;
+
+    uint64_t round_start;
+    uint32_t round_acked;
+
+    /* Whether the connection ran out of send budget this round. Rounds
+     * limited by the application say nothing about the bottleneck. */
+    bool round_limited;
+    double full_bw;
+    uint8_t full_bw_rounds;
+
+    uint8_t cycle_index;
+} Bbr_State;
+
+typedef struct Cubic_State {
+    double cwnd;
+    double ssthresh;
+    double w_max;
+    double k;
+    uint64_t epoch_start;
+    uint64_t last_loss;
+    uint64_t last_send_limited;
+    uint64_t rtt;
+} Cubic_State;
+
+typedef struct Congestion_Control_Funcs {
+    void (*on_ack)(Congestion_Control *cc, uint64_t now, uint32_t num_acked);
+    void (*on_loss)(Congestion_Control *cc, uint64_t now, uint32_t num_lost);
+    void (*on_send_limited)(Congestion_Control *cc, uint64_t now);
+    void (*update)(Congestion_Control *cc, const Congestion_Sample *sample);
+    bool paced;
+} Congestion_Control_Funcs;
+
+struct Congestion_Control {
+    Congestion_Control_Type type;
+    const Congestion_Control_Funcs *funcs;
+
+    double send_rate;
+    double send_rate_requested;
+
+    union {
+        Tox_Congestion_State tox;
+        Bbr_State bbr;
+        Cubic_State cubic;
+    } state;
+};
+
+static uint64_t effective_rtt(uint64_t rtt)
+{
+    return rtt < CONGESTION_MIN_RTT ? CONGESTION_MIN_RTT : rtt;
+}
+
+static void set_rates(Congestion_Control *cc, double send_rate, double send_rate_requested)
+{
+    if (send_rate < CRYPTO_PACKET_MIN_RATE) {
+        send_rate = CRYPTO_PACKET_MIN_RATE;
+    }
+
+    if (send_rate_requested < send_rate) {
+        send_rate_requested = send_rate;
+    }
+
+    cc->send_rate = send_rate;
+    cc->send_rate_requested = send_rate_requested;
+}
+
+/*** The original toxcore algorithm. */
+
+static void tox_cc_on_ack(Congestion_Control *cc, uint64_t now, uint32_t num_acked)
+{
+}
+
+static void tox_cc_on_loss(Congestion_Control *cc, uint64_t now, uint32_t num_lost)
+{
+}
+
+static void tox_cc_on_send_limited(Congestion_Control *cc, uint64_t now)
+{
+    cc->state.tox.last_congestion_event = now;
+}
+
+static void tox_cc_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    Tox_Congestion_State *const st = &cc->state.tox;
+
+    unsigned int pos = st->last_sendqueue_counter % CONGESTION_QUEUE_ARRAY_SIZE;
+    st->last_sendqueue_size[pos] = sample->send_queue_size;
+    ++st->last_sendqueue_counter;
+
+    long signed int sum = 0;
+    sum = (long signed int)st->last_sendqueue_size[(pos) % CONGESTION_QUEUE_ARRAY_SIZE] -
+          (long signed int)st->last_sendqueue_size[(pos - (CONGESTION_QUEUE_ARRAY_SIZE - 1)) % CONGESTION_QUEUE_ARRAY_SIZE];
+
+    unsigned int n_p_pos = st->last_sendqueue_counter % CONGESTION_LAST_SENT_ARRAY_SIZE;
+    st->last_num_packets_sent[n_p_pos] = sample->packets_sent;
+    st->last_num_packets_resent[n_p_pos] = sample->packets_resent;
+
+    if (sample->hold_rate) {
+        return;
+    }
+
+    long signed int total_sent = 0, total_resent = 0;
+
+    // TODO(irungentoo): use real delay
+    unsigned int delay = (unsigned int)((sample->rtt / PACKET_COUNTER_AVERAGE_INTERVAL) + 0.5);
+    unsigned int packets_set_rem_array = (CONGESTION_LAST_SENT_ARRAY_SIZE - CONGESTION_QUEUE_ARRAY_SIZE);
+
+    if (delay > packets_set_rem_array) {
+        delay = packets_set_rem_array;
+    }
+
+    for (unsigned j = 0; j < CONGESTION_QUEUE_ARRAY_SIZE; ++j) {
+        unsigned int ind = (j + (packets_set_rem_array  - delay) + n_p_pos) % CONGESTION_LAST_SENT_ARRAY_SIZE;
+        total_sent += st->last_num_packets_sent[ind];
+        total_resent += st->last_num_packets_resent[ind];
+    }
+
+    if (sum > 0) {
+        total_sent -= sum;
+    } else {
+        if (total_resent > -sum) {
+            total_resent = -sum;
+        }
+    }
+
+    /* if queue is too big only allow resending packets. */
+    uint32_t npackets = sample->send_queue_size;
+    double min_speed = 1000.0 * (((double)(total_sent)) / ((double)(CONGESTION_QUEUE_ARRAY_SIZE) *
+                                 PACKET_COUNTER_AVERAGE_INTERVAL));
+
+    double min_speed_request = 1000.0 * (((double)(total_sent + total_resent)) / ((double)(
+            CONGESTION_QUEUE_ARRAY_SIZE) * PACKET_COUNTER_AVERAGE_INTERVAL));
+
+    if (min_speed < CRYPTO_PACKET_MIN_RATE) {
+        min_speed = CRYPTO_PACKET_MIN_RATE;
+    }
+
+    double send_array_ratio = (((double)npackets) / min_speed);
+    double send_rate;
+
+    // TODO(irungentoo): Improve formula?
+    if (send_array_ratio > SEND_QUEUE_RATIO && CRYPTO_MIN_QUEUE_LENGTH < npackets) {
+        send_rate = min_speed * (1.0 / (send_array_ratio / SEND_QUEUE_RATIO));
+    } else if (st->last_congestion_event + CONGESTION_EVENT_TIMEOUT < sample->time) {
+        send_rate = min_speed * 1.2;
+    } else {
+        send_rate = min_speed * 0.9;
+    }
+
+    set_rates(cc, send_rate, min_speed_request * 1.2);
+}
+
+/* Not paced: the algorithm only grows the rate from what the connection actually sent, which
+ * bursts push above the rate, and takes being send limited for congestion. Paced at its own rate
+ * it is send limited all the time and shrinks to CRYPTO_PACKET_MIN_RATE. */
+static const Congestion_Control_Funcs tox_cc_funcs = {
+    tox_cc_on_ack,
+    tox_cc_on_loss,
+    tox_cc_on_send_limited,
+    tox_cc_update,
+    false,
+};
+
+/*** BBR-like: pace at the estimated bottleneck bandwidth. */
+
+static const double bbr_pacing_gain_cycle[BBR_GAIN_CYCLE_LENGTH] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+static void bbr_on_ack(Congestion_Control *cc, uint64_t now, uint32_t num_acked)
+{
+    cc->state.bbr.round_acked += num_acked;
+}
+
+static void bbr_on_loss(Congestion_Control *cc, uint64_t now, uint32_t num_lost)
+{
+    /* The model only reacts to the delivery rate, not to individual losses. */
+}
+
+static void bbr_on_send_limited(Congestion_Control *cc, uint64_t now)
+{
+    cc->state.bbr.round_limited = true;
+}
+
+static double bbr_pacing_gain(const Bbr_State *st)
+{
+    switch (st->mode) {
+        case BBR_STARTUP:
+            return BBR_STARTUP_GAIN;
+
+        case BBR_DRAIN:
+            return 1.0 / BBR_STARTUP_GAIN;
+
+        case BBR_PROBE_BW:
+            return bbr_pacing_gain_cycle[st->cycle_index];
+    }
+
+    return 1.0;
+}
+
+static void bbr_end_round(Bbr_State *st, uint64_t now)
+{
+    const double delivery_rate = (double)st->round_acked * 1000.0 / (double)(now - st->round_start);
+    const bool round_limited = st->round_limited;
+    st->round_start = now;
+    st->round_acked = 0;
+    st->round_limited = false;
+
+    st->bw_samples[st->bw_index % BBR_BW_FILTER_SIZE] = delivery_rate;
+    ++st->bw_index;
+
+    double btl_bw = 0;
+
+    for (uint32_t i = 0; i < BBR_BW_FILTER_SIZE; ++i) {
+        if (st->bw_samples[i] > btl_bw) {
+            btl_bw = st->bw_samples[i];
+        }
+    }
+
+    if (btl_bw > 0) {
+        st->btl_bw = btl_bw;
+    }
+
+    switch (st->mode) {
+        case BBR_STARTUP: {
+            /* The pipe is full once the bandwidth stops growing for a few rounds. */
+            if (!round_limited) {
+                break;
+            }
+
+            if (st->btl_bw >= st->full_bw * BBR_FULL_BW_THRESHOLD) {
+                st->full_bw = st->btl_bw;
+                st->full_bw_rounds = 0;
+            } else if (++st->full_bw_rounds >= BBR_FULL_BW_ROUNDS) {
+                st->mode = BBR_DRAIN;
+            }
+
+            break;
+        }
+
+        case BBR_DRAIN: {
+            /* One round at the inverse gain empties the queue startup built. */
+            st->mode = BBR_PROBE_BW;
+            st->cycle_index = 2;
+            break;
+        }
+
+        case BBR_PROBE_BW: {
+            st->cycle_index = (st->cycle_index + 1) % BBR_GAIN_CYCLE_LENGTH;
+            break;
+        }
+    }
+}
+
+static void bbr_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    Bbr_State *const st = &cc->state.bbr;
+
+    if (sample->hold_rate) {
+        return;
+    }
+
+    if (st->round_start + effective_rtt(sample->rtt) <= sample->time) {
+        bbr_end_round(st, sample->time);
+    }
+
+    const double rate = bbr_pacing_gain(st) * st->btl_bw;
+    set_rates(cc, rate, rate);
+}
+
+static const Congestion_Control_Funcs bbr_funcs = {
+    bbr_on_ack,
+    bbr_on_loss,
+    bbr_on_send_limited,
+    bbr_update,
+    true,
+};
+
+/*** CUBIC: loss based window growing along a cubic curve. */
+
+/* Cube root of a positive number by Newton's method, so toxcore doesn't need
+ * to link libm for a single call. */
+static double cube_root(double x)
+{
+    double r = x > 1 ? x : 1;
+
+    for (uint8_t i = 0; i < 64; ++i) {
+        const double next = r - (r * r * r - x) / (3 * r * r);
+
+        if (next >= r) {
+            break;
+        }
+
+        r = next;
+    }
+
+    return r;
+}
+
+static void cubic_on_ack(Congestion_Control *cc, uint64_t now, uint32_t num_acked)
+{
+    Cubic_State *const st = &cc->state.cubic;
+
+    /* Don't grow the window while the application isn't using it. */
+    if (st->last_send_limited + CONGESTION_LIMITED_TIMEOUT < now) {
+        return;
+    }
+
+    if (st->cwnd < st->ssthresh) {
+        st->cwnd += num_acked;
+        return;
+    }
+
+    if (st->epoch_start == 0) {
+        st->epoch_start = now;
+
+        if (st->cwnd < st->w_max) {
+            st->k = cube_root((st->w_max - st->cwnd) / CUBIC_C);
+        } else {
+            st->k = 0;
+            st->w_max = st->cwnd;
+        }
+    }
+
+    const double rtt = (double)effective_rtt(st->rtt) / 1000.0;
+    const double t = (double)(now - st->epoch_start) / 1000.0 + rtt;
+    const double target = CUBIC_C * (t - st->k) * (t - st->k) * (t - st->k) + st->w_max;
+
+    if (target > st->cwnd) {
+        st->cwnd += (target - st->cwnd) / st->cwnd * num_acked;
+    } else {
+        st->cwnd += 0.01 * num_acked / st->cwnd;
+    }
+
+    /* Grow at least as fast as Reno would (the "TCP friendly" region). */
+    const double w_est = st->w_max * CUBIC_BETA + 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * (t / rtt);
+
+    if (w_est > st->cwnd) {
+        st->cwnd = w_est;
+    }
+}
+
+static void cubic_on_loss(Congestion_Control *cc, uint64_t now, uint32_t num_lost)
+{
+    Cubic_State *const st = &cc->state.cubic;
+
+    /* Back off at most once per round trip. */
+    if (st->last_loss + effective_rtt(st->rtt) > now) {
+        return;
+    }
+
+    /* Fast convergence: release bandwidth to newer flows when still shrinking. */
+    if (st->cwnd < st->w_max) {
+        st->w_max = st->cwnd * (1 + CUBIC_BETA) / 2;
+    } else {
+        st->w_max = st->cwnd;
+    }
+
+    st->cwnd *= CUBIC_BETA;
+
+    if (st->cwnd < CUBIC_MIN_WINDOW) {
+        st->cwnd = CUBIC_MIN_WINDOW;
+    }
+
+    st->ssthresh = st->cwnd;
+    st->epoch_start = 0;
+    st->last_loss = now;
+}
+
+static void cubic_on_send_limited(Congestion_Control *cc, uint64_t now)
+{
+    cc->state.cubic.last_send_limited = now;
+}
+
+static void cubic_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    Cubic_State *const st = &cc->state.cubic;
+    st->rtt = sample->rtt;
+
+    if (sample->hold_rate) {
+        return;
+    }
+
+    const double rate = st->cwnd * 1000.0 / (double)effective_rtt(st->rtt);
+    set_rates(cc, rate, rate);
+}
+
+static const Congestion_Control_Funcs cubic_funcs = {
+    cubic_on_ack,
+    cubic_on_loss,
+    cubic_on_send_limited,
+    cubic_update,
+    true,
+};
+
+Congestion_Control *congestion_control_new(Congestion_Control_Type type, uint64_t now)
+{
+    Congestion_Control *cc = (Congestion_Control *)calloc(1, sizeof(Congestion_Control));
+
+    if (cc == nullptr) {
+        return nullptr;
+    }
+
+    cc->type = type;
+
+    switch (type) {
+        case CONGESTION_CONTROL_TOX: {
+            cc->funcs = &tox_cc_funcs;
+            set_rates(cc, CRYPTO_PACKET_MIN_RATE, CRYPTO_PACKET_MIN_RATE);
+            break;
+        }
+
+        case CONGESTION_CONTROL_BBR: {
+            cc->funcs = &bbr_funcs;
+            cc->state.bbr.mode = BBR_STARTUP;
+            cc->state.bbr.btl_bw = CONGESTION_INITIAL_RATE;
+            cc->state.bbr.round_start = now;
+            set_rates(cc, BBR_STARTUP_GAIN * CONGESTION_INITIAL_RATE, BBR_STARTUP_GAIN * CONGESTION_INITIAL_RATE);
+            break;
+        }
+
+        case CONGESTION_CONTROL_CUBIC: {
+            cc->funcs = &cubic_funcs;
+            cc->state.cubic.cwnd = CUBIC_INITIAL_WINDOW;
+            cc->state.cubic.ssthresh = INFINITY;
+            cc->state.cubic.last_send_limited = now;
+            set_rates(cc, CONGESTION_INITIAL_RATE, CONGESTION_INITIAL_RATE);
+            break;
+        }
+
+        default: {
+            free(cc);
+            return nullptr;
+        }
+    }
+
+    return cc;
+}
+
+void congestion_control_kill(Congestion_Control *cc)
+{
+    free(cc);
+}
+
+Congestion_Control_Type congestion_control_type(const Congestion_Control *cc)
+{
+    return cc->type;
+}
+
+void congestion_control_on_ack(Congestion_Control *cc, uint64_t now, uint32_t num_acked)
+{
+    if (num_acked != 0) {
+        cc->funcs->on_ack(cc, now, num_acked);
+    }
+}
+
+void congestion_control_on_loss(Congestion_Control *cc, uint64_t now, uint32_t num_lost)
+{
+    if (num_lost != 0) {
+        cc->funcs->on_loss(cc, now, num_lost);
+    }
+}
+
+void congestion_control_on_send_limited(Congestion_Control *cc, uint64_t now)
+{
+    cc->funcs->on_send_limited(cc, now);
+}
+
+void congestion_control_update(Congestion_Control *cc, const Congestion_Sample *sample)
+{
+    cc->funcs->update(cc, sample);
+}
+
+double congestion_control_send_rate(const Congestion_Control *cc)
+{
+    return cc->send_rate;
+}
+
+double congestion_control_send_rate_requested(const Congestion_Control *cc)
+{
+    return cc->send_rate_requested;
+}
+
+bool congestion_control_paced(const Congestion_Control *cc)
+{
+    return cc->funcs->paced;
+}
+
+const char *congestion_control_type_to_string(Congestion_Control_Type type)
+{
+    switch (type) {
+        case CONGESTION_CONTROL_TOX:
+            return "tox";
+
+        case CONGESTION_CONTROL_BBR:
+            return "bbr";
+
+        case CONGESTION_CONTROL_CUBIC:
+            return "cubic";
+    }
+
+    return "<invalid>";
+}
@@ -0,0 +1,139 @@
+/**
+ * Congestion control for net_crypto connections.
+ *
+ * A Congestion_Control object turns what a connection observes (packets sent,
+ * acknowledged and lost, round trip time, send queue length) into the packet
+ * rate net_crypto may send at. The algorithm is chosen when the object is
+ * created; net_crypto only talks to it through the functions below.
+ *
+ * All times are monotonic milliseconds, all rates are packets per second.
+ */
+#ifndef C_TOXCORE_TOXCORE_CONGESTION_CONTROL_H
+#define C_TOXCORE_TOXCORE_CONGESTION_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimum packet rate per second. */
+#define CRYPTO_PACKET_MIN_RATE 4.0
+
+/* Minimum packet queue max length. */
+#define CRYPTO_MIN_QUEUE_LENGTH 64
+
+/* The dT for the average packet receiving rate calculations and for
+   congestion_control_update. */
+#define PACKET_COUNTER_AVERAGE_INTERVAL 50
+
+/* Base current transfer speed on last CONGESTION_QUEUE_ARRAY_SIZE number of points taken
+   at the dT defined above. */
+#define CONGESTION_QUEUE_ARRAY_SIZE 12
+#define CONGESTION_LAST_SENT_ARRAY_SIZE (CONGESTION_QUEUE_ARRAY_SIZE * 2)
+
+/* Timeout for increasing speed after congestion event (in ms). */
+#define CONGESTION_EVENT_TIMEOUT 1000
+
+typedef enum Congestion_Control_Type {
+    /**
+     * The original toxcore algorithm: the rate follows the measured send
+     * rate, shrinking when the send queue grows.
+     */
+    CONGESTION_CONTROL_TOX,
+
+    /**
+     * A BBR-like model: estimates the bottleneck bandwidth from the delivery
+     * rate and paces at a multiple of it, ignoring isolated losses.
+     */
+    CONGESTION_CONTROL_BBR,
+
+    /**
+     * CUBIC: a loss-based window that grows along a cubic curve, converted
+     * to a rate using the round trip time.
+     */
+    CONGESTION_CONTROL_CUBIC,
+} Congestion_Control_Type;
+
+/**
+ * What a connection observed during the last PACKET_COUNTER_AVERAGE_INTERVAL.
+ */
+typedef struct Congestion_Sample {
+    /** The current time. */
+    uint64_t time;
+    /** Number of new packets sent since the last sample. */
+    uint32_t packets_sent;
+    /** Number of packets sent again on request since the last sample. */
+    uint32_t packets_resent;
+    /** Number of packets in the send queue (sent but not acknowledged, or not sent yet). */
+    uint32_t send_queue_size;
+    /** The lowest measured round trip time. */
+    uint64_t rtt;
+    /**
+     * Only record the sample, keep sending at the current rate. Set while the
+     * connection switches from TCP to UDP and the samples don't describe the
+     * new path yet.
+     */
+    bool hold_rate;
+} Congestion_Sample;
+
+typedef struct Congestion_Control Congestion_Control;
+
+/**
+ * Create a congestion controller running the given algorithm.
+ *
+ * @return NULL on allocation failure or if the type is unknown.
+ */
+Congestion_Control *congestion_control_new(Congestion_Control_Type type, uint64_t now);
+void congestion_control_kill(Congestion_Control *cc);
+
+Congestion_Control_Type congestion_control_type(const Congestion_Control *cc);
+
+/**
+ * The peer acknowledged num_acked packets.
+ */
+void congestion_control_on_ack(Congestion_Control *cc, uint64_t now, uint32_t num_acked);
+
+/**
+ * The peer requested num_lost packets again.
+ */
+void congestion_control_on_loss(Congestion_Control *cc, uint64_t now, uint32_t num_lost);
+
+/**
+ * The connection had more data than the rate allowed it to send.
+ */
+void congestion_control_on_send_limited(Congestion_Control *cc, uint64_t now);
+
+/**
+ * Recalculate the send rates. Called every PACKET_COUNTER_AVERAGE_INTERVAL.
+ */
+void congestion_control_update(Congestion_Control *cc, const Congestion_Sample *sample);
+
+/**
+ * The rate at which new packets may be sent.
+ */
+double congestion_control_send_rate(const Congestion_Control *cc);
+
+/**
+ * The rate at which packets requested by the peer may be sent, including new
+ * packets. Never lower than congestion_control_send_rate.
+ */
+double congestion_control_send_rate_requested(const Congestion_Control *cc);
+
+/**
+ * Whether packets of this connection should be paced: sent evenly over time
+ * instead of in bursts of up to a few hundred ms worth of data.
+ */
+bool congestion_control_paced(const Congestion_Control *cc);
+
+/**
+ * Human readable name of the algorithm, for logging.
+ */
+const char *congestion_control_type_to_string(Congestion_Control_Type type);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_CONGESTION_CONTROL_H
@@ -141,6 +141,13 @@ int32_t encrypt_data_symmetric(const uint8_t *secret_key, const uint8_t *nonce,
         return -1;
     }
 
+#ifndef VANILLA_NACL
+    /* The easy API writes MAC || cipher text directly, no padding copies needed. */
+    if (crypto_box_easy_afternm(encrypted, plain, length, nonce, secret_key) != 0) {
+        return -1;
+    }
+
+#else
     VLA(uint8_t, temp_plain, length + crypto_box_ZEROBYTES);
     VLA(uint8_t, temp_encrypted, length + crypto_box_MACBYTES + crypto_box_BOXZEROBYTES);
 
@@ -153,6 +160,7 @@ int32_t encrypt_data_symmetric(const uint8_t *secret_key, const uint8_t *nonce,
 
     /* Unpad the encrypted message. */
     memcpy(encrypted, temp_encrypted + crypto_box_BOXZEROBYTES, length + crypto_box_MACBYTES);
+#endif
     return length + crypto_box_MACBYTES;
 }
 
@@ -163,6 +171,13 @@ int32_t decrypt_data_symmetric(const uint8_t *secret_key, const uint8_t *nonce,
         return -1;
     }
 
+#ifndef VANILLA_NACL
+
+    if (crypto_box_open_easy_afternm(plain, encrypted, length, nonce, secret_key) != 0) {
+        return -1;
+    }
+
+#else
     VLA(uint8_t, temp_plain, length + crypto_box_ZEROBYTES);
     VLA(uint8_t, temp_encrypted, length + crypto_box_BOXZEROBYTES);
 
@@ -174,9 +189,87 @@ int32_t decrypt_data_symmetric(const uint8_t *secret_key, const uint8_t *nonce,
     }
 
     memcpy(plain, temp_plain + crypto_box_ZEROBYTES, length - crypto_box_MACBYTES);
+#endif
     return length - crypto_box_MACBYTES;
 }
 
+int32_t encrypt_data_symmetric_inplace(const uint8_t *shared_key, const uint8_t *nonce, uint8_t *data, size_t length)
+{
+    if (length == 0 || !shared_key || !nonce || !data) {
+        return -1;
+    }
+
+#ifndef VANILLA_NACL
+    uint8_t *const text = data + crypto_box_MACBYTES;
+
+    if (crypto_box_detached_afternm(text, data, text, length, nonce, shared_key) != 0) {
+        return -1;
+    }
+
+    return length + crypto_box_MACBYTES;
+#else
+    /* NaCl has no detached API; the padded path copies through temporaries anyway. */
+    return encrypt_data_symmetric(shared_key, nonce, data + crypto_box_MACBYTES, length, data);
+#endif
+}
+
+int32_t decrypt_data_symmetric_inplace(const uint8_t *shared_key, const uint8_t *nonce, uint8_t *data, size_t length)
+{
+    if (length <= crypto_box_MACBYTES || !shared_key || !nonce || !data) {
+        return -1;
+    }
+
+    const size_t text_length = length - crypto_box_MACBYTES;
+
+#ifndef VANILLA_NACL
+    uint8_t *const text = data + crypto_box_MACBYTES;
+
+    if (crypto_box_open_detached_afternm(text, text, data, text_length, nonce, shared_key) != 0) {
+        return -1;
+    }
+
+#else
+
+    if (decrypt_data_symmetric(shared_key, nonce, data, length, data + crypto_box_MACBYTES) == -1) {
+        return -1;
+    }
+
+#endif
+    return text_length;
+}
+
+uint32_t encrypt_data_symmetric_batch(const uint8_t *shared_key, uint8_t *nonce, const Crypto_Buffer *buffers,
+                                      uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; ++i) {
+        if (encrypt_data_symmetric_inplace(shared_key, nonce, buffers[i].data, buffers[i].length) == -1) {
+            break;
+        }
+
+        increment_nonce(nonce);
+    }
+
+    return i;
+}
+
+uint32_t decrypt_data_symmetric_batch(const uint8_t *shared_key, uint8_t *nonce, const Crypto_Buffer *buffers,
+                                      uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; ++i) {
+        if (decrypt_data_symmetric_inplace(shared_key, nonce, buffers[i].data, buffers[i].length) == -1) {
+            break;
+        }
+
+        increment_nonce(nonce);
+    }
+
+    return i;
+}
+
 int32_t encrypt_data(const uint8_t *public_key, const uint8_t *secret_key, const uint8_t *nonce,
                      const uint8_t *plain, size_t length, uint8_t *encrypted)
 {
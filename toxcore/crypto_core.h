@@ -228,6 +228,57 @@ int32_t encrypt_data_symmetric(const uint8_t *shared_key, const uint8_t *nonce,
 int32_t decrypt_data_symmetric(const uint8_t *shared_key, const uint8_t *nonce, const uint8_t *encrypted, size_t length,
                                uint8_t *plain);
 
+/**
+ * Encrypts length bytes in place. data must point at CRYPTO_MAC_SIZE bytes
+ * reserved for the MAC, followed by the length bytes of plain text. On
+ * success the buffer holds the same MAC || cipher text layout that
+ * encrypt_data_symmetric produces, without any intermediate copies.
+ *
+ * @return -1 if there was a problem, length + CRYPTO_MAC_SIZE otherwise.
+ */
+int32_t encrypt_data_symmetric_inplace(const uint8_t *shared_key, const uint8_t *nonce, uint8_t *data, size_t length);
+
+/**
+ * Decrypts length bytes of MAC || cipher text in place. On success the plain
+ * text starts at data + CRYPTO_MAC_SIZE.
+ *
+ * @return -1 if decryption failed, length - CRYPTO_MAC_SIZE otherwise.
+ */
+int32_t decrypt_data_symmetric_inplace(const uint8_t *shared_key, const uint8_t *nonce, uint8_t *data, size_t length);
+
+/**
+ * A buffer for in-place batch encryption or decryption.
+ *
+ * For encryption, data points at CRYPTO_MAC_SIZE free bytes followed by
+ * length bytes of plain text. For decryption, length is the full size of the
+ * MAC || cipher text at data.
+ */
+typedef struct Crypto_Buffer {
+    uint8_t *data;
+    uint16_t length;
+} Crypto_Buffer;
+
+/**
+ * Encrypts num buffers in place with consecutive nonces, starting at nonce.
+ * The nonce is incremented once per encrypted buffer, so on return it is the
+ * nonce for the next packet, exactly as if each buffer had been passed to
+ * encrypt_data_symmetric followed by increment_nonce.
+ *
+ * @return the number of buffers encrypted. Fewer than num means the buffer
+ *   at that index was invalid; the nonce was not incremented for it.
+ */
+uint32_t encrypt_data_symmetric_batch(const uint8_t *shared_key, uint8_t *nonce, const Crypto_Buffer *buffers,
+                                      uint32_t num);
+
+/**
+ * Decrypts num buffers in place with consecutive nonces, starting at nonce.
+ * Stops at the first buffer that fails to decrypt.
+ *
+ * @return the number of buffers decrypted successfully.
+ */
+uint32_t decrypt_data_symmetric_batch(const uint8_t *shared_key, uint8_t *nonce, const Crypto_Buffer *buffers,
+                                      uint32_t num);
+
 /**
  * Increment the given nonce by 1 in big endian (rightmost byte incremented
  * first).
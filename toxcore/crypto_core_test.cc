@@ -1,6 +1,9 @@
 #include "crypto_core.h"
 
 #include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -88,4 +91,140 @@ TEST(CryptoCore, MemcmpTimingIsDataIndependent) {
       << "Time of the different data comparation: " << not_same_median << " clocks";
 }
 
+enum {
+  /** Size of each packet in the batch tests, roughly a full net_crypto data packet. */
+  CRYPTO_TEST_BATCH_PACKET_SIZE = 1024,
+  /** Number of packets encrypted together in one batch. */
+  CRYPTO_TEST_BATCH_SIZE = 8,
+  /** Number of batches encrypted in the benchmark. */
+  CRYPTO_TEST_BATCH_ITERATIONS = 2000,
+};
+
+/**
+ * Packet buffers laid out for in-place encryption: CRYPTO_MAC_SIZE bytes of
+ * room for the MAC followed by the plain text.
+ */
+struct PacketBatch {
+  std::vector<std::vector<uint8_t>> storage;
+  std::vector<Crypto_Buffer> buffers;
+
+  PacketBatch(size_t num, size_t length) : storage(num), buffers(num) {
+    for (size_t i = 0; i < num; ++i) {
+      storage[i].resize(CRYPTO_MAC_SIZE + length);
+      random_bytes(storage[i].data() + CRYPTO_MAC_SIZE, length);
+      buffers[i].data = storage[i].data();
+      buffers[i].length = length;
+    }
+  }
+};
+
+TEST(CryptoCore, BatchEncryptionMatchesSinglePacketEncryption) {
+  uint8_t key[CRYPTO_SHARED_KEY_SIZE];
+  new_symmetric_key(key);
+  uint8_t start_nonce[CRYPTO_NONCE_SIZE];
+  random_nonce(start_nonce);
+
+  PacketBatch batch(CRYPTO_TEST_BATCH_SIZE, CRYPTO_TEST_BATCH_PACKET_SIZE);
+  const std::vector<std::vector<uint8_t>> plain = batch.storage;
+
+  uint8_t nonce[CRYPTO_NONCE_SIZE];
+  memcpy(nonce, start_nonce, CRYPTO_NONCE_SIZE);
+  ASSERT_EQ(encrypt_data_symmetric_batch(key, nonce, batch.buffers.data(), CRYPTO_TEST_BATCH_SIZE),
+            static_cast<uint32_t>(CRYPTO_TEST_BATCH_SIZE));
+
+  uint8_t single_nonce[CRYPTO_NONCE_SIZE];
+  memcpy(single_nonce, start_nonce, CRYPTO_NONCE_SIZE);
+
+  for (size_t i = 0; i < CRYPTO_TEST_BATCH_SIZE; ++i) {
+    std::vector<uint8_t> encrypted(CRYPTO_MAC_SIZE + CRYPTO_TEST_BATCH_PACKET_SIZE);
+    ASSERT_EQ(encrypt_data_symmetric(key, single_nonce, plain[i].data() + CRYPTO_MAC_SIZE,
+                                     CRYPTO_TEST_BATCH_PACKET_SIZE, encrypted.data()),
+              static_cast<int32_t>(encrypted.size()));
+    EXPECT_EQ(encrypted, batch.storage[i]) << "packet " << i << " differs";
+    increment_nonce(single_nonce);
+  }
+
+  EXPECT_EQ(memcmp(nonce, single_nonce, CRYPTO_NONCE_SIZE), 0)
+      << "batch must leave the nonce ready for the next packet";
+
+  for (size_t i = 0; i < CRYPTO_TEST_BATCH_SIZE; ++i) {
+    batch.buffers[i].length = CRYPTO_MAC_SIZE + CRYPTO_TEST_BATCH_PACKET_SIZE;
+  }
+
+  memcpy(nonce, start_nonce, CRYPTO_NONCE_SIZE);
+  ASSERT_EQ(decrypt_data_symmetric_batch(key, nonce, batch.buffers.data(), CRYPTO_TEST_BATCH_SIZE),
+            static_cast<uint32_t>(CRYPTO_TEST_BATCH_SIZE));
+
+  for (size_t i = 0; i < CRYPTO_TEST_BATCH_SIZE; ++i) {
+    EXPECT_EQ(memcmp(batch.storage[i].data() + CRYPTO_MAC_SIZE, plain[i].data() + CRYPTO_MAC_SIZE,
+                     CRYPTO_TEST_BATCH_PACKET_SIZE),
+              0);
+  }
+}
+
+TEST(CryptoCore, BatchDecryptionStopsAtForgedPacket) {
+  uint8_t key[CRYPTO_SHARED_KEY_SIZE];
+  new_symmetric_key(key);
+  uint8_t start_nonce[CRYPTO_NONCE_SIZE];
+  random_nonce(start_nonce);
+
+  PacketBatch batch(CRYPTO_TEST_BATCH_SIZE, CRYPTO_TEST_BATCH_PACKET_SIZE);
+  uint8_t nonce[CRYPTO_NONCE_SIZE];
+  memcpy(nonce, start_nonce, CRYPTO_NONCE_SIZE);
+  ASSERT_EQ(encrypt_data_symmetric_batch(key, nonce, batch.buffers.data(), CRYPTO_TEST_BATCH_SIZE),
+            static_cast<uint32_t>(CRYPTO_TEST_BATCH_SIZE));
+
+  for (size_t i = 0; i < CRYPTO_TEST_BATCH_SIZE; ++i) {
+    batch.buffers[i].length = CRYPTO_MAC_SIZE + CRYPTO_TEST_BATCH_PACKET_SIZE;
+  }
+
+  batch.storage[3][CRYPTO_MAC_SIZE] ^= 1;
+
+  memcpy(nonce, start_nonce, CRYPTO_NONCE_SIZE);
+  EXPECT_EQ(decrypt_data_symmetric_batch(key, nonce, batch.buffers.data(), CRYPTO_TEST_BATCH_SIZE), 3U);
+}
+
+/**
+ * Microbenchmark comparing the copy-based per-packet API with in-place batch
+ * encryption. This only reports timings; it does not fail on slow machines.
+ */
+TEST(CryptoCore, BatchEncryptionBenchmark) {
+  uint8_t key[CRYPTO_SHARED_KEY_SIZE];
+  new_symmetric_key(key);
+  uint8_t nonce[CRYPTO_NONCE_SIZE];
+  random_nonce(nonce);
+
+  PacketBatch batch(CRYPTO_TEST_BATCH_SIZE, CRYPTO_TEST_BATCH_PACKET_SIZE);
+  std::vector<uint8_t> encrypted(CRYPTO_MAC_SIZE + CRYPTO_TEST_BATCH_PACKET_SIZE);
+
+  const auto single_start = std::chrono::steady_clock::now();
+
+  for (size_t n = 0; n < CRYPTO_TEST_BATCH_ITERATIONS; ++n) {
+    for (size_t i = 0; i < CRYPTO_TEST_BATCH_SIZE; ++i) {
+      encrypt_data_symmetric(key, nonce, batch.storage[i].data() + CRYPTO_MAC_SIZE,
+                             CRYPTO_TEST_BATCH_PACKET_SIZE, encrypted.data());
+      increment_nonce(nonce);
+    }
+  }
+
+  const auto batch_start = std::chrono::steady_clock::now();
+
+  for (size_t n = 0; n < CRYPTO_TEST_BATCH_ITERATIONS; ++n) {
+    ASSERT_EQ(encrypt_data_symmetric_batch(key, nonce, batch.buffers.data(), CRYPTO_TEST_BATCH_SIZE),
+              static_cast<uint32_t>(CRYPTO_TEST_BATCH_SIZE));
+  }
+
+  const auto batch_end = std::chrono::steady_clock::now();
+
+  using std::chrono::duration_cast;
+  using std::chrono::nanoseconds;
+  const double packets = CRYPTO_TEST_BATCH_ITERATIONS * CRYPTO_TEST_BATCH_SIZE;
+  std::cout << "encrypt_data_symmetric:       "
+            << duration_cast<nanoseconds>(batch_start - single_start).count() / packets
+            << " ns/packet\n"
+            << "encrypt_data_symmetric_batch: "
+            << duration_cast<nanoseconds>(batch_end - batch_start).count() / packets
+            << " ns/packet\n";
+}
+
 }  // namespace
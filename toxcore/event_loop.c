@@ -0,0 +1,201 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "event_loop.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include "ccompat.h"
+
+#ifdef __linux__
+
+struct Event_Loop {
+    const Logger *log;
+
+    int efd;
+    int timer_fd;
+
+    /* Sockets currently registered with efd. */
+    Socket *socks;
+    uint32_t num_socks;
+    uint32_t socks_size;
+};
+
+Event_Loop *event_loop_new(const Logger *log)
+{
+    Event_Loop *loop = (Event_Loop *)calloc(1, sizeof(Event_Loop));
+
+    if (loop == nullptr) {
+        return nullptr;
+    }
+
+    loop->log = log;
+    loop->efd = epoll_create(8);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+    if (loop->efd == -1 || loop->timer_fd == -1) {
+        LOGGER_ERROR(log, "failed to create event loop descriptors");
+        event_loop_kill(loop);
+        return nullptr;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = loop->timer_fd;
+
+    if (epoll_ctl(loop->efd, EPOLL_CTL_ADD, loop->timer_fd, &ev) == -1) {
+        LOGGER_ERROR(log, "failed to register event loop timer");
+        event_loop_kill(loop);
+        return nullptr;
+    }
+
+    return loop;
+}
+
+void event_loop_kill(Event_Loop *loop)
+{
+    if (loop == nullptr) {
+        return;
+    }
+
+    if (loop->timer_fd != -1) {
+        close(loop->timer_fd);
+    }
+
+    if (loop->efd != -1) {
+        close(loop->efd);
+    }
+
+    free(loop->socks);
+    free(loop);
+}
+
+int event_loop_fd(const Event_Loop *loop)
+{
+    return loop->efd;
+}
+
+static bool contains_socket(const Socket *socks, uint32_t num_socks, Socket sock)
+{
+    for (uint32_t i = 0; i < num_socks; ++i) {
+        if (socks[i].socket == sock.socket) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool rearm_timer(Event_Loop *loop, uint32_t timeout_ms)
+{
+    /* Clear a pending expiration so the descriptor stops being readable. */
+    uint64_t expirations;
+
+    if (read(loop->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+        return false;
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = timeout_ms / 1000;
+    its.it_value.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+    if (timeout_ms == 0) {
+        /* An all-zero value would disarm the timer; expire immediately instead. */
+        its.it_value.tv_nsec = 1;
+    }
+
+    return timerfd_settime(loop->timer_fd, 0, &its, nullptr) == 0;
+}
+
+bool event_loop_update(Event_Loop *loop, const Socket *socks, uint32_t num_socks, uint32_t timeout_ms)
+{
+    bool ok = true;
+
+    /* Sockets that went away. Closed descriptors are removed by the kernel already, so errors are expected. */
+    for (uint32_t i = 0; i < loop->num_socks; ++i) {
+        if (!contains_socket(socks, num_socks, loop->socks[i])) {
+            epoll_ctl(loop->efd, EPOLL_CTL_DEL, loop->socks[i].socket, nullptr);
+        }
+    }
+
+    if (num_socks > loop->socks_size) {
+        Socket *new_socks = (Socket *)realloc(loop->socks, num_socks * sizeof(Socket));
+
+        if (new_socks == nullptr) {
+            loop->num_socks = 0;
+            return false;
+        }
+
+        loop->socks = new_socks;
+        loop->socks_size = num_socks;
+    }
+
+    uint32_t registered = 0;
+
+    for (uint32_t i = 0; i < num_socks; ++i) {
+        if (!sock_valid(socks[i]) || contains_socket(loop->socks, registered, socks[i])) {
+            continue;
+        }
+
+        /* Always try to add: a descriptor number may have been closed and reused since the last update,
+         * in which case the kernel has already forgotten about it. */
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.fd = socks[i].socket;
+
+        if (epoll_ctl(loop->efd, EPOLL_CTL_ADD, socks[i].socket, &ev) == -1 && errno != EEXIST) {
+            LOGGER_WARNING(loop->log, "failed to watch socket %d: %d", socks[i].socket, errno);
+            ok = false;
+            continue;
+        }
+
+        loop->socks[registered] = socks[i];
+        ++registered;
+    }
+
+    loop->num_socks = registered;
+
+    if (!rearm_timer(loop, timeout_ms)) {
+        LOGGER_WARNING(loop->log, "failed to arm event loop timer");
+        ok = false;
+    }
+
+    return ok;
+}
+
+#else
+
+Event_Loop *event_loop_new(const Logger *log)
+{
+    return nullptr;
+}
+
+void event_loop_kill(Event_Loop *loop)
+{
+}
+
+int event_loop_fd(const Event_Loop *loop)
+{
+    return -1;
+}
+
+bool event_loop_update(Event_Loop *loop, const Socket *socks, uint32_t num_socks, uint32_t timeout_ms)
+{
+    return false;
+}
+
+#endif
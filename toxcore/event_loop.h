@@ -0,0 +1,47 @@
+/**
+ * The event loop module lets applications wait for toxcore work in their own
+ * event loop instead of calling tox_iterate on a fixed cadence.
+ *
+ * An Event_Loop wraps a single pollable descriptor. It becomes readable when
+ * any of the registered sockets has data to read, or when the iteration timer
+ * set by the last call to event_loop_update expires. On platforms without
+ * epoll, event_loop_new returns NULL and callers fall back to polling.
+ */
+#ifndef C_TOXCORE_TOXCORE_EVENT_LOOP_H
+#define C_TOXCORE_TOXCORE_EVENT_LOOP_H
+
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Event_Loop Event_Loop;
+
+/**
+ * Create a new event loop.
+ *
+ * @return NULL on allocation failure or if the platform is not supported.
+ */
+Event_Loop *event_loop_new(const Logger *log);
+void event_loop_kill(Event_Loop *loop);
+
+/**
+ * Return the descriptor that becomes readable when there is work to do.
+ */
+int event_loop_fd(const Event_Loop *loop);
+
+/**
+ * Replace the set of watched sockets with the num_socks sockets in socks and
+ * re-arm the iteration timer to expire in timeout_ms milliseconds. Invalid
+ * sockets are ignored.
+ *
+ * @return false if the set could not be (fully) updated.
+ */
+bool event_loop_update(Event_Loop *loop, const Socket *socks, uint32_t num_socks, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_EVENT_LOOP_H
@@ -134,6 +134,8 @@ typedef struct Group_Lossy_Handler {
 } Group_Lossy_Handler;
 
 typedef struct Group_Chats {
+    const Mono_Time *mono_time;
+
     Messenger *m;
     Friend_Connections *fr_c;
 
@@ -0,0 +1,255 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "hash_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+#include "crypto_core.h"
+
+#define HASH_MAP_MIN_CAPACITY 16
+
+/* The map grows when more than 3/4 of its slots are used, and shrinks when
+ * less than 1/8 are. */
+static bool hash_map_too_full(uint32_t n, uint32_t capacity)
+{
+    return (uint64_t)n * 4 > (uint64_t)capacity * 3;
+}
+
+static uint64_t hash_map_mix(uint64_t h, uint64_t word)
+{
+    h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 32);
+}
+
+/* return the hash of key, which is never 0. */
+static uint32_t hash_map_hash(const Hash_Map *map, const uint8_t *key)
+{
+    uint64_t h = map->seed;
+    uint32_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= map->key_size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, key + i, sizeof(uint64_t));
+        h = hash_map_mix(h, word);
+    }
+
+    if (i < map->key_size) {
+        uint64_t word = 0;
+        memcpy(&word, key + i, map->key_size - i);
+        h = hash_map_mix(h, word);
+    }
+
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+
+    const uint32_t hash = (uint32_t)h;
+    return hash == 0 ? 1 : hash;
+}
+
+/* Compare keys a word at a time without branching on the words, so that for a
+ * constant size the loop becomes a few vector compares. */
+static bool hash_map_keys_equal_size(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+    uint64_t diff = 0;
+    uint32_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t x;
+        uint64_t y;
+        memcpy(&x, a + i, sizeof(uint64_t));
+        memcpy(&y, b + i, sizeof(uint64_t));
+        diff |= x ^ y;
+    }
+
+    for (; i < size; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+
+    return diff == 0;
+}
+
+static bool hash_map_keys_equal(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+    switch (size) {
+        case 32:
+            return hash_map_keys_equal_size(a, b, 32);
+
+        case 24:
+            return hash_map_keys_equal_size(a, b, 24);
+
+        default:
+            return hash_map_keys_equal_size(a, b, size);
+    }
+}
+
+/* return the slot of key, or the free slot where it would go. */
+static uint32_t hash_map_slot(const Hash_Map *map, const uint8_t *key, uint32_t hash)
+{
+    const uint32_t mask = map->capacity - 1;
+    uint32_t i = hash & mask;
+
+    while (map->hashes[i] != 0
+            && (map->hashes[i] != hash || !hash_map_keys_equal(map->keys + (size_t)i * map->key_size, key, map->key_size))) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+static bool hash_map_resize(Hash_Map *map, uint32_t capacity)
+{
+    uint32_t *hashes = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+    uint8_t *keys = (uint8_t *)malloc((size_t)capacity * map->key_size);
+    int *ids = (int *)malloc(capacity * sizeof(int));
+
+    if (hashes == nullptr || keys == nullptr || ids == nullptr) {
+        free(hashes);
+        free(keys);
+        free(ids);
+        return false;
+    }
+
+    const uint32_t mask = capacity - 1;
+
+    for (uint32_t i = 0; i < map->capacity; ++i) {
+        if (map->hashes[i] == 0) {
+            continue;
+        }
+
+        uint32_t j = map->hashes[i] & mask;
+
+        while (hashes[j] != 0) {
+            j = (j + 1) & mask;
+        }
+
+        hashes[j] = map->hashes[i];
+        memcpy(keys + (size_t)j * map->key_size, map->keys + (size_t)i * map->key_size, map->key_size);
+        ids[j] = map->ids[i];
+    }
+
+    free(map->hashes);
+    free(map->keys);
+    free(map->ids);
+
+    map->hashes = hashes;
+    map->keys = keys;
+    map->ids = ids;
+    map->capacity = capacity;
+    return true;
+}
+
+bool hash_map_init(Hash_Map *map, uint32_t key_size, uint32_t initial_capacity)
+{
+    if (key_size == 0) {
+        return false;
+    }
+
+    uint32_t capacity = HASH_MAP_MIN_CAPACITY;
+
+    while (hash_map_too_full(initial_capacity, capacity)) {
+        capacity *= 2;
+    }
+
+    map->key_size = key_size;
+    map->capacity = 0;
+    map->min_capacity = capacity;
+    map->n = 0;
+    map->seed = random_u64();
+    map->hashes = nullptr;
+    map->keys = nullptr;
+    map->ids = nullptr;
+
+    return hash_map_resize(map, capacity);
+}
+
+void hash_map_free(Hash_Map *map)
+{
+    free(map->hashes);
+    free(map->keys);
+    free(map->ids);
+    map->hashes = nullptr;
+    map->keys = nullptr;
+    map->ids = nullptr;
+    map->capacity = 0;
+    map->n = 0;
+}
+
+int hash_map_find(const Hash_Map *map, const uint8_t *key)
+{
+    if (map->n == 0) {
+        return -1;
+    }
+
+    const uint32_t i = hash_map_slot(map, key, hash_map_hash(map, key));
+
+    if (map->hashes[i] == 0) {
+        return -1;
+    }
+
+    return map->ids[i];
+}
+
+bool hash_map_add(Hash_Map *map, const uint8_t *key, int id)
+{
+    if (hash_map_too_full(map->n + 1, map->capacity) && !hash_map_resize(map, map->capacity * 2)) {
+        return false;
+    }
+
+    const uint32_t hash = hash_map_hash(map, key);
+    const uint32_t i = hash_map_slot(map, key, hash);
+
+    if (map->hashes[i] != 0) {
+        return false;
+    }
+
+    map->hashes[i] = hash;
+    memcpy(map->keys + (size_t)i * map->key_size, key, map->key_size);
+    map->ids[i] = id;
+    ++map->n;
+    return true;
+}
+
+bool hash_map_remove(Hash_Map *map, const uint8_t *key, int id)
+{
+    if (map->n == 0) {
+        return false;
+    }
+
+    uint32_t i = hash_map_slot(map, key, hash_map_hash(map, key));
+
+    if (map->hashes[i] == 0 || map->ids[i] != id) {
+        return false;
+    }
+
+    map->hashes[i] = 0;
+    --map->n;
+
+    /* Move later entries of the probe sequence back into the gap, so that
+     * lookups never need to step over removed entries. An entry can move if
+     * the gap is no further from its home slot than it is now. */
+    const uint32_t mask = map->capacity - 1;
+
+    for (uint32_t j = (i + 1) & mask; map->hashes[j] != 0; j = (j + 1) & mask) {
+        const uint32_t home = map->hashes[j] & mask;
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->hashes[i] = map->hashes[j];
+            memcpy(map->keys + (size_t)i * map->key_size, map->keys + (size_t)j * map->key_size, map->key_size);
+            map->ids[i] = map->ids[j];
+            map->hashes[j] = 0;
+            i = j;
+        }
+    }
+
+    if (map->capacity > map->min_capacity && map->n < map->capacity / 8) {
+        /* Failing to shrink only wastes memory. */
+        hash_map_resize(map, map->capacity / 2);
+    }
+
+    return true;
+}
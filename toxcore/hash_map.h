@@ -0,0 +1,71 @@
+/**
+ * Hash map from fixed size keys to ids, replacing BS_List where entries come
+ * and go often.
+ *
+ * Open addressing with linear probing. The hashes of the entries are kept in
+ * an array of their own, so a lookup mostly scans consecutive 32 bit words and
+ * only compares the keys whose hash matches. Keys are compared a machine word
+ * at a time, which compilers turn into vector compares for the 32 byte public
+ * keys and the 24 byte keys net_crypto makes of addresses.
+ *
+ * Every map hashes with a random seed of its own, so peers can't pick keys
+ * that collide.
+ */
+#ifndef C_TOXCORE_TOXCORE_HASH_MAP_H
+#define C_TOXCORE_TOXCORE_HASH_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Hash_Map {
+    uint32_t key_size;
+    uint32_t capacity; // number of slots, a power of two
+    uint32_t min_capacity; // the map never shrinks below this
+    uint32_t n; // number of entries
+    uint64_t seed;
+    uint32_t *hashes; // hash of the entry of each slot, 0 for free slots
+    uint8_t *keys;
+    int *ids;
+} Hash_Map;
+
+/**
+ * Initialize a map with keys of key_size bytes, with room for at least
+ * initial_capacity entries before it grows.
+ *
+ * @return false if memory ran out.
+ */
+bool hash_map_init(Hash_Map *map, uint32_t key_size, uint32_t initial_capacity);
+
+/**
+ * Free the memory of a map initialized with hash_map_init.
+ */
+void hash_map_free(Hash_Map *map);
+
+/**
+ * @return the id associated with key, or -1 if key is not in the map.
+ */
+int hash_map_find(const Hash_Map *map, const uint8_t *key);
+
+/**
+ * Associate id with key.
+ *
+ * @return false if key is in the map already or memory ran out.
+ */
+bool hash_map_add(Hash_Map *map, const uint8_t *key, int id);
+
+/**
+ * Remove key from the map.
+ *
+ * @return false if key is not in the map or is associated with another id.
+ */
+bool hash_map_remove(Hash_Map *map, const uint8_t *key, int id);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_HASH_MAP_H
@@ -0,0 +1,123 @@
+#include "hash_map.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <map>
+#include <random>
+
+namespace {
+
+using Key = std::array<uint8_t, 32>;
+
+Key make_key(uint32_t n) {
+  Key key = {};
+  key[0] = n & 0xff;
+  key[31] = (n >> 8) & 0xff;
+  key[17] = (n >> 16) & 0xff;
+  return key;
+}
+
+TEST(HashMap, FindsAddedKeys) {
+  Hash_Map map;
+  ASSERT_TRUE(hash_map_init(&map, 32, 0));
+
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(hash_map_add(&map, make_key(i).data(), i));
+  }
+
+  EXPECT_EQ(map.n, 1000);
+
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(hash_map_find(&map, make_key(i).data()), i);
+  }
+
+  EXPECT_EQ(hash_map_find(&map, make_key(1000).data()), -1);
+
+  hash_map_free(&map);
+}
+
+TEST(HashMap, KeysAreAddedOnce) {
+  Hash_Map map;
+  ASSERT_TRUE(hash_map_init(&map, 32, 8));
+
+  ASSERT_TRUE(hash_map_add(&map, make_key(1).data(), 1));
+  EXPECT_FALSE(hash_map_add(&map, make_key(1).data(), 2));
+  EXPECT_EQ(hash_map_find(&map, make_key(1).data()), 1);
+
+  hash_map_free(&map);
+}
+
+TEST(HashMap, RemoveNeedsTheId) {
+  Hash_Map map;
+  ASSERT_TRUE(hash_map_init(&map, 32, 8));
+
+  ASSERT_TRUE(hash_map_add(&map, make_key(1).data(), 1));
+  EXPECT_FALSE(hash_map_remove(&map, make_key(1).data(), 2));
+  EXPECT_FALSE(hash_map_remove(&map, make_key(2).data(), 1));
+  EXPECT_EQ(hash_map_find(&map, make_key(1).data()), 1);
+
+  EXPECT_TRUE(hash_map_remove(&map, make_key(1).data(), 1));
+  EXPECT_EQ(hash_map_find(&map, make_key(1).data()), -1);
+  EXPECT_FALSE(hash_map_remove(&map, make_key(1).data(), 1));
+
+  hash_map_free(&map);
+}
+
+TEST(HashMap, OddKeySizes) {
+  Hash_Map map;
+  ASSERT_TRUE(hash_map_init(&map, 3, 8));
+
+  const uint8_t a[3] = {1, 2, 3};
+  const uint8_t b[3] = {1, 2, 4};
+  ASSERT_TRUE(hash_map_add(&map, a, 1));
+  ASSERT_TRUE(hash_map_add(&map, b, 2));
+  EXPECT_EQ(hash_map_find(&map, a), 1);
+  EXPECT_EQ(hash_map_find(&map, b), 2);
+
+  hash_map_free(&map);
+}
+
+TEST(HashMap, MatchesStdMapUnderChurn) {
+  Hash_Map map;
+  ASSERT_TRUE(hash_map_init(&map, 32, 8));
+  std::map<uint32_t, int> expected;
+  std::mt19937 rng(42);
+
+  for (int i = 0; i < 100000; ++i) {
+    // Few distinct keys, so that removals hit keys in long probe sequences.
+    const uint32_t n = rng() % 2000;
+    const Key key = make_key(n);
+
+    if (rng() % 2 == 0) {
+      EXPECT_EQ(hash_map_add(&map, key.data(), i), expected.emplace(n, i).second);
+    } else {
+      const auto it = expected.find(n);
+      const int id = it == expected.end() ? 0 : it->second;
+      EXPECT_EQ(hash_map_remove(&map, key.data(), id), it != expected.end());
+
+      if (it != expected.end()) {
+        expected.erase(it);
+      }
+    }
+
+    ASSERT_EQ(map.n, expected.size());
+  }
+
+  for (uint32_t n = 0; n < 2000; ++n) {
+    const auto it = expected.find(n);
+    EXPECT_EQ(hash_map_find(&map, make_key(n).data()), it == expected.end() ? -1 : it->second);
+  }
+
+  // The map shrinks again once most entries are gone.
+  for (const auto &entry : expected) {
+    ASSERT_TRUE(hash_map_remove(&map, make_key(entry.first).data(), entry.second));
+  }
+
+  EXPECT_EQ(map.n, 0);
+  EXPECT_EQ(map.capacity, map.min_capacity);
+
+  hash_map_free(&map);
+}
+
+}  // namespace
@@ -28,16 +28,103 @@
 #include "logger.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Arguments of one message kept by the asynchronous logger. Strings are
+ * copied into the text of the record, other arguments are kept by value.
+ */
+#define LOGGER_RECORD_MAX_ARGS 16
+#define LOGGER_RECORD_TEXT_SIZE 256
+
+/* Longest conversion specification formatted from a record, e.g. "%-08.3lld". */
+#define LOGGER_MAX_SPEC_LENGTH 16
+
+#define LOGGER_FILE_NAME_SIZE 32
+
+typedef enum Logger_Arg_Type {
+    LOGGER_ARG_INT,
+    LOGGER_ARG_UINT,
+    LOGGER_ARG_LONG,
+    LOGGER_ARG_ULONG,
+    LOGGER_ARG_LLONG,
+    LOGGER_ARG_ULLONG,
+    LOGGER_ARG_SIZE,
+    LOGGER_ARG_DOUBLE,
+    LOGGER_ARG_POINTER,
+    LOGGER_ARG_STRING,
+} Logger_Arg_Type;
+
+typedef struct Logger_Arg {
+    Logger_Arg_Type type;
+    union {
+        int i;
+        unsigned int u;
+        long l;
+        unsigned long ul;
+        long long ll;
+        unsigned long long ull;
+        size_t size;
+        double d;
+        const void *p;
+        uint16_t str;  // Offset of the string in the record text.
+    } value;
+} Logger_Arg;
+
+typedef struct Logger_Record {
+    Logger_Level level;
+    const char *file;
+    int line;
+    const char *func;
+
+    /* NULL if text holds the formatted message, because the format string
+     * uses a conversion the record can't keep the argument of. */
+    const char *format;
+
+    uint8_t num_args;
+    Logger_Arg args[LOGGER_RECORD_MAX_ARGS];
+    uint16_t text_length;
+    char text[LOGGER_RECORD_TEXT_SIZE];
+} Logger_Record;
+
+typedef struct Logger_Async {
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    pthread_t thread;
+    bool stop;
+
+    /* Ring of records {start, start + num). */
+    Logger_Record *records;
+    uint32_t size;
+    uint32_t start;
+    uint32_t num;
+
+    uint32_t dropped;
+} Logger_Async;
+
+typedef struct Logger_File_Level {
+    char file[LOGGER_FILE_NAME_SIZE];
+    Logger_Level level;
+} Logger_File_Level;
 
 struct Logger {
     logger_cb *callback;
     void *context;
     void *userdata;
+
+    Logger_Level level;
+    Logger_File_Level file_levels[LOGGER_MAX_FILE_LEVELS];
+    uint8_t num_file_levels;
+
+    /* Lowest of level and the file levels, so that most messages below the
+     * level are rejected without looking at their file. */
+    Logger_Level min_level;
+
+    Logger_Async *async;
 };
 
 #ifdef USE_STDERR_LOGGER
@@ -77,6 +164,411 @@ static const Logger logger_stderr = {
 };
 #endif
 
+/* Only pass the file name, not the entire file path, for privacy reasons.
+ * The full path may contain PII of the person compiling toxcore (their
+ * username and directory layout).
+ */
+static const char *logger_file_name(const char *file)
+{
+    const char *filename = strrchr(file, '/');
+    file = filename ? filename + 1 : file;
+#if defined(_WIN32) || defined(__CYGWIN__)
+    // On Windows, the path separator *may* be a backslash, so we look for that
+    // one too.
+    const char *windows_filename = strrchr(file, '\\');
+    file = windows_filename ? windows_filename + 1 : file;
+#endif
+    return file;
+}
+
+/* Parses the conversion specification after a '%' and sets the type of its
+ * argument. Precision is set to the precision given, or -1.
+ *
+ * Returns the length of the specification including the conversion
+ * character, or 0 if a record can't keep its argument, e.g. for a '*' width.
+ */
+static uint32_t logger_parse_spec(const char *spec, Logger_Arg_Type *type, int *precision)
+{
+    uint32_t i = 0;
+
+    while (spec[i] == '-' || spec[i] == '+' || spec[i] == ' ' || spec[i] == '#' || spec[i] == '0') {
+        ++i;
+    }
+
+    while (spec[i] >= '0' && spec[i] <= '9') {
+        ++i;
+    }
+
+    *precision = -1;
+
+    if (spec[i] == '.') {
+        ++i;
+        *precision = 0;
+
+        while (spec[i] >= '0' && spec[i] <= '9') {
+            *precision = *precision * 10 + (spec[i] - '0');
+            ++i;
+        }
+    }
+
+    uint32_t longs = 0;
+    bool size = false;
+
+    if (spec[i] == 'h') {
+        // Promoted to int, and narrowed again by the conversion.
+        ++i;
+
+        if (spec[i] == 'h') {
+            ++i;
+        }
+    } else if (spec[i] == 'l') {
+        ++i;
+        longs = 1;
+
+        if (spec[i] == 'l') {
+            ++i;
+            longs = 2;
+        }
+    } else if (spec[i] == 'z') {
+        ++i;
+        size = true;
+    }
+
+    switch (spec[i]) {
+        case 'd':
+        case 'i':
+            *type = size ? LOGGER_ARG_SIZE : longs == 0 ? LOGGER_ARG_INT : longs == 1 ? LOGGER_ARG_LONG : LOGGER_ARG_LLONG;
+            break;
+
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            *type = size ? LOGGER_ARG_SIZE : longs == 0 ? LOGGER_ARG_UINT : longs == 1 ? LOGGER_ARG_ULONG : LOGGER_ARG_ULLONG;
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (size || longs == 2) {
+                return 0;
+            }
+
+            *type = LOGGER_ARG_DOUBLE;
+            break;
+
+        case 'c':
+        case 'p':
+        case 's':
+            if (size || longs != 0) {
+                return 0;
+            }
+
+            *type = spec[i] == 'c' ? LOGGER_ARG_INT : spec[i] == 'p' ? LOGGER_ARG_POINTER : LOGGER_ARG_STRING;
+            break;
+
+        default:
+            return 0;
+    }
+
+    return i + 1;
+}
+
+/* Copies at most max_length characters of string into the record text.
+ * Strings that don't fit are cut off.
+ */
+static uint16_t logger_record_add_string(Logger_Record *record, const char *string, int max_length)
+{
+    const uint16_t offset = record->text_length;
+
+    if (string == nullptr) {
+        string = "(null)";
+    }
+
+    for (int i = 0; string[i] != '\0' && i != max_length && record->text_length < LOGGER_RECORD_TEXT_SIZE - 1; ++i) {
+        record->text[record->text_length] = string[i];
+        ++record->text_length;
+    }
+
+    record->text[record->text_length] = '\0';
+    ++record->text_length;
+    return offset;
+}
+
+/* Keeps the arguments of the format string in the record.
+ *
+ * Returns false if the record can't keep them.
+ */
+static bool logger_record_capture(Logger_Record *record, const char *format, va_list args)
+{
+    record->num_args = 0;
+    record->text_length = 0;
+
+    for (const char *p = format; *p != '\0'; ++p) {
+        if (*p != '%') {
+            continue;
+        }
+
+        if (p[1] == '%') {
+            ++p;
+            continue;
+        }
+
+        Logger_Arg_Type type;
+        int precision;
+        const uint32_t length = logger_parse_spec(p + 1, &type, &precision);
+
+        if (length == 0 || length >= LOGGER_MAX_SPEC_LENGTH || record->num_args == LOGGER_RECORD_MAX_ARGS
+                || record->text_length == LOGGER_RECORD_TEXT_SIZE) {
+            return false;
+        }
+
+        Logger_Arg *arg = &record->args[record->num_args];
+        ++record->num_args;
+        arg->type = type;
+
+        switch (type) {
+            case LOGGER_ARG_INT:
+                arg->value.i = va_arg(args, int);
+                break;
+
+            case LOGGER_ARG_UINT:
+                arg->value.u = va_arg(args, unsigned int);
+                break;
+
+            case LOGGER_ARG_LONG:
+                arg->value.l = va_arg(args, long);
+                break;
+
+            case LOGGER_ARG_ULONG:
+                arg->value.ul = va_arg(args, unsigned long);
+                break;
+
+            case LOGGER_ARG_LLONG:
+                arg->value.ll = va_arg(args, long long);
+                break;
+
+            case LOGGER_ARG_ULLONG:
+                arg->value.ull = va_arg(args, unsigned long long);
+                break;
+
+            case LOGGER_ARG_SIZE:
+                arg->value.size = va_arg(args, size_t);
+                break;
+
+            case LOGGER_ARG_DOUBLE:
+                arg->value.d = va_arg(args, double);
+                break;
+
+            case LOGGER_ARG_POINTER:
+                arg->value.p = va_arg(args, const void *);
+                break;
+
+            case LOGGER_ARG_STRING:
+                arg->value.str = logger_record_add_string(record, va_arg(args, const char *), precision);
+                break;
+        }
+
+        p += length;
+    }
+
+    return true;
+}
+
+/* Formats the message of a record the way vsnprintf would have when it was
+ * written, one conversion at a time.
+ */
+static void logger_record_format(const Logger_Record *record, char *msg, size_t size)
+{
+    if (record->format == nullptr) {
+        snprintf(msg, size, "%s", record->text);
+        return;
+    }
+
+    size_t pos = 0;
+    uint8_t num_args = 0;
+    const char *p = record->format;
+
+    while (*p != '\0' && pos < size - 1) {
+        if (*p != '%' || p[1] == '%') {
+            msg[pos] = *p;
+            ++pos;
+            p += *p == '%' ? 2 : 1;
+            continue;
+        }
+
+        Logger_Arg_Type type;
+        int precision;
+        const uint32_t length = logger_parse_spec(p + 1, &type, &precision);
+        char spec[LOGGER_MAX_SPEC_LENGTH + 1];
+        memcpy(spec, p, length + 1);
+        spec[length + 1] = '\0';
+        p += length + 1;
+
+        const Logger_Arg *arg = &record->args[num_args];
+        ++num_args;
+        int written = 0;
+
+        switch (arg->type) {
+            case LOGGER_ARG_INT:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.i);
+                break;
+
+            case LOGGER_ARG_UINT:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.u);
+                break;
+
+            case LOGGER_ARG_LONG:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.l);
+                break;
+
+            case LOGGER_ARG_ULONG:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.ul);
+                break;
+
+            case LOGGER_ARG_LLONG:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.ll);
+                break;
+
+            case LOGGER_ARG_ULLONG:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.ull);
+                break;
+
+            case LOGGER_ARG_SIZE:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.size);
+                break;
+
+            case LOGGER_ARG_DOUBLE:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.d);
+                break;
+
+            case LOGGER_ARG_POINTER:
+                written = snprintf(msg + pos, size - pos, spec, arg->value.p);
+                break;
+
+            case LOGGER_ARG_STRING:
+                written = snprintf(msg + pos, size - pos, spec, record->text + arg->value.str);
+                break;
+        }
+
+        if (written > 0) {
+            pos += (size_t)written < size - pos ? (size_t)written : size - 1 - pos;
+        }
+    }
+
+    msg[pos] = '\0';
+}
+
+static void *logger_async_thread(void *arg)
+{
+    const Logger *log = (const Logger *)arg;
+    Logger_Async *async = log->async;
+    Logger_Record record;
+    char msg[LOGGER_MAX_MSG_LENGTH];
+
+    pthread_mutex_lock(&async->mutex);
+
+    while (true) {
+        while (!async->stop && async->num == 0 && async->dropped == 0) {
+            pthread_cond_wait(&async->work, &async->mutex);
+        }
+
+        const uint32_t dropped = async->dropped;
+        async->dropped = 0;
+        const bool have_record = async->num != 0;
+
+        if (!have_record && dropped == 0) {
+            break;
+        }
+
+        if (have_record) {
+            record = async->records[async->start];
+            async->start = (async->start + 1) % async->size;
+            --async->num;
+        }
+
+        // The callback can only change while we hold the mutex.
+        logger_cb *const callback = log->callback;
+        void *const context = log->context;
+        void *const userdata = log->userdata;
+        pthread_mutex_unlock(&async->mutex);
+
+        if (callback != nullptr && dropped != 0) {
+            snprintf(msg, sizeof(msg), "%u log messages dropped, the queue was full", dropped);
+            callback(context, LOG_WARNING, "logger.c", __LINE__, __func__, msg, userdata);
+        }
+
+        if (callback != nullptr && have_record) {
+            logger_record_format(&record, msg, sizeof(msg));
+            callback(context, record.level, record.file, record.line, record.func, msg, userdata);
+        }
+
+        pthread_mutex_lock(&async->mutex);
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+    return nullptr;
+}
+
+static void logger_write_async(const Logger *log, Logger_Level level, const char *file, int line, const char *func,
+                               const char *format, va_list args)
+{
+    Logger_Async *async = log->async;
+    Logger_Record record;
+    record.level = level;
+    record.file = file;
+    record.line = line;
+    record.func = func;
+    record.format = format;
+
+    va_list capture_args;
+    va_copy(capture_args, args);
+
+    if (!logger_record_capture(&record, format, capture_args)) {
+        record.format = nullptr;
+        record.num_args = 0;
+        vsnprintf(record.text, sizeof(record.text), format, args);
+    }
+
+    va_end(capture_args);
+
+    pthread_mutex_lock(&async->mutex);
+
+    if (async->num == async->size) {
+        ++async->dropped;
+        pthread_mutex_unlock(&async->mutex);
+        return;
+    }
+
+    // The text is the largest part of a record, and mostly unused.
+    Logger_Record *const slot = &async->records[(async->start + async->num) % async->size];
+    memcpy(slot, &record, offsetof(Logger_Record, text));
+    memcpy(slot->text, record.text, record.format == nullptr ? LOGGER_RECORD_TEXT_SIZE : record.text_length);
+    ++async->num;
+
+    if (async->num == 1) {
+        pthread_cond_signal(&async->work);
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+}
+
+static void logger_update_min_level(Logger *log)
+{
+    log->min_level = log->level;
+
+    for (uint8_t i = 0; i < log->num_file_levels; ++i) {
+        if (log->file_levels[i].level < log->min_level) {
+            log->min_level = log->file_levels[i].level;
+        }
+    }
+}
+
 /**
  * Public Functions
  */
@@ -87,14 +579,144 @@ Logger *logger_new(void)
 
 void logger_kill(Logger *log)
 {
+    if (log == nullptr) {
+        return;
+    }
+
+    Logger_Async *async = log->async;
+
+    if (async != nullptr) {
+        pthread_mutex_lock(&async->mutex);
+        async->stop = true;
+        pthread_cond_signal(&async->work);
+        pthread_mutex_unlock(&async->mutex);
+
+        // The thread writes the records still queued before it exits.
+        pthread_join(async->thread, nullptr);
+        pthread_cond_destroy(&async->work);
+        pthread_mutex_destroy(&async->mutex);
+        free(async->records);
+        free(async);
+    }
+
     free(log);
 }
 
 void logger_callback_log(Logger *log, logger_cb *function, void *context, void *userdata)
 {
+    if (log->async != nullptr) {
+        pthread_mutex_lock(&log->async->mutex);
+    }
+
     log->callback = function;
     log->context  = context;
     log->userdata = userdata;
+
+    if (log->async != nullptr) {
+        pthread_mutex_unlock(&log->async->mutex);
+    }
+}
+
+bool logger_set_level(Logger *log, const char *file, Logger_Level level)
+{
+    if (file == nullptr) {
+        log->level = level;
+        logger_update_min_level(log);
+        return true;
+    }
+
+    file = logger_file_name(file);
+    uint8_t i = 0;
+
+    while (i < log->num_file_levels && strcmp(log->file_levels[i].file, file) != 0) {
+        ++i;
+    }
+
+    if (i == log->num_file_levels) {
+        if (i == LOGGER_MAX_FILE_LEVELS || strlen(file) >= LOGGER_FILE_NAME_SIZE) {
+            return false;
+        }
+
+        strcpy(log->file_levels[i].file, file);
+        ++log->num_file_levels;
+    }
+
+    log->file_levels[i].level = level;
+    logger_update_min_level(log);
+    return true;
+}
+
+bool logger_start_async(Logger *log, uint32_t queue_size)
+{
+    if (log->async != nullptr || queue_size == 0) {
+        return false;
+    }
+
+    Logger_Async *async = (Logger_Async *)calloc(1, sizeof(Logger_Async));
+
+    if (async == nullptr) {
+        return false;
+    }
+
+    async->records = (Logger_Record *)calloc(queue_size, sizeof(Logger_Record));
+    async->size = queue_size;
+
+    if (async->records == nullptr) {
+        free(async);
+        return false;
+    }
+
+    if (pthread_mutex_init(&async->mutex, nullptr) != 0) {
+        free(async->records);
+        free(async);
+        return false;
+    }
+
+    if (pthread_cond_init(&async->work, nullptr) != 0) {
+        pthread_mutex_destroy(&async->mutex);
+        free(async->records);
+        free(async);
+        return false;
+    }
+
+    log->async = async;
+
+    if (pthread_create(&async->thread, nullptr, &logger_async_thread, log) != 0) {
+        log->async = nullptr;
+        pthread_cond_destroy(&async->work);
+        pthread_mutex_destroy(&async->mutex);
+        free(async->records);
+        free(async);
+        return false;
+    }
+
+    return true;
+}
+
+bool logger_enabled(const Logger *log, Logger_Level level, const char *file)
+{
+    if (log == nullptr) {
+        // Written to stderr by logger_write, or an assertion failure.
+        return true;
+    }
+
+    if (log->callback == nullptr || level < log->min_level) {
+        return false;
+    }
+
+    if (log->num_file_levels == 0) {
+        return true;
+    }
+
+    file = logger_file_name(file);
+
+    for (uint8_t i = 0; i < log->num_file_levels; ++i) {
+        if (strcmp(log->file_levels[i].file, file) == 0) {
+            return level >= log->file_levels[i].level;
+        }
+    }
+
+    return level >= log->level;
 }
 
 void logger_write(const Logger *log, Logger_Level level, const char *file, int line, const char *func,
@@ -112,22 +734,19 @@ void logger_write(const Logger *log, Logger_Level level, const char *file, int l
         return;
     }
 
-    // Only pass the file name, not the entire file path, for privacy reasons.
-    // The full path may contain PII of the person compiling toxcore (their
-    // username and directory layout).
-    const char *filename = strrchr(file, '/');
-    file = filename ? filename + 1 : file;
-#if defined(_WIN32) || defined(__CYGWIN__)
-    // On Windows, the path separator *may* be a backslash, so we look for that
-    // one too.
-    const char *windows_filename = strrchr(file, '\\');
-    file = windows_filename ? windows_filename + 1 : file;
-#endif
+    file = logger_file_name(file);
 
-    // Format message
-    char msg[LOGGER_MAX_MSG_LENGTH];
     va_list args;
     va_start(args, format);
+
+    if (log->async != nullptr) {
+        logger_write_async(log, level, file, line, func, format, args);
+        va_end(args);
+        return;
+    }
+
+    // Format message
+    char msg[LOGGER_MAX_MSG_LENGTH];
     vsnprintf(msg, sizeof(msg), format, args);
     va_end(args);
 
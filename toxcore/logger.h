@@ -24,6 +24,7 @@
 #ifndef TOXLOGGER_H
 #define TOXLOGGER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "ccompat.h"
@@ -36,6 +37,14 @@
 #define LOGGER_MAX_MSG_LENGTH (2048) // ORIG 1024
 #endif
 
+#ifndef LOGGER_MAX_FILE_LEVELS
+#define LOGGER_MAX_FILE_LEVELS 16
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef enum Logger_Level {
     LOG_TRACE,
     LOG_DEBUG,
@@ -65,6 +74,39 @@ void logger_kill(Logger *log);
  */
 void logger_callback_log(Logger *log, logger_cb *function, void *context, void *userdata);
 
+/**
+ * Sets the lowest level passed to the callback. If file is not NULL, the level
+ * only applies to messages from the source file with that name (e.g.
+ * "video.c") and takes precedence over the level for all files. By default,
+ * every level allowed by MIN_LOGGER_LEVEL is passed.
+ *
+ * @return true on success, false if LOGGER_MAX_FILE_LEVELS files already have
+ *   a level of their own.
+ */
+bool logger_set_level(Logger *log, const char *file, Logger_Level level);
+
+/**
+ * Formats messages and calls the callback on a background thread instead of
+ * the thread writing the message. Writing then only copies the format string
+ * pointer and the arguments into a queue of queue_size messages. Messages
+ * written while the queue is full are dropped and counted in a warning.
+ *
+ * The callback is called on the background thread, and for messages still
+ * queued in logger_kill. The format strings of messages written must outlive
+ * the logger, which string literals do.
+ *
+ * @return true on success, false if the thread could not be started or the
+ *   logger is already asynchronous.
+ */
+bool logger_start_async(Logger *log, uint32_t queue_size);
+
+/**
+ * Returns whether a message of this level from this source file would be
+ * passed to the callback. LOGGER_WRITE checks this before evaluating the
+ * arguments of the message.
+ */
+bool logger_enabled(const Logger *log, Logger_Level level, const char *file);
+
 /**
  * Main write function. If logging is disabled, this does nothing.
  *
@@ -82,7 +124,7 @@ void logger_write(
 
 #define LOGGER_WRITE(log, level, ...) \
     do { \
-        if (level >= MIN_LOGGER_LEVEL) { \
+        if (level >= MIN_LOGGER_LEVEL && logger_enabled(log, level, __FILE__)) { \
             logger_write(log, level, __FILE__, __LINE__, __func__, __VA_ARGS__); \
         } \
     } while (0)
@@ -94,4 +136,8 @@ void logger_write(
 #define LOGGER_WARNING(log, ...) LOGGER_WRITE(log, LOG_WARNING, __VA_ARGS__)
 #define LOGGER_ERROR(log, ...)   LOGGER_WRITE(log, LOG_ERROR  , __VA_ARGS__)
 
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
 #endif /* TOXLOGGER_H */
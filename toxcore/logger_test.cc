@@ -0,0 +1,131 @@
+#include "logger.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Message {
+  Logger_Level level;
+  std::string file;
+  int line;
+  std::string text;
+
+  bool operator==(const Message &other) const {
+    return level == other.level && file == other.file && line == other.line && text == other.text;
+  }
+};
+
+void collect(void *, Logger_Level level, const char *file, int line, const char *,
+             const char *message, void *userdata) {
+  static_cast<std::vector<Message> *>(userdata)->push_back({level, file, line, message});
+}
+
+void write_messages(const Logger *log) {
+  const char *name = "relay";
+  const char *null_name = nullptr;
+  char unterminated[3] = {'a', 'b', 'c'};
+  int width = 6;
+
+  for (int i = 0; i < 3; ++i) {
+    LOGGER_INFO(log, "plain message %d", i);
+    LOGGER_WARNING(log, "%s:%5u %-4d|%x %lld %zu %.2f %c 100%%", name, 42U, -7, 255U, -1234567890123LL,
+                   static_cast<size_t>(1) << 40, 3.14159, 'q');
+    LOGGER_ERROR(log, "%s %.3s %ld %lu %hu %p", null_name, unterminated, -5L, 6UL, 70000U, nullptr);
+    LOGGER_INFO(log, "star width: [%*d]", width, 12);
+    LOGGER_INFO(log, "long string: %s", std::string(1000, 'x').c_str());
+  }
+}
+
+TEST(Logger, AsyncFormatsLikeSync) {
+  std::vector<Message> sync_messages;
+  Logger *sync_log = logger_new();
+  logger_callback_log(sync_log, collect, nullptr, &sync_messages);
+  write_messages(sync_log);
+  logger_kill(sync_log);
+
+  std::vector<Message> async_messages;
+  Logger *async_log = logger_new();
+  logger_callback_log(async_log, collect, nullptr, &async_messages);
+  ASSERT_TRUE(logger_start_async(async_log, 64));
+  EXPECT_FALSE(logger_start_async(async_log, 64));
+  write_messages(async_log);
+  // Queued messages are written before the logger is freed.
+  logger_kill(async_log);
+
+  ASSERT_EQ(sync_messages.size(), async_messages.size());
+
+  for (size_t i = 0; i < sync_messages.size(); ++i) {
+    // Long strings are cut off when queued.
+    if (sync_messages[i].text.size() > 200) {
+      EXPECT_EQ(sync_messages[i].text.substr(0, 200), async_messages[i].text.substr(0, 200));
+      continue;
+    }
+
+    EXPECT_EQ(sync_messages[i], async_messages[i]) << sync_messages[i].text << " != " << async_messages[i].text;
+  }
+
+  EXPECT_EQ(sync_messages[1].file, "logger_test.cc");
+}
+
+TEST(Logger, ArgumentsOfFilteredMessagesAreNotEvaluated) {
+  std::vector<Message> messages;
+  Logger *log = logger_new();
+  int evaluated = 0;
+
+  LOGGER_ERROR(log, "no callback %d", ++evaluated);
+  EXPECT_EQ(evaluated, 0);
+
+  logger_callback_log(log, collect, nullptr, &messages);
+  ASSERT_TRUE(logger_set_level(log, nullptr, LOG_ERROR));
+
+  LOGGER_WARNING(log, "below the level %d", ++evaluated);
+  EXPECT_EQ(evaluated, 0);
+  LOGGER_ERROR(log, "at the level %d", ++evaluated);
+  EXPECT_EQ(evaluated, 1);
+  ASSERT_EQ(messages.size(), 1);
+  EXPECT_EQ(messages[0].text, "at the level 1");
+
+  logger_kill(log);
+}
+
+TEST(Logger, FileLevelOverridesLevel) {
+  std::vector<Message> messages;
+  Logger *log = logger_new();
+  logger_callback_log(log, collect, nullptr, &messages);
+
+  ASSERT_TRUE(logger_set_level(log, nullptr, LOG_ERROR));
+  ASSERT_TRUE(logger_set_level(log, "other.c", LOG_INFO));
+  LOGGER_WARNING(log, "filtered");
+  EXPECT_TRUE(messages.empty());
+
+  ASSERT_TRUE(logger_set_level(log, "toxcore/logger_test.cc", LOG_WARNING));
+  LOGGER_INFO(log, "filtered");
+  LOGGER_WARNING(log, "passed");
+  ASSERT_EQ(messages.size(), 1);
+  EXPECT_EQ(messages[0].text, "passed");
+
+  EXPECT_TRUE(logger_enabled(log, LOG_WARNING, "/src/toxcore/logger_test.cc"));
+  EXPECT_TRUE(logger_enabled(log, LOG_INFO, "other.c"));
+  EXPECT_FALSE(logger_enabled(log, LOG_WARNING, "util.c"));
+
+  logger_kill(log);
+}
+
+TEST(Logger, FileLevelsAreLimited) {
+  Logger *log = logger_new();
+
+  for (int i = 0; i < LOGGER_MAX_FILE_LEVELS; ++i) {
+    EXPECT_TRUE(logger_set_level(log, ("file" + std::to_string(i) + ".c").c_str(), LOG_TRACE));
+  }
+
+  EXPECT_FALSE(logger_set_level(log, "one_more.c", LOG_TRACE));
+  // Files with a level can still change it.
+  EXPECT_TRUE(logger_set_level(log, "file0.c", LOG_ERROR));
+
+  logger_kill(log);
+}
+
+}  // namespace
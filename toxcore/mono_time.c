@@ -26,71 +26,65 @@
 
 /* don't call into system billions of times for no reason */
 struct Mono_Time {
+    /* Unix time in seconds and monotonic time in milliseconds at the last update. */
     uint64_t time;
+    uint64_t cur_time;
     uint64_t base_time;
+
+    mono_time_current_time_cb *current_time_callback;
+    void *user_data;
 };
 
 Mono_Time *mono_time_new(void)
 {
-    Mono_Time *monotime = (Mono_Time *)malloc(sizeof(Mono_Time));
+    Mono_Time *mono_time = (Mono_Time *)calloc(1, sizeof(Mono_Time));
 
-    if (monotime == nullptr) {
+    if (mono_time == nullptr) {
         return nullptr;
     }
 
-    monotime->time = 0;
-    monotime->base_time = 0;
+    mono_time_update(mono_time);
 
-    return monotime;
+    return mono_time;
 }
 
-void mono_time_free(Mono_Time *monotime)
+void mono_time_free(Mono_Time *mono_time)
 {
-    free(monotime);
+    free(mono_time);
 }
 
-void mono_time_update(Mono_Time *monotime)
+void mono_time_update(Mono_Time *mono_time)
 {
-    if (monotime->base_time == 0) {
-        monotime->base_time = ((uint64_t)time(nullptr) - (current_time_monotonic() / 1000ULL));
+    mono_time->cur_time = current_time_monotonic(mono_time);
+
+    if (mono_time->base_time == 0) {
+        mono_time->base_time = ((uint64_t)time(nullptr) - (mono_time->cur_time / 1000ULL));
     }
 
-    monotime->time = (current_time_monotonic() / 1000ULL) + monotime->base_time;
+    mono_time->time = (mono_time->cur_time / 1000ULL) + mono_time->base_time;
 }
 
-uint64_t mono_time_get(const Mono_Time *monotime)
+uint64_t mono_time_get(const Mono_Time *mono_time)
 {
-    return monotime->time;
+    return mono_time->time;
 }
 
-bool mono_time_is_timeout(const Mono_Time *monotime, uint64_t timestamp, uint64_t timeout)
+uint64_t mono_time_get_ms(const Mono_Time *mono_time)
 {
-    return timestamp + timeout <= mono_time_get(monotime);
+    return mono_time->cur_time;
 }
 
-
-//!TOKSTYLE-
-// No global mutable state in Tokstyle.
-static Mono_Time global_time;
-//!TOKSTYLE+
-
-/* XXX: note that this is not thread-safe; if multiple threads call unix_time_update() concurrently, the return value of
- * unix_time() may fail to increase monotonically with increasing time */
-void unix_time_update(void)
+bool mono_time_is_timeout(const Mono_Time *mono_time, uint64_t timestamp, uint64_t timeout)
 {
-    mono_time_update(&global_time);
+    return timestamp + timeout <= mono_time_get(mono_time);
 }
-uint64_t unix_time(void)
-{
-    return mono_time_get(&global_time);
-}
-int is_timeout(uint64_t timestamp, uint64_t timeout)
+
+void mono_time_set_current_time_callback(Mono_Time *mono_time, mono_time_current_time_cb *callback, void *user_data)
 {
-    return mono_time_is_timeout(&global_time, timestamp, timeout);
+    mono_time->current_time_callback = callback;
+    mono_time->user_data = user_data;
 }
 
-
-
 /* return current UNIX time in microseconds (us). */
 uint64_t current_time_actual(void)
 {
@@ -122,8 +116,12 @@ static uint64_t add_monotime;
 //!TOKSTYLE+
 
 /* return current monotonic time in milliseconds (ms). */
-uint64_t current_time_monotonic(void)
+uint64_t current_time_monotonic(const Mono_Time *mono_time)
 {
+    if (mono_time->current_time_callback != nullptr) {
+        return mono_time->current_time_callback(mono_time->user_data);
+    }
+
     uint64_t time;
 #ifdef OS_WIN32
     uint64_t old_add_monotime = add_monotime;
@@ -8,25 +8,46 @@
 extern "C" {
 #endif
 
+/* A clock owned by each instance. It caches the time at its last update, so that the
+ * many timestamps taken in one iteration cost no system calls and agree with each other.
+ * The owner updates it once per iteration. It is not thread-safe: a thread that needs the
+ * time must use its own Mono_Time.
+ */
+#ifndef MONO_TIME_DEFINED
+#define MONO_TIME_DEFINED
 typedef struct Mono_Time Mono_Time;
+#endif /* MONO_TIME_DEFINED */
 
 Mono_Time *mono_time_new(void);
-void mono_time_free(Mono_Time *monotime);
+void mono_time_free(Mono_Time *mono_time);
 
-void mono_time_update(Mono_Time *monotime);
-uint64_t mono_time_get(const Mono_Time *monotime);
-bool mono_time_is_timeout(const Mono_Time *monotime, uint64_t timestamp, uint64_t timeout);
+/* Read the clock of mono_time and cache the time. */
+void mono_time_update(Mono_Time *mono_time);
 
-// TODO(#405): Use per-tox monotime, delete these functions.
-void unix_time_update(void);
-uint64_t unix_time(void);
-int is_timeout(uint64_t timestamp, uint64_t timeout);
+/* return the UNIX time in seconds at the last update. */
+uint64_t mono_time_get(const Mono_Time *mono_time);
+
+/* return the monotonic time in milliseconds (ms) at the last update. */
+uint64_t mono_time_get_ms(const Mono_Time *mono_time);
+
+/* return true if timeout seconds have passed since timestamp at the last update. */
+bool mono_time_is_timeout(const Mono_Time *mono_time, uint64_t timestamp, uint64_t timeout);
 
 /* return current UNIX time in microseconds (us). */
 uint64_t current_time_actual(void);
 
-/* return current monotonic time in milliseconds (ms). */
-uint64_t current_time_monotonic(void);
+/* return current monotonic time in milliseconds (ms) of the clock of mono_time, without
+ * updating it. Only use this where the time at the last update is not precise enough.
+ */
+uint64_t current_time_monotonic(const Mono_Time *mono_time);
+
+typedef uint64_t mono_time_current_time_cb(void *user_data);
+
+/* Make mono_time read the milliseconds returned by callback instead of the system clock,
+ * e.g. to run instances on a simulated clock. The time must not go backwards. Pass NULL to
+ * go back to the system clock.
+ */
+void mono_time_set_current_time_callback(Mono_Time *mono_time, mono_time_current_time_cb *callback, void *user_data);
 
 #ifdef __cplusplus
 }
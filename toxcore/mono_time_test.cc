@@ -4,27 +4,76 @@
 
 namespace {
 
-TEST(Util, UnixTimeIncreasesOverTime) {
-  unix_time_update();
-  uint64_t const start = unix_time();
+TEST(MonoTime, UnixTimeIncreasesOverTime) {
+  Mono_Time *mono_time = mono_time_new();
 
-  while (start == unix_time()) {
-    unix_time_update();
+  mono_time_update(mono_time);
+  uint64_t const start = mono_time_get(mono_time);
+
+  while (start == mono_time_get(mono_time)) {
+    mono_time_update(mono_time);
   }
 
-  uint64_t const end = unix_time();
+  uint64_t const end = mono_time_get(mono_time);
   EXPECT_GT(end, start);
+
+  mono_time_free(mono_time);
 }
 
-TEST(Util, IsTimeout) {
-  uint64_t const start = unix_time();
-  EXPECT_FALSE(is_timeout(start, 1));
+TEST(MonoTime, IsTimeout) {
+  Mono_Time *mono_time = mono_time_new();
+
+  uint64_t const start = mono_time_get(mono_time);
+  EXPECT_FALSE(mono_time_is_timeout(mono_time, start, 1));
 
-  while (start == unix_time()) {
-    unix_time_update();
+  while (start == mono_time_get(mono_time)) {
+    mono_time_update(mono_time);
   }
 
-  EXPECT_TRUE(is_timeout(start, 1));
+  EXPECT_TRUE(mono_time_is_timeout(mono_time, start, 1));
+
+  mono_time_free(mono_time);
+}
+
+uint64_t test_current_time(void *user_data) { return *static_cast<uint64_t *>(user_data); }
+
+TEST(MonoTime, CustomTime) {
+  Mono_Time *mono_time = mono_time_new();
+
+  uint64_t test_time = current_time_monotonic(mono_time) + 42137;
+
+  mono_time_set_current_time_callback(mono_time, test_current_time, &test_time);
+  mono_time_update(mono_time);
+
+  EXPECT_EQ(current_time_monotonic(mono_time), test_time);
+  EXPECT_EQ(mono_time_get_ms(mono_time), test_time);
+
+  uint64_t const start = mono_time_get(mono_time);
+
+  test_time += 7000;
+
+  // The cached time only moves on update.
+  EXPECT_EQ(mono_time_get(mono_time), start);
+  mono_time_update(mono_time);
+  EXPECT_EQ(mono_time_get(mono_time) - start, 7);
+
+  mono_time_free(mono_time);
+}
+
+TEST(MonoTime, InstancesHaveTheirOwnClock) {
+  Mono_Time *mono_time1 = mono_time_new();
+  Mono_Time *mono_time2 = mono_time_new();
+
+  uint64_t test_time = 1000;
+  mono_time_set_current_time_callback(mono_time1, test_current_time, &test_time);
+  mono_time_update(mono_time1);
+  mono_time_update(mono_time2);
+
+  EXPECT_EQ(mono_time_get_ms(mono_time1), 1000);
+  EXPECT_NE(mono_time_get_ms(mono_time2), 1000);
+
+  mono_time_free(mono_time2);
+  mono_time_free(mono_time1);
 }
 
 }  // namespace
@@ -33,7 +33,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "hash_map.h"
 #include "mono_time.h"
+#include "sack.h"
 #include "util.h"
 
 typedef struct Packet_Data {
@@ -111,15 +113,32 @@ typedef struct Crypto_Connection {
     uint64_t last_packets_left_requested_set;
     double last_packets_left_requested_rem;
 
-    uint32_t last_sendqueue_size[CONGESTION_QUEUE_ARRAY_SIZE];
-    uint32_t last_sendqueue_counter;
-    long signed int last_num_packets_sent[CONGESTION_LAST_SENT_ARRAY_SIZE];
-    long signed int last_num_packets_resent[CONGESTION_LAST_SENT_ARRAY_SIZE];
+    /* Earliest time in ms the next packet of a paced connection may be sent. */
+    double pacing_next_send;
+
+    Congestion_Control *congestion;
     uint32_t packets_sent;
     uint32_t packets_resent;
-    uint64_t last_congestion_event;
     uint64_t rtt_time;
 
+    /* Packets above recv_array.buffer_start we already received. */
+    Sack_Ranges recv_ranges;
+    /* Packets above send_array.buffer_start the peer acknowledged in a SACK packet. */
+    Sack_Ranges sacked;
+    /* Packets a SACK packet reported lost that wait to be sent again. */
+    Sack_Ranges lost;
+    /* A packet may wait to be sent without being in lost, because its first send failed or it was
+     * requested by a request packet. send_requested_packets() then walks the whole array once. */
+    bool resend_walk;
+    /* Holes before this packet number were already checked for lost packets. */
+    uint32_t sack_checked_end;
+    /* Time in ms from which all holes are checked again. */
+    uint64_t sack_recheck_time;
+    uint8_t peer_capabilities;
+    /* The peer knows our capabilities once it sent us a SACK packet. */
+    bool sack_received;
+    uint8_t capability_announcements;
+
     /* TCP_connection connection_number */
     unsigned int connection_number_tcp;
 
@@ -134,6 +153,7 @@ typedef struct Crypto_Connection {
 
 struct Net_Crypto {
     const Logger *log;
+    const Mono_Time *mono_time;
 
     DHT *dht;
     TCP_Connections *tcp_c;
@@ -159,7 +179,10 @@ struct Net_Crypto {
     /* The current optimal sleep time */
     uint32_t current_sleep_time;
 
-    BS_List ip_port_list;
+    /* The congestion control algorithm of new connections. */
+    Congestion_Control_Type congestion_control_type;
+
+    Hash_Map ip_port_map;
 };
 
 const uint8_t *nc_get_self_public_key(const Net_Crypto *c)
@@ -248,10 +271,11 @@ static int create_cookie_request(const Net_Crypto *c, uint8_t *packet, uint8_t *
  * return -1 on failure.
  * return 0 on success.
  */
-static int create_cookie(const Logger *log, uint8_t *cookie, const uint8_t *bytes, const uint8_t *encryption_key)
+static int create_cookie(const Logger *log, const Mono_Time *mono_time, uint8_t *cookie, const uint8_t *bytes,
+                         const uint8_t *encryption_key)
 {
     uint8_t contents[COOKIE_CONTENTS_LENGTH];
-    const uint64_t temp_time = unix_time();
+    const uint64_t temp_time = mono_time_get(mono_time);
     memcpy(contents, &temp_time, sizeof(temp_time));
     memcpy(contents + sizeof(temp_time), bytes, COOKIE_DATA_LENGTH);
     random_nonce(cookie);
@@ -269,7 +293,8 @@ static int create_cookie(const Logger *log, uint8_t *cookie, const uint8_t *byte
  * return -1 on failure.
  * return 0 on success.
  */
-static int open_cookie(const Logger *log, uint8_t *bytes, const uint8_t *cookie, const uint8_t *encryption_key)
+static int open_cookie(const Logger *log, const Mono_Time *mono_time, uint8_t *bytes, const uint8_t *cookie,
+                       const uint8_t *encryption_key)
 {
     uint8_t contents[COOKIE_CONTENTS_LENGTH];
     const int len = decrypt_data_symmetric(encryption_key, cookie, cookie + CRYPTO_NONCE_SIZE,
@@ -281,7 +306,7 @@ static int open_cookie(const Logger *log, uint8_t *bytes, const uint8_t *cookie,
 
     uint64_t cookie_time;
     memcpy(&cookie_time, contents, sizeof(cookie_time));
-    const uint64_t temp_time = unix_time();
+    const uint64_t temp_time = mono_time_get(mono_time);
 
     if (cookie_time + COOKIE_TIMEOUT < temp_time || temp_time < cookie_time) {
         return -1;
@@ -307,7 +332,7 @@ static int create_cookie_response(const Net_Crypto *c, uint8_t *packet, const ui
     memcpy(cookie_plain + CRYPTO_PUBLIC_KEY_SIZE, dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
     uint8_t plain[COOKIE_LENGTH + sizeof(uint64_t)];
 
-    if (create_cookie(c->log, plain, cookie_plain, c->secret_symmetric_key) != 0) {
+    if (create_cookie(c->log, c->mono_time, plain, cookie_plain, c->secret_symmetric_key) != 0) {
         return -1;
     }
 
@@ -395,7 +420,7 @@ static int tcp_handle_cookie_request(Net_Crypto *c, int connections_number, cons
         return -1;
     }
 
-    int ret = send_packet_tcp_connection(c->tcp_c, connections_number, data, sizeof(data));
+    int ret = send_packet_tcp_connection(c->tcp_c, connections_number, data, sizeof(data), false);
     return ret;
 }
 
@@ -475,8 +500,8 @@ static int create_crypto_handshake(const Net_Crypto *c, uint8_t *packet, const u
     memcpy(cookie_plain, peer_real_pk, CRYPTO_PUBLIC_KEY_SIZE);
     memcpy(cookie_plain + CRYPTO_PUBLIC_KEY_SIZE, peer_dht_pubkey, CRYPTO_PUBLIC_KEY_SIZE);
 
-    if (create_cookie(c->log, plain + CRYPTO_NONCE_SIZE + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_SHA512_SIZE, cookie_plain,
-                      c->secret_symmetric_key) != 0) {
+    if (create_cookie(c->log, c->mono_time, plain + CRYPTO_NONCE_SIZE + CRYPTO_PUBLIC_KEY_SIZE + CRYPTO_SHA512_SIZE,
+                      cookie_plain, c->secret_symmetric_key) != 0) {
         return -1;
     }
 
@@ -521,7 +546,7 @@ static int handle_crypto_handshake(const Net_Crypto *c, uint8_t *nonce, uint8_t
 
     uint8_t cookie_plain[COOKIE_DATA_LENGTH];
 
-    if (open_cookie(c->log, cookie_plain, packet + 1, c->secret_symmetric_key) != 0) {
+    if (open_cookie(c->log, c->mono_time, cookie_plain, packet + 1, c->secret_symmetric_key) != 0) {
         return -1;
     }
 
@@ -567,6 +592,39 @@ static Crypto_Connection *get_crypto_connection(const Net_Crypto *c, int crypt_c
 }
 
 
+#define IP_PORT_KEY_SIZE 24
+
+/* Make the key of ip_port in ip_port_map from the bytes of its family, port
+ * and IP that tell it apart, so that padding and unused address bytes don't
+ * matter.
+ */
+static void ip_port_key(uint8_t *key, const IP_Port *ip_port)
+{
+    memset(key, 0, IP_PORT_KEY_SIZE);
+    key[0] = ip_port->ip.family.value;
+    memcpy(key + 2, &ip_port->port, sizeof(ip_port->port));
+
+    if (net_family_is_ipv4(ip_port->ip.family)) {
+        memcpy(key + 8, ip_port->ip.ip.v4.uint8, sizeof(IP4));
+    } else {
+        memcpy(key + 8, ip_port->ip.ip.v6.uint8, sizeof(IP6));
+    }
+}
+
+static bool ip_port_map_add(Hash_Map *map, const IP_Port *ip_port, int crypt_connection_id)
+{
+    uint8_t key[IP_PORT_KEY_SIZE];
+    ip_port_key(key, ip_port);
+    return hash_map_add(map, key, crypt_connection_id);
+}
+
+static void ip_port_map_remove(Hash_Map *map, const IP_Port *ip_port, int crypt_connection_id)
+{
+    uint8_t key[IP_PORT_KEY_SIZE];
+    ip_port_key(key, ip_port);
+    hash_map_remove(map, key, crypt_connection_id);
+}
+
 /* Associate an ip_port to a connection.
  *
  * return -1 on failure.
@@ -582,21 +640,21 @@ static int add_ip_port_connection(Net_Crypto *c, int crypt_connection_id, IP_Por
 
     if (net_family_is_ipv4(ip_port.ip.family)) {
         if (!ipport_equal(&ip_port, &conn->ip_portv4) && ip_is_lan(conn->ip_portv4.ip) != 0) {
-            if (!bs_list_add(&c->ip_port_list, (uint8_t *)&ip_port, crypt_connection_id)) {
+            if (!ip_port_map_add(&c->ip_port_map, &ip_port, crypt_connection_id)) {
                 return -1;
             }
 
-            bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv4, crypt_connection_id);
+            ip_port_map_remove(&c->ip_port_map, &conn->ip_portv4, crypt_connection_id);
             conn->ip_portv4 = ip_port;
             return 0;
         }
     } else if (net_family_is_ipv6(ip_port.ip.family)) {
         if (!ipport_equal(&ip_port, &conn->ip_portv6)) {
-            if (!bs_list_add(&c->ip_port_list, (uint8_t *)&ip_port, crypt_connection_id)) {
+            if (!ip_port_map_add(&c->ip_port_map, &ip_port, crypt_connection_id)) {
                 return -1;
             }
 
-            bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv6, crypt_connection_id);
+            ip_port_map_remove(&c->ip_port_map, &conn->ip_portv6, crypt_connection_id);
             conn->ip_portv6 = ip_port;
             return 0;
         }
@@ -620,7 +678,7 @@ static IP_Port return_ip_port_connection(Net_Crypto *c, int crypt_connection_id)
         return empty;
     }
 
-    uint64_t current_time = unix_time();
+    uint64_t current_time = mono_time_get(c->mono_time);
     bool v6 = 0, v4 = 0;
 
     if ((UDP_DIRECT_TIMEOUT + conn->direct_lastrecv_timev4) > current_time) {
@@ -646,12 +704,13 @@ static IP_Port return_ip_port_connection(Net_Crypto *c, int crypt_connection_id)
     return empty;
 }
 
-/* Sends a packet to the peer using the fastest route.
+/* Sends a packet to the peer using the fastest route. Lossy packets are the
+ * first to be dropped on congested TCP relays.
  *
  * return -1 on failure.
  * return 0 on success.
  */
-static int send_packet_to(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length)
+static int send_packet_to(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length, bool lossy)
 {
 // TODO(irungentoo): TCP, etc...
     Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
@@ -681,26 +740,26 @@ static int send_packet_to(Net_Crypto *c, int crypt_connection_id, const uint8_t
         }
 
         // TODO(irungentoo): a better way of sending packets directly to confirm the others ip.
-        uint64_t current_time = unix_time();
+        uint64_t current_time = mono_time_get(c->mono_time);
 
         if ((((UDP_DIRECT_TIMEOUT / 2) + conn->direct_send_attempt_time) > current_time && length < 96)
                 || data[0] == NET_PACKET_COOKIE_REQUEST || data[0] == NET_PACKET_CRYPTO_HS) {
             if ((uint32_t)sendpacket(dht_get_net(c->dht), ip_port, data, length) == length) {
                 direct_send_attempt = 1;
-                conn->direct_send_attempt_time = unix_time();
+                conn->direct_send_attempt_time = mono_time_get(c->mono_time);
             }
         }
     }
 
     pthread_mutex_unlock(&conn->mutex);
     pthread_mutex_lock(&c->tcp_mutex);
-    int ret = send_packet_tcp_connection(c->tcp_c, conn->connection_number_tcp, data, length);
+    int ret = send_packet_tcp_connection(c->tcp_c, conn->connection_number_tcp, data, length, lossy);
     pthread_mutex_unlock(&c->tcp_mutex);
 
     pthread_mutex_lock(&conn->mutex);
 
     if (ret == 0) {
-        conn->last_tcp_sent = current_time_monotonic();
+        conn->last_tcp_sent = mono_time_get_ms(c->mono_time);
     }
 
     pthread_mutex_unlock(&conn->mutex);
@@ -806,35 +865,32 @@ static int64_t add_data_end_of_buffer(const Logger *log, Packets_Array *array, c
     return id;
 }
 
-/* Read data from beginning of array.
+/* Take the data at the beginning of array out of it. The caller frees it.
  *
- * return -1 on failure.
- * return packet number on success.
+ * return nullptr if there is no data at the beginning.
  */
-static int64_t read_data_beg_buffer(const Logger *log, Packets_Array *array, Packet_Data *data)
+static Packet_Data *take_data_beg_buffer(Packets_Array *array)
 {
     if (array->buffer_end == array->buffer_start) {
-        return -1;
+        return nullptr;
     }
 
     const uint32_t num = array->buffer_start % CRYPTO_PACKET_BUFFER_SIZE;
+    Packet_Data *data = array->buffer[num];
 
-    if (!array->buffer[num]) {
-        return -1;
+    if (data == nullptr) {
+        return nullptr;
     }
 
-    memcpy(data, array->buffer[num], sizeof(Packet_Data));
-    uint32_t id = array->buffer_start;
     ++array->buffer_start;
-    free(array->buffer[num]);
     array->buffer[num] = nullptr;
-    return id;
+    return data;
 }
 
 /* Delete all packets in array before number (but not number)
  *
  * return -1 on failure.
- * return 0 on success
+ * return number of deleted packets on success
  */
 static int clear_buffer_until(const Logger *log, Packets_Array *array, uint32_t number)
 {
@@ -845,6 +901,7 @@ static int clear_buffer_until(const Logger *log, Packets_Array *array, uint32_t
     }
 
     uint32_t i;
+    int deleted = 0;
 
     for (i = array->buffer_start; i != number; ++i) {
         uint32_t num = i % CRYPTO_PACKET_BUFFER_SIZE;
@@ -852,11 +909,12 @@ static int clear_buffer_until(const Logger *log, Packets_Array *array, uint32_t
         if (array->buffer[num]) {
             free(array->buffer[num]);
             array->buffer[num] = nullptr;
+            ++deleted;
         }
     }
 
     array->buffer_start = i;
-    return 0;
+    return deleted;
 }
 
 static int clear_buffer(Packets_Array *array)
@@ -950,12 +1008,14 @@ static int generate_request_packet(const Logger *log, uint8_t *data, uint16_t le
 
 /* Handle a request data packet.
  * Remove all the packets the other received from the array.
+ * The number of removed packets is added to num_acked.
  *
  * return -1 on failure.
- * return number of requested packets on success.
+ * return number of requested packets that will be sent again on success.
  */
-static int handle_request_packet(const Logger *log, Packets_Array *send_array, const uint8_t *data, uint16_t length,
-                                 uint64_t *latest_send_time, uint64_t rtt_time)
+static int handle_request_packet(const Logger *log, const Mono_Time *mono_time, Packets_Array *send_array,
+                                 const uint8_t *data, uint16_t length, uint64_t *latest_send_time, uint64_t rtt_time,
+                                 uint32_t *num_acked)
 {
     if (length == 0) {
         return -1;
@@ -975,7 +1035,7 @@ static int handle_request_packet(const Logger *log, Packets_Array *send_array, c
     uint32_t n = 1;
     uint32_t requested = 0;
 
-    const uint64_t temp_time = current_time_monotonic();
+    const uint64_t temp_time = mono_time_get_ms(mono_time);
     uint64_t l_sent_time = ~0;
 
     for (uint32_t i = send_array->buffer_start; i != send_array->buffer_end; ++i) {
@@ -991,13 +1051,13 @@ static int handle_request_packet(const Logger *log, Packets_Array *send_array, c
 
                 if ((sent_time + rtt_time) < temp_time) {
                     send_array->buffer[num]->sent_time = 0;
+                    ++requested;
                 }
             }
 
             ++data;
             --length;
             n = 0;
-            ++requested;
         } else {
             if (send_array->buffer[num]) {
                 uint64_t sent_time = send_array->buffer[num]->sent_time;
@@ -1008,6 +1068,7 @@ static int handle_request_packet(const Logger *log, Packets_Array *send_array, c
 
                 free(send_array->buffer[num]);
                 send_array->buffer[num] = nullptr;
+                ++*num_acked;
             }
         }
 
@@ -1032,44 +1093,249 @@ static int handle_request_packet(const Logger *log, Packets_Array *send_array, c
     return requested;
 }
 
-/** END: Array Related functions **/
-
-#define MAX_DATA_DATA_PACKET_SIZE (MAX_CRYPTO_PACKET_SIZE - (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE))
-
-/* Creates and sends a data packet to the peer using the fastest route.
+/* Create a SACK packet reporting the packets in recv_array as the ranges in recv_ranges,
+ * so that unlike generate_request_packet it never has to walk the array.
  *
  * return -1 on failure.
- * return 0 on success.
+ * return length of packet on success.
  */
-static int send_data_packet(Net_Crypto *c, int crypt_connection_id, const uint8_t *data, uint16_t length)
+static int generate_sack_packet(uint8_t *data, uint16_t length, const Packets_Array *recv_array,
+                                Sack_Ranges *recv_ranges)
 {
-    const uint16_t max_length = MAX_CRYPTO_PACKET_SIZE - (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE);
+    if (length < 2) {
+        return -1;
+    }
 
-    if (length == 0 || length > max_length) {
+    data[0] = PACKET_ID_SACK;
+    sack_ranges_trim(recv_ranges, recv_array->buffer_start);
+    const uint16_t len = sack_ranges_encode(recv_ranges, recv_array->buffer_start, recv_array->buffer_end, data + 1,
+                                            length - 1);
+
+    if (len == 0) {
         return -1;
     }
 
-    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+    return 1 + len;
+}
 
-    if (conn == nullptr) {
+/* Mark a packet the peer reported missing for sending again unless it was sent less than
+ * rtt_time ago, and add it to the lost set. A packet that does not fit in the lost set is
+ * left alone until the next check.
+ *
+ * return 1 if the packet will be sent again, 0 otherwise.
+ */
+static uint32_t sack_mark_lost(Packets_Array *send_array, Sack_Ranges *lost, uint32_t number, uint64_t rtt_time,
+                               uint64_t now)
+{
+    Packet_Data *packet = send_array->buffer[number % CRYPTO_PACKET_BUFFER_SIZE];
+
+    if (packet == nullptr || packet->sent_time == 0 || packet->sent_time + rtt_time >= now) {
+        return 0;
+    }
+
+    if (!sack_ranges_add(lost, send_array->buffer_start, number, number + 1)) {
+        return 0;
+    }
+
+    packet->sent_time = 0;
+    return 1;
+}
+
+/* Handle a SACK packet.
+ * Remove the packets the peer received from the array and mark the ones in the holes between
+ * them for sending again. conn->sacked holds the ranges acknowledged by earlier SACK packets,
+ * whose packets are already gone, so that only new ranges are walked.
+ * The number of removed packets is added to num_acked.
+ *
+ * Each hole is checked for lost packets once, when a SACK packet first reports a range after
+ * it. Sent again packets that got lost again are found by checking all holes again, at most
+ * once every rtt_time ms.
+ *
+ * A SACKed packet may have been sent more than once, so unlike the buffer start in the
+ * header its sent time is no RTT sample.
+ *
+ * return -1 on failure.
+ * return number of requested packets that will be sent again on success.
+ */
+static int handle_sack_packet(const Mono_Time *mono_time, Crypto_Connection *conn, const uint8_t *data,
+                              uint16_t length, uint64_t rtt_time, uint32_t *num_acked)
+{
+    if (length == 0 || data[0] != PACKET_ID_SACK) {
         return -1;
     }
 
-    pthread_mutex_lock(&conn->mutex);
-    VLA(uint8_t, packet, 1 + sizeof(uint16_t) + length + CRYPTO_MAC_SIZE);
-    packet[0] = NET_PACKET_CRYPTO_DATA;
-    memcpy(packet + 1, conn->sent_nonce + (CRYPTO_NONCE_SIZE - sizeof(uint16_t)), sizeof(uint16_t));
-    const int len = encrypt_data_symmetric(conn->shared_key, conn->sent_nonce, data, length, packet + 1 + sizeof(uint16_t));
+    Packets_Array *send_array = &conn->send_array;
+    Sack_Ranges *sacked = &conn->sacked;
+    const uint32_t base = send_array->buffer_start;
+    Sack_Ranges reported;
+    uint32_t end;
 
-    if (len + 1 + sizeof(uint16_t) != SIZEOF_VLA(packet)) {
-        pthread_mutex_unlock(&conn->mutex);
+    if (sack_ranges_decode(&reported, &end, base, num_packets_array(send_array), data + 1, length - 1) == -1) {
         return -1;
     }
 
-    increment_nonce(conn->sent_nonce);
+    sack_ranges_trim(sacked, base);
+
+    uint16_t j = 0;
+
+    for (uint16_t i = 0; i < reported.num; ++i) {
+        uint32_t pos = reported.range[i].start - base;
+        const uint32_t range_end = reported.range[i].end - base;
+
+        while (pos < range_end) {
+            while (j < sacked->num && sacked->range[j].end - base <= pos) {
+                ++j;
+            }
+
+            if (j < sacked->num && sacked->range[j].start - base <= pos) {
+                pos = sacked->range[j].end - base;
+                continue;
+            }
+
+            uint32_t stop = range_end;
+
+            if (j < sacked->num && sacked->range[j].start - base < stop) {
+                stop = sacked->range[j].start - base;
+            }
+
+            for (; pos < stop; ++pos) {
+                const uint32_t num = (base + pos) % CRYPTO_PACKET_BUFFER_SIZE;
+
+                if (send_array->buffer[num]) {
+                    free(send_array->buffer[num]);
+                    send_array->buffer[num] = nullptr;
+                    ++*num_acked;
+                }
+            }
+        }
+    }
+
+    for (uint16_t i = 0; i < reported.num; ++i) {
+        sack_ranges_add(sacked, base, reported.range[i].start, reported.range[i].end);
+    }
+
+    /* Holes between the acknowledged ranges are packets the peer is missing. */
+    const uint64_t now = mono_time_get_ms(mono_time);
+    uint32_t requested = 0;
+    uint32_t pos = conn->sack_checked_end - base;
+
+    if (pos > num_packets_array(send_array) || conn->sack_recheck_time <= now) {
+        pos = 0;
+        conn->sack_recheck_time = now + rtt_time;
+    }
+
+    sack_ranges_trim(&conn->lost, base);
+
+    for (uint16_t i = 0; i < sacked->num; ++i) {
+        for (; pos < sacked->range[i].start - base; ++pos) {
+            requested += sack_mark_lost(send_array, &conn->lost, base + pos, rtt_time, now);
+        }
+
+        if (pos < sacked->range[i].end - base) {
+            pos = sacked->range[i].end - base;
+        }
+    }
+
+    /* After the highest range packets are mostly still in flight. They are sent in order, so stop
+     * at the first one sent less than rtt_time ago. A full list may be missing ranges the peer
+     * received after its highest one, so then nothing after it is taken for lost. */
+    if (reported.num < SACK_MAX_RANGES) {
+        for (; pos < end - base; ++pos) {
+            const Packet_Data *packet = send_array->buffer[(base + pos) % CRYPTO_PACKET_BUFFER_SIZE];
+
+            if (packet != nullptr && packet->sent_time != 0 && packet->sent_time + rtt_time >= now) {
+                break;
+            }
+
+            requested += sack_mark_lost(send_array, &conn->lost, base + pos, rtt_time, now);
+        }
+    }
+
+    conn->sack_checked_end = base + pos;
+    return requested;
+}
+
+/** END: Array Related functions **/
+
+#define MAX_DATA_DATA_PACKET_SIZE (MAX_CRYPTO_PACKET_SIZE - (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE))
+
+/* Size of the cleartext header of a data packet: packet id and the last 2 bytes of the nonce. */
+#define DATA_PACKET_HEADER_SIZE (1 + sizeof(uint16_t))
+
+/* Capability flags announced in a PACKET_ID_CAPABILITIES packet. */
+#define CRYPTO_CAPABILITY_SACK 0x01
+
+/* Capabilities are announced with the first request packets until the peer shows it
+ * received them; older peers drop the announcement, so give up eventually. */
+#define CRYPTO_MAX_CAPABILITY_ANNOUNCEMENTS 16
+
+/* Number of data packets send_requested_packets encrypts in one go. */
+#define CRYPTO_SEND_BATCH_SIZE 8
+
+/* Writes the plain text of a data packet with buffer_start and num into packet, leaving room
+ * in front of it for the header and the MAC so that it can be encrypted in place.
+ *
+ * packet must be MAX_CRYPTO_PACKET_SIZE big.
+ *
+ * return 0 on failure.
+ * return length of the plain text on success.
+ */
+static uint16_t create_data_packet_plain(uint8_t *packet, uint32_t buffer_start, uint32_t num, const uint8_t *data,
+        uint16_t length)
+{
+    if (length == 0 || length > MAX_CRYPTO_DATA_SIZE) {
+        return 0;
+    }
+
+    uint8_t *plain = packet + DATA_PACKET_HEADER_SIZE + CRYPTO_MAC_SIZE;
+    num = net_htonl(num);
+    buffer_start = net_htonl(buffer_start);
+    const uint16_t padding_length = (MAX_CRYPTO_DATA_SIZE - length) % CRYPTO_MAX_PADDING;
+    memcpy(plain, &buffer_start, sizeof(uint32_t));
+    memcpy(plain + sizeof(uint32_t), &num, sizeof(uint32_t));
+    memset(plain + (sizeof(uint32_t) * 2), PACKET_ID_PADDING, padding_length);
+    memcpy(plain + (sizeof(uint32_t) * 2) + padding_length, data, length);
+
+    return (sizeof(uint32_t) * 2) + padding_length + length;
+}
+
+/* Encrypts num data packets created with create_data_packet_plain in place, using consecutive
+ * nonces of the connection, and fills in their headers.
+ *
+ * lengths holds the plain text lengths on entry and the full packet lengths on return.
+ *
+ * return number of packets encrypted.
+ */
+static uint32_t encrypt_data_packets(Crypto_Connection *conn, uint8_t packets[][MAX_CRYPTO_PACKET_SIZE],
+                                     uint16_t *lengths, uint32_t num)
+{
+    Crypto_Buffer buffers[CRYPTO_SEND_BATCH_SIZE];
+
+    if (num > CRYPTO_SEND_BATCH_SIZE) {
+        num = CRYPTO_SEND_BATCH_SIZE;
+    }
+
+    for (uint32_t i = 0; i < num; ++i) {
+        buffers[i].data = packets[i] + DATA_PACKET_HEADER_SIZE;
+        buffers[i].length = lengths[i];
+    }
+
+    pthread_mutex_lock(&conn->mutex);
+    uint16_t nonce_num;
+    memcpy(&nonce_num, conn->sent_nonce + (CRYPTO_NONCE_SIZE - sizeof(uint16_t)), sizeof(uint16_t));
+    const uint32_t encrypted = encrypt_data_symmetric_batch(conn->shared_key, conn->sent_nonce, buffers, num);
     pthread_mutex_unlock(&conn->mutex);
 
-    return send_packet_to(c, crypt_connection_id, packet, SIZEOF_VLA(packet));
+    nonce_num = net_ntohs(nonce_num);
+
+    for (uint32_t i = 0; i < encrypted; ++i) {
+        const uint16_t packet_nonce = net_htons((uint16_t)(nonce_num + i));
+        packets[i][0] = NET_PACKET_CRYPTO_DATA;
+        memcpy(packets[i] + 1, &packet_nonce, sizeof(uint16_t));
+        lengths[i] += DATA_PACKET_HEADER_SIZE + CRYPTO_MAC_SIZE;
+    }
+
+    return encrypted;
 }
 
 /* Creates and sends a data packet with buffer_start and num to the peer using the fastest route.
@@ -1080,20 +1346,25 @@ static int send_data_packet(Net_Crypto *c, int crypt_connection_id, const uint8_
 static int send_data_packet_helper(Net_Crypto *c, int crypt_connection_id, uint32_t buffer_start, uint32_t num,
                                    const uint8_t *data, uint16_t length)
 {
-    if (length == 0 || length > MAX_CRYPTO_DATA_SIZE) {
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
         return -1;
     }
 
-    num = net_htonl(num);
-    buffer_start = net_htonl(buffer_start);
-    uint16_t padding_length = (MAX_CRYPTO_DATA_SIZE - length) % CRYPTO_MAX_PADDING;
-    VLA(uint8_t, packet, sizeof(uint32_t) + sizeof(uint32_t) + padding_length + length);
-    memcpy(packet, &buffer_start, sizeof(uint32_t));
-    memcpy(packet + sizeof(uint32_t), &num, sizeof(uint32_t));
-    memset(packet + (sizeof(uint32_t) * 2), PACKET_ID_PADDING, padding_length);
-    memcpy(packet + (sizeof(uint32_t) * 2) + padding_length, data, length);
+    uint8_t packet[1][MAX_CRYPTO_PACKET_SIZE];
+    uint16_t packet_length = create_data_packet_plain(packet[0], buffer_start, num, data, length);
+
+    if (packet_length == 0) {
+        return -1;
+    }
+
+    if (encrypt_data_packets(conn, packet, &packet_length, 1) != 1) {
+        return -1;
+    }
 
-    return send_data_packet(c, crypt_connection_id, packet, SIZEOF_VLA(packet));
+    const bool lossy = length != 0 && data[0] >= PACKET_ID_LOSSY_RANGE_START;
+    return send_packet_to(c, crypt_connection_id, packet[0], packet_length, lossy);
 }
 
 static int reset_max_speed_reached(Net_Crypto *c, int crypt_connection_id)
@@ -1117,7 +1388,7 @@ static int reset_max_speed_reached(Net_Crypto *c, int crypt_connection_id)
                 return -1;
             }
 
-            dt->sent_time = current_time_monotonic();
+            dt->sent_time = mono_time_get_ms(c->mono_time);
         }
 
         conn->maximum_speed_reached = 0;
@@ -1163,6 +1434,7 @@ static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, cons
     }
 
     if (!congestion_control && conn->maximum_speed_reached) {
+        conn->resend_walk = true;
         return packet_num;
     }
 
@@ -1170,10 +1442,11 @@ static int64_t send_lossless_packet(Net_Crypto *c, int crypt_connection_id, cons
         Packet_Data *dt1 = nullptr;
 
         if (get_data_pointer(c->log, &conn->send_array, &dt1, packet_num) == 1) {
-            dt1->sent_time = current_time_monotonic();
+            dt1->sent_time = mono_time_get_ms(c->mono_time);
         }
     } else {
         conn->maximum_speed_reached = 1;
+        conn->resend_walk = true;
         LOGGER_ERROR(c->log, "send_data_packet failed [maximum_speed_reached]");
     }
 
@@ -1199,8 +1472,7 @@ static uint16_t get_nonce_uint16(const uint8_t *nonce)
  * return -1 on failure.
  * return length of data on success.
  */
-static int handle_data_packet(const Net_Crypto *c, int crypt_connection_id, uint8_t *data, const uint8_t *packet,
-                              uint16_t length)
+static int handle_data_packet(Crypto_Connection *conn, uint8_t *data, const uint8_t *packet, uint16_t length)
 {
     const uint16_t crypto_packet_overhead = 1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE;
 
@@ -1208,12 +1480,6 @@ static int handle_data_packet(const Net_Crypto *c, int crypt_connection_id, uint
         return -1;
     }
 
-    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
-
-    if (conn == nullptr) {
-        return -1;
-    }
-
     uint8_t nonce[CRYPTO_NONCE_SIZE];
     memcpy(nonce, conn->recv_nonce, CRYPTO_NONCE_SIZE);
     uint16_t num_cur_nonce = get_nonce_uint16(nonce);
@@ -1235,7 +1501,10 @@ static int handle_data_packet(const Net_Crypto *c, int crypt_connection_id, uint
     return len;
 }
 
-/* Send a request packet.
+/* Send a request packet, or a SACK packet if the peer understands them.
+ *
+ * Until the peer has sent a SACK packet, which shows that it knows we understand them,
+ * our capabilities are announced alongside.
  *
  * return -1 on failure.
  * return 0 on success.
@@ -1248,8 +1517,23 @@ static int send_request_packet(Net_Crypto *c, int crypt_connection_id)
         return -1;
     }
 
+    if (!conn->sack_received && conn->capability_announcements < CRYPTO_MAX_CAPABILITY_ANNOUNCEMENTS) {
+        const uint8_t capabilities[] = {PACKET_ID_CAPABILITIES, CRYPTO_CAPABILITY_SACK};
+
+        if (send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, conn->send_array.buffer_end,
+                                    capabilities, sizeof(capabilities)) == 0) {
+            ++conn->capability_announcements;
+        }
+    }
+
     uint8_t data[MAX_CRYPTO_DATA_SIZE];
-    int len = generate_request_packet(c->log, data, sizeof(data), &conn->recv_array);
+    int len;
+
+    if (conn->peer_capabilities & CRYPTO_CAPABILITY_SACK) {
+        len = generate_sack_packet(data, sizeof(data), &conn->recv_array, &conn->recv_ranges);
+    } else {
+        len = generate_request_packet(c->log, data, sizeof(data), &conn->recv_array);
+    }
 
     if (len == -1) {
         return -1;
@@ -1259,7 +1543,84 @@ static int send_request_packet(Net_Crypto *c, int crypt_connection_id)
                                    len);
 }
 
+/* Encrypts and sends a batch of data packets created with create_data_packet_plain, marking
+ * each one that was sent with sent_time.
+ *
+ * return number of packets sent.
+ */
+static uint32_t send_data_packet_batch(Net_Crypto *c, int crypt_connection_id,
+                                       uint8_t packets[][MAX_CRYPTO_PACKET_SIZE], uint16_t *lengths,
+                                       Packet_Data *const *batch, uint32_t num, uint64_t sent_time)
+{
+    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
+
+    if (conn == nullptr) {
+        return 0;
+    }
+
+    const uint32_t encrypted = encrypt_data_packets(conn, packets, lengths, num);
+    uint32_t num_sent = 0;
+
+    for (uint32_t i = 0; i < encrypted; ++i) {
+        if (send_packet_to(c, crypt_connection_id, packets[i], lengths[i], false) == 0) {
+            batch[i]->sent_time = sent_time;
+            ++num_sent;
+        }
+    }
+
+    if (num_sent != num) {
+        conn->resend_walk = true;
+    }
+
+    return num_sent;
+}
+
+/* Find the next span of packets send_requested_packets() looks at, starting at offset *pos from
+ * base: the next range of the lost set, or with walk_all the next hole between the ranges the peer
+ * acknowledged. *pos is moved to the start of the span and *span_end set to its end.
+ *
+ * return false if there is none.
+ */
+static bool next_requested_span(const Crypto_Connection *conn, bool walk_all, uint32_t base, uint32_t array_size,
+                                uint32_t *pos, uint32_t *span_end)
+{
+    const Sack_Ranges *ranges = walk_all ? &conn->sacked : &conn->lost;
+
+    for (uint16_t i = 0; i < ranges->num; ++i) {
+        const uint32_t start = ranges->range[i].start - base;
+        const uint32_t end = ranges->range[i].end - base;
+
+        if (end <= *pos) {
+            continue;
+        }
+
+        if (!walk_all) {
+            if (*pos < start) {
+                *pos = start;
+            }
+
+            *span_end = end < array_size ? end : array_size;
+            return *pos < *span_end;
+        }
+
+        if (start <= *pos) {
+            *pos = end;
+            continue;
+        }
+
+        *span_end = start < array_size ? start : array_size;
+        return *pos < *span_end;
+    }
+
+    *span_end = array_size;
+    return walk_all && *pos < array_size;
+}
+
 /* Send up to max num previously requested data packets.
+ *
+ * Usually only the packets in the lost set are looked at. After a packet was left out of it, the
+ * whole array is walked once, skipping the ranges the peer acknowledged with SACK packets, whose
+ * packets are gone from the array.
  *
  * return -1 on failure.
  * return number of packets sent on success.
@@ -1276,37 +1637,73 @@ static int send_requested_packets(Net_Crypto *c, int crypt_connection_id, uint32
         return -1;
     }
 
-    const uint64_t temp_time = current_time_monotonic();
-    uint32_t i, num_sent = 0, array_size = num_packets_array(&conn->send_array);
+    const uint64_t temp_time = mono_time_get_ms(c->mono_time);
+    const uint32_t base = conn->send_array.buffer_start;
+    const uint32_t array_size = num_packets_array(&conn->send_array);
+    uint32_t num_sent = 0;
 
-    for (i = 0; i < array_size; ++i) {
-        Packet_Data *dt;
-        const uint32_t packet_num = i + conn->send_array.buffer_start;
-        const int ret = get_data_pointer(c->log, &conn->send_array, &dt, packet_num);
+    /* Packets are collected and encrypted in batches of CRYPTO_SEND_BATCH_SIZE, each one
+     * built directly in its final buffer so the plain text is never copied again. */
+    uint8_t packets[CRYPTO_SEND_BATCH_SIZE][MAX_CRYPTO_PACKET_SIZE];
+    uint16_t lengths[CRYPTO_SEND_BATCH_SIZE];
+    Packet_Data *batch[CRYPTO_SEND_BATCH_SIZE];
+    uint32_t num_batched = 0;
 
-        if (ret == -1) {
-            return -1;
-        }
+    sack_ranges_trim(&conn->sacked, base);
+    sack_ranges_trim(&conn->lost, base);
 
-        if (ret == 0) {
-            continue;
-        }
+    const bool walk_all = conn->resend_walk;
+    conn->resend_walk = false;
+    uint32_t pos = 0;
+    uint32_t span_end;
 
-        if (dt->sent_time) {
-            continue;
-        }
+    while (num_sent + num_batched < max_num && next_requested_span(conn, walk_all, base, array_size, &pos, &span_end)) {
+        for (; pos < span_end && num_sent + num_batched < max_num; ++pos) {
+            Packet_Data *dt;
+            const uint32_t packet_num = base + pos;
+            const int ret = get_data_pointer(c->log, &conn->send_array, &dt, packet_num);
 
-        if (send_data_packet_helper(c, crypt_connection_id, conn->recv_array.buffer_start, packet_num, dt->data,
-                                    dt->length) == 0) {
-            dt->sent_time = temp_time;
-            ++num_sent;
-        }
+            if (ret == -1) {
+                return -1;
+            }
 
-        if (num_sent >= max_num) {
-            break;
+            if (ret == 0) {
+                continue;
+            }
+
+            if (dt->sent_time) {
+                continue;
+            }
+
+            lengths[num_batched] = create_data_packet_plain(packets[num_batched], conn->recv_array.buffer_start,
+                                   packet_num, dt->data, dt->length);
+
+            if (lengths[num_batched] == 0) {
+                continue;
+            }
+
+            batch[num_batched] = dt;
+            ++num_batched;
+
+            if (num_batched == CRYPTO_SEND_BATCH_SIZE) {
+                num_sent += send_data_packet_batch(c, crypt_connection_id, packets, lengths, batch, num_batched,
+                                                   temp_time);
+                num_batched = 0;
+            }
         }
     }
 
+    if (num_batched != 0) {
+        num_sent += send_data_packet_batch(c, crypt_connection_id, packets, lengths, batch, num_batched, temp_time);
+    }
+
+    if (walk_all && pos < array_size) {
+        /* Stopped early, go on with the walk next time. */
+        conn->resend_walk = true;
+    }
+
+    /* The lost packets looked at were sent, or their sending failed and set resend_walk. */
+    sack_ranges_trim(&conn->lost, base + pos);
     return num_sent;
 }
 
@@ -1388,11 +1785,11 @@ static int send_temp_packet(Net_Crypto *c, int crypt_connection_id)
         return -1;
     }
 
-    if (send_packet_to(c, crypt_connection_id, conn->temp_packet, conn->temp_packet_length) != 0) {
+    if (send_packet_to(c, crypt_connection_id, conn->temp_packet, conn->temp_packet_length, false) != 0) {
         return -1;
     }
 
-    conn->temp_packet_sent_time = current_time_monotonic();
+    conn->temp_packet_sent_time = mono_time_get_ms(c->mono_time);
     ++conn->temp_packet_num_sent;
     return 0;
 }
@@ -1466,21 +1863,15 @@ static void connection_kill(Net_Crypto *c, int crypt_connection_id, void *userda
  * return -1 on failure.
  * return 0 on success.
  */
-static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const uint8_t *packet, uint16_t length,
-                                   bool udp, void *userdata)
+static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, Crypto_Connection *conn,
+                                   const uint8_t *packet, uint16_t length, bool udp, void *userdata)
 {
     if (length > MAX_CRYPTO_PACKET_SIZE || length <= CRYPTO_DATA_PACKET_MIN_SIZE) {
         return -1;
     }
 
-    Crypto_Connection *conn = get_crypto_connection(c, crypt_connection_id);
-
-    if (conn == nullptr) {
-        return -1;
-    }
-
     uint8_t data[MAX_DATA_DATA_PACKET_SIZE];
-    int len = handle_data_packet(c, crypt_connection_id, data, packet, length);
+    int len = handle_data_packet(conn, data, packet, length);
 
     if (len <= (int)(sizeof(uint32_t) * 2)) {
         return -1;
@@ -1501,9 +1892,13 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
             rtt_calc_time = packet_time->sent_time;
         }
 
-        if (clear_buffer_until(c->log, &conn->send_array, buffer_start) != 0) {
+        const int num_acked = clear_buffer_until(c->log, &conn->send_array, buffer_start);
+
+        if (num_acked == -1) {
             return -1;
         }
+
+        congestion_control_on_ack(conn->congestion, mono_time_get_ms(c->mono_time), num_acked);
     }
 
     uint8_t *real_data = data + (sizeof(uint32_t) * 2);
@@ -1542,36 +1937,106 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
             rtt_time = DEFAULT_TCP_PING_CONNECTION;
         }
 
-        int requested = handle_request_packet(c->log, &conn->send_array, real_data, real_length, &rtt_calc_time, rtt_time);
+        uint32_t num_acked = 0;
+        int requested = handle_request_packet(c->log, c->mono_time, &conn->send_array, real_data, real_length,
+                                              &rtt_calc_time, rtt_time, &num_acked);
 
         if (requested == -1) {
             return -1;
         }
 
+        if (requested > 0) {
+            conn->resend_walk = true;
+        }
+
+        const uint64_t now = mono_time_get_ms(c->mono_time);
+        congestion_control_on_ack(conn->congestion, now, num_acked);
+        congestion_control_on_loss(conn->congestion, now, requested);
+
         set_buffer_end(c->log, &conn->recv_array, num);
-    } else if (real_data[0] >= CRYPTO_RESERVED_PACKETS && real_data[0] < PACKET_ID_LOSSY_RANGE_START) {
-        Packet_Data dt = {0};
-        dt.length = real_length;
-        memcpy(dt.data, real_data, real_length);
+    } else if (real_data[0] == PACKET_ID_SACK) {
+        const uint64_t rtt_time = udp ? conn->rtt_time : DEFAULT_TCP_PING_CONNECTION;
+        uint32_t num_acked = 0;
+        const int requested = handle_sack_packet(c->mono_time, conn, real_data, real_length, rtt_time, &num_acked);
 
-        if (add_data_to_buffer(c->log, &conn->recv_array, num, &dt) != 0) {
+        if (requested == -1) {
             return -1;
         }
 
+        conn->peer_capabilities |= CRYPTO_CAPABILITY_SACK;
+        conn->sack_received = true;
+
+        const uint64_t now = mono_time_get_ms(c->mono_time);
+        congestion_control_on_ack(conn->congestion, now, num_acked);
+        congestion_control_on_loss(conn->congestion, now, requested);
+
+        set_buffer_end(c->log, &conn->recv_array, num);
+    } else if (real_data[0] == PACKET_ID_CAPABILITIES) {
+        if (real_length < 2) {
+            return -1;
+        }
+
+        conn->peer_capabilities = real_data[1];
+        set_buffer_end(c->log, &conn->recv_array, num);
+    } else if (real_data[0] >= CRYPTO_RESERVED_PACKETS && real_data[0] < PACKET_ID_LOSSY_RANGE_START) {
+        if (num == conn->recv_array.buffer_start
+                && conn->recv_array.buffer[num % CRYPTO_PACKET_BUFFER_SIZE] == nullptr) {
+            /* The packet is the next one in order, so it is passed on without
+             * going through the receive buffer. */
+            sack_ranges_trim(&conn->recv_ranges, num);
+            sack_ranges_add(&conn->recv_ranges, num, num, num + 1);
+
+            pthread_mutex_lock(&conn->mutex);
+
+            if (conn->recv_array.buffer_end == num) {
+                conn->recv_array.buffer_end = num + 1;
+            }
+
+            ++conn->recv_array.buffer_start;
+            pthread_mutex_unlock(&conn->mutex);
+
+            if (conn->connection_data_callback) {
+                conn->connection_data_callback(conn->connection_data_callback_object, conn->connection_data_callback_id,
+                                               real_data, real_length, userdata);
+            }
+
+            /* conn might get killed in callback. */
+            conn = get_crypto_connection(c, crypt_connection_id);
+
+            if (conn == nullptr) {
+                return -1;
+            }
+        } else {
+            /* Only the used part of the packet is initialized. */
+            Packet_Data dt;
+            dt.sent_time = 0;
+            dt.length = real_length;
+            memcpy(dt.data, real_data, real_length);
+
+            if (add_data_to_buffer(c->log, &conn->recv_array, num, &dt) != 0) {
+                return -1;
+            }
+
+            sack_ranges_trim(&conn->recv_ranges, conn->recv_array.buffer_start);
+            sack_ranges_add(&conn->recv_ranges, conn->recv_array.buffer_start, num, num + 1);
+        }
+
         while (1) {
             pthread_mutex_lock(&conn->mutex);
-            int ret = read_data_beg_buffer(c->log, &conn->recv_array, &dt);
+            Packet_Data *dt = take_data_beg_buffer(&conn->recv_array);
             pthread_mutex_unlock(&conn->mutex);
 
-            if (ret == -1) {
+            if (dt == nullptr) {
                 break;
             }
 
             if (conn->connection_data_callback) {
-                conn->connection_data_callback(conn->connection_data_callback_object, conn->connection_data_callback_id, dt.data,
-                                               dt.length, userdata);
+                conn->connection_data_callback(conn->connection_data_callback_object, conn->connection_data_callback_id, dt->data,
+                                               dt->length, userdata);
             }
 
+            free(dt);
+
             /* conn might get killed in callback. */
             conn = get_crypto_connection(c, crypt_connection_id);
 
@@ -1596,7 +2061,7 @@ static int handle_data_packet_core(Net_Crypto *c, int crypt_connection_id, const
     }
 
     if (rtt_calc_time != 0) {
-        uint64_t rtt_time = current_time_monotonic() - rtt_calc_time;
+        uint64_t rtt_time = mono_time_get_ms(c->mono_time) - rtt_calc_time;
 
         if (rtt_time < conn->rtt_time) {
             conn->rtt_time = rtt_time;
@@ -1689,7 +2154,7 @@ static int handle_packet_connection(Net_Crypto *c, int crypt_connection_id, cons
                 return -1;
             }
 
-            return handle_data_packet_core(c, crypt_connection_id, packet, length, udp, userdata);
+            return handle_data_packet_core(c, crypt_connection_id, conn, packet, length, udp, userdata);
         }
 
         default: {
@@ -1782,6 +2247,8 @@ static int wipe_crypto_connection(Net_Crypto *c, int crypt_connection_id)
 
     uint32_t i;
 
+    congestion_control_kill(c->crypto_connections[crypt_connection_id].congestion);
+
     /* Keep mutex, only destroy it when connection is realloced out. */
     pthread_mutex_t mutex = c->crypto_connections[crypt_connection_id].mutex;
     crypto_memzero(&c->crypto_connections[crypt_connection_id], sizeof(Crypto_Connection));
@@ -1842,9 +2309,9 @@ static int crypto_connection_add_source(Net_Crypto *c, int crypt_connection_id,
         }
 
         if (net_family_is_ipv4(source.ip.family)) {
-            conn->direct_lastrecv_timev4 = unix_time();
+            conn->direct_lastrecv_timev4 = mono_time_get(c->mono_time);
         } else {
-            conn->direct_lastrecv_timev6 = unix_time();
+            conn->direct_lastrecv_timev6 = mono_time_get(c->mono_time);
         }
 
         return 0;
@@ -1941,6 +2408,25 @@ static int handle_new_connection_handshake(Net_Crypto *c, IP_Port source, const
  * return -1 on failure.
  * return connection id on success.
  */
+/* Set up congestion control and the initial send rates of a new connection.
+ *
+ * conn->congestion is NULL if the congestion controller could not be allocated.
+ */
+static void init_connection_rates(const Net_Crypto *c, Crypto_Connection *conn)
+{
+    conn->congestion = congestion_control_new(c->congestion_control_type, mono_time_get_ms(c->mono_time));
+    conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
+    conn->packet_send_rate_requested = CRYPTO_PACKET_MIN_RATE;
+
+    if (conn->congestion != nullptr) {
+        conn->packet_send_rate = congestion_control_send_rate(conn->congestion);
+        conn->packet_send_rate_requested = congestion_control_send_rate_requested(conn->congestion);
+    }
+
+    conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
+    conn->rtt_time = DEFAULT_PING_CONNECTION;
+}
+
 int accept_crypto_connection(Net_Crypto *c, New_Connection *n_c)
 {
     if (getcryptconnection_id(c, n_c->public_key) != -1) {
@@ -1986,10 +2472,16 @@ int accept_crypto_connection(Net_Crypto *c, New_Connection *n_c)
     }
 
     memcpy(conn->dht_public_key, n_c->dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
-    conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-    conn->packet_send_rate_requested = CRYPTO_PACKET_MIN_RATE;
-    conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
-    conn->rtt_time = DEFAULT_PING_CONNECTION;
+    init_connection_rates(c, conn);
+
+    if (conn->congestion == nullptr) {
+        pthread_mutex_lock(&c->tcp_mutex);
+        kill_tcp_connection_to(c->tcp_c, conn->connection_number_tcp);
+        pthread_mutex_unlock(&c->tcp_mutex);
+        conn->status = CRYPTO_CONN_NO_CONNECTION;
+        return -1;
+    }
+
     crypto_connection_add_source(c, crypt_connection_id, n_c->source);
     return crypt_connection_id;
 }
@@ -2029,21 +2521,21 @@ int new_crypto_connection(Net_Crypto *c, const uint8_t *real_public_key, const u
     random_nonce(conn->sent_nonce);
     crypto_new_keypair(conn->sessionpublic_key, conn->sessionsecret_key);
     conn->status = CRYPTO_CONN_COOKIE_REQUESTING;
-    conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-    conn->packet_send_rate_requested = CRYPTO_PACKET_MIN_RATE;
-    conn->packets_left = CRYPTO_MIN_QUEUE_LENGTH;
-    conn->rtt_time = DEFAULT_PING_CONNECTION;
+    init_connection_rates(c, conn);
     memcpy(conn->dht_public_key, dht_public_key, CRYPTO_PUBLIC_KEY_SIZE);
 
     conn->cookie_request_number = random_u64();
     uint8_t cookie_request[COOKIE_REQUEST_LENGTH];
 
-    if (create_cookie_request(c, cookie_request, conn->dht_public_key, conn->cookie_request_number,
-                              conn->shared_key) != sizeof(cookie_request)
+    if (conn->congestion == nullptr
+            || create_cookie_request(c, cookie_request, conn->dht_public_key, conn->cookie_request_number,
+                                     conn->shared_key) != sizeof(cookie_request)
             || new_temp_packet(c, crypt_connection_id, cookie_request, sizeof(cookie_request)) != 0) {
         pthread_mutex_lock(&c->tcp_mutex);
         kill_tcp_connection_to(c->tcp_c, conn->connection_number_tcp);
         pthread_mutex_unlock(&c->tcp_mutex);
+        congestion_control_kill(conn->congestion);
+        conn->congestion = nullptr;
         conn->status = CRYPTO_CONN_NO_CONNECTION;
         return -1;
     }
@@ -2070,7 +2562,7 @@ int set_direct_ip_port(Net_Crypto *c, int crypt_connection_id, IP_Port ip_port,
         return -1;
     }
 
-    const uint64_t direct_lastrecv_time = connected ? unix_time() : 0;
+    const uint64_t direct_lastrecv_time = connected ? mono_time_get(c->mono_time) : 0;
 
     if (net_family_is_ipv4(ip_port.ip.family)) {
         conn->direct_lastrecv_timev4 = direct_lastrecv_time;
@@ -2360,9 +2852,11 @@ int nc_dht_pk_callback(Net_Crypto *c, int crypt_connection_id, dht_pk_cb *functi
  * return -1 on failure.
  * return connection id on success.
  */
-static int crypto_id_ip_port(const Net_Crypto *c, IP_Port ip_port)
+static int crypto_id_ip_port(const Net_Crypto *c, const IP_Port *ip_port)
 {
-    return bs_list_find(&c->ip_port_list, (uint8_t *)&ip_port);
+    uint8_t key[IP_PORT_KEY_SIZE];
+    ip_port_key(key, ip_port);
+    return hash_map_find(&c->ip_port_map, key);
 }
 
 #define CRYPTO_MIN_PACKET_SIZE (1 + sizeof(uint16_t) + CRYPTO_MAC_SIZE)
@@ -2383,7 +2877,7 @@ static int udp_handle_packet(void *object, IP_Port source, const uint8_t *packet
         return 1;
     }
 
-    const int crypt_connection_id = crypto_id_ip_port(c, source);
+    const int crypt_connection_id = crypto_id_ip_port(c, &source);
 
     if (crypt_connection_id == -1) {
         if (packet[0] != NET_PACKET_CRYPTO_HS) {
@@ -2410,38 +2904,72 @@ static int udp_handle_packet(void *object, IP_Port source, const uint8_t *packet
     pthread_mutex_lock(&conn->mutex);
 
     if (net_family_is_ipv4(source.ip.family)) {
-        conn->direct_lastrecv_timev4 = unix_time();
+        conn->direct_lastrecv_timev4 = mono_time_get(c->mono_time);
     } else {
-        conn->direct_lastrecv_timev6 = unix_time();
+        conn->direct_lastrecv_timev6 = mono_time_get(c->mono_time);
     }
 
     pthread_mutex_unlock(&conn->mutex);
     return 0;
 }
 
-/* The dT for the average packet receiving rate calculations.
-   Also used as the */
-#define PACKET_COUNTER_AVERAGE_INTERVAL 50
-
 /* Ratio of recv queue size / recv packet rate (in seconds) times
  * the number of ms between request packets to send at that ratio
  */
 #define REQUEST_PACKETS_COMPARE_CONSTANT (0.125 * 100.0)
 
-/* Timeout for increasing speed after congestion event (in ms). */
-#define CONGESTION_EVENT_TIMEOUT 1000
+/* Number of packets a paced connection may send back to back after it was
+ * idle, so small timer jitter doesn't cost throughput.
+ */
+#define CRYPTO_PACING_BURST 4
 
-/* If the send queue is SEND_QUEUE_RATIO times larger than the
- * calculated link speed the packet send speed will be reduced
- * by a value depending on this number.
+/* Paced connections send a packet every 1000 / packet_send_rate ms, the rate
+ * being the one their congestion control asks for.
+ *
+ * return the number of packets conn may send at time now.
  */
-#define SEND_QUEUE_RATIO 2.0
+static uint32_t pacing_packets_allowed(const Crypto_Connection *conn, uint64_t now)
+{
+    if (!congestion_control_paced(conn->congestion) || conn->packet_send_rate <= 0) {
+        return UINT32_MAX;
+    }
+
+    const double interval = 1000.0 / conn->packet_send_rate;
+    double next_send = conn->pacing_next_send;
+
+    if (next_send < (double)now - interval * CRYPTO_PACING_BURST) {
+        next_send = (double)now - interval * CRYPTO_PACING_BURST;
+    }
+
+    if (next_send > (double)now) {
+        return 0;
+    }
+
+    return (uint32_t)(((double)now - next_send) / interval) + 1;
+}
+
+/* Move the pacing schedule of conn on by num_packets sent at time now. */
+static void pacing_packets_sent(Crypto_Connection *conn, uint64_t now, uint32_t num_packets)
+{
+    if (!congestion_control_paced(conn->congestion) || conn->packet_send_rate <= 0) {
+        return;
+    }
+
+    const double interval = 1000.0 / conn->packet_send_rate;
+
+    if (conn->pacing_next_send < (double)now - interval * CRYPTO_PACING_BURST) {
+        conn->pacing_next_send = (double)now - interval * CRYPTO_PACING_BURST;
+    }
+
+    conn->pacing_next_send += interval * num_packets;
+}
 
 static void send_crypto_packets(Net_Crypto *c)
 {
-    const uint64_t temp_time = current_time_monotonic();
+    const uint64_t temp_time = mono_time_get_ms(c->mono_time);
     double total_send_rate = 0;
     uint32_t peak_request_packet_interval = ~0;
+    uint32_t pacing_sleep_time = ~0;
 
     for (uint32_t i = 0; i < c->crypto_connections_length; ++i) {
         Crypto_Connection *conn = get_crypto_connection(c, i);
@@ -2499,90 +3027,24 @@ static void send_crypto_packets(Net_Crypto *c)
                 conn->packet_counter = 0;
                 conn->packet_counter_set = temp_time;
 
-                uint32_t packets_sent = conn->packets_sent;
-                conn->packets_sent = 0;
-
-                uint32_t packets_resent = conn->packets_resent;
-                conn->packets_resent = 0;
-
-                /* conjestion control
-                    calculate a new value of conn->packet_send_rate based on some data
-                 */
-
-                unsigned int pos = conn->last_sendqueue_counter % CONGESTION_QUEUE_ARRAY_SIZE;
-                conn->last_sendqueue_size[pos] = num_packets_array(&conn->send_array);
-                ++conn->last_sendqueue_counter;
-
-                long signed int sum = 0;
-                sum = (long signed int)conn->last_sendqueue_size[(pos) % CONGESTION_QUEUE_ARRAY_SIZE] -
-                      (long signed int)conn->last_sendqueue_size[(pos - (CONGESTION_QUEUE_ARRAY_SIZE - 1)) % CONGESTION_QUEUE_ARRAY_SIZE];
-
-                unsigned int n_p_pos = conn->last_sendqueue_counter % CONGESTION_LAST_SENT_ARRAY_SIZE;
-                conn->last_num_packets_sent[n_p_pos] = packets_sent;
-                conn->last_num_packets_resent[n_p_pos] = packets_resent;
-
                 bool direct_connected = 0;
                 crypto_connection_status(c, i, &direct_connected, nullptr);
 
+                Congestion_Sample sample;
+                sample.time = temp_time;
+                sample.packets_sent = conn->packets_sent;
+                sample.packets_resent = conn->packets_resent;
+                sample.send_queue_size = num_packets_array(&conn->send_array);
+                sample.rtt = conn->rtt_time;
                 /* When switching from TCP to UDP, don't change the packet send rate for CONGESTION_EVENT_TIMEOUT ms. */
-                if (!(direct_connected && conn->last_tcp_sent + CONGESTION_EVENT_TIMEOUT > temp_time)) {
-                    long signed int total_sent = 0, total_resent = 0;
-
-                    // TODO(irungentoo): use real delay
-                    unsigned int delay = (unsigned int)((conn->rtt_time / PACKET_COUNTER_AVERAGE_INTERVAL) + 0.5);
-                    unsigned int packets_set_rem_array = (CONGESTION_LAST_SENT_ARRAY_SIZE - CONGESTION_QUEUE_ARRAY_SIZE);
-
-                    if (delay > packets_set_rem_array) {
-                        delay = packets_set_rem_array;
-                    }
-
-                    for (unsigned j = 0; j < CONGESTION_QUEUE_ARRAY_SIZE; ++j) {
-                        unsigned int ind = (j + (packets_set_rem_array  - delay) + n_p_pos) % CONGESTION_LAST_SENT_ARRAY_SIZE;
-                        total_sent += conn->last_num_packets_sent[ind];
-                        total_resent += conn->last_num_packets_resent[ind];
-                    }
-
-                    if (sum > 0) {
-                        total_sent -= sum;
-                    } else {
-                        if (total_resent > -sum) {
-                            total_resent = -sum;
-                        }
-                    }
-
-                    /* if queue is too big only allow resending packets. */
-                    uint32_t npackets = num_packets_array(&conn->send_array);
-                    double min_speed = 1000.0 * (((double)(total_sent)) / ((double)(CONGESTION_QUEUE_ARRAY_SIZE) *
-                                                 PACKET_COUNTER_AVERAGE_INTERVAL));
+                sample.hold_rate = direct_connected && conn->last_tcp_sent + CONGESTION_EVENT_TIMEOUT > temp_time;
 
-                    double min_speed_request = 1000.0 * (((double)(total_sent + total_resent)) / ((double)(
-                            CONGESTION_QUEUE_ARRAY_SIZE) * PACKET_COUNTER_AVERAGE_INTERVAL));
-
-                    if (min_speed < CRYPTO_PACKET_MIN_RATE) {
-                        min_speed = CRYPTO_PACKET_MIN_RATE;
-                    }
-
-                    double send_array_ratio = (((double)npackets) / min_speed);
-
-                    // TODO(irungentoo): Improve formula?
-                    if (send_array_ratio > SEND_QUEUE_RATIO && CRYPTO_MIN_QUEUE_LENGTH < npackets) {
-                        conn->packet_send_rate = min_speed * (1.0 / (send_array_ratio / SEND_QUEUE_RATIO));
-                    } else if (conn->last_congestion_event + CONGESTION_EVENT_TIMEOUT < temp_time) {
-                        conn->packet_send_rate = min_speed * 1.2;
-                    } else {
-                        conn->packet_send_rate = min_speed * 0.9;
-                    }
-
-                    conn->packet_send_rate_requested = min_speed_request * 1.2;
-
-                    if (conn->packet_send_rate < CRYPTO_PACKET_MIN_RATE) {
-                        conn->packet_send_rate = CRYPTO_PACKET_MIN_RATE;
-                    }
+                conn->packets_sent = 0;
+                conn->packets_resent = 0;
 
-                    if (conn->packet_send_rate_requested < conn->packet_send_rate) {
-                        conn->packet_send_rate_requested = conn->packet_send_rate;
-                    }
-                }
+                congestion_control_update(conn->congestion, &sample);
+                conn->packet_send_rate = congestion_control_send_rate(conn->congestion);
+                conn->packet_send_rate_requested = congestion_control_send_rate_requested(conn->congestion);
             }
 
             if (conn->last_packets_left_set == 0 || conn->last_packets_left_requested_set == 0) {
@@ -2598,8 +3060,10 @@ static void send_crypto_packets(Net_Crypto *c)
                     uint32_t num_packets = n_packets;
                     double rem = n_packets - (double)num_packets;
 
-                    if (conn->packets_left > num_packets * 4 + CRYPTO_MIN_QUEUE_LENGTH) {
-                        conn->packets_left = num_packets * 4 + CRYPTO_MIN_QUEUE_LENGTH;
+                    const uint32_t max_packets_left = num_packets * 4 + CRYPTO_MIN_QUEUE_LENGTH;
+
+                    if (conn->packets_left > max_packets_left) {
+                        conn->packets_left = max_packets_left;
                     } else {
                         conn->packets_left += num_packets;
                     }
@@ -2627,16 +3091,24 @@ static void send_crypto_packets(Net_Crypto *c)
                 }
             }
 
-            int ret = send_requested_packets(c, i, conn->packets_left_requested);
+            uint32_t max_num = conn->packets_left_requested;
+            const uint32_t paced_num = pacing_packets_allowed(conn, temp_time);
+
+            if (paced_num < max_num) {
+                max_num = paced_num;
+            }
+
+            int ret = send_requested_packets(c, i, max_num);
 
             if (ret != -1) {
+                pacing_packets_sent(conn, temp_time, ret);
                 conn->packets_left_requested -= ret;
                 conn->packets_resent += ret;
 
                 if ((unsigned int)ret < conn->packets_left) {
                     conn->packets_left -= ret;
                 } else {
-                    conn->last_congestion_event = temp_time;
+                    congestion_control_on_send_limited(conn->congestion, temp_time);
                     conn->packets_left = 0;
                 }
             }
@@ -2644,6 +3116,12 @@ static void send_crypto_packets(Net_Crypto *c)
             if (conn->packet_send_rate > CRYPTO_PACKET_MIN_RATE * 1.5) {
                 total_send_rate += conn->packet_send_rate;
             }
+
+            /* Wake up when a paced connection may send again. */
+            if (conn->pacing_next_send > (double)temp_time
+                    && conn->pacing_next_send - (double)temp_time < (double)pacing_sleep_time) {
+                pacing_sleep_time = (uint32_t)(conn->pacing_next_send - (double)temp_time) + 1;
+            }
         }
     }
 
@@ -2662,6 +3140,10 @@ static void send_crypto_packets(Net_Crypto *c)
         }
     }
 
+    if (c->current_sleep_time > pacing_sleep_time) {
+        c->current_sleep_time = pacing_sleep_time;
+    }
+
     sleep_time = CRYPTO_SEND_PACKET_INTERVAL;
 
     if (c->current_sleep_time > sleep_time) {
@@ -2689,6 +3171,13 @@ uint32_t crypto_num_free_sendqueue_slots(const Net_Crypto *c, int crypt_connecti
     }
 
     uint32_t max_packets = CRYPTO_PACKET_BUFFER_SIZE - num_packets_array(&conn->send_array);
+    /* Callers on other threads ask between two runs of do_net_crypto(), when mono_time can be a whole
+     * run interval old. The pacing allowance grows every few ms, so it needs a fresh reading. */
+    const uint32_t paced_packets = pacing_packets_allowed(conn, current_time_monotonic(c->mono_time));
+
+    if (paced_packets < max_packets) {
+        max_packets = paced_packets;
+    }
 
     if (conn->packets_left < max_packets) {
         return conn->packets_left;
@@ -2729,7 +3218,10 @@ int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
         return -1;
     }
 
-    if (congestion_control && conn->packets_left == 0) {
+    /* As in crypto_num_free_sendqueue_slots(), pacing needs a fresh reading, not mono_time's. */
+    const uint64_t temp_time = current_time_monotonic(c->mono_time);
+
+    if (congestion_control && (conn->packets_left == 0 || pacing_packets_allowed(conn, temp_time) == 0)) {
         return -1;
     }
 
@@ -2740,6 +3232,7 @@ int64_t write_cryptpacket(Net_Crypto *c, int crypt_connection_id, const uint8_t
     }
 
     if (congestion_control) {
+        pacing_packets_sent(conn, temp_time, 1);
         --conn->packets_left;
         --conn->packets_left_requested;
         ++conn->packets_sent;
@@ -2852,8 +3345,8 @@ int crypto_kill(Net_Crypto *c, int crypt_connection_id)
         kill_tcp_connection_to(c->tcp_c, conn->connection_number_tcp);
         pthread_mutex_unlock(&c->tcp_mutex);
 
-        bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv4, crypt_connection_id);
-        bs_list_remove(&c->ip_port_list, (uint8_t *)&conn->ip_portv6, crypt_connection_id);
+        ip_port_map_remove(&c->ip_port_map, &conn->ip_portv4, crypt_connection_id);
+        ip_port_map_remove(&c->ip_port_map, &conn->ip_portv6, crypt_connection_id);
         clear_temp_packet(c, crypt_connection_id);
         clear_buffer(&conn->send_array);
         clear_buffer(&conn->recv_array);
@@ -2882,7 +3375,7 @@ Crypto_Conn_State crypto_connection_status(const Net_Crypto *c, int crypt_connec
     if (direct_connected) {
         *direct_connected = 0;
 
-        uint64_t current_time = unix_time();
+        uint64_t current_time = mono_time_get(c->mono_time);
 
         if ((UDP_DIRECT_TIMEOUT + conn->direct_lastrecv_timev4) > current_time) {
             *direct_connected = 1;
@@ -2928,10 +3421,8 @@ void load_secret_key(Net_Crypto *c, const uint8_t *sk)
 /* Run this to (re)initialize net_crypto.
  * Sets all the global connection variables to their default values.
  */
-Net_Crypto *new_net_crypto(const Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info)
+Net_Crypto *new_net_crypto(const Logger *log, const Mono_Time *mono_time, DHT *dht, TCP_Proxy_Info *proxy_info)
 {
-    unix_time_update();
-
     if (dht == nullptr) {
         return nullptr;
     }
@@ -2944,7 +3435,7 @@ Net_Crypto *new_net_crypto(const Logger *log, DHT *dht, TCP_Proxy_Info *proxy_in
 
     temp->log = log;
 
-    temp->tcp_c = new_tcp_connections(dht_get_self_secret_key(dht), proxy_info);
+    temp->tcp_c = new_tcp_connections(mono_time, dht_get_self_secret_key(dht), proxy_info);
 
     if (temp->tcp_c == nullptr) {
         free(temp);
@@ -2954,13 +3445,21 @@ Net_Crypto *new_net_crypto(const Logger *log, DHT *dht, TCP_Proxy_Info *proxy_in
     set_packet_tcp_connection_callback(temp->tcp_c, &tcp_data_callback, temp);
     set_oob_packet_tcp_connection_callback(temp->tcp_c, &tcp_oob_callback, temp);
 
+    if (!hash_map_init(&temp->ip_port_map, IP_PORT_KEY_SIZE, 8)) {
+        kill_tcp_connections(temp->tcp_c);
+        free(temp);
+        return nullptr;
+    }
+
     if (create_recursive_mutex(&temp->tcp_mutex) != 0 ||
             pthread_mutex_init(&temp->connections_mutex, nullptr) != 0) {
+        hash_map_free(&temp->ip_port_map);
         kill_tcp_connections(temp->tcp_c);
         free(temp);
         return nullptr;
     }
 
+    temp->mono_time = mono_time;
     temp->dht = dht;
 
     new_keys(temp);
@@ -2973,8 +3472,6 @@ Net_Crypto *new_net_crypto(const Logger *log, DHT *dht, TCP_Proxy_Info *proxy_in
     networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_HS, &udp_handle_packet, temp);
     networking_registerhandler(dht_get_net(dht), NET_PACKET_CRYPTO_DATA, &udp_handle_packet, temp);
 
-    bs_list_init(&temp->ip_port_list, sizeof(IP_Port), 8);
-
     return temp;
 }
 
@@ -3011,6 +3508,32 @@ static void kill_timedout(Net_Crypto *c, void *userdata)
     }
 }
 
+int net_crypto_set_congestion_control(Net_Crypto *c, Congestion_Control_Type type)
+{
+    c->congestion_control_type = type;
+    int ret = 0;
+
+    for (uint32_t i = 0; i < c->crypto_connections_length; ++i) {
+        Crypto_Connection *conn = get_crypto_connection(c, i);
+
+        if (conn == nullptr || conn->congestion == nullptr || congestion_control_type(conn->congestion) == type) {
+            continue;
+        }
+
+        Congestion_Control *const congestion = congestion_control_new(type, mono_time_get_ms(c->mono_time));
+
+        if (congestion == nullptr) {
+            ret = -1;
+            continue;
+        }
+
+        congestion_control_kill(conn->congestion);
+        conn->congestion = congestion;
+    }
+
+    return ret;
+}
+
 /* return the optimal interval in ms for running do_net_crypto.
  */
 uint32_t crypto_run_interval(const Net_Crypto *c)
@@ -3021,7 +3544,6 @@ uint32_t crypto_run_interval(const Net_Crypto *c)
 /* Main loop. */
 void do_net_crypto(Net_Crypto *c, void *userdata)
 {
-    unix_time_update();
     kill_timedout(c, userdata);
     do_tcp(c, userdata);
     send_crypto_packets(c);
@@ -3039,7 +3561,7 @@ void kill_net_crypto(Net_Crypto *c)
     pthread_mutex_destroy(&c->connections_mutex);
 
     kill_tcp_connections(c->tcp_c);
-    bs_list_free(&c->ip_port_list);
+    hash_map_free(&c->ip_port_map);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_COOKIE_REQUEST, nullptr, nullptr);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_COOKIE_RESPONSE, nullptr, nullptr);
     networking_registerhandler(dht_get_net(c->dht), NET_PACKET_CRYPTO_HS, nullptr, nullptr);
@@ -27,6 +27,7 @@
 #include "DHT.h"
 #include "LAN_discovery.h"
 #include "TCP_connection.h"
+#include "congestion_control.h"
 #include "logger.h"
 
 #include <pthread.h>
@@ -42,12 +43,6 @@ typedef enum Crypto_Conn_State {
 /* Maximum size of receiving and sending packet buffers. */
 #define CRYPTO_PACKET_BUFFER_SIZE 32768 /* Must be a power of 2 */
 
-/* Minimum packet rate per second. */
-#define CRYPTO_PACKET_MIN_RATE 4.0
-
-/* Minimum packet queue max length. */
-#define CRYPTO_MIN_QUEUE_LENGTH 64
-
 /* Maximum total size of packets that net_crypto sends. */
 #define MAX_CRYPTO_PACKET_SIZE (uint16_t)1400
 
@@ -69,6 +64,8 @@ typedef enum Crypto_Conn_State {
 #define PACKET_ID_PADDING 0 /* Denotes padding */
 #define PACKET_ID_REQUEST 1 /* Used to request unreceived packets */
 #define PACKET_ID_KILL    2 /* Used to kill connection */
+#define PACKET_ID_CAPABILITIES 3 /* Used to announce optional protocol features */
+#define PACKET_ID_SACK    4 /* Used to acknowledge received packets as ranges */
 
 /* Packet ids 0 to CRYPTO_RESERVED_PACKETS - 1 are reserved for use by net_crypto. */
 #define CRYPTO_RESERVED_PACKETS 16
@@ -82,11 +79,6 @@ typedef enum Crypto_Conn_State {
 
 #define CRYPTO_MAX_PADDING 8 /* All packets will be padded a number of bytes based on this number. */
 
-/* Base current transfer speed on last CONGESTION_QUEUE_ARRAY_SIZE number of points taken
-   at the dT defined in net_crypto.c */
-#define CONGESTION_QUEUE_ARRAY_SIZE 12
-#define CONGESTION_LAST_SENT_ARRAY_SIZE (CONGESTION_QUEUE_ARRAY_SIZE * 2)
-
 /* Default connection ping in ms. */
 #define DEFAULT_PING_CONNECTION 1000
 #define DEFAULT_TCP_PING_CONNECTION 500
@@ -301,7 +293,15 @@ void load_secret_key(Net_Crypto *c, const uint8_t *sk);
 /* Create new instance of Net_Crypto.
  *  Sets all the global connection variables to their default values.
  */
-Net_Crypto *new_net_crypto(const Logger *log, DHT *dht, TCP_Proxy_Info *proxy_info);
+Net_Crypto *new_net_crypto(const Logger *log, const Mono_Time *mono_time, DHT *dht, TCP_Proxy_Info *proxy_info);
+
+/* Set the congestion control algorithm used by all current and future connections.
+ * Connections that switch algorithm start over with a fresh estimate of the link.
+ *
+ * return -1 if some connections could not be switched (out of memory).
+ * return 0 on success.
+ */
+int net_crypto_set_congestion_control(Net_Crypto *c, Congestion_Control_Type type);
 
 /* return the optimal interval in ms for running do_net_crypto.
  */
@@ -0,0 +1,584 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "net_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccompat.h"
+
+/* First port symmetric NATs map destinations to. */
+#define NET_SIM_FIRST_MAPPED_PORT 1024
+
+/* Public addresses are 11.0.0.1, 11.0.0.2, ... */
+#define NET_SIM_FIRST_ADDRESS 0x0B000001
+
+typedef struct Net_Sim_Packet {
+    struct Net_Sim_Packet *next;
+    uint64_t time;
+    uint64_t seq;
+    IP_Port from;
+    IP_Port to;
+    uint16_t length;
+    /* The data follows the struct. */
+} Net_Sim_Packet;
+
+/* A NAT mapping, keyed by the destination it was opened for. */
+typedef struct Net_Sim_Mapping {
+    uint64_t key;
+    uint64_t last_used;
+    uint16_t port;
+} Net_Sim_Mapping;
+
+struct Net_Sim_Node {
+    Net_Sim *sim;
+    Net_Sim_NAT nat;
+    Net_Sim_Link link;
+    IP_Port ip_port;
+    Net_Sim_Stats stats;
+    bool has_networking;
+
+    /* Open addressing table of mappings, 0 keys are free. */
+    Net_Sim_Mapping *mappings;
+    uint32_t mappings_capacity;
+    uint32_t num_mappings;
+
+    /* Destination key of every port a symmetric NAT mapped, from NET_SIM_FIRST_MAPPED_PORT on. */
+    uint64_t *mapped_ports;
+    uint32_t mapped_ports_capacity;
+    uint32_t num_mapped_ports;
+
+    /* Packets that arrived and wait for networking_poll. */
+    Net_Sim_Packet *inbox_head;
+    Net_Sim_Packet *inbox_tail;
+};
+
+struct Net_Sim {
+    uint64_t time;
+    Mono_Time *mono_time;
+    uint64_t random_state;
+    uint64_t next_seq;
+    Net_Sim_Link link;
+
+    Net_Sim_Node **nodes;
+    uint32_t num_nodes;
+    uint32_t nodes_capacity;
+
+    /* Binary heap of packets in flight, ordered by arrival time and then sending order. */
+    Net_Sim_Packet **in_flight;
+    uint32_t num_in_flight;
+    uint32_t in_flight_capacity;
+};
+
+static uint64_t net_sim_current_time(void *user_data)
+{
+    const Net_Sim *sim = (const Net_Sim *)user_data;
+    return sim->time;
+}
+
+/* xorshift64* */
+static uint32_t net_sim_random(Net_Sim *sim)
+{
+    sim->random_state ^= sim->random_state >> 12;
+    sim->random_state ^= sim->random_state << 25;
+    sim->random_state ^= sim->random_state >> 27;
+    return (uint32_t)((sim->random_state * 2685821657736338717ULL) >> 32);
+}
+
+Net_Sim *net_sim_new(uint64_t seed)
+{
+    Net_Sim *sim = (Net_Sim *)calloc(1, sizeof(Net_Sim));
+
+    if (sim == nullptr) {
+        return nullptr;
+    }
+
+    sim->mono_time = mono_time_new();
+
+    if (sim->mono_time == nullptr) {
+        free(sim);
+        return nullptr;
+    }
+
+    sim->time = current_time_monotonic(sim->mono_time);
+    /* The generator must not start at 0. */
+    sim->random_state = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+
+    mono_time_set_current_time_callback(sim->mono_time, &net_sim_current_time, sim);
+    mono_time_update(sim->mono_time);
+    return sim;
+}
+
+static void net_sim_free_inbox(Net_Sim_Node *node)
+{
+    while (node->inbox_head != nullptr) {
+        Net_Sim_Packet *packet = node->inbox_head;
+        node->inbox_head = packet->next;
+        free(packet);
+    }
+
+    node->inbox_tail = nullptr;
+}
+
+void net_sim_kill(Net_Sim *sim)
+{
+    if (sim == nullptr) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < sim->num_in_flight; ++i) {
+        free(sim->in_flight[i]);
+    }
+
+    for (uint32_t i = 0; i < sim->num_nodes; ++i) {
+        Net_Sim_Node *node = sim->nodes[i];
+        net_sim_free_inbox(node);
+        free(node->mappings);
+        free(node->mapped_ports);
+        free(node);
+    }
+
+    mono_time_free(sim->mono_time);
+    free(sim->in_flight);
+    free(sim->nodes);
+    free(sim);
+}
+
+void net_sim_set_link(Net_Sim *sim, const Net_Sim_Link *link)
+{
+    sim->link = *link;
+}
+
+Net_Sim_Node *net_sim_node_new(Net_Sim *sim, Net_Sim_NAT nat)
+{
+    if (sim->num_nodes == sim->nodes_capacity) {
+        const uint32_t capacity = sim->nodes_capacity == 0 ? 64 : sim->nodes_capacity * 2;
+        Net_Sim_Node **nodes = (Net_Sim_Node **)realloc(sim->nodes, capacity * sizeof(Net_Sim_Node *));
+
+        if (nodes == nullptr) {
+            return nullptr;
+        }
+
+        sim->nodes = nodes;
+        sim->nodes_capacity = capacity;
+    }
+
+    Net_Sim_Node *node = (Net_Sim_Node *)calloc(1, sizeof(Net_Sim_Node));
+
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    node->sim = sim;
+    node->nat = nat;
+    node->link = sim->link;
+    node->ip_port.ip.family = net_family_ipv4;
+    node->ip_port.ip.ip.v4.uint32 = net_htonl(NET_SIM_FIRST_ADDRESS + sim->num_nodes);
+    node->ip_port.port = net_htons(NET_SIM_PORT);
+
+    sim->nodes[sim->num_nodes] = node;
+    ++sim->num_nodes;
+    return node;
+}
+
+void net_sim_node_set_link(Net_Sim_Node *node, const Net_Sim_Link *link)
+{
+    node->link = *link;
+}
+
+IP_Port net_sim_node_ip_port(const Net_Sim_Node *node)
+{
+    return node->ip_port;
+}
+
+const Net_Sim_Stats *net_sim_node_stats(const Net_Sim_Node *node)
+{
+    return &node->stats;
+}
+
+uint64_t net_sim_time(const Net_Sim *sim)
+{
+    return sim->time;
+}
+
+Mono_Time *net_sim_mono_time(Net_Sim *sim)
+{
+    return sim->mono_time;
+}
+
+uint32_t net_sim_in_flight(const Net_Sim *sim)
+{
+    return sim->num_in_flight;
+}
+
+static Net_Sim_Node *net_sim_find_node(const Net_Sim *sim, IP ip)
+{
+    if (!net_family_is_ipv4(ip.family)) {
+        return nullptr;
+    }
+
+    const uint32_t index = net_ntohl(ip.ip.v4.uint32) - NET_SIM_FIRST_ADDRESS;
+
+    if (index >= sim->num_nodes) {
+        return nullptr;
+    }
+
+    return sim->nodes[index];
+}
+
+static uint64_t net_sim_key(IP_Port ip_port)
+{
+    return ((uint64_t)net_ntohl(ip_port.ip.ip.v4.uint32) << 16) | net_ntohs(ip_port.port);
+}
+
+/* NAT mappings */
+
+static uint32_t net_sim_mapping_slot(const Net_Sim_Mapping *mappings, uint32_t capacity, uint64_t key)
+{
+    uint32_t slot = (uint32_t)((key * 11400714819323198485ULL) >> 32) & (capacity - 1);
+
+    while (mappings[slot].key != 0 && mappings[slot].key != key) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    return slot;
+}
+
+static Net_Sim_Mapping *net_sim_find_mapping(const Net_Sim_Node *node, uint64_t key)
+{
+    if (node->mappings_capacity == 0) {
+        return nullptr;
+    }
+
+    Net_Sim_Mapping *mapping = &node->mappings[net_sim_mapping_slot(node->mappings, node->mappings_capacity, key)];
+    return mapping->key == key ? mapping : nullptr;
+}
+
+static bool net_sim_grow_mappings(Net_Sim_Node *node)
+{
+    const uint32_t capacity = node->mappings_capacity == 0 ? 16 : node->mappings_capacity * 2;
+    Net_Sim_Mapping *mappings = (Net_Sim_Mapping *)calloc(capacity, sizeof(Net_Sim_Mapping));
+
+    if (mappings == nullptr) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < node->mappings_capacity; ++i) {
+        if (node->mappings[i].key != 0) {
+            mappings[net_sim_mapping_slot(mappings, capacity, node->mappings[i].key)] = node->mappings[i];
+        }
+    }
+
+    free(node->mappings);
+    node->mappings = mappings;
+    node->mappings_capacity = capacity;
+    return true;
+}
+
+/* return the port a symmetric NAT maps a new destination to, 0 if it has none left. */
+static uint16_t net_sim_map_port(Net_Sim_Node *node, uint64_t key)
+{
+    if (node->num_mapped_ports == UINT16_MAX - NET_SIM_FIRST_MAPPED_PORT) {
+        return 0;
+    }
+
+    if (node->num_mapped_ports == node->mapped_ports_capacity) {
+        const uint32_t capacity = node->mapped_ports_capacity == 0 ? 16 : node->mapped_ports_capacity * 2;
+        uint64_t *mapped_ports = (uint64_t *)realloc(node->mapped_ports, capacity * sizeof(uint64_t));
+
+        if (mapped_ports == nullptr) {
+            return 0;
+        }
+
+        node->mapped_ports = mapped_ports;
+        node->mapped_ports_capacity = capacity;
+    }
+
+    node->mapped_ports[node->num_mapped_ports] = key;
+    ++node->num_mapped_ports;
+    return NET_SIM_FIRST_MAPPED_PORT + node->num_mapped_ports - 1;
+}
+
+/* Open or refresh the mapping for a packet the node sends to, and return the
+ * port it leaves the NAT from, 0 if it can't be sent.
+ */
+static uint16_t net_sim_nat_outgoing(Net_Sim_Node *node, IP_Port to)
+{
+    if (node->nat == NET_SIM_NAT_NONE || node->nat == NET_SIM_NAT_FULL_CONE) {
+        return NET_SIM_PORT;
+    }
+
+    IP_Port destination = to;
+
+    if (node->nat == NET_SIM_NAT_RESTRICTED_CONE) {
+        destination.port = 0;
+    }
+
+    const uint64_t key = net_sim_key(destination);
+    Net_Sim_Mapping *mapping = net_sim_find_mapping(node, key);
+
+    if (mapping == nullptr) {
+        if (2 * (node->num_mappings + 1) > node->mappings_capacity && !net_sim_grow_mappings(node)) {
+            return 0;
+        }
+
+        const uint16_t port = node->nat == NET_SIM_NAT_SYMMETRIC ? net_sim_map_port(node, key) : NET_SIM_PORT;
+
+        if (port == 0) {
+            return 0;
+        }
+
+        mapping = &node->mappings[net_sim_mapping_slot(node->mappings, node->mappings_capacity, key)];
+        mapping->key = key;
+        mapping->port = port;
+        ++node->num_mappings;
+    }
+
+    mapping->last_used = node->sim->time;
+    return mapping->port;
+}
+
+static bool net_sim_mapping_open(const Net_Sim_Node *node, const Net_Sim_Mapping *mapping)
+{
+    return mapping != nullptr && mapping->last_used + NET_SIM_NAT_TIMEOUT > node->sim->time;
+}
+
+/* return true if the NAT of node lets a packet from from to port through. */
+static bool net_sim_nat_incoming(const Net_Sim_Node *node, IP_Port from, uint16_t port)
+{
+    switch (node->nat) {
+        case NET_SIM_NAT_NONE:
+        case NET_SIM_NAT_FULL_CONE:
+            return port == NET_SIM_PORT;
+
+        case NET_SIM_NAT_RESTRICTED_CONE: {
+            IP_Port source = from;
+            source.port = 0;
+            return port == NET_SIM_PORT && net_sim_mapping_open(node, net_sim_find_mapping(node, net_sim_key(source)));
+        }
+
+        case NET_SIM_NAT_PORT_RESTRICTED_CONE:
+            return port == NET_SIM_PORT && net_sim_mapping_open(node, net_sim_find_mapping(node, net_sim_key(from)));
+
+        case NET_SIM_NAT_SYMMETRIC: {
+            const uint32_t index = (uint32_t)port - NET_SIM_FIRST_MAPPED_PORT;
+
+            if (port < NET_SIM_FIRST_MAPPED_PORT || index >= node->num_mapped_ports) {
+                return false;
+            }
+
+            const uint64_t key = node->mapped_ports[index];
+            return key == net_sim_key(from) && net_sim_mapping_open(node, net_sim_find_mapping(node, key));
+        }
+    }
+
+    return false;
+}
+
+/* Packets in flight */
+
+static bool net_sim_packet_before(const Net_Sim_Packet *a, const Net_Sim_Packet *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static bool net_sim_push(Net_Sim *sim, Net_Sim_Packet *packet)
+{
+    if (sim->num_in_flight == sim->in_flight_capacity) {
+        const uint32_t capacity = sim->in_flight_capacity == 0 ? 1024 : sim->in_flight_capacity * 2;
+        Net_Sim_Packet **in_flight = (Net_Sim_Packet **)realloc(sim->in_flight, capacity * sizeof(Net_Sim_Packet *));
+
+        if (in_flight == nullptr) {
+            return false;
+        }
+
+        sim->in_flight = in_flight;
+        sim->in_flight_capacity = capacity;
+    }
+
+    uint32_t i = sim->num_in_flight;
+    ++sim->num_in_flight;
+
+    while (i > 0 && net_sim_packet_before(packet, sim->in_flight[(i - 1) / 2])) {
+        sim->in_flight[i] = sim->in_flight[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    sim->in_flight[i] = packet;
+    return true;
+}
+
+static Net_Sim_Packet *net_sim_pop(Net_Sim *sim)
+{
+    Net_Sim_Packet *first = sim->in_flight[0];
+    --sim->num_in_flight;
+    Net_Sim_Packet *last = sim->in_flight[sim->num_in_flight];
+    uint32_t i = 0;
+
+    while (true) {
+        uint32_t child = 2 * i + 1;
+
+        if (child >= sim->num_in_flight) {
+            break;
+        }
+
+        if (child + 1 < sim->num_in_flight && net_sim_packet_before(sim->in_flight[child + 1], sim->in_flight[child])) {
+            ++child;
+        }
+
+        if (!net_sim_packet_before(sim->in_flight[child], last)) {
+            break;
+        }
+
+        sim->in_flight[i] = sim->in_flight[child];
+        i = child;
+    }
+
+    sim->in_flight[i] = last;
+    return first;
+}
+
+static void net_sim_deliver(Net_Sim *sim, Net_Sim_Packet *packet)
+{
+    Net_Sim_Node *node = net_sim_find_node(sim, packet->to.ip);
+
+    if (node == nullptr || !node->has_networking
+            || !net_sim_nat_incoming(node, packet->from, net_ntohs(packet->to.port))) {
+        if (node != nullptr) {
+            ++node->stats.packets_filtered;
+        }
+
+        free(packet);
+        return;
+    }
+
+    ++node->stats.packets_received;
+    node->stats.bytes_received += packet->length;
+
+    packet->next = nullptr;
+
+    if (node->inbox_tail != nullptr) {
+        node->inbox_tail->next = packet;
+    } else {
+        node->inbox_head = packet;
+    }
+
+    node->inbox_tail = packet;
+}
+
+void net_sim_advance(Net_Sim *sim, uint32_t ms)
+{
+    sim->time += ms;
+    mono_time_update(sim->mono_time);
+
+    while (sim->num_in_flight > 0 && sim->in_flight[0]->time <= sim->time) {
+        net_sim_deliver(sim, net_sim_pop(sim));
+    }
+}
+
+/* Networking_Core functions */
+
+static int net_sim_send(void *object, IP_Port ip_port, const uint8_t *data, uint16_t length)
+{
+    Net_Sim_Node *node = (Net_Sim_Node *)object;
+    Net_Sim *sim = node->sim;
+
+    if (!net_family_is_ipv4(ip_port.ip.family)) {
+        return -1;
+    }
+
+    const uint16_t port = net_sim_nat_outgoing(node, ip_port);
+
+    if (port == 0) {
+        return -1;
+    }
+
+    ++node->stats.packets_sent;
+    node->stats.bytes_sent += length;
+
+    if (node->link.loss_percent != 0 && net_sim_random(sim) % 100 < node->link.loss_percent) {
+        ++node->stats.packets_lost;
+        return length;
+    }
+
+    Net_Sim_Packet *packet = (Net_Sim_Packet *)malloc(sizeof(Net_Sim_Packet) + length);
+
+    if (packet == nullptr) {
+        return -1;
+    }
+
+    packet->next = nullptr;
+    packet->time = sim->time + node->link.latency;
+
+    if (node->link.jitter != 0) {
+        packet->time += net_sim_random(sim) % (node->link.jitter + 1);
+    }
+
+    packet->seq = sim->next_seq;
+    ++sim->next_seq;
+    packet->from = node->ip_port;
+    packet->from.port = net_htons(port);
+    packet->to = ip_port;
+    packet->length = length;
+    memcpy(packet + 1, data, length);
+
+    if (!net_sim_push(sim, packet)) {
+        free(packet);
+        return -1;
+    }
+
+    return length;
+}
+
+static int net_sim_recv(void *object, IP_Port *ip_port, uint8_t *data, uint32_t *length)
+{
+    Net_Sim_Node *node = (Net_Sim_Node *)object;
+    Net_Sim_Packet *packet = node->inbox_head;
+
+    if (packet == nullptr) {
+        return -1;
+    }
+
+    node->inbox_head = packet->next;
+
+    if (node->inbox_head == nullptr) {
+        node->inbox_tail = nullptr;
+    }
+
+    *ip_port = packet->from;
+    *length = packet->length;
+    memcpy(data, packet + 1, packet->length);
+    free(packet);
+    return 0;
+}
+
+static const Network_Funcs net_sim_funcs = {
+    &net_sim_send,
+    &net_sim_recv,
+};
+
+Networking_Core *new_networking_sim(const Logger *log, Net_Sim_Node *node)
+{
+    if (node->has_networking) {
+        return nullptr;
+    }
+
+    IP_Port ip_port = node->ip_port;
+
+    if (node->nat != NET_SIM_NAT_NONE) {
+        /* Behind a NAT, the node only knows its private address. */
+        ip_port.ip.ip.v4.uint32 = net_htonl(0xC0A80002);
+    }
+
+    Networking_Core *net = new_networking_funcs(log, &net_sim_funcs, node, ip_port);
+
+    if (net == nullptr) {
+        return nullptr;
+    }
+
+    net_sim_free_inbox(node);
+    node->has_networking = true;
+    return net;
+}
@@ -0,0 +1,138 @@
+/**
+ * Deterministic in-memory network for simulating many instances in one thread.
+ *
+ * A Net_Sim holds nodes, each with its own IPv4 address, and a virtual clock.
+ * Networking_Cores created with new_networking_sim send and receive through a
+ * node instead of a socket. A sent packet is dropped or scheduled to arrive
+ * after the latency of the sending node's link, and arrives when the clock is
+ * advanced past that time with net_sim_advance. Nodes can sit behind NATs of
+ * the usual kinds, which filter the packets that arrive.
+ *
+ * The virtual clock only moves in net_sim_advance. Instances on the network
+ * use it through the Mono_Time of the Net_Sim. Loss and jitter come from a
+ * generator seeded at creation, so a simulation driven the same way delivers
+ * the same packets at the same times.
+ *
+ * A Net_Sim and its instances must only be used from one thread.
+ */
+#ifndef C_TOXCORE_TOXCORE_NET_SIM_H
+#define C_TOXCORE_TOXCORE_NET_SIM_H
+
+#include <stdint.h>
+
+#include "mono_time.h"
+#include "network.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* UDP port of every node, and the port cone NATs map it to. */
+#define NET_SIM_PORT 33445
+
+/* Milliseconds a NAT mapping stays open after its last outgoing packet. */
+#define NET_SIM_NAT_TIMEOUT 120000
+
+typedef enum Net_Sim_NAT {
+    /* The node has a public address. */
+    NET_SIM_NAT_NONE,
+    /* Anyone can send to the mapped port once the node has sent a packet. */
+    NET_SIM_NAT_FULL_CONE,
+    /* Only addresses the node has sent to can reach it. */
+    NET_SIM_NAT_RESTRICTED_CONE,
+    /* Only address and port pairs the node has sent to can reach it. */
+    NET_SIM_NAT_PORT_RESTRICTED_CONE,
+    /* Every destination gets its own mapped port, which only that destination can use. */
+    NET_SIM_NAT_SYMMETRIC,
+} Net_Sim_NAT;
+
+/* Properties of the link packets sent by a node go through. */
+typedef struct Net_Sim_Link {
+    /* Milliseconds every packet takes. */
+    uint32_t latency;
+    /* Up to this many milliseconds are added to the latency of a packet at random. */
+    uint32_t jitter;
+    uint8_t loss_percent;
+} Net_Sim_Link;
+
+typedef struct Net_Sim_Stats {
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_received;
+    uint64_t bytes_received;
+    /* Sent packets lost on the link. */
+    uint64_t packets_lost;
+    /* Arriving packets dropped by the NAT or for lack of a Networking_Core. */
+    uint64_t packets_filtered;
+} Net_Sim_Stats;
+
+typedef struct Net_Sim Net_Sim;
+typedef struct Net_Sim_Node Net_Sim_Node;
+
+/**
+ * Create a simulated network whose clock starts at the current time.
+ *
+ * @return NULL on failure.
+ */
+Net_Sim *net_sim_new(uint64_t seed);
+
+/**
+ * Free the network, its nodes and its Mono_Time. The instances on the network
+ * must be killed first.
+ */
+void net_sim_kill(Net_Sim *sim);
+
+/**
+ * Set the link of nodes created afterwards.
+ */
+void net_sim_set_link(Net_Sim *sim, const Net_Sim_Link *link);
+
+/**
+ * Add a node. It is freed with the network.
+ *
+ * @return NULL on failure.
+ */
+Net_Sim_Node *net_sim_node_new(Net_Sim *sim, Net_Sim_NAT nat);
+
+void net_sim_node_set_link(Net_Sim_Node *node, const Net_Sim_Link *link);
+
+/**
+ * The public address of the node: the one other nodes bootstrap from. Behind a
+ * NAT it is the address of the NAT with NET_SIM_PORT, which only works for a
+ * full cone NAT until the node has sent packets.
+ */
+IP_Port net_sim_node_ip_port(const Net_Sim_Node *node);
+
+const Net_Sim_Stats *net_sim_node_stats(const Net_Sim_Node *node);
+
+/**
+ * Create a Networking_Core sending and receiving through node. A node can
+ * only have one at a time.
+ *
+ * @return NULL on failure.
+ */
+Networking_Core *new_networking_sim(const Logger *log, Net_Sim_Node *node);
+
+/* Current time of the virtual clock in milliseconds. */
+uint64_t net_sim_time(const Net_Sim *sim);
+
+/**
+ * A Mono_Time reading the virtual clock, for the instances on the network.
+ * net_sim_advance updates it.
+ */
+Mono_Time *net_sim_mono_time(Net_Sim *sim);
+
+/**
+ * Move the clock forward, update the Mono_Time, and make the packets due by
+ * then available to the networking_poll of their receivers.
+ */
+void net_sim_advance(Net_Sim *sim, uint32_t ms);
+
+/* Number of packets sent but not yet arrived. */
+uint32_t net_sim_in_flight(const Net_Sim *sim);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_NET_SIM_H
@@ -0,0 +1,213 @@
+#include "net_sim.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "logger.h"
+#include "mono_time.h"
+
+namespace {
+
+constexpr uint8_t kPacketId = 200;
+
+struct Received {
+  std::vector<IP_Port> from;
+  std::vector<uint64_t> times;
+  const Net_Sim *sim;
+};
+
+int handle_packet(void *object, IP_Port ip_port, const uint8_t *, uint16_t, void *) {
+  Received *received = static_cast<Received *>(object);
+  received->from.push_back(ip_port);
+  received->times.push_back(net_sim_time(received->sim));
+  return 0;
+}
+
+class NetSim : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    log_ = logger_new();
+    sim_ = net_sim_new(1234);
+    ASSERT_NE(sim_, nullptr);
+  }
+
+  void TearDown() override {
+    for (Networking_Core *net : nets_) {
+      kill_networking(net);
+    }
+
+    net_sim_kill(sim_);
+    logger_kill(log_);
+  }
+
+  Networking_Core *add(Net_Sim_Node *node, Received *received) {
+    Networking_Core *net = new_networking_sim(log_, node);
+    received->sim = sim_;
+    networking_registerhandler(net, kPacketId, &handle_packet, received);
+    nets_.push_back(net);
+    return net;
+  }
+
+  void step(uint32_t ms) {
+    net_sim_advance(sim_, ms);
+
+    for (Networking_Core *net : nets_) {
+      networking_poll(net, nullptr);
+    }
+  }
+
+  Logger *log_;
+  Net_Sim *sim_;
+  std::vector<Networking_Core *> nets_;
+};
+
+bool same_ip_port(IP_Port a, IP_Port b) {
+  return a.ip.ip.v4.uint32 == b.ip.ip.v4.uint32 && a.port == b.port;
+}
+
+const uint8_t kPacket[] = {kPacketId, 1, 2, 3};
+
+TEST_F(NetSim, DrivesItsMonotonicClock) {
+  Mono_Time *mono_time = net_sim_mono_time(sim_);
+  const uint64_t start = mono_time_get_ms(mono_time);
+  EXPECT_EQ(start, net_sim_time(sim_));
+  net_sim_advance(sim_, 1500);
+  EXPECT_EQ(mono_time_get_ms(mono_time), start + 1500);
+  EXPECT_EQ(current_time_monotonic(mono_time), start + 1500);
+}
+
+TEST_F(NetSim, SimsHaveIndependentClocks) {
+  Net_Sim *other = net_sim_new(1);
+  ASSERT_NE(other, nullptr);
+  const uint64_t start = net_sim_time(other);
+  net_sim_advance(sim_, 1500);
+  EXPECT_EQ(net_sim_time(other), start);
+  EXPECT_EQ(mono_time_get_ms(net_sim_mono_time(other)), start);
+  net_sim_kill(other);
+}
+
+TEST_F(NetSim, DeliversAfterLatency) {
+  const Net_Sim_Link link = {50, 0, 0};
+  net_sim_set_link(sim_, &link);
+  Net_Sim_Node *a = net_sim_node_new(sim_, NET_SIM_NAT_NONE);
+  Net_Sim_Node *b = net_sim_node_new(sim_, NET_SIM_NAT_NONE);
+  Received received_a, received_b;
+  Networking_Core *net_a = add(a, &received_a);
+  add(b, &received_b);
+
+  ASSERT_EQ(sendpacket(net_a, net_sim_node_ip_port(b), kPacket, sizeof(kPacket)), static_cast<int>(sizeof(kPacket)));
+  EXPECT_EQ(net_sim_in_flight(sim_), 1);
+
+  const uint64_t start = net_sim_time(sim_);
+  step(49);
+  EXPECT_TRUE(received_b.from.empty());
+  step(1);
+  ASSERT_EQ(received_b.from.size(), 1);
+  EXPECT_TRUE(same_ip_port(received_b.from[0], net_sim_node_ip_port(a)));
+  EXPECT_EQ(received_b.times[0], start + 50);
+  EXPECT_EQ(net_sim_in_flight(sim_), 0);
+
+  EXPECT_EQ(net_sim_node_stats(a)->packets_sent, 1);
+  EXPECT_EQ(net_sim_node_stats(b)->bytes_received, sizeof(kPacket));
+}
+
+// Send 1000 packets over a lossy, jittery link and return when each arrived.
+std::vector<uint64_t> lossy_run(uint64_t seed) {
+  Logger *log = logger_new();
+  Net_Sim *sim = net_sim_new(seed);
+  const Net_Sim_Link link = {20, 30, 25};
+  net_sim_set_link(sim, &link);
+  Net_Sim_Node *a = net_sim_node_new(sim, NET_SIM_NAT_NONE);
+  Net_Sim_Node *b = net_sim_node_new(sim, NET_SIM_NAT_NONE);
+  Networking_Core *net_a = new_networking_sim(log, a);
+  Networking_Core *net_b = new_networking_sim(log, b);
+  Received received;
+  received.sim = sim;
+  networking_registerhandler(net_b, kPacketId, &handle_packet, &received);
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    sendpacket(net_a, net_sim_node_ip_port(b), kPacket, sizeof(kPacket));
+    net_sim_advance(sim, 1);
+    networking_poll(net_b, nullptr);
+  }
+
+  net_sim_advance(sim, 100);
+  networking_poll(net_b, nullptr);
+
+  const uint64_t start = net_sim_time(sim) - 1100;
+
+  for (uint64_t &time : received.times) {
+    time -= start;
+  }
+
+  EXPECT_EQ(net_sim_node_stats(a)->packets_lost + received.times.size(), 1000);
+
+  kill_networking(net_b);
+  kill_networking(net_a);
+  net_sim_kill(sim);
+  logger_kill(log);
+  return received.times;
+}
+
+TEST(NetSimLoss, SameSeedGivesSameRun) {
+  const std::vector<uint64_t> first = lossy_run(42);
+  EXPECT_GT(first.size(), 600);
+  EXPECT_LT(first.size(), 900);
+  EXPECT_EQ(lossy_run(42), first);
+  EXPECT_NE(lossy_run(43), first);
+}
+
+TEST_F(NetSim, PortRestrictedNatOnlyLetsRepliesIn) {
+  Net_Sim_Node *nat = net_sim_node_new(sim_, NET_SIM_NAT_PORT_RESTRICTED_CONE);
+  Net_Sim_Node *peer = net_sim_node_new(sim_, NET_SIM_NAT_NONE);
+  Received received_nat, received_peer;
+  Networking_Core *net_nat = add(nat, &received_nat);
+  Networking_Core *net_peer = add(peer, &received_peer);
+
+  sendpacket(net_peer, net_sim_node_ip_port(nat), kPacket, sizeof(kPacket));
+  step(1);
+  EXPECT_TRUE(received_nat.from.empty());
+  EXPECT_EQ(net_sim_node_stats(nat)->packets_filtered, 1);
+
+  sendpacket(net_nat, net_sim_node_ip_port(peer), kPacket, sizeof(kPacket));
+  step(1);
+  ASSERT_EQ(received_peer.from.size(), 1);
+  sendpacket(net_peer, received_peer.from[0], kPacket, sizeof(kPacket));
+  step(1);
+  EXPECT_EQ(received_nat.from.size(), 1);
+
+  step(NET_SIM_NAT_TIMEOUT);
+  sendpacket(net_peer, received_peer.from[0], kPacket, sizeof(kPacket));
+  step(1);
+  EXPECT_EQ(received_nat.from.size(), 1);
+}
+
+TEST_F(NetSim, SymmetricNatMapsEveryDestinationToItsOwnPort) {
+  Net_Sim_Node *nat = net_sim_node_new(sim_, NET_SIM_NAT_SYMMETRIC);
+  Net_Sim_Node *peer1 = net_sim_node_new(sim_, NET_SIM_NAT_NONE);
+  Net_Sim_Node *peer2 = net_sim_node_new(sim_, NET_SIM_NAT_NONE);
+  Received received_nat, received_peer1, received_peer2;
+  Networking_Core *net_nat = add(nat, &received_nat);
+  Networking_Core *net_peer1 = add(peer1, &received_peer1);
+  Networking_Core *net_peer2 = add(peer2, &received_peer2);
+
+  sendpacket(net_nat, net_sim_node_ip_port(peer1), kPacket, sizeof(kPacket));
+  sendpacket(net_nat, net_sim_node_ip_port(peer2), kPacket, sizeof(kPacket));
+  step(1);
+  ASSERT_EQ(received_peer1.from.size(), 1);
+  ASSERT_EQ(received_peer2.from.size(), 1);
+  EXPECT_NE(received_peer1.from[0].port, received_peer2.from[0].port);
+
+  // peer2 can't use the port mapped for peer1.
+  sendpacket(net_peer2, received_peer1.from[0], kPacket, sizeof(kPacket));
+  step(1);
+  EXPECT_TRUE(received_nat.from.empty());
+
+  sendpacket(net_peer1, received_peer1.from[0], kPacket, sizeof(kPacket));
+  step(1);
+  ASSERT_EQ(received_nat.from.size(), 1);
+  EXPECT_TRUE(same_ip_port(received_nat.from[0], net_sim_node_ip_port(peer1)));
+}
+
+}  // namespace
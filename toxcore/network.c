@@ -83,6 +83,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define TOX_EWOULDBLOCK EWOULDBLOCK
@@ -165,10 +166,12 @@ static int inet_pton(int family, const char *addrString, void *addrbuf)
 #endif
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "crypto_core.h"
 #include "logger.h"
 #include "mono_time.h"
 #include "util.h"
@@ -462,6 +465,29 @@ typedef struct Packet_Handler {
     void *object;
 } Packet_Handler;
 
+/* Number of addresses remembered to find the instances replies from them belong to. */
+#define NET_TENANT_ROUTES 1024
+
+/* Number of instances remembered per address, i.e. the most a packet is handed to. */
+#define NET_TENANT_ROUTE_SLOTS 8
+
+/* Packets kept for a tenant until its next networking_poll. */
+#define NET_TENANT_QUEUE_SIZE 256
+
+typedef struct Tenant_Route {
+    IP_Port ip_port;
+    /* The instances that last sent to ip_port. */
+    Networking_Core *tenants[NET_TENANT_ROUTE_SLOTS];
+    uint8_t next_slot;
+} Tenant_Route;
+
+/* A packet the host read for a tenant. The packet data follows the struct. */
+typedef struct Tenant_Packet {
+    struct Tenant_Packet *next;
+    IP_Port ip_port;
+    uint16_t length;
+} Tenant_Packet;
+
 struct Networking_Core {
     const Logger *log;
     Packet_Handler packethandlers[256];
@@ -470,6 +496,26 @@ struct Networking_Core {
     uint16_t port;
     /* Our UDP socket. */
     Socket sock;
+
+    /* Key packets addressed to this instance carry after the packet id, if any. */
+    const uint8_t *receiver_key;
+
+    /* If set, the socket belongs to host and packets are read by it. */
+    Networking_Core *host;
+    /* Packets the host read for us, oldest first. Guarded by the tenants_mutex of host. */
+    Tenant_Packet *queue_head;
+    Tenant_Packet *queue_tail;
+    uint32_t queue_length;
+
+    /* Instances sharing our socket and the addresses they last sent to. */
+    pthread_mutex_t tenants_mutex;
+    Networking_Core **tenants;
+    uint32_t num_tenants;
+    Tenant_Route *routes;
+
+    /* If set, packets go through these functions instead of the socket. */
+    const Network_Funcs *funcs;
+    void *funcs_object;
 };
 
 Family net_family(const Networking_Core *net)
@@ -482,6 +528,88 @@ uint16_t net_port(const Networking_Core *net)
     return net->port;
 }
 
+bool net_is_tenant(const Networking_Core *net)
+{
+    return net->host != nullptr;
+}
+
+Socket net_sock(const Networking_Core *net)
+{
+    return net->sock;
+}
+
+static uint32_t tenant_route_index(IP_Port ip_port)
+{
+    uint32_t hash = ip_port.port;
+
+    if (net_family_is_ipv4(ip_port.ip.family)) {
+        /* The rest of the address union is not necessarily cleared. */
+        hash = hash * 31 + ip_port.ip.ip.v4.uint32;
+    } else {
+        for (uint32_t i = 0; i < sizeof(ip_port.ip.ip.v6.uint32) / sizeof(uint32_t); ++i) {
+            hash = hash * 31 + ip_port.ip.ip.v6.uint32[i];
+        }
+    }
+
+    return hash % NET_TENANT_ROUTES;
+}
+
+/* return true if packets from ip_port come from the socket of host itself, i.e. were sent
+ * by one of the instances sharing it to another.
+ */
+static bool is_shared_socket_address(const Networking_Core *host, IP_Port ip_port)
+{
+    if (ip_port.port != host->port) {
+        return false;
+    }
+
+    if (net_family_is_ipv4(ip_port.ip.family)) {
+        return ip_port.ip.ip.v4.uint8[0] == 127;
+    }
+
+    if (net_family_is_ipv6(ip_port.ip.family)) {
+        const IP6 loopback = get_ip6_loopback();
+        return (ip_port.ip.ip.v6.uint64[0] == loopback.uint64[0] && ip_port.ip.ip.v6.uint64[1] == loopback.uint64[1])
+               || (ip_port.ip.ip.v6.uint8[0] == 0xFE && (ip_port.ip.ip.v6.uint8[1] & 0xC0) == 0x80);
+    }
+
+    return false;
+}
+
+/* Remember that replies from ip_port may belong to net, if net shares a socket. */
+static void add_tenant_route(Networking_Core *net, IP_Port ip_port)
+{
+    Networking_Core *host = net->host != nullptr ? net->host : net;
+
+    if (!net_family_is_ipv4(ip_port.ip.family) && !net_family_is_ipv6(ip_port.ip.family)) {
+        return;
+    }
+
+    pthread_mutex_lock(&host->tenants_mutex);
+
+    if (host->routes != nullptr && !is_shared_socket_address(host, ip_port)) {
+        Tenant_Route *route = &host->routes[tenant_route_index(ip_port)];
+
+        if (!ipport_equal(&route->ip_port, &ip_port)) {
+            memset(route, 0, sizeof(Tenant_Route));
+            route->ip_port = ip_port;
+        }
+
+        bool known = false;
+
+        for (uint32_t i = 0; i < NET_TENANT_ROUTE_SLOTS; ++i) {
+            known = known || route->tenants[i] == net;
+        }
+
+        if (!known) {
+            route->tenants[route->next_slot] = net;
+            route->next_slot = (route->next_slot + 1) % NET_TENANT_ROUTE_SLOTS;
+        }
+    }
+
+    pthread_mutex_unlock(&host->tenants_mutex);
+}
+
 /* Basic network functions:
  * Function to send packet(data) of length length to ip_port.
  */
@@ -499,6 +627,14 @@ int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint1
         return -1;
     }
 
+    add_tenant_route(net, ip_port);
+
+    if (net->funcs != nullptr) {
+        const int res = net->funcs->send(net->funcs_object, ip_port, data, length);
+        loglogdata(net->log, "O=>", data, length, ip_port, res);
+        return res;
+    }
+
     if (net_family_is_ipv4(ip_port.ip.family) && net_family_is_ipv6(net->family)) {
         /* must convert to IPV4-in-IPV6 address */
         IP6 ip6;
@@ -623,30 +759,221 @@ void networking_registerhandler(Networking_Core *net, uint8_t byte, packet_handl
     net->packethandlers[byte].object = object;
 }
 
+void networking_set_receiver_key(Networking_Core *net, const uint8_t *public_key)
+{
+    net->receiver_key = public_key;
+}
+
+/* Queue a copy of a packet for the next networking_poll of tenant.
+ *
+ * Must be called with the tenants_mutex of the tenant's host held.
+ */
+static void queue_tenant_packet(Networking_Core *tenant, IP_Port ip_port, const uint8_t *data, uint16_t length)
+{
+    if (tenant->queue_length >= NET_TENANT_QUEUE_SIZE) {
+        LOGGER_WARNING(tenant->log, "[%02u] -- Tenant queue is full, dropping packet", data[0]);
+        return;
+    }
+
+    Tenant_Packet *packet = (Tenant_Packet *)malloc(sizeof(Tenant_Packet) + length);
+
+    if (packet == nullptr) {
+        return;
+    }
+
+    packet->next = nullptr;
+    packet->ip_port = ip_port;
+    packet->length = length;
+    memcpy(packet + 1, data, length);
+
+    if (tenant->queue_tail != nullptr) {
+        tenant->queue_tail->next = packet;
+    } else {
+        tenant->queue_head = packet;
+    }
+
+    tenant->queue_tail = packet;
+    ++tenant->queue_length;
+}
+
+/* Find out which of the instances sharing the socket of host a packet is for.
+ *
+ * - Packets that carry the receiver key (NET_PACKET_CRYPTO) are for the instance owning it.
+ * - LAN discovery packets are not encrypted and carry no receiver, so they are for every instance.
+ *   So are packets from the socket itself, which one instance sharing it sent to another.
+ * - Any other packet is for the instances that last sent a packet to its source address, or for
+ *   the host if none did. Only the one it is encrypted to accepts it. A packet thus costs at
+ *   most NET_TENANT_ROUTE_SLOTS decryptions, and one if it comes from an unknown sender. When
+ *   more instances talk to an address at once, replies to the ones that sent to it first are
+ *   lost; the requests they answer are retried.
+ *
+ * Must be called with the tenants_mutex of host held.
+ *
+ * return the number of instances put in receivers, or UINT32_MAX if the packet is for every
+ *   instance.
+ */
+static uint32_t shared_packet_receivers(Networking_Core *host, IP_Port ip_port, const uint8_t *data,
+                                        uint16_t length, Networking_Core **receivers)
+{
+    if (data[0] == NET_PACKET_CRYPTO && length > 1 + CRYPTO_PUBLIC_KEY_SIZE) {
+        if (host->receiver_key && id_equal(data + 1, host->receiver_key)) {
+            receivers[0] = host;
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < host->num_tenants; ++i) {
+            Networking_Core *tenant = host->tenants[i];
+
+            if (tenant->receiver_key && id_equal(data + 1, tenant->receiver_key)) {
+                receivers[0] = tenant;
+                return 1;
+            }
+        }
+    }
+
+    if (data[0] == NET_PACKET_LAN_DISCOVERY || is_shared_socket_address(host, ip_port)) {
+        return UINT32_MAX;
+    }
+
+    const Tenant_Route *route = &host->routes[tenant_route_index(ip_port)];
+    uint32_t num = 0;
+
+    if (ipport_equal(&route->ip_port, &ip_port)) {
+        for (uint32_t i = 0; i < NET_TENANT_ROUTE_SLOTS; ++i) {
+            if (route->tenants[i] != nullptr) {
+                receivers[num] = route->tenants[i];
+                ++num;
+            }
+        }
+    }
+
+    if (num == 0) {
+        receivers[0] = host;
+        num = 1;
+    }
+
+    return num;
+}
+
+static void handle_received_packet(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint16_t length,
+                                   void *userdata)
+{
+    if (!(net->packethandlers[data[0]].function)) {
+        LOGGER_WARNING(net->log, "[%02u] -- Packet has no handler", data[0]);
+        return;
+    }
+
+    net->packethandlers[data[0]].function(net->packethandlers[data[0]].object, ip_port, data, length, userdata);
+}
+
+/* Handle a packet read from the socket host shares with other instances.
+ *
+ * The host handles its own packets right away. Packets for a tenant are queued for its
+ * networking_poll, so that every instance can run on a thread of its own.
+ */
+static void handle_shared_packet(Networking_Core *host, IP_Port ip_port, const uint8_t *data, uint16_t length,
+                                 void *userdata)
+{
+    Networking_Core *receivers[NET_TENANT_ROUTE_SLOTS];
+    bool to_host = false;
+
+    pthread_mutex_lock(&host->tenants_mutex);
+
+    const uint32_t num = shared_packet_receivers(host, ip_port, data, length, receivers);
+
+    if (num == UINT32_MAX) {
+        for (uint32_t i = 0; i < host->num_tenants; ++i) {
+            queue_tenant_packet(host->tenants[i], ip_port, data, length);
+        }
+
+        to_host = true;
+    } else {
+        for (uint32_t i = 0; i < num; ++i) {
+            if (receivers[i] == host) {
+                to_host = true;
+            } else {
+                queue_tenant_packet(receivers[i], ip_port, data, length);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&host->tenants_mutex);
+
+    if (to_host) {
+        handle_received_packet(host, ip_port, data, length, userdata);
+    }
+}
+
+/* Read the next packet from the socket, or from the receive function of net.
+ *
+ * return -1 if there is none.
+ */
+static int net_receive(const Networking_Core *net, IP_Port *ip_port, uint8_t *data, uint32_t *length)
+{
+    if (net->funcs == nullptr) {
+        return receivepacket(net->log, net->sock, ip_port, data, length);
+    }
+
+    *length = 0;
+
+    if (net->funcs->recv(net->funcs_object, ip_port, data, length) == -1) {
+        return -1;
+    }
+
+    loglogdata(net->log, "=>O", data, MAX_UDP_PACKET_SIZE, *ip_port, *length);
+    return 0;
+}
+
+/* Handle the packets the host of tenant read for it. */
+static void poll_tenant(Networking_Core *tenant, void *userdata)
+{
+    Networking_Core *host = tenant->host;
+
+    pthread_mutex_lock(&host->tenants_mutex);
+    Tenant_Packet *packet = tenant->queue_head;
+    tenant->queue_head = nullptr;
+    tenant->queue_tail = nullptr;
+    tenant->queue_length = 0;
+    pthread_mutex_unlock(&host->tenants_mutex);
+
+    while (packet != nullptr) {
+        Tenant_Packet *next = packet->next;
+        handle_received_packet(tenant, packet->ip_port, (const uint8_t *)(packet + 1), packet->length, userdata);
+        free(packet);
+        packet = next;
+    }
+}
+
 void networking_poll(Networking_Core *net, void *userdata)
 {
+    if (net->host != nullptr) {
+        poll_tenant(net, userdata);
+        return;
+    }
+
     if (net_family_is_unspec(net->family)) {
         /* Socket not initialized */
         return;
     }
 
-    unix_time_update();
+    pthread_mutex_lock(&net->tenants_mutex);
+    const bool shared = net->routes != nullptr;
+    pthread_mutex_unlock(&net->tenants_mutex);
 
     IP_Port ip_port;
     uint8_t data[MAX_UDP_PACKET_SIZE];
     uint32_t length;
 
-    while (receivepacket(net->log, net->sock, &ip_port, data, &length) != -1) {
+    while (net_receive(net, &ip_port, data, &length) != -1) {
         if (length < 1) {
             continue;
         }
 
-        if (!(net->packethandlers[data[0]].function)) {
-            LOGGER_WARNING(net->log, "[%02u] -- Packet has no handler", data[0]);
-            continue;
+        if (shared) {
+            handle_shared_packet(net, ip_port, data, length, userdata);
+        } else {
+            handle_received_packet(net, ip_port, data, length, userdata);
         }
-
-        net->packethandlers[data[0]].function(net->packethandlers[data[0]].object, ip_port, data, length, userdata);
     }
 }
 
@@ -762,6 +1089,7 @@ Networking_Core *new_networking_ex(const Logger *log, IP ip, uint16_t port_from,
     temp->log = log;
     temp->family = ip.family;
     temp->port = 0;
+    pthread_mutex_init(&temp->tenants_mutex, nullptr);
 
     /* Initialize our socket. */
     /* add log message what we're creating */
@@ -773,6 +1101,7 @@ Networking_Core *new_networking_ex(const Logger *log, IP ip, uint16_t port_from,
         const char *strerror = net_new_strerror(neterror);
         LOGGER_ERROR(log, "Failed to get a socket?! %d, %s", neterror, strerror);
         net_kill_strerror(strerror);
+        pthread_mutex_destroy(&temp->tenants_mutex);
         free(temp);
 
         if (error) {
@@ -843,6 +1172,7 @@ Networking_Core *new_networking_ex(const Logger *log, IP ip, uint16_t port_from,
 
         portptr = &addr6->sin6_port;
     } else {
+        pthread_mutex_destroy(&temp->tenants_mutex);
         free(temp);
         return nullptr;
     }
@@ -945,10 +1275,104 @@ Networking_Core *new_networking_no_udp(const Logger *log)
     }
 
     net->log = log;
+    pthread_mutex_init(&net->tenants_mutex, nullptr);
 
     return net;
 }
 
+Networking_Core *new_networking_funcs(const Logger *log, const Network_Funcs *funcs, void *object, IP_Port ip_port)
+{
+    if (!net_family_is_ipv4(ip_port.ip.family) && !net_family_is_ipv6(ip_port.ip.family)) {
+        return nullptr;
+    }
+
+    Networking_Core *net = (Networking_Core *)calloc(1, sizeof(Networking_Core));
+
+    if (net == nullptr) {
+        return nullptr;
+    }
+
+    net->log = log;
+    net->family = ip_port.ip.family;
+    net->port = ip_port.port;
+    net->sock = net_invalid_socket;
+    net->funcs = funcs;
+    net->funcs_object = object;
+    pthread_mutex_init(&net->tenants_mutex, nullptr);
+
+    return net;
+}
+
+Networking_Core *new_networking_tenant(const Logger *log, Networking_Core *host)
+{
+    if (host->host != nullptr || net_family_is_unspec(host->family)) {
+        LOGGER_ERROR(log, "a tenant can only share an initialised socket that is not shared itself");
+        return nullptr;
+    }
+
+    Networking_Core *net = (Networking_Core *)calloc(1, sizeof(Networking_Core));
+
+    if (net == nullptr) {
+        return nullptr;
+    }
+
+    net->log = log;
+    net->family = host->family;
+    net->port = host->port;
+    net->sock = host->sock;
+    net->host = host;
+    net->funcs = host->funcs;
+    net->funcs_object = host->funcs_object;
+    pthread_mutex_init(&net->tenants_mutex, nullptr);
+
+    pthread_mutex_lock(&host->tenants_mutex);
+
+    if (host->routes == nullptr) {
+        host->routes = (Tenant_Route *)calloc(NET_TENANT_ROUTES, sizeof(Tenant_Route));
+    }
+
+    Networking_Core **tenants = nullptr;
+
+    if (host->routes != nullptr) {
+        tenants = (Networking_Core **)realloc(host->tenants, (host->num_tenants + 1) * sizeof(Networking_Core *));
+    }
+
+    if (tenants == nullptr) {
+        pthread_mutex_unlock(&host->tenants_mutex);
+        pthread_mutex_destroy(&net->tenants_mutex);
+        free(net);
+        return nullptr;
+    }
+
+    host->tenants = tenants;
+    host->tenants[host->num_tenants] = net;
+    ++host->num_tenants;
+
+    pthread_mutex_unlock(&host->tenants_mutex);
+
+    return net;
+}
+
+/* Must be called with the tenants_mutex of host held. */
+static void remove_tenant(Networking_Core *host, const Networking_Core *tenant)
+{
+    for (uint32_t i = 0; i < host->num_tenants; ++i) {
+        if (host->tenants[i] == tenant) {
+            --host->num_tenants;
+            host->tenants[i] = host->tenants[host->num_tenants];
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < NET_TENANT_ROUTES; ++i) {
+        for (uint32_t j = 0; j < NET_TENANT_ROUTE_SLOTS; ++j) {
+            if (host->routes[i].tenants[j] == tenant) {
+                host->routes[i].tenants[j] = nullptr;
+            }
+        }
+    }
+}
+
 /* Function to cleanup networking stuff. */
 void kill_networking(Networking_Core *net)
 {
@@ -956,11 +1380,36 @@ void kill_networking(Networking_Core *net)
         return;
     }
 
-    if (!net_family_is_unspec(net->family)) {
+    if (net->host != nullptr) {
+        /* The socket belongs to the host. */
+        pthread_mutex_lock(&net->host->tenants_mutex);
+        remove_tenant(net->host, net);
+        pthread_mutex_unlock(&net->host->tenants_mutex);
+    }
+
+    for (uint32_t i = 0; i < net->num_tenants; ++i) {
+        /* Tenants outliving their host can no longer send. */
+        Networking_Core *tenant = net->tenants[i];
+        tenant->host = nullptr;
+        tenant->family = net_family_unspec;
+        tenant->sock = net_invalid_socket;
+        tenant->funcs = nullptr;
+    }
+
+    while (net->queue_head != nullptr) {
+        Tenant_Packet *next = net->queue_head->next;
+        free(net->queue_head);
+        net->queue_head = next;
+    }
+
+    if (net->host == nullptr && !net_family_is_unspec(net->family) && net->funcs == nullptr) {
         /* Socket is initialized, so we close it. */
         kill_sock(net->sock);
     }
 
+    pthread_mutex_destroy(&net->tenants_mutex);
+    free(net->tenants);
+    free(net->routes);
     free(net);
 }
 
@@ -1527,6 +1976,44 @@ int net_send(Socket sock, const void *buf, size_t len)
     return send(sock.socket, (const char *)buf, len, MSG_NOSIGNAL);
 }
 
+int net_send_gather(Socket sock, const Net_Send_Chunk *chunks, uint16_t num_chunks)
+{
+    if (num_chunks > NET_SEND_MAX_CHUNKS) {
+        num_chunks = NET_SEND_MAX_CHUNKS;
+    }
+
+#ifdef OS_WIN32
+    WSABUF bufs[NET_SEND_MAX_CHUNKS];
+
+    for (uint16_t i = 0; i < num_chunks; ++i) {
+        bufs[i].buf = (char *)chunks[i].data;
+        bufs[i].len = chunks[i].length;
+    }
+
+    DWORD sent = 0;
+
+    if (WSASend(sock.socket, bufs, num_chunks, &sent, 0, nullptr, nullptr) != 0) {
+        return -1;
+    }
+
+    return sent;
+#else
+    struct iovec iov[NET_SEND_MAX_CHUNKS];
+
+    for (uint16_t i = 0; i < num_chunks; ++i) {
+        iov[i].iov_base = (void *)chunks[i].data;
+        iov[i].iov_len = chunks[i].length;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = num_chunks;
+
+    return sendmsg(sock.socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
 int net_recv(Socket sock, void *buf, size_t len)
 {
     return recv(sock.socket, (char *)buf, len, MSG_NOSIGNAL);
@@ -81,6 +81,21 @@ int net_send(Socket sockfd, const void *buf, size_t len);
  * Calls recv(sockfd, buf, len, MSG_NOSIGNAL).
  */
 int net_recv(Socket sockfd, void *buf, size_t len);
+
+/* Maximum number of chunks net_send_gather sends in one call. */
+#define NET_SEND_MAX_CHUNKS 8
+
+/** A piece of the data passed to net_send_gather. */
+typedef struct Net_Send_Chunk {
+    const uint8_t *data;
+    size_t length;
+} Net_Send_Chunk;
+
+/**
+ * Sends the first NET_SEND_MAX_CHUNKS chunks in order in a single call, like
+ * writev(2). Returns the number of bytes sent like net_send.
+ */
+int net_send_gather(Socket sockfd, const Net_Send_Chunk *chunks, uint16_t num_chunks);
 /**
  * Calls listen(sockfd, backlog).
  */
@@ -347,6 +362,9 @@ typedef struct Networking_Core Networking_Core;
 
 Family net_family(const Networking_Core *net);
 uint16_t net_port(const Networking_Core *net);
+Socket net_sock(const Networking_Core *net);
+/* Return true if net shares the socket of another Networking_Core. */
+bool net_is_tenant(const Networking_Core *net);
 
 /* Run this before creating sockets.
  *
@@ -395,7 +413,17 @@ int sendpacket(Networking_Core *net, IP_Port ip_port, const uint8_t *data, uint1
 /* Function to call when packet beginning with byte is received. */
 void networking_registerhandler(Networking_Core *net, uint8_t byte, packet_handler_cb *cb, void *object);
 
-/* Call this several times a second. */
+/* Set the public key that packets addressed to this instance carry right after the packet id
+ * (NET_PACKET_CRYPTO). The key is not copied and must stay valid until it is reset to NULL.
+ * Only used to demultiplex packets arriving on a shared socket.
+ */
+void networking_set_receiver_key(Networking_Core *net, const uint8_t *public_key);
+
+/* Call this several times a second.
+ *
+ * For a tenant, this does not read from the socket. It handles the packets the host's
+ * networking_poll read for it since its last call.
+ */
 void networking_poll(Networking_Core *net, void *userdata);
 
 /* Connect a socket to the address specified by the ip_port. */
@@ -465,7 +493,41 @@ Networking_Core *new_networking(const Logger *log, IP ip, uint16_t port);
 Networking_Core *new_networking_ex(const Logger *log, IP ip, uint16_t port_from, uint16_t port_to, unsigned int *error);
 Networking_Core *new_networking_no_udp(const Logger *log);
 
-/* Function to cleanup networking stuff (doesn't do much right now). */
+/* Functions a Networking_Core created with new_networking_funcs uses instead of a UDP socket.
+ *
+ * send returns the number of bytes sent or -1 on failure, like sendto.
+ * recv returns 0 and fills in the sender, data and length of the next packet, or returns -1
+ * if there is none. data has room for MAX_UDP_PACKET_SIZE bytes.
+ */
+typedef int net_send_cb(void *object, IP_Port ip_port, const uint8_t *data, uint16_t length);
+typedef int net_recv_cb(void *object, IP_Port *ip_port, uint8_t *data, uint32_t *length);
+
+typedef struct Network_Funcs {
+    net_send_cb *send;
+    net_recv_cb *recv;
+} Network_Funcs;
+
+/* Create a Networking_Core that sends and receives through funcs, called with object, instead
+ * of a socket, e.g. to run instances on a simulated network. ip_port is the address it
+ * reports as its own. funcs and object must outlive it.
+ *
+ * return NULL on failure.
+ */
+Networking_Core *new_networking_funcs(const Logger *log, const Network_Funcs *funcs, void *object, IP_Port ip_port);
+
+/* Create a tenant of host: a Networking_Core with its own packet handlers that sends through
+ * and receives from the UDP socket of host. Packets are read by networking_poll(host) and passed to
+ * the host or queued for the tenant they belong to. Each instance sharing a socket may be polled
+ * from a thread of its own.
+ *
+ * return NULL if host is itself a tenant, has no socket, or on allocation failure.
+ */
+Networking_Core *new_networking_tenant(const Logger *log, Networking_Core *host);
+
+/* Function to cleanup networking stuff (doesn't do much right now).
+ *
+ * Killing a host leaves its tenants without a socket; they should be killed first.
+ */
 void kill_networking(Networking_Core *net);
 
 #ifdef __cplusplus
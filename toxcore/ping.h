@@ -41,12 +41,17 @@ typedef struct IP_Port IP_Port;
 typedef struct DHT DHT;
 #endif /* DHT_DEFINED */
 
+#ifndef MONO_TIME_DEFINED
+#define MONO_TIME_DEFINED
+typedef struct Mono_Time Mono_Time;
+#endif /* MONO_TIME_DEFINED */
+
 #ifndef PING_DEFINED
 #define PING_DEFINED
 typedef struct Ping Ping;
 #endif /* PING_DEFINED */
 
-Ping *ping_new(DHT *dht);
+Ping *ping_new(const Mono_Time *mono_time, DHT *dht);
 
 void ping_kill(Ping *ping);
 
@@ -25,6 +25,7 @@
 #ifndef PING_ARRAY_H
 #define PING_ARRAY_H
 
+#include "mono_time.h"
 #include "network.h"
 %}
 
@@ -53,7 +54,7 @@ void kill();
  * return ping_id on success.
  * return 0 on failure.
  */
-uint64_t add(const uint8_t *data, uint32_t length);
+uint64_t add(const mono_Time *mono_time, const uint8_t *data, uint32_t length);
 
 /**
  * Check if ping_id is valid and not timed out.
@@ -63,7 +64,7 @@ uint64_t add(const uint8_t *data, uint32_t length);
  * return length of data copied on success.
  * return -1 on failure.
  */
-int32_t check(uint8_t[length] data, uint64_t ping_id);
+int32_t check(const mono_Time *mono_time, uint8_t[length] data, uint64_t ping_id);
 
 }
 
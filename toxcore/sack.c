@@ -0,0 +1,220 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sack.h"
+
+#include <string.h>
+
+#include "ccompat.h"
+
+void sack_ranges_trim(Sack_Ranges *ranges, uint32_t base)
+{
+    /* Packet windows are far smaller than 2^31, so a negative signed distance
+     * means a number lies before base. Ranges are sorted, so the ones to drop
+     * are at the front. */
+    uint16_t i = 0;
+
+    while (i < ranges->num && (int32_t)(ranges->range[i].end - base) <= 0) {
+        ++i;
+    }
+
+    if (i < ranges->num && (int32_t)(ranges->range[i].start - base) < 0) {
+        ranges->range[i].start = base;
+    }
+
+    if (i != 0) {
+        memmove(&ranges->range[0], &ranges->range[i], (ranges->num - i) * sizeof(Sack_Range));
+        ranges->num -= i;
+    }
+}
+
+bool sack_ranges_add(Sack_Ranges *ranges, uint32_t base, uint32_t start, uint32_t end)
+{
+    const uint32_t s = start - base;
+    const uint32_t e = end - base;
+
+    if (s >= e) {
+        return true;
+    }
+
+    /* First range that ends at or after the new one starts: it touches or follows it. */
+    uint16_t first = ranges->num;
+
+    while (first > 0 && ranges->range[first - 1].end - base >= s) {
+        --first;
+    }
+
+    /* Ranges [first, last) touch the new range and are merged into it. */
+    uint16_t last = first;
+    uint32_t merged_s = s;
+    uint32_t merged_e = e;
+
+    while (last < ranges->num && ranges->range[last].start - base <= e) {
+        if (ranges->range[last].start - base < merged_s) {
+            merged_s = ranges->range[last].start - base;
+        }
+
+        if (ranges->range[last].end - base > merged_e) {
+            merged_e = ranges->range[last].end - base;
+        }
+
+        ++last;
+    }
+
+    if (first == last) {
+        if (ranges->num == SACK_MAX_RANGES) {
+            return false;
+        }
+
+        memmove(&ranges->range[first + 1], &ranges->range[first], (ranges->num - first) * sizeof(Sack_Range));
+        ++ranges->num;
+    } else if (last - first > 1) {
+        memmove(&ranges->range[first + 1], &ranges->range[last], (ranges->num - last) * sizeof(Sack_Range));
+        ranges->num -= last - first - 1;
+    }
+
+    ranges->range[first].start = base + merged_s;
+    ranges->range[first].end = base + merged_e;
+    return true;
+}
+
+bool sack_ranges_contains(const Sack_Ranges *ranges, uint32_t base, uint32_t number)
+{
+    const uint32_t n = number - base;
+
+    for (uint16_t i = 0; i < ranges->num; ++i) {
+        if (ranges->range[i].start - base > n) {
+            return false;
+        }
+
+        if (ranges->range[i].end - base > n) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Write value as a varint.
+ *
+ * return number of bytes written, 0 if it doesn't fit.
+ */
+static uint16_t write_varint(uint8_t *data, uint16_t length, uint32_t value)
+{
+    uint16_t i = 0;
+
+    do {
+        if (i == length) {
+            return 0;
+        }
+
+        data[i] = value & 0x7F;
+        value >>= 7;
+
+        if (value != 0) {
+            data[i] |= 0x80;
+        }
+
+        ++i;
+    } while (value != 0);
+
+    return i;
+}
+
+/* Read a varint.
+ *
+ * return number of bytes read, 0 if the data is malformed.
+ */
+static uint16_t read_varint(const uint8_t *data, uint16_t length, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    for (uint16_t i = 0; i < length && i < 5; ++i) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+uint16_t sack_ranges_encode(const Sack_Ranges *ranges, uint32_t base, uint32_t end, uint8_t *data, uint16_t length)
+{
+    uint16_t pos = write_varint(data, length, end - base);
+
+    if (pos == 0) {
+        return 0;
+    }
+
+    uint32_t prev = base;
+
+    for (uint16_t i = 0; i < ranges->num; ++i) {
+        uint8_t buf[10];
+        uint16_t len = write_varint(buf, sizeof(buf), ranges->range[i].start - prev);
+        len += write_varint(buf + len, sizeof(buf) - len, ranges->range[i].end - ranges->range[i].start);
+
+        if (pos + len > length) {
+            break;
+        }
+
+        memcpy(data + pos, buf, len);
+        pos += len;
+        prev = ranges->range[i].end;
+    }
+
+    return pos;
+}
+
+int sack_ranges_decode(Sack_Ranges *ranges, uint32_t *end, uint32_t base, uint32_t max_distance, const uint8_t *data,
+                       uint16_t length)
+{
+    uint32_t distance;
+    uint16_t pos = read_varint(data, length, &distance);
+
+    if (pos == 0 || distance > max_distance) {
+        return -1;
+    }
+
+    *end = base + distance;
+    ranges->num = 0;
+    uint32_t prev = 0;
+
+    while (pos < length) {
+        if (ranges->num == SACK_MAX_RANGES) {
+            return -1;
+        }
+
+        uint32_t gap;
+        uint32_t run;
+        const uint16_t gap_len = read_varint(data + pos, length - pos, &gap);
+
+        if (gap_len == 0) {
+            return -1;
+        }
+
+        pos += gap_len;
+        const uint16_t run_len = read_varint(data + pos, length - pos, &run);
+
+        if (run_len == 0 || run == 0) {
+            return -1;
+        }
+
+        pos += run_len;
+
+        /* The first range may start at base, all others leave a gap. */
+        if ((ranges->num != 0 && gap == 0) || gap > max_distance - prev || run > max_distance - prev - gap) {
+            return -1;
+        }
+
+        ranges->range[ranges->num].start = base + prev + gap;
+        ranges->range[ranges->num].end = base + prev + gap + run;
+        prev += gap + run;
+        ++ranges->num;
+    }
+
+    return 0;
+}
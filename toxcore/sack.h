@@ -0,0 +1,86 @@
+/**
+ * Selective acknowledgement ranges for net_crypto.
+ *
+ * A Sack_Ranges list holds sorted, disjoint ranges of packet numbers. The
+ * receiver of a lossless stream uses one to remember which packets above its
+ * buffer start it already has, and the sender uses one to remember which of
+ * its packets the peer already acknowledged, so neither side has to walk its
+ * whole packet window to build or process a loss report.
+ *
+ * Packet numbers wrap around, so all operations take a base: the lowest packet
+ * number still of interest. Ranges are compared by their distance from it.
+ */
+#ifndef C_TOXCORE_TOXCORE_SACK_H
+#define C_TOXCORE_TOXCORE_SACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of ranges a list holds. Further ranges above the highest
+ * one are not recorded, which only makes reports less precise. */
+#define SACK_MAX_RANGES 64
+
+/* Longest encoding of a list of SACK_MAX_RANGES ranges. */
+#define SACK_MAX_ENCODED_SIZE (5 + SACK_MAX_RANGES * 2 * 5)
+
+/** Packet numbers [start, end). */
+typedef struct Sack_Range {
+    uint32_t start;
+    uint32_t end;
+} Sack_Range;
+
+typedef struct Sack_Ranges {
+    Sack_Range range[SACK_MAX_RANGES];
+    uint16_t num;
+} Sack_Ranges;
+
+/**
+ * Remove all packet numbers before base from the list.
+ */
+void sack_ranges_trim(Sack_Ranges *ranges, uint32_t base);
+
+/**
+ * Add packet numbers [start, end) to a list trimmed to base, merging it with
+ * the ranges it touches.
+ *
+ * @return false if the range could not be added because the list is full.
+ */
+bool sack_ranges_add(Sack_Ranges *ranges, uint32_t base, uint32_t start, uint32_t end);
+
+/**
+ * Return true if the packet number is in one of the ranges.
+ */
+bool sack_ranges_contains(const Sack_Ranges *ranges, uint32_t base, uint32_t number);
+
+/**
+ * Encode a list trimmed to base into data, together with end: the number
+ * after the highest packet the sender is known to have sent. Everything in
+ * [base, end) that is not in a range is reported as missing.
+ *
+ * Each number is encoded relative to the previous one as a little endian base
+ * 128 varint: first end - base, then for each range the gap before it and its
+ * length. Ranges that don't fit in length bytes are left out.
+ *
+ * @return the number of bytes written.
+ */
+uint16_t sack_ranges_encode(const Sack_Ranges *ranges, uint32_t base, uint32_t end, uint8_t *data, uint16_t length);
+
+/**
+ * Decode a list encoded by sack_ranges_encode with the same base. Neither the
+ * end nor any range may lie more than max_distance packets after base.
+ *
+ * @return -1 if the data is malformed.
+ * @return 0 on success.
+ */
+int sack_ranges_decode(Sack_Ranges *ranges, uint32_t *end, uint32_t base, uint32_t max_distance, const uint8_t *data,
+                       uint16_t length);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // C_TOXCORE_TOXCORE_SACK_H
@@ -0,0 +1,134 @@
+#include "sack.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+Sack_Ranges make_ranges(std::initializer_list<Sack_Range> list) {
+  Sack_Ranges ranges = {};
+
+  for (const Sack_Range &range : list) {
+    ranges.range[ranges.num++] = range;
+  }
+
+  return ranges;
+}
+
+void expect_ranges(const Sack_Ranges &ranges, std::initializer_list<Sack_Range> expected) {
+  ASSERT_EQ(ranges.num, expected.size());
+  uint16_t i = 0;
+
+  for (const Sack_Range &range : expected) {
+    EXPECT_EQ(ranges.range[i].start, range.start) << "range " << i;
+    EXPECT_EQ(ranges.range[i].end, range.end) << "range " << i;
+    ++i;
+  }
+}
+
+TEST(Sack, AddMergesTouchingRanges) {
+  Sack_Ranges ranges = {};
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 10, 11));
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 20, 25));
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 5, 6));
+  expect_ranges(ranges, {{5, 6}, {10, 11}, {20, 25}});
+
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 11, 12));
+  expect_ranges(ranges, {{5, 6}, {10, 12}, {20, 25}});
+
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 8, 22));
+  expect_ranges(ranges, {{5, 6}, {8, 25}});
+
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 6, 8));
+  expect_ranges(ranges, {{5, 25}});
+}
+
+TEST(Sack, AddFailsOnlyWhenANewRangeIsNeeded) {
+  Sack_Ranges ranges = {};
+
+  for (uint32_t i = 0; i < SACK_MAX_RANGES; ++i) {
+    ASSERT_TRUE(sack_ranges_add(&ranges, 0, i * 2, i * 2 + 1));
+  }
+
+  EXPECT_FALSE(sack_ranges_add(&ranges, 0, 1000, 1001));
+  EXPECT_TRUE(sack_ranges_add(&ranges, 0, 1, 2));
+  EXPECT_EQ(ranges.num, SACK_MAX_RANGES - 1);
+}
+
+TEST(Sack, TrimDropsAndClipsRanges) {
+  Sack_Ranges ranges = make_ranges({{5, 10}, {12, 20}, {30, 31}});
+  sack_ranges_trim(&ranges, 15);
+  expect_ranges(ranges, {{15, 20}, {30, 31}});
+
+  sack_ranges_trim(&ranges, 31);
+  EXPECT_EQ(ranges.num, 0);
+}
+
+TEST(Sack, WorksAcrossPacketNumberWraparound) {
+  const uint32_t base = UINT32_MAX - 5;
+  Sack_Ranges ranges = {};
+  EXPECT_TRUE(sack_ranges_add(&ranges, base, base + 8, base + 10));
+  EXPECT_TRUE(sack_ranges_add(&ranges, base, base + 2, base + 4));
+  expect_ranges(ranges, {{base + 2, base + 4}, {base + 8, base + 10}});
+
+  EXPECT_TRUE(sack_ranges_contains(&ranges, base, base + 9));
+  EXPECT_FALSE(sack_ranges_contains(&ranges, base, base + 5));
+
+  sack_ranges_trim(&ranges, base + 9);
+  expect_ranges(ranges, {{base + 9, base + 10}});
+}
+
+TEST(Sack, EncodeDecodeRoundTrip) {
+  const uint32_t base = 1000;
+  const Sack_Ranges ranges = make_ranges({{1000, 1003}, {1200, 1201}, {5000, 6000}});
+
+  uint8_t data[SACK_MAX_ENCODED_SIZE];
+  const uint16_t length = sack_ranges_encode(&ranges, base, 6500, data, sizeof(data));
+  ASSERT_GT(length, 0);
+  EXPECT_LT(length, 16) << "encoding should be compact";
+
+  Sack_Ranges decoded;
+  uint32_t end;
+  ASSERT_EQ(sack_ranges_decode(&decoded, &end, base, 32768, data, length), 0);
+  EXPECT_EQ(end, 6500u);
+  expect_ranges(decoded, {{1000, 1003}, {1200, 1201}, {5000, 6000}});
+}
+
+TEST(Sack, EncodeLeavesOutRangesThatDontFit) {
+  const Sack_Ranges ranges = make_ranges({{1, 2}, {3, 4}, {5, 6}});
+
+  uint8_t data[5];
+  const uint16_t length = sack_ranges_encode(&ranges, 0, 10, data, sizeof(data));
+  EXPECT_EQ(length, 5);
+
+  Sack_Ranges decoded;
+  uint32_t end;
+  ASSERT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, data, length), 0);
+  expect_ranges(decoded, {{1, 2}, {3, 4}});
+}
+
+TEST(Sack, DecodeRejectsMalformedData) {
+  Sack_Ranges decoded;
+  uint32_t end;
+
+  // Truncated varint.
+  const uint8_t truncated[] = {0x80};
+  EXPECT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, truncated, sizeof(truncated)), -1);
+
+  // Range without a length.
+  const uint8_t no_run[] = {10, 1};
+  EXPECT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, no_run, sizeof(no_run)), -1);
+
+  // Empty range.
+  const uint8_t empty_run[] = {10, 1, 0};
+  EXPECT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, empty_run, sizeof(empty_run)), -1);
+
+  // Ranges that touch should have been merged.
+  const uint8_t touching[] = {10, 1, 1, 0, 1};
+  EXPECT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, touching, sizeof(touching)), -1);
+
+  // Beyond the window.
+  const uint8_t too_far[] = {10, 0x80, 0x80, 0x02, 1};
+  EXPECT_EQ(sack_ranges_decode(&decoded, &end, 0, 32768, too_far, sizeof(too_far)), -1);
+}
+
+}  // namespace
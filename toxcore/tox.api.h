@@ -712,6 +712,30 @@ static this new(const options_t *options) {
 }
 
 
+/**
+ * @brief Creates a new Tox instance that shares the UDP socket of another one.
+ *
+ * This is meant for hosts running many identities: instead of binding its own
+ * UDP port, the new instance sends through and receives from the socket of
+ * host. Incoming packets are read by $iterate on host and queued for the
+ * instance they belong to, which handles them in its own next $iterate
+ * call. Each instance sharing a socket may be iterated from a thread of its
+ * own. Host must be killed after all instances sharing its socket.
+ *
+ * Packets from a sender no instance has sent a packet to yet only reach host.
+ * A new instance therefore has to bootstrap before others can reach it. The
+ * start_port and end_port options are ignored, udp_enabled must be true.
+ * Every instance has its own DHT, onion and TCP relay connections: peers find
+ * an instance by its own DHT key, so these cannot be shared.
+ *
+ * @param host An instance with UDP enabled that does not share another
+ *   instance's socket itself. Otherwise TOX_ERR_NEW_PORT_ALLOC is set.
+ *
+ * @return A new Tox instance pointer on success or NULL on failure.
+ */
+static this new_shared(const options_t *options, this *host) with error for new;
+
+
 /**
  * Releases all resources associated with the Tox instance and disconnects from
  * the network.
@@ -721,6 +745,33 @@ static this new(const options_t *options) {
  */
 void kill();
 
+/**
+ * Sets the lowest level of messages passed to the log callback.
+ *
+ * Messages below the level are dropped before their arguments are evaluated,
+ * so that builds with debug logging cost little while it is not wanted.
+ *
+ * @param file If not NULL, the level only applies to messages from the source
+ *   file with this name, e.g. "video.c", and takes precedence over the level
+ *   for all files.
+ *
+ * @return true on success, false if too many files have a level of their own.
+ */
+bool set_log_level(string file, LOG_LEVEL level);
+
+/**
+ * Formats log messages and calls the log callback on a background thread.
+ *
+ * The threads logging then only queue the arguments of each message. The log
+ * callback must be safe to call from that thread. Messages logged while
+ * queue_size messages are waiting are dropped, and a warning tells how many.
+ * Messages still queued are passed to the callback in $kill.
+ *
+ * @return true on success, false if the thread could not be started or the
+ *   log callback already runs on one.
+ */
+bool start_log_thread(uint32_t queue_size);
+
 
 uint8_t[size] savedata {
   /**
@@ -868,6 +919,23 @@ const uint32_t iteration_interval();
 void iterate(any user_data);
 
 
+/**
+ * Return a file descriptor that becomes readable when $iterate() should be
+ * called: either a socket used by this instance has data to read, or one of
+ * its timers is due. This can be less often than $iteration_interval()
+ * suggests; an idle instance only needs to run once per second.
+ *
+ * This allows clients to wait for work in their own event loop (poll, select,
+ * epoll, ...) instead of calling $iterate() on a fixed cadence. The descriptor
+ * is owned by the Tox instance and must not be read from or closed by the
+ * client. It is kept up to date by $iterate(), so clients must call $iterate()
+ * every time it becomes readable.
+ *
+ * @return the file descriptor, or -1 if the platform does not support it.
+ */
+int32_t get_event_fd();
+
+
 /*******************************************************************************
  *
  * :: Internal client information (Tox address/id)
@@ -2626,6 +2694,39 @@ inline namespace self {
 
 }
 
+
+/**
+ * Congestion control algorithm of the connections to friends.
+ */
+enum class CONGESTION_CONTROL {
+  /**
+   * The original toxcore algorithm: the rate follows the rate the connection
+   * achieves and shrinks when the send queue grows. This is the default.
+   */
+  TOX,
+  /**
+   * Estimates the bottleneck bandwidth of the path from the delivery rate and
+   * paces packets at a multiple of it. Isolated losses don't slow it down.
+   */
+  BBR,
+  /**
+   * CUBIC: a loss-based window that grows along a cubic curve, paced over the
+   * round trip time.
+   */
+  CUBIC,
+}
+
+
+/**
+ * Sets the congestion control algorithm of all current and future connections.
+ * Connections that switch algorithm start over with a fresh estimate of the
+ * path.
+ *
+ * @return true on success, false if the algorithm is unknown or some
+ *   connections could not be switched.
+ */
+bool set_congestion_control(CONGESTION_CONTROL algorithm);
+
 } // class tox
 
 %{
@@ -2668,6 +2769,7 @@ typedef TOX_LOG_LEVEL Tox_Log_Level;
 typedef TOX_CONNECTION Tox_Connection;
 typedef TOX_FILE_CONTROL Tox_File_Control;
 typedef TOX_CONFERENCE_TYPE Tox_Conference_Type;
+typedef TOX_CONGESTION_CONTROL Tox_Congestion_Control;
 
 #endif
 %}
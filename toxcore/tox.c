@@ -81,7 +81,7 @@ bool tox_version_is_compatible(uint32_t major, uint32_t minor, uint32_t patch)
 }
 
 
-Tox *tox_new(const struct Tox_Options *options, Tox_Err_New *error)
+static Tox *tox_new_internal(const struct Tox_Options *options, Messenger *host, Tox_Err_New *error)
 {
     Messenger_Options m_options = {0};
 
@@ -149,6 +149,10 @@ Tox *tox_new(const struct Tox_Options *options, Tox_Err_New *error)
     m_options.log_callback = (logger_cb *)tox_options_get_log_callback(opts);
     m_options.log_user_data = tox_options_get_log_user_data(opts);
 
+    if (host != nullptr) {
+        m_options.host_net = host->net;
+    }
+
     switch (tox_options_get_proxy_type(opts)) {
         case TOX_PROXY_TYPE_HTTP:
             m_options.proxy_info.proxy_type = TCP_PROXY_HTTP;
@@ -223,6 +227,28 @@ Tox *tox_new(const struct Tox_Options *options, Tox_Err_New *error)
     return m;
 }
 
+Tox *tox_new(const struct Tox_Options *options, Tox_Err_New *error)
+{
+    return tox_new_internal(options, nullptr, error);
+}
+
+Tox *tox_new_shared(const struct Tox_Options *options, Tox *host, Tox_Err_New *error)
+{
+    if (host == nullptr) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_NEW_NULL);
+        return nullptr;
+    }
+
+    Messenger *m = host;
+
+    if (m->options.udp_disabled || net_is_tenant(m->net)) {
+        SET_ERROR_PARAMETER(error, TOX_ERR_NEW_PORT_ALLOC);
+        return nullptr;
+    }
+
+    return tox_new_internal(options, m, error);
+}
+
 void tox_kill(Tox *tox)
 {
     if (tox == nullptr) {
@@ -234,6 +260,18 @@ void tox_kill(Tox *tox)
     kill_messenger(m);
 }
 
+bool tox_set_log_level(Tox *tox, const char *file, Tox_Log_Level level)
+{
+    Messenger *m = tox;
+    return logger_set_level(m->log, file, (Logger_Level)level);
+}
+
+bool tox_start_log_thread(Tox *tox, uint32_t queue_size)
+{
+    Messenger *m = tox;
+    return logger_start_async(m->log, queue_size);
+}
+
 size_t tox_get_savedata_size(const Tox *tox)
 {
     const Messenger *m = tox;
@@ -371,6 +409,12 @@ void tox_iterate(Tox *tox, void *user_data)
     do_groupchats((Group_Chats *)m->conferences_object, user_data);
 }
 
+int32_t tox_get_event_fd(Tox *tox)
+{
+    Messenger *m = tox;
+    return m_get_event_fd(m);
+}
+
 void tox_self_get_address(const Tox *tox, uint8_t *address)
 {
     if (address) {
@@ -1586,6 +1630,31 @@ uint16_t tox_self_get_tcp_port(const Tox *tox, Tox_Err_Get_Port *error)
     return 0;
 }
 
+bool tox_set_congestion_control(Tox *tox, Tox_Congestion_Control algorithm)
+{
+    Messenger *m = tox;
+    Congestion_Control_Type type;
+
+    switch (algorithm) {
+        case TOX_CONGESTION_CONTROL_TOX:
+            type = CONGESTION_CONTROL_TOX;
+            break;
+
+        case TOX_CONGESTION_CONTROL_BBR:
+            type = CONGESTION_CONTROL_BBR;
+            break;
+
+        case TOX_CONGESTION_CONTROL_CUBIC:
+            type = CONGESTION_CONTROL_CUBIC;
+            break;
+
+        default:
+            return false;
+    }
+
+    return net_crypto_set_congestion_control(m->net_crypto, type) == 0;
+}
+
 
 /* * * * * * * * * * * * * * *
  *
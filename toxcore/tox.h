@@ -882,6 +882,29 @@ typedef enum TOX_ERR_NEW {
  */
 Tox *tox_new(const struct Tox_Options *options, TOX_ERR_NEW *error);
 
+/**
+ * @brief Creates a new Tox instance that shares the UDP socket of another one.
+ *
+ * This is meant for hosts running many identities: instead of binding its own
+ * UDP port, the new instance sends through and receives from the socket of
+ * host. Incoming packets are read by tox_iterate on host and queued for the
+ * instance they belong to, which handles them in its own next tox_iterate
+ * call. Each instance sharing a socket may be iterated from a thread of its
+ * own. Host must be killed after all instances sharing its socket.
+ *
+ * Packets from a sender no instance has sent a packet to yet only reach host.
+ * A new instance therefore has to bootstrap before others can reach it. The
+ * start_port and end_port options are ignored, udp_enabled must be true.
+ * Every instance has its own DHT, onion and TCP relay connections: peers find
+ * an instance by its own DHT key, so these cannot be shared.
+ *
+ * @param host An instance with UDP enabled that does not share another
+ *   instance's socket itself. Otherwise TOX_ERR_NEW_PORT_ALLOC is set.
+ *
+ * @return A new Tox instance pointer on success or NULL on failure.
+ */
+Tox *tox_new_shared(const struct Tox_Options *options, Tox *host, TOX_ERR_NEW *error);
+
 /**
  * Releases all resources associated with the Tox instance and disconnects from
  * the network.
@@ -891,6 +914,33 @@ Tox *tox_new(const struct Tox_Options *options, TOX_ERR_NEW *error);
  */
 void tox_kill(Tox *tox);
 
+/**
+ * Sets the lowest level of messages passed to the log callback.
+ *
+ * Messages below the level are dropped before their arguments are evaluated,
+ * so that builds with debug logging cost little while it is not wanted.
+ *
+ * @param file If not NULL, the level only applies to messages from the source
+ *   file with this name, e.g. "video.c", and takes precedence over the level
+ *   for all files.
+ *
+ * @return true on success, false if too many files have a level of their own.
+ */
+bool tox_set_log_level(Tox *tox, const char *file, TOX_LOG_LEVEL level);
+
+/**
+ * Formats log messages and calls the log callback on a background thread.
+ *
+ * The threads logging then only queue the arguments of each message. The log
+ * callback must be safe to call from that thread. Messages logged while
+ * queue_size messages are waiting are dropped, and a warning tells how many.
+ * Messages still queued are passed to the callback in tox_kill.
+ *
+ * @return true on success, false if the thread could not be started or the
+ *   log callback already runs on one.
+ */
+bool tox_start_log_thread(Tox *tox, uint32_t queue_size);
+
 /**
  * Calculates the number of bytes required to store the tox instance with
  * tox_get_savedata. This function cannot fail. The result is always greater than 0.
@@ -1045,6 +1095,22 @@ uint32_t tox_iteration_interval(const Tox *tox);
  */
 void tox_iterate(Tox *tox, void *user_data);
 
+/**
+ * Return a file descriptor that becomes readable when tox_iterate() should be
+ * called: either a socket used by this instance has data to read, or one of
+ * its timers is due. This can be less often than tox_iteration_interval()
+ * suggests; an idle instance only needs to run once per second.
+ *
+ * This allows clients to wait for work in their own event loop (poll, select,
+ * epoll, ...) instead of calling tox_iterate() on a fixed cadence. The descriptor
+ * is owned by the Tox instance and must not be read from or closed by the
+ * client. It is kept up to date by tox_iterate(), so clients must call tox_iterate()
+ * every time it becomes readable.
+ *
+ * @return the file descriptor, or -1 if the platform does not support it.
+ */
+int32_t tox_get_event_fd(Tox *tox);
+
 
 /*******************************************************************************
  *
@@ -3052,6 +3118,42 @@ uint16_t tox_self_get_udp_port(const Tox *tox, TOX_ERR_GET_PORT *error);
  */
 uint16_t tox_self_get_tcp_port(const Tox *tox, TOX_ERR_GET_PORT *error);
 
+/**
+ * Congestion control algorithm of the connections to friends.
+ */
+typedef enum TOX_CONGESTION_CONTROL {
+
+    /**
+     * The original toxcore algorithm: the rate follows the rate the connection
+     * achieves and shrinks when the send queue grows. This is the default.
+     */
+    TOX_CONGESTION_CONTROL_TOX,
+
+    /**
+     * Estimates the bottleneck bandwidth of the path from the delivery rate and
+     * paces packets at a multiple of it. Isolated losses don't slow it down.
+     */
+    TOX_CONGESTION_CONTROL_BBR,
+
+    /**
+     * CUBIC: a loss-based window that grows along a cubic curve, paced over the
+     * round trip time.
+     */
+    TOX_CONGESTION_CONTROL_CUBIC,
+
+} TOX_CONGESTION_CONTROL;
+
+
+/**
+ * Sets the congestion control algorithm of all current and future connections.
+ * Connections that switch algorithm start over with a fresh estimate of the
+ * path.
+ *
+ * @return true on success, false if the algorithm is unknown or some
+ *   connections could not be switched.
+ */
+bool tox_set_congestion_control(Tox *tox, TOX_CONGESTION_CONTROL algorithm);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3091,5 +3193,6 @@ typedef TOX_LOG_LEVEL Tox_Log_Level;
 typedef TOX_CONNECTION Tox_Connection;
 typedef TOX_FILE_CONTROL Tox_File_Control;
 typedef TOX_CONFERENCE_TYPE Tox_Conference_Type;
+typedef TOX_CONGESTION_CONTROL Tox_Congestion_Control;
 
 #endif
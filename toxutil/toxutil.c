@@ -102,6 +102,12 @@ static int timed_out(time_t timestamp, time_t timeout)
     return timestamp + timeout <= get_unix_time();
 }
 
+/* Milliseconds on the monotonic clock of the tox instance. */
+static uint64_t tox_utils_current_time(const Tox *tox)
+{
+    return current_time_monotonic(((const Messenger *)tox)->mono_time);
+}
+
 /* compares 2 items of length len (e.g.: Tox Pubkeys)
    Returns 0 if they are the same, 1 if they differ
  */
@@ -487,7 +493,7 @@ static void tox_utils_housekeeping(Tox *tox)
         if (head->data) {
             global_msgv2_outgoing_ft_entry *e = ((global_msgv2_outgoing_ft_entry *)(head->data));
 
-            if ((e->timestamp + TOX_UTIL_EXPIRE_FT_MS) < current_time_monotonic()) {
+            if ((e->timestamp + TOX_UTIL_EXPIRE_FT_MS) < tox_utils_current_time(tox)) {
                 // cancel FT
                 uint32_t friend_number = e->friend_number;
                 uint32_t file_number = e->file_number;
@@ -530,7 +536,7 @@ static void tox_utils_housekeeping(Tox *tox)
         if (head->data) {
             global_msgv2_incoming_ft_entry *e = ((global_msgv2_incoming_ft_entry *)(head->data));
 
-            if ((e->timestamp + TOX_UTIL_EXPIRE_FT_MS) < current_time_monotonic()) {
+            if ((e->timestamp + TOX_UTIL_EXPIRE_FT_MS) < tox_utils_current_time(tox)) {
                 // cancel FT
                 uint32_t friend_number = e->friend_number;
                 uint32_t file_number = e->file_number;
@@ -930,7 +936,7 @@ void tox_utils_file_recv_cb(Tox *tox, uint32_t friend_number, uint32_t file_numb
             data->file_number = file_number;
             data->kind = kind;
             data->file_size = file_size;
-            data->timestamp = current_time_monotonic();
+            data->timestamp = tox_utils_current_time(tox);
 
             uint8_t *friend_pubkey = calloc(1, TOX_PUBLIC_KEY_SIZE);
 
@@ -1122,7 +1128,7 @@ bool tox_util_friend_send_msg_receipt_v2(Tox *tox, uint32_t friend_number, uint8
                     data->file_number = file_num_new;
                     data->kind = TOX_FILE_KIND_MESSAGEV2_ANSWER;
                     data->file_size = raw_msg_len;
-                    data->timestamp = current_time_monotonic();
+                    data->timestamp = tox_utils_current_time(tox);
 
                     if (raw_msg_len <= TOX_MAX_FILETRANSFER_SIZE_MSGV2) {
                         memcpy(data->msg_data, raw_message, raw_msg_len);
@@ -1217,7 +1223,7 @@ bool tox_util_friend_resend_message_v2(Tox *tox, uint32_t friend_number,
         data->file_number = file_num_new;
         data->kind = TOX_FILE_KIND_MESSAGEV2_SEND;
         data->file_size = raw_msg_len;
-        data->timestamp = current_time_monotonic();
+        data->timestamp = tox_utils_current_time(tox);
 
         if (raw_msg_len <= TOX_MAX_FILETRANSFER_SIZE_MSGV2) {
             memcpy(data->msg_data, raw_message, raw_msg_len);
@@ -1370,7 +1376,7 @@ int64_t tox_util_friend_send_message_v2(Tox *tox, uint32_t friend_number, TOX_ME
                     data->file_number = file_num_new;
                     data->kind = TOX_FILE_KIND_MESSAGEV2_SEND;
                     data->file_size = raw_msg_len;
-                    data->timestamp = current_time_monotonic();
+                    data->timestamp = tox_utils_current_time(tox);
 
                     if (raw_msg_len <= TOX_MAX_FILETRANSFER_SIZE_MSGV2) {
                         memcpy(data->msg_data, raw_message, raw_msg_len);